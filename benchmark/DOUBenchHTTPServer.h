@@ -0,0 +1,58 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+
+#import <Foundation/Foundation.h>
+
+typedef double (^DOUBenchHTTPServerBandwidthBlock)(NSTimeInterval time);
+
+/*
+ * A minimal HTTP/1.1 server on the loopback interface for the headless
+ * tests.  Every connection serves one GET of the same entity and is then
+ * closed.  Range requests are answered with 206 unless the server is told
+ * to ignore them or If-Range does not match the current entity tag.  The
+ * body can be throttled to a bandwidth that varies over time, sent chunked
+ * without a Content-Length, or cut short once to simulate a dropped
+ * connection.  Every response is logged for the tests to inspect.
+ */
+
+@interface DOUBenchHTTPServer : NSObject
+
++ (instancetype)serverWithData:(NSData *)data;
+- (instancetype)initWithData:(NSData *)data;
+
+- (BOOL)start;
+- (void)stop;
+
+- (NSURL *)URLWithPath:(NSString *)path;
+
+@property (strong) NSData *data;
+@property (copy) NSString *entityTag;
+@property (copy) NSString *contentType;
+
+@property (assign) BOOL advertisesRanges;
+@property (assign) BOOL honorsRanges;
+@property (assign) BOOL chunked;
+@property (assign) NSUInteger dropAfterLength;
+
+// Bytes per second at the given time since -start; zero stalls the body.
+// Without a block the body is sent as fast as the socket takes it.
+@property (copy) DOUBenchHTTPServerBandwidthBlock bandwidthBlock;
+
+@property (readonly) NSArray *responses;
+- (void)removeAllResponses;
+
+@end
@@ -0,0 +1,408 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+
+#import "DOUBenchHTTPServer.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <mach/mach_time.h>
+
+static const NSUInteger kDOUBenchHTTPServerMaximumHeaderLength = 16 * 1024;
+static const NSUInteger kDOUBenchHTTPServerSendLength = 4096;
+static const NSTimeInterval kDOUBenchHTTPServerBandwidthSlice = 0.01;
+
+@interface DOUBenchHTTPServer () {
+@private
+  int _socket;
+  uint16_t _port;
+  uint64_t _startHostTime;
+  NSMutableArray *_responses;
+}
+@end
+
+@implementation DOUBenchHTTPServer
+
+@synthesize data = _data;
+@synthesize entityTag = _entityTag;
+@synthesize contentType = _contentType;
+@synthesize advertisesRanges = _advertisesRanges;
+@synthesize honorsRanges = _honorsRanges;
+@synthesize chunked = _chunked;
+@synthesize dropAfterLength = _dropAfterLength;
+@synthesize bandwidthBlock = _bandwidthBlock;
+
++ (instancetype)serverWithData:(NSData *)data
+{
+  return [[[self class] alloc] initWithData:data];
+}
+
+- (instancetype)initWithData:(NSData *)data
+{
+  self = [super init];
+  if (self) {
+    _data = data;
+    _entityTag = @"\"0\"";
+    _contentType = @"audio/wav";
+    _advertisesRanges = YES;
+    _honorsRanges = YES;
+    _socket = -1;
+    _responses = [NSMutableArray array];
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  [self stop];
+}
+
+static double server_seconds_per_host_time(void)
+{
+  static double conversion;
+
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    mach_timebase_info_data_t info;
+    mach_timebase_info(&info);
+    conversion = 1.0e-9 * info.numer / info.denom;
+  });
+
+  return conversion;
+}
+
+static BOOL server_send_all(int fd, const void *bytes, size_t length)
+{
+  while (length > 0) {
+    ssize_t sent = send(fd, bytes, length, 0);
+    if (sent <= 0) {
+      return NO;
+    }
+
+    bytes = (const uint8_t *)bytes + sent;
+    length -= (size_t)sent;
+  }
+
+  return YES;
+}
+
+static NSDictionary *server_read_request(int fd)
+{
+  NSMutableData *buffer = [NSMutableData data];
+  char chunk[1024];
+
+  while ([buffer length] < kDOUBenchHTTPServerMaximumHeaderLength) {
+    ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+    if (received <= 0) {
+      return nil;
+    }
+
+    [buffer appendBytes:chunk length:(NSUInteger)received];
+    NSRange end = [buffer rangeOfData:[NSData dataWithBytes:"\r\n\r\n" length:4]
+                              options:0
+                                range:NSMakeRange(0, [buffer length])];
+    if (end.location == NSNotFound) {
+      continue;
+    }
+
+    NSString *head = [[NSString alloc] initWithBytes:[buffer bytes] length:end.location encoding:NSISOLatin1StringEncoding];
+    NSArray *lines = [head componentsSeparatedByString:@"\r\n"];
+    NSMutableDictionary *headers = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 1; i < [lines count]; ++i) {
+      NSString *line = [lines objectAtIndex:i];
+      NSRange colon = [line rangeOfString:@":"];
+      if (colon.location == NSNotFound) {
+        continue;
+      }
+
+      NSString *name = [[line substringToIndex:colon.location] lowercaseString];
+      NSString *value = [[line substringFromIndex:colon.location + 1] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+      [headers setObject:value forKey:name];
+    }
+
+    return headers;
+  }
+
+  return nil;
+}
+
+static BOOL server_parse_range(NSString *header, NSUInteger total, NSUInteger *first, NSUInteger *last)
+{
+  unsigned long long start = 0;
+  unsigned long long end = total - 1;
+
+  NSScanner *scanner = [NSScanner scannerWithString:header];
+  if (![scanner scanString:@"bytes=" intoString:NULL] ||
+      ![scanner scanUnsignedLongLong:&start] ||
+      ![scanner scanString:@"-" intoString:NULL]) {
+    return NO;
+  }
+
+  [scanner scanUnsignedLongLong:&end];
+  if (start >= total || end < start) {
+    return NO;
+  }
+
+  *first = (NSUInteger)start;
+  *last = (NSUInteger)MIN(end, (unsigned long long)total - 1);
+  return YES;
+}
+
+- (NSTimeInterval)_elapsedTime
+{
+  return (mach_absolute_time() - _startHostTime) * server_seconds_per_host_time();
+}
+
+- (NSUInteger)_takeDropAfterLength
+{
+  @synchronized(self) {
+    NSUInteger length = _dropAfterLength;
+    _dropAfterLength = 0;
+    return length;
+  }
+}
+
+- (void)_serveConnection:(int)fd
+{
+  NSDictionary *headers = server_read_request(fd);
+  if (headers == nil) {
+    close(fd);
+    return;
+  }
+
+  NSData *data = [self data];
+  NSString *entityTag = [self entityTag];
+  NSString *rangeHeader = [headers objectForKey:@"range"];
+  NSString *ifRange = [headers objectForKey:@"if-range"];
+  BOOL chunked = [self chunked];
+
+  NSUInteger total = [data length];
+  NSUInteger first = 0;
+  NSUInteger last = total > 0 ? total - 1 : 0;
+  BOOL partial = rangeHeader != nil &&
+                 [self honorsRanges] &&
+                 (ifRange == nil || [ifRange isEqualToString:entityTag]) &&
+                 server_parse_range(rangeHeader, total, &first, &last);
+  if (!partial) {
+    first = 0;
+    last = total > 0 ? total - 1 : 0;
+  }
+
+  NSUInteger length = total > 0 ? last - first + 1 : 0;
+  NSInteger statusCode = partial ? 206 : 200;
+
+  NSMutableString *response = [NSMutableString stringWithFormat:@"HTTP/1.1 %ld %@\r\n", (long)statusCode, partial ? @"Partial Content" : @"OK"];
+  [response appendFormat:@"Content-Type: %@\r\n", [self contentType]];
+  if (entityTag != nil) {
+    [response appendFormat:@"ETag: %@\r\n", entityTag];
+  }
+  if ([self advertisesRanges]) {
+    [response appendString:@"Accept-Ranges: bytes\r\n"];
+  }
+  if (chunked) {
+    [response appendString:@"Transfer-Encoding: chunked\r\n"];
+  }
+  else {
+    [response appendFormat:@"Content-Length: %lu\r\n", (unsigned long)length];
+  }
+  if (partial) {
+    [response appendFormat:@"Content-Range: bytes %lu-%lu/%lu\r\n", (unsigned long)first, (unsigned long)last, (unsigned long)total];
+  }
+  [response appendString:@"Connection: close\r\n\r\n"];
+
+  NSUInteger dropAfterLength = [self _takeDropAfterLength];
+  NSUInteger sentLength = 0;
+  BOOL dropped = NO;
+  BOOL succeeded = server_send_all(fd, [response UTF8String], strlen([response UTF8String]));
+
+  while (succeeded && sentLength < length) {
+    NSUInteger pieceLength = MIN(kDOUBenchHTTPServerSendLength, length - sentLength);
+    if (dropAfterLength > 0) {
+      if (sentLength >= dropAfterLength) {
+        dropped = YES;
+        break;
+      }
+      pieceLength = MIN(pieceLength, dropAfterLength - sentLength);
+    }
+
+    // The bandwidth is sampled in short slices so that it may change, or
+    // drop to nothing, while a piece is on its way.
+    DOUBenchHTTPServerBandwidthBlock bandwidthBlock = [self bandwidthBlock];
+    if (bandwidthBlock != NULL) {
+      double credit = 0.0;
+      while (credit < pieceLength && _socket >= 0) {
+        double bandwidth = MAX(bandwidthBlock([self _elapsedTime]), 0.0);
+        NSTimeInterval slice = bandwidth > 0.0 ? MIN((pieceLength - credit) / bandwidth, kDOUBenchHTTPServerBandwidthSlice) : kDOUBenchHTTPServerBandwidthSlice;
+        usleep((useconds_t)(slice * 1.0e6));
+        credit += bandwidth * slice;
+      }
+    }
+
+    const uint8_t *bytes = (const uint8_t *)[data bytes] + first + sentLength;
+    if (chunked) {
+      char prefix[32];
+      snprintf(prefix, sizeof(prefix), "%lx\r\n", (unsigned long)pieceLength);
+      succeeded = server_send_all(fd, prefix, strlen(prefix)) &&
+                  server_send_all(fd, bytes, pieceLength) &&
+                  server_send_all(fd, "\r\n", 2);
+    }
+    else {
+      succeeded = server_send_all(fd, bytes, pieceLength);
+    }
+
+    if (succeeded) {
+      sentLength += pieceLength;
+    }
+  }
+
+  if (succeeded && !dropped && chunked) {
+    server_send_all(fd, "0\r\n\r\n", 5);
+  }
+
+  close(fd);
+
+  @synchronized(_responses) {
+    [_responses addObject:@{
+      @"range": rangeHeader ?: [NSNull null],
+      @"if_range": ifRange ?: [NSNull null],
+      @"status": @(statusCode),
+      @"first": @(first),
+      @"length": @(length),
+      @"sent": @(sentLength),
+      @"dropped": @(dropped || !succeeded),
+      @"time": @([self _elapsedTime])
+    }];
+  }
+}
+
+static void *server_connection_main(void *info)
+{
+  @autoreleasepool {
+    NSArray *arguments = (__bridge_transfer NSArray *)info;
+    DOUBenchHTTPServer *server = [arguments objectAtIndex:0];
+    [server _serveConnection:[[arguments objectAtIndex:1] intValue]];
+  }
+
+  return NULL;
+}
+
+static void *server_accept_main(void *info)
+{
+  DOUBenchHTTPServer *server = (__bridge_transfer DOUBenchHTTPServer *)info;
+  int listeningSocket = server->_socket;
+
+  for (;;) {
+    int fd = accept(listeningSocket, NULL, NULL);
+    if (fd < 0) {
+      break;
+    }
+
+    int value = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &value, sizeof(value));
+
+    pthread_t thread;
+    void *arguments = (__bridge_retained void *)@[server, @(fd)];
+    if (pthread_create(&thread, NULL, server_connection_main, arguments) != 0) {
+      CFRelease(arguments);
+      close(fd);
+      continue;
+    }
+    pthread_detach(thread);
+  }
+
+  return NULL;
+}
+
+- (BOOL)start
+{
+  if (_socket >= 0) {
+    return YES;
+  }
+
+  _socket = socket(AF_INET, SOCK_STREAM, 0);
+  if (_socket < 0) {
+    return NO;
+  }
+
+  int value = 1;
+  setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_len = sizeof(address);
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+
+  socklen_t addressLength = sizeof(address);
+  if (bind(_socket, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(_socket, 16) != 0 ||
+      getsockname(_socket, (struct sockaddr *)&address, &addressLength) != 0) {
+    close(_socket);
+    _socket = -1;
+    return NO;
+  }
+
+  _port = ntohs(address.sin_port);
+  _startHostTime = mach_absolute_time();
+
+  pthread_t thread;
+  void *info = (__bridge_retained void *)self;
+  if (pthread_create(&thread, NULL, server_accept_main, info) != 0) {
+    CFRelease(info);
+    close(_socket);
+    _socket = -1;
+    return NO;
+  }
+  pthread_detach(thread);
+
+  return YES;
+}
+
+- (void)stop
+{
+  if (_socket < 0) {
+    return;
+  }
+
+  shutdown(_socket, SHUT_RDWR);
+  close(_socket);
+  _socket = -1;
+}
+
+- (NSURL *)URLWithPath:(NSString *)path
+{
+  return [NSURL URLWithString:[NSString stringWithFormat:@"http://127.0.0.1:%u/%@", (unsigned)_port, path]];
+}
+
+- (NSArray *)responses
+{
+  @synchronized(_responses) {
+    return [_responses copy];
+  }
+}
+
+- (void)removeAllResponses
+{
+  @synchronized(_responses) {
+    [_responses removeAllObjects];
+  }
+}
+
+@end
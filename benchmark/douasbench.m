@@ -0,0 +1,460 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+/*
+ * douasbench - headless benchmark of the decode -> LPCM -> render pipeline.
+ *
+ * Local audio files are fed through DOUAudioPlaybackItem, DOUAudioDecoder and
+ * DOUAudioLPCM into a null sink, and the results are printed as JSON:
+ *
+ *     douasbench [--seeks count] [--seed seed] file ...
+ *
+ * Every file is benchmarked in a fresh child process, so that peak_rss is
+ * the high-water mark of that file alone.  CPU time covers every thread of
+ * the process, the decoder's converter threads included.
+ *
+ * make_fixtures.sh generates a deterministic set of WAV, AAC, ALAC and MP3
+ * files, both CBR and VBR, to run it against.
+ *
+ * Build it from this directory with:
+ *
+ *     clang -fobjc-arc -O2 -I../src ../src/*.m douasbench.m -o douasbench \
+ *       -framework Foundation -framework Accelerate -framework CFNetwork \
+ *       -framework CoreAudio -framework AudioToolbox -framework AudioUnit \
+ *       -framework CoreServices
+ */
+
+#import <Foundation/Foundation.h>
+#import "DOUAudioFile.h"
+#import "DOUAudioFileProvider.h"
+#import "DOUAudioPlaybackItem.h"
+#import "DOUAudioDecoder.h"
+#import "DOUAudioLPCM.h"
+#import "DOUAudioMetrics.h"
+#include <malloc/malloc.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <sys/resource.h>
+#include <stdatomic.h>
+
+static const NSUInteger kBenchBufferTime = 200;
+static const NSUInteger kBenchMaximumZoneCount = 16;
+
+@interface BenchAudioFile : NSObject <DOUAudioFile> {
+@private
+  NSURL *_url;
+}
+- (instancetype)initWithPath:(NSString *)path;
+@end
+
+@implementation BenchAudioFile
+- (instancetype)initWithPath:(NSString *)path
+{
+  self = [super init];
+  if (self) {
+    _url = [NSURL fileURLWithPath:path];
+  }
+
+  return self;
+}
+
+- (NSURL *)audioFileURL
+{
+  return _url;
+}
+@end
+
+/*
+ * Allocations are counted by hooking every malloc zone.  Zones may forward
+ * to a helper zone, so nested calls on the same thread are counted once.
+ */
+
+typedef struct {
+  malloc_zone_t *zone;
+  void *(*malloc)(malloc_zone_t *zone, size_t size);
+  void *(*calloc)(malloc_zone_t *zone, size_t count, size_t size);
+  void *(*realloc)(malloc_zone_t *zone, void *ptr, size_t size);
+} bench_zone;
+
+static bench_zone gZones[kBenchMaximumZoneCount];
+static NSUInteger gZoneCount = 0;
+static _Atomic(uint64_t) gAllocationCount;
+static __thread int gAllocationDepth;
+
+static bench_zone *bench_zone_for(malloc_zone_t *zone)
+{
+  for (NSUInteger i = 0; i < gZoneCount; ++i) {
+    if (gZones[i].zone == zone) {
+      return &gZones[i];
+    }
+  }
+
+  abort();
+}
+
+static void bench_count_allocation(void)
+{
+  if (gAllocationDepth == 0) {
+    atomic_fetch_add_explicit(&gAllocationCount, 1, memory_order_relaxed);
+  }
+}
+
+static void *bench_malloc(malloc_zone_t *zone, size_t size)
+{
+  bench_count_allocation();
+  gAllocationDepth++;
+  void *ptr = bench_zone_for(zone)->malloc(zone, size);
+  gAllocationDepth--;
+  return ptr;
+}
+
+static void *bench_calloc(malloc_zone_t *zone, size_t count, size_t size)
+{
+  bench_count_allocation();
+  gAllocationDepth++;
+  void *ptr = bench_zone_for(zone)->calloc(zone, count, size);
+  gAllocationDepth--;
+  return ptr;
+}
+
+static void *bench_realloc(malloc_zone_t *zone, void *ptr, size_t size)
+{
+  bench_count_allocation();
+  gAllocationDepth++;
+  ptr = bench_zone_for(zone)->realloc(zone, ptr, size);
+  gAllocationDepth--;
+  return ptr;
+}
+
+static void bench_hook_allocations(void)
+{
+  vm_address_t *addresses = NULL;
+  unsigned count = 0;
+  if (malloc_get_all_zones(mach_task_self(), NULL, &addresses, &count) != KERN_SUCCESS) {
+    return;
+  }
+
+  for (unsigned i = 0; i < count && gZoneCount < kBenchMaximumZoneCount; ++i) {
+    malloc_zone_t *zone = (malloc_zone_t *)addresses[i];
+    if (vm_protect(mach_task_self(), (vm_address_t)zone, sizeof(*zone), 0, VM_PROT_READ | VM_PROT_WRITE) != KERN_SUCCESS) {
+      continue;
+    }
+
+    bench_zone *hooked = &gZones[gZoneCount];
+    hooked->zone = zone;
+    hooked->malloc = zone->malloc;
+    hooked->calloc = zone->calloc;
+    hooked->realloc = zone->realloc;
+    gZoneCount++;
+
+    zone->malloc = bench_malloc;
+    zone->calloc = bench_calloc;
+    zone->realloc = bench_realloc;
+
+    vm_protect(mach_task_self(), (vm_address_t)zone, sizeof(*zone), 0, VM_PROT_READ);
+  }
+}
+
+static double bench_seconds_per_host_time(void)
+{
+  static double conversion;
+
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    mach_timebase_info_data_t info;
+    mach_timebase_info(&info);
+    conversion = 1.0e-9 * info.numer / info.denom;
+  });
+
+  return conversion;
+}
+
+static double bench_elapsed(uint64_t startHostTime)
+{
+  return (mach_absolute_time() - startHostTime) * bench_seconds_per_host_time();
+}
+
+static double bench_cpu_time(void)
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1.0e-6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1.0e-6;
+}
+
+static NSString *bench_format_id(UInt32 formatID)
+{
+  char chars[5] = {
+    (char)(formatID >> 24), (char)(formatID >> 16), (char)(formatID >> 8), (char)formatID, 0
+  };
+
+  return [NSString stringWithUTF8String:chars] ?: [NSString stringWithFormat:@"%u", (unsigned)formatID];
+}
+
+// The null sink copies the PCM out like the renderer ring would, then drops it.
+static NSUInteger bench_drain_lpcm(DOUAudioLPCM *lpcm, NSMutableData *sink)
+{
+  NSUInteger drainedLength = 0;
+  const void *bytes = NULL;
+  NSUInteger length = 0;
+  while ([lpcm borrowBytes:&bytes length:&length] && length > 0) {
+    length = MIN(length, [sink length]);
+    memcpy([sink mutableBytes], bytes, length);
+    [lpcm commitLength:length];
+    drainedLength += length;
+  }
+
+  return drainedLength;
+}
+
+static NSUInteger bench_decoder_buffer_size(AudioStreamBasicDescription format)
+{
+  return (NSUInteger)(kBenchBufferTime * format.mSampleRate / 1000) * format.mBytesPerFrame;
+}
+
+static DOUAudioDecoder *bench_create_decoder(NSString *path, DOUAudioPlaybackItem **playbackItem)
+{
+  DOUAudioFileProvider *provider = [DOUAudioFileProvider fileProviderWithAudioFile:[[BenchAudioFile alloc] initWithPath:path]];
+  if (provider == nil) {
+    return nil;
+  }
+
+  DOUAudioPlaybackItem *item = [DOUAudioPlaybackItem playbackItemWithFileProvider:provider];
+  if (![item open]) {
+    return nil;
+  }
+
+  AudioStreamBasicDescription outputFormat = [DOUAudioDecoder outputFormatWithSampleRate:[item fileFormat].mSampleRate];
+  DOUAudioDecoder *decoder = [DOUAudioDecoder decoderWithPlaybackItem:item
+                                                         outputFormat:outputFormat
+                                                           bufferSize:bench_decoder_buffer_size(outputFormat)];
+  if (![decoder setUp]) {
+    return nil;
+  }
+
+  if (playbackItem != NULL) {
+    *playbackItem = item;
+  }
+
+  return decoder;
+}
+
+static NSDictionary *bench_percentiles(NSMutableArray *samples)
+{
+  if ([samples count] == 0) {
+    return @{};
+  }
+
+  [samples sortUsingSelector:@selector(compare:)];
+
+  double total = 0.0;
+  for (NSNumber *sample in samples) {
+    total += [sample doubleValue];
+  }
+
+  NSUInteger count = [samples count];
+  return @{
+    @"count": @(count),
+    @"mean": @(total / count),
+    @"p50": samples[(count - 1) / 2],
+    @"p95": samples[(count - 1) * 95 / 100],
+    @"max": [samples lastObject]
+  };
+}
+
+static NSDictionary *bench_run_file(NSString *path, NSUInteger seekCount)
+{
+  DOUAudioPlaybackItem *playbackItem = nil;
+  DOUAudioDecoder *decoder = bench_create_decoder(path, &playbackItem);
+  if (decoder == nil) {
+    return @{ @"path": path, @"error": @"failed to open" };
+  }
+
+  AudioStreamBasicDescription fileFormat = [playbackItem fileFormat];
+  AudioStreamBasicDescription outputFormat = [decoder outputFormat];
+  NSMutableData *sink = [NSMutableData dataWithLength:bench_decoder_buffer_size(outputFormat)];
+
+  unsigned long long decodedLength = 0;
+  NSUInteger decodeCount = 0;
+  DOUAudioDecoderStatus status = DOUAudioDecoderSucceeded;
+
+  uint64_t allocationCount = atomic_load(&gAllocationCount);
+  double cpuTime = bench_cpu_time();
+  uint64_t startHostTime = mach_absolute_time();
+
+  while (status == DOUAudioDecoderSucceeded) {
+    status = [decoder decodeOnce];
+    decodedLength += bench_drain_lpcm([decoder lpcm], sink);
+    decodeCount++;
+  }
+
+  double wallTime = bench_elapsed(startHostTime);
+  cpuTime = bench_cpu_time() - cpuTime;
+  allocationCount = atomic_load(&gAllocationCount) - allocationCount;
+
+  if (status != DOUAudioDecoderEndEncountered) {
+    return @{ @"path": path, @"error": @"failed to decode" };
+  }
+
+  double audioTime = (double)(decodedLength / outputFormat.mBytesPerFrame) / outputFormat.mSampleRate;
+
+  NSMutableArray *seekLatencies = [NSMutableArray arrayWithCapacity:seekCount];
+  NSUInteger duration = [playbackItem estimatedDuration];
+  for (NSUInteger i = 0; i < seekCount && duration > 0; ++i) {
+    DOUAudioDecoder *seekDecoder = bench_create_decoder(path, NULL);
+    if (seekDecoder == nil) {
+      break;
+    }
+
+    NSUInteger milliseconds = (NSUInteger)random() % duration;
+    uint64_t seekStartHostTime = mach_absolute_time();
+
+    [seekDecoder seekToTime:milliseconds];
+    while ([seekDecoder decodeOnce] == DOUAudioDecoderSucceeded &&
+           [[seekDecoder lpcm] readableLength] == 0) {
+    }
+
+    [seekLatencies addObject:@(bench_elapsed(seekStartHostTime))];
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  return @{
+    @"path": path,
+    @"format": bench_format_id(fileFormat.mFormatID),
+    @"sample_rate": @(fileFormat.mSampleRate),
+    @"channels": @(fileFormat.mChannelsPerFrame),
+    @"bit_rate": @([playbackItem bitRate]),
+    @"vbr": @(fileFormat.mBytesPerPacket == 0),
+    @"audio_time": @(audioTime),
+    @"wall_time": @(wallTime),
+    @"cpu_time": @(cpuTime),
+    @"realtime_factor": @(wallTime > 0.0 ? audioTime / wallTime : 0.0),
+    @"cpu_per_audio_minute": @(audioTime > 0.0 ? cpuTime * 60.0 / audioTime : 0.0),
+    @"decode_count": @(decodeCount),
+    @"allocations": @(allocationCount),
+    @"allocations_per_second": @(wallTime > 0.0 ? allocationCount / wallTime : 0.0),
+    @"peak_rss": @(usage.ru_maxrss),
+    @"seek_latency": bench_percentiles(seekLatencies),
+    @"metrics": [[[[playbackItem fileProvider] metrics] snapshot] dictionaryRepresentation]
+  };
+}
+
+static void bench_usage(void)
+{
+  fprintf(stderr, "usage: douasbench [--seeks count] [--seed seed] file ...\n");
+}
+
+static void bench_print_json(id object)
+{
+  NSData *json = [NSJSONSerialization dataWithJSONObject:object
+                                                 options:NSJSONWritingPrettyPrinted
+                                                   error:NULL];
+  fwrite([json bytes], 1, [json length], stdout);
+  fputc('\n', stdout);
+}
+
+// Runs a single file in a child process started with --child.
+static NSDictionary *bench_run_child(NSString *path, NSUInteger seekCount, unsigned seed)
+{
+  NSPipe *pipe = [NSPipe pipe];
+  NSTask *task = [[NSTask alloc] init];
+  [task setLaunchPath:[[NSBundle mainBundle] executablePath]];
+  [task setArguments:@[
+    @"--child",
+    @"--seeks", [NSString stringWithFormat:@"%lu", (unsigned long)seekCount],
+    @"--seed", [NSString stringWithFormat:@"%u", seed],
+    path
+  ]];
+  [task setStandardOutput:pipe];
+
+  @try {
+    [task launch];
+  }
+  @catch (NSException *exception) {
+    return @{ @"path": path, @"error": @"failed to launch" };
+  }
+
+  NSData *output = [[pipe fileHandleForReading] readDataToEndOfFile];
+  [task waitUntilExit];
+
+  NSDictionary *result = [NSJSONSerialization JSONObjectWithData:output options:0 error:NULL];
+  if ([task terminationStatus] != 0 || ![result isKindOfClass:[NSDictionary class]]) {
+    return @{ @"path": path, @"error": @"child process failed" };
+  }
+
+  return result;
+}
+
+int main(int argc, const char *argv[])
+{
+  @autoreleasepool {
+    NSUInteger seekCount = 20;
+    unsigned seed = 1;
+    BOOL child = NO;
+    NSMutableArray *paths = [NSMutableArray array];
+
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--child") == 0) {
+        child = YES;
+      }
+      else if (strcmp(argv[i], "--seeks") == 0 && i + 1 < argc) {
+        seekCount = (NSUInteger)strtoul(argv[++i], NULL, 10);
+      }
+      else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+        seed = (unsigned)strtoul(argv[++i], NULL, 10);
+      }
+      else if (argv[i][0] == '-') {
+        bench_usage();
+        return 1;
+      }
+      else {
+        [paths addObject:@(argv[i])];
+      }
+    }
+
+    if ([paths count] == 0) {
+      bench_usage();
+      return 1;
+    }
+
+    if (child) {
+      srandom(seed);
+      bench_hook_allocations();
+      bench_print_json(bench_run_file([paths firstObject], seekCount));
+      return 0;
+    }
+
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:[paths count]];
+    for (NSString *path in paths) {
+      @autoreleasepool {
+        [results addObject:bench_run_child(path, seekCount, seed)];
+      }
+    }
+
+    NSDictionary *report = @{
+      @"buffer_time": @(kBenchBufferTime),
+      @"seeks": @(seekCount),
+      @"seed": @(seed),
+      @"files": results
+    };
+
+    bench_print_json(report);
+  }
+
+  return 0;
+}
@@ -0,0 +1,365 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+
+/*
+ * douasrangetest - headless test of DOUAudioFileProvider against a local
+ * HTTP server that supports byte ranges.
+ *
+ * Each case serves a generated WAV file from DOUBenchHTTPServer and drives a
+ * remote file provider through the shared cache:
+ *
+ *     partial_content      a seek far past the download opens a range
+ *                          request that is answered with 206
+ *     full_fallback        a server that advertises ranges but answers
+ *                          them with 200 still yields the whole file
+ *     if_range_mismatch    cached ranges of an older entity are dropped
+ *                          when If-Range does not match
+ *     dropped_connection   a connection closed mid-body is resumed with a
+ *                          range request instead of starting over
+ *
+ * The results are printed as JSON, and the exit status is non-zero if any
+ * case failed.
+ *
+ * Build it from this directory with:
+ *
+ *     clang -fobjc-arc -O2 -I../src ../src/*.m DOUBenchHTTPServer.m \
+ *       douasrangetest.m -o douasrangetest \
+ *       -framework Foundation -framework Accelerate -framework CFNetwork \
+ *       -framework CoreAudio -framework AudioToolbox -framework AudioUnit \
+ *       -framework CoreServices
+ */
+
+#import <Foundation/Foundation.h>
+#import "DOUAudioFile.h"
+#import "DOUAudioFileProvider.h"
+#import "DOUAudioCache.h"
+#import "DOUBenchHTTPServer.h"
+
+static const NSUInteger kTestSampleRate = 44100;
+static const NSUInteger kTestDuration = 48;
+static const NSTimeInterval kTestTimeout = 15.0;
+
+@interface TestAudioFile : NSObject <DOUAudioFile> {
+@private
+  NSURL *_url;
+}
+- (instancetype)initWithURL:(NSURL *)url;
+@end
+
+@implementation TestAudioFile
+- (instancetype)initWithURL:(NSURL *)url
+{
+  self = [super init];
+  if (self) {
+    _url = url;
+  }
+
+  return self;
+}
+
+- (NSURL *)audioFileURL
+{
+  return _url;
+}
+@end
+
+static void test_append_le(NSMutableData *data, uint32_t value, NSUInteger size)
+{
+  uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+  [data appendBytes:bytes length:size];
+}
+
+// 16-bit stereo PCM filled with noise from the given seed.
+static NSData *test_make_wav(NSUInteger seconds, unsigned seed)
+{
+  uint32_t dataLength = (uint32_t)(seconds * kTestSampleRate * 4);
+
+  NSMutableData *data = [NSMutableData dataWithCapacity:44 + dataLength];
+  [data appendBytes:"RIFF" length:4];
+  test_append_le(data, 36 + dataLength, 4);
+  [data appendBytes:"WAVEfmt " length:8];
+  test_append_le(data, 16, 4);
+  test_append_le(data, 1, 2);
+  test_append_le(data, 2, 2);
+  test_append_le(data, (uint32_t)kTestSampleRate, 4);
+  test_append_le(data, (uint32_t)kTestSampleRate * 4, 4);
+  test_append_le(data, 4, 2);
+  test_append_le(data, 16, 2);
+  [data appendBytes:"data" length:4];
+  test_append_le(data, dataLength, 4);
+
+  [data setLength:44 + dataLength];
+  uint8_t *samples = (uint8_t *)[data mutableBytes] + 44;
+  for (uint32_t i = 0; i < dataLength; ++i) {
+    samples[i] = (uint8_t)(rand_r(&seed) >> 7);
+  }
+
+  return data;
+}
+
+static BOOL test_wait(NSTimeInterval timeout, BOOL (^condition)(void))
+{
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+  while (!condition()) {
+    if ([deadline timeIntervalSinceNow] <= 0.0) {
+      return NO;
+    }
+
+    usleep(10000);
+  }
+
+  return YES;
+}
+
+static DOUAudioFileProvider *test_create_provider(NSURL *url)
+{
+  return [DOUAudioFileProvider fileProviderWithAudioFile:[[TestAudioFile alloc] initWithURL:url]];
+}
+
+// Drops the provider and waits until its cached ranges are on disk.
+static BOOL test_release_provider(DOUAudioFileProvider *__strong *provider, NSURL *url)
+{
+  @autoreleasepool {
+    *provider = nil;
+  }
+
+  NSString *rangesPath = [[DOUAudioCache sharedCache] rangesPathForURL:url];
+  return test_wait(5.0, ^BOOL{
+    return [[NSFileManager defaultManager] fileExistsAtPath:rangesPath];
+  });
+}
+
+static BOOL test_cached_data_matches(DOUAudioFileProvider *provider, NSData *data)
+{
+  return [[NSData dataWithContentsOfFile:[provider cachedPath]] isEqualToData:data];
+}
+
+static NSDictionary *test_find_response(DOUBenchHTTPServer *server, BOOL (^predicate)(NSDictionary *response))
+{
+  for (NSDictionary *response in [server responses]) {
+    if (predicate(response)) {
+      return response;
+    }
+  }
+
+  return nil;
+}
+
+static NSDictionary *test_result(NSString *name, BOOL passed, NSString *detail, DOUBenchHTTPServer *server)
+{
+  return @{
+    @"name": name,
+    @"passed": @(passed),
+    @"detail": detail ?: @"",
+    @"responses": [server responses]
+  };
+}
+
+static NSDictionary *test_partial_content(DOUBenchHTTPServer *server, NSData *data)
+{
+  NSURL *url = [server URLWithPath:@"partial_content.wav"];
+  [[DOUAudioCache sharedCache] removeEntryForURL:url];
+
+  [server setData:data];
+  [server setHonorsRanges:YES];
+  [server setBandwidthBlock:^double(NSTimeInterval time) {
+    return 512.0 * 1024.0;
+  }];
+
+  DOUAudioFileProvider *provider = test_create_provider(url);
+  if (!test_wait(kTestTimeout, ^BOOL{ return [provider isReady] || [provider isFailed]; }) ||
+      [provider isFailed]) {
+    return test_result(@"partial_content", NO, @"provider never became ready", server);
+  }
+
+  NSUInteger offset = [data length] * 3 / 4;
+  NSDate *seekDate = [NSDate date];
+  [provider seekToOffset:offset];
+
+  // The throttled linear download would need well over ten seconds to get there.
+  BOOL available = test_wait(5.0, ^BOOL{ return [provider availableLengthFromOffset:offset] >= 64 * 1024; });
+  NSTimeInterval latency = -[seekDate timeIntervalSinceNow];
+
+  NSDictionary *response = test_find_response(server, ^BOOL(NSDictionary *r) {
+    return [[r objectForKey:@"status"] integerValue] == 206 &&
+           [[r objectForKey:@"first"] unsignedIntegerValue] == offset;
+  });
+
+  provider = nil;
+  [[DOUAudioCache sharedCache] removeEntryForURL:url];
+
+  if (!available) {
+    return test_result(@"partial_content", NO, @"seek target never became available", server);
+  }
+
+  return test_result(@"partial_content",
+                     response != nil,
+                     [NSString stringWithFormat:@"seek latency %.3fs", latency],
+                     server);
+}
+
+static NSDictionary *test_full_fallback(DOUBenchHTTPServer *server, NSData *data)
+{
+  NSURL *url = [server URLWithPath:@"full_fallback.wav"];
+  [[DOUAudioCache sharedCache] removeEntryForURL:url];
+
+  [server setData:data];
+  [server setHonorsRanges:NO];
+  [server setBandwidthBlock:^double(NSTimeInterval time) {
+    return 2.0 * 1024.0 * 1024.0;
+  }];
+
+  DOUAudioFileProvider *provider = test_create_provider(url);
+  if (!test_wait(kTestTimeout, ^BOOL{ return [provider isReady] || [provider isFailed]; }) ||
+      [provider isFailed]) {
+    [server setHonorsRanges:YES];
+    return test_result(@"full_fallback", NO, @"provider never became ready", server);
+  }
+
+  [provider seekToOffset:[data length] * 3 / 4];
+
+  BOOL finished = test_wait(kTestTimeout, ^BOOL{ return [provider isFinished] || [provider isFailed]; });
+  BOOL passed = finished && ![provider isFailed] && test_cached_data_matches(provider, data);
+
+  NSDictionary *response = test_find_response(server, ^BOOL(NSDictionary *r) {
+    return [r objectForKey:@"range"] != [NSNull null] &&
+           [[r objectForKey:@"status"] integerValue] == 200;
+  });
+
+  provider = nil;
+  [server setHonorsRanges:YES];
+  [[DOUAudioCache sharedCache] removeEntryForURL:url];
+
+  return test_result(@"full_fallback",
+                     passed && response != nil,
+                     response != nil ? nil : @"the seek never reached the server",
+                     server);
+}
+
+static NSDictionary *test_if_range_mismatch(DOUBenchHTTPServer *server, NSData *oldData, NSData *newData)
+{
+  NSURL *url = [server URLWithPath:@"if_range_mismatch.wav"];
+  [[DOUAudioCache sharedCache] removeEntryForURL:url];
+
+  [server setData:oldData];
+  [server setEntityTag:@"\"old\""];
+  [server setBandwidthBlock:^double(NSTimeInterval time) {
+    return 1024.0 * 1024.0;
+  }];
+
+  DOUAudioFileProvider *provider = test_create_provider(url);
+  BOOL partial = test_wait(kTestTimeout, ^BOOL{
+    return [provider receivedLength] >= [oldData length] / 4 || [provider isFailed];
+  });
+
+  if (!partial || [provider isFailed] || !test_release_provider(&provider, url)) {
+    return test_result(@"if_range_mismatch", NO, @"could not cache part of the old entity", server);
+  }
+
+  [server removeAllResponses];
+  [server setData:newData];
+  [server setEntityTag:@"\"new\""];
+  [server setBandwidthBlock:NULL];
+
+  provider = test_create_provider(url);
+  BOOL finished = test_wait(kTestTimeout, ^BOOL{ return [provider isFinished] || [provider isFailed]; });
+  BOOL passed = finished && ![provider isFailed] && test_cached_data_matches(provider, newData);
+
+  NSDictionary *response = test_find_response(server, ^BOOL(NSDictionary *r) {
+    return [[r objectForKey:@"if_range"] isEqual:@"\"old\""] &&
+           [[r objectForKey:@"status"] integerValue] == 200;
+  });
+
+  provider = nil;
+  [server setEntityTag:@"\"0\""];
+  [[DOUAudioCache sharedCache] removeEntryForURL:url];
+
+  return test_result(@"if_range_mismatch",
+                     passed && response != nil,
+                     response != nil ? nil : @"no If-Range request was sent for the cached ranges",
+                     server);
+}
+
+static NSDictionary *test_dropped_connection(DOUBenchHTTPServer *server, NSData *data)
+{
+  NSURL *url = [server URLWithPath:@"dropped_connection.wav"];
+  [[DOUAudioCache sharedCache] removeEntryForURL:url];
+
+  [server setData:data];
+  [server setBandwidthBlock:NULL];
+  [server setDropAfterLength:[data length] / 3];
+
+  DOUAudioFileProvider *provider = test_create_provider(url);
+  BOOL finished = test_wait(kTestTimeout, ^BOOL{ return [provider isFinished] || [provider isFailed]; });
+  BOOL passed = finished && ![provider isFailed] && test_cached_data_matches(provider, data);
+
+  NSDictionary *response = test_find_response(server, ^BOOL(NSDictionary *r) {
+    return [[r objectForKey:@"status"] integerValue] == 206 &&
+           [[r objectForKey:@"first"] unsignedIntegerValue] > 0 &&
+           [[r objectForKey:@"if_range"] isEqual:@"\"0\""];
+  });
+
+  provider = nil;
+  [[DOUAudioCache sharedCache] removeEntryForURL:url];
+
+  return test_result(@"dropped_connection",
+                     passed && response != nil,
+                     response != nil ? nil : @"the download was not resumed with a range request",
+                     server);
+}
+
+int main(int argc, const char *argv[])
+{
+  @autoreleasepool {
+    NSData *data = test_make_wav(kTestDuration, 1);
+    NSData *otherData = test_make_wav(kTestDuration, 2);
+
+    DOUBenchHTTPServer *server = [DOUBenchHTTPServer serverWithData:data];
+    if (![server start]) {
+      fprintf(stderr, "douasrangetest: failed to start the HTTP server\n");
+      return 1;
+    }
+
+    NSMutableArray *results = [NSMutableArray array];
+    NSArray *cases = @[
+      ^NSDictionary *{ return test_partial_content(server, data); },
+      ^NSDictionary *{ return test_full_fallback(server, data); },
+      ^NSDictionary *{ return test_if_range_mismatch(server, data, otherData); },
+      ^NSDictionary *{ return test_dropped_connection(server, data); }
+    ];
+
+    BOOL passed = YES;
+    for (NSDictionary *(^testCase)(void) in cases) {
+      @autoreleasepool {
+        [server removeAllResponses];
+        NSDictionary *result = testCase();
+        passed = passed && [[result objectForKey:@"passed"] boolValue];
+        [results addObject:result];
+      }
+    }
+
+    [server stop];
+
+    NSData *json = [NSJSONSerialization dataWithJSONObject:@{ @"passed": @(passed), @"cases": results }
+                                                   options:NSJSONWritingPrettyPrinted
+                                                     error:NULL];
+    fwrite([json bytes], 1, [json length], stdout);
+    fputc('\n', stdout);
+
+    return passed ? 0 : 1;
+  }
+}
@@ -0,0 +1,469 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+
+/*
+ * douasreplay - replays recorded bandwidth traces against the buffering
+ * policies and reports how often and for how long playback rebuffers.
+ *
+ *     douasreplay [--file path] [--speed factor] trace ...
+ *
+ * Every trace is served through a throttled local HTTP server while a
+ * DOUAudioStreamer plays the file into a renderer paced at real time, once
+ * per policy.  A trace is a text file of "<seconds> <kbit/s>" lines, each
+ * setting the bandwidth from that time on; it loops when playback outlasts
+ * it, and lines starting with '#' are ignored.  The sample traces are in
+ * the traces folder.  Without --file a 60 second 22.05 kHz mono WAV file
+ * (353 kbit/s) is generated.  A speed factor above one compresses both the
+ * trace and the playback clock.
+ *
+ * Build it from this directory with:
+ *
+ *     clang -fobjc-arc -O2 -I../src ../src/*.m DOUBenchHTTPServer.m \
+ *       douasreplay.m -o douasreplay \
+ *       -framework Foundation -framework Accelerate -framework CFNetwork \
+ *       -framework CoreAudio -framework AudioToolbox -framework AudioUnit \
+ *       -framework CoreServices
+ */
+
+#import <Foundation/Foundation.h>
+#import "DOUAudioStreamer.h"
+#import "DOUAudioStreamer+Options.h"
+#import "DOUAudioBufferingPolicy.h"
+#import "DOUAudioNullRenderer.h"
+#import "DOUAudioCache.h"
+#import "DOUBenchHTTPServer.h"
+#include <mach/mach_time.h>
+
+static const NSUInteger kReplaySampleRate = 22050;
+static const NSUInteger kReplayDuration = 60;
+static const NSTimeInterval kReplayPollInterval = 0.005;
+static const NSTimeInterval kReplayStallTimeout = 60.0;
+
+@interface ReplayAudioFile : NSObject <DOUAudioFile> {
+@private
+  NSURL *_url;
+}
+- (instancetype)initWithURL:(NSURL *)url;
+@end
+
+@implementation ReplayAudioFile
+- (instancetype)initWithURL:(NSURL *)url
+{
+  self = [super init];
+  if (self) {
+    _url = url;
+  }
+
+  return self;
+}
+
+- (NSURL *)audioFileURL
+{
+  return _url;
+}
+@end
+
+/*
+ * Consumes PCM no faster than it would play, so the decoder runs dry
+ * whenever the network falls behind.  After a stall the clock starts over
+ * instead of catching up.
+ */
+
+@interface ReplayRenderer : DOUAudioNullRenderer {
+@private
+  double _speed;
+  double _bytesPerSecond;
+  uint64_t _startHostTime;
+  double _renderedSeconds;
+}
+- (instancetype)initWithSpeed:(double)speed;
+@end
+
+@implementation ReplayRenderer
+
+- (instancetype)initWithSpeed:(double)speed
+{
+  self = [super init];
+  if (self) {
+    _speed = speed;
+  }
+
+  return self;
+}
+
+static double replay_seconds_per_host_time(void)
+{
+  static double conversion;
+
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    conversion = 1.0e-9 * timebase.numer / timebase.denom;
+  });
+
+  return conversion;
+}
+
+- (void)consumeBytes:(const void *)bytes length:(NSUInteger)length
+{
+  AudioStreamBasicDescription format = [self format];
+  double bytesPerSecond = format.mSampleRate * format.mBytesPerFrame * _speed;
+
+  uint64_t now = mach_absolute_time();
+  double elapsed = (now - _startHostTime) * replay_seconds_per_host_time();
+  if (_startHostTime == 0 ||
+      bytesPerSecond != _bytesPerSecond ||
+      elapsed > _renderedSeconds + 0.05) {
+    _startHostTime = now;
+    _bytesPerSecond = bytesPerSecond;
+    _renderedSeconds = 0.0;
+    elapsed = 0.0;
+  }
+
+  _renderedSeconds += length / bytesPerSecond;
+  if (_renderedSeconds > elapsed) {
+    usleep((useconds_t)((_renderedSeconds - elapsed) * 1.0e6));
+  }
+}
+
+@end
+
+/*
+ * Always waits for the tail of the watermark range before playing on, with
+ * no regard to throughput.  A baseline for the throughput-aware policies.
+ */
+
+@interface ReplayFixedBufferingPolicy : DOUAudioWatermarkBufferingPolicy
+@end
+
+@implementation ReplayFixedBufferingPolicy
+
+- (BOOL)shouldBufferWithBufferedTime:(NSUInteger)bufferedTime
+                     remainingLength:(NSUInteger)remainingLength
+                          throughput:(double)throughput
+                           deviation:(double)deviation
+                             bitRate:(double)bitRate
+                           buffering:(BOOL)buffering
+{
+  if (buffering) {
+    return bufferedTime < [self highWatermark];
+  }
+
+  return bufferedTime < [self lowWatermark];
+}
+
+@end
+
+static void replay_append_le(NSMutableData *data, uint32_t value, NSUInteger size)
+{
+  uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+  [data appendBytes:bytes length:size];
+}
+
+// A 16-bit mono sine sweep, so the file cannot be compressed in transit.
+static NSData *replay_make_wav(void)
+{
+  uint32_t frameCount = (uint32_t)(kReplayDuration * kReplaySampleRate);
+  uint32_t dataLength = frameCount * 2;
+
+  NSMutableData *data = [NSMutableData dataWithCapacity:44 + dataLength];
+  [data appendBytes:"RIFF" length:4];
+  replay_append_le(data, 36 + dataLength, 4);
+  [data appendBytes:"WAVEfmt " length:8];
+  replay_append_le(data, 16, 4);
+  replay_append_le(data, 1, 2);
+  replay_append_le(data, 1, 2);
+  replay_append_le(data, (uint32_t)kReplaySampleRate, 4);
+  replay_append_le(data, (uint32_t)kReplaySampleRate * 2, 4);
+  replay_append_le(data, 2, 2);
+  replay_append_le(data, 16, 2);
+  [data appendBytes:"data" length:4];
+  replay_append_le(data, dataLength, 4);
+
+  [data setLength:44 + dataLength];
+  int16_t *samples = (int16_t *)((uint8_t *)[data mutableBytes] + 44);
+  double phase = 0.0;
+  for (uint32_t i = 0; i < frameCount; ++i) {
+    double frequency = 220.0 + 880.0 * i / frameCount;
+    phase += 2.0 * M_PI * frequency / kReplaySampleRate;
+    samples[i] = (int16_t)OSSwapHostToLittleInt16((int16_t)(sin(phase) * 16384.0));
+  }
+
+  return data;
+}
+
+// Returns the trace as pairs of (seconds, bytes per second), or nil.
+static NSArray *replay_load_trace(NSString *path)
+{
+  NSString *contents = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+  if (contents == nil) {
+    return nil;
+  }
+
+  NSMutableArray *steps = [NSMutableArray array];
+  for (NSString *line in [contents componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]]) {
+    NSString *trimmed = [line stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    if ([trimmed length] == 0 || [trimmed hasPrefix:@"#"]) {
+      continue;
+    }
+
+    double time, kbps;
+    if (sscanf([trimmed UTF8String], "%lf %lf", &time, &kbps) != 2 ||
+        time < 0.0 || kbps < 0.0 ||
+        time < [[[steps lastObject] firstObject] doubleValue]) {
+      return nil;
+    }
+
+    [steps addObject:@[@(time), @(kbps * 1000.0 / 8.0)]];
+  }
+
+  return [steps count] > 0 ? steps : nil;
+}
+
+static DOUBenchHTTPServerBandwidthBlock replay_bandwidth_block(NSArray *steps, double speed)
+{
+  NSUInteger count = [steps count];
+  NSMutableData *times = [NSMutableData dataWithLength:count * sizeof(double)];
+  NSMutableData *rates = [NSMutableData dataWithLength:count * sizeof(double)];
+  for (NSUInteger i = 0; i < count; ++i) {
+    ((double *)[times mutableBytes])[i] = [[[steps objectAtIndex:i] firstObject] doubleValue];
+    ((double *)[rates mutableBytes])[i] = [[[steps objectAtIndex:i] lastObject] doubleValue];
+  }
+
+  // The last step lasts as long as the gap before it, or a second.
+  const double *t = (const double *)[times bytes];
+  double period = t[count - 1] + (count > 1 ? MAX(t[count - 1] - t[count - 2], 1.0) : 1.0);
+
+  return ^double(NSTimeInterval time) {
+    const double *t = (const double *)[times bytes];
+    const double *r = (const double *)[rates bytes];
+    double position = fmod(time * speed, period);
+
+    NSUInteger i = count - 1;
+    while (i > 0 && t[i] > position) {
+      --i;
+    }
+
+    return r[i] * speed;
+  };
+}
+
+static NSDictionary *replay_run(NSData *data, NSString *contentType, NSArray *steps,
+                                id <DOUAudioBufferingPolicy> policy, NSString *name, double speed)
+{
+  DOUBenchHTTPServer *server = [DOUBenchHTTPServer serverWithData:data];
+  [server setContentType:contentType];
+  [server setBandwidthBlock:replay_bandwidth_block(steps, speed)];
+  if (![server start]) {
+    return nil;
+  }
+
+  NSURL *url = [server URLWithPath:[NSString stringWithFormat:@"%@.%@", name, [contentType lastPathComponent]]];
+  [[DOUAudioCache sharedCache] removeEntryForURL:url];
+
+  [DOUAudioStreamer setBufferingPolicy:policy];
+  [DOUAudioStreamer setRenderer:[[ReplayRenderer alloc] initWithSpeed:speed]];
+
+  DOUAudioStreamer *streamer = [DOUAudioStreamer streamerWithAudioFile:[[ReplayAudioFile alloc] initWithURL:url]];
+  [streamer play];
+
+  NSDate *startDate = [NSDate date];
+  NSDate *progressDate = startDate;
+  NSTimeInterval startupTime = -1.0;
+  NSTimeInterval rebufferTime = 0.0;
+  NSTimeInterval lastPlayedTime = 0.0;
+  NSUInteger rebufferCount = 0;
+  NSDate *rebufferDate = nil;
+  BOOL timedOut = NO;
+
+  for (;;) {
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:kReplayPollInterval]];
+
+    DOUAudioStreamerStatus status = [streamer status];
+    if (status == DOUAudioStreamerFinished || status == DOUAudioStreamerError) {
+      break;
+    }
+
+    if (status == DOUAudioStreamerPlaying) {
+      if (startupTime < 0.0) {
+        startupTime = -[startDate timeIntervalSinceNow];
+      }
+
+      if (rebufferDate != nil) {
+        rebufferTime -= [rebufferDate timeIntervalSinceNow];
+        rebufferDate = nil;
+      }
+    }
+    else if (status == DOUAudioStreamerBuffering &&
+             startupTime >= 0.0 &&
+             rebufferDate == nil) {
+      rebufferCount++;
+      rebufferDate = [NSDate date];
+    }
+
+    NSTimeInterval currentTime = [streamer currentTime];
+    if (currentTime != lastPlayedTime) {
+      lastPlayedTime = currentTime;
+      progressDate = [NSDate date];
+    }
+    else if (-[progressDate timeIntervalSinceNow] > kReplayStallTimeout) {
+      timedOut = YES;
+      break;
+    }
+  }
+
+  if (rebufferDate != nil) {
+    rebufferTime -= [rebufferDate timeIntervalSinceNow];
+  }
+
+  DOUAudioStreamerStatus status = [streamer status];
+  [streamer stop];
+  streamer = nil;
+  [server stop];
+  [[DOUAudioCache sharedCache] removeEntryForURL:url];
+
+  // Times are reported on the audio clock, independent of the speed factor.
+  return @{
+    @"policy": name,
+    @"finished": @(status == DOUAudioStreamerFinished),
+    @"timed_out": @(timedOut),
+    @"startup_time": @(startupTime >= 0.0 ? startupTime * speed : -1.0),
+    @"rebuffer_count": @(rebufferCount),
+    @"rebuffer_time": @(rebufferTime * speed),
+    @"wall_time": @(-[startDate timeIntervalSinceNow] * speed)
+  };
+}
+
+static NSDictionary *replay_policies(void)
+{
+  DOUAudioWatermarkBufferingPolicy *conservative = [[DOUAudioWatermarkBufferingPolicy alloc] init];
+  [conservative setLowWatermark:2000];
+  [conservative setHighWatermark:6000];
+  [conservative setDeviationFactor:2.0];
+
+  DOUAudioWatermarkBufferingPolicy *optimistic = [[DOUAudioWatermarkBufferingPolicy alloc] init];
+  [optimistic setDeviationFactor:0.0];
+
+  return @{
+    @"watermark": [[DOUAudioWatermarkBufferingPolicy alloc] init],
+    @"watermark_conservative": conservative,
+    @"watermark_optimistic": optimistic,
+    @"fixed": [[ReplayFixedBufferingPolicy alloc] init]
+  };
+}
+
+static void replay_usage(void)
+{
+  fprintf(stderr, "usage: douasreplay [--file path] [--speed factor] trace ...\n");
+}
+
+int main(int argc, const char *argv[])
+{
+  @autoreleasepool {
+    NSString *filePath = nil;
+    double speed = 1.0;
+    NSMutableArray *tracePaths = [NSMutableArray array];
+
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+        filePath = @(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+        speed = MAX(strtod(argv[++i], NULL), 0.1);
+      }
+      else if (argv[i][0] == '-') {
+        replay_usage();
+        return 1;
+      }
+      else {
+        [tracePaths addObject:@(argv[i])];
+      }
+    }
+
+    if ([tracePaths count] == 0) {
+      replay_usage();
+      return 1;
+    }
+
+    NSData *data;
+    NSString *contentType;
+    if (filePath != nil) {
+      data = [NSData dataWithContentsOfFile:filePath];
+      contentType = [@"audio" stringByAppendingPathComponent:[[filePath pathExtension] lowercaseString]];
+    }
+    else {
+      data = replay_make_wav();
+      contentType = @"audio/wav";
+    }
+
+    if (data == nil) {
+      fprintf(stderr, "douasreplay: cannot read %s\n", [filePath UTF8String]);
+      return 1;
+    }
+
+    NSDictionary *policies = replay_policies();
+    NSArray *policyNames = [[policies allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    NSMutableDictionary *totals = [NSMutableDictionary dictionary];
+    NSMutableArray *traces = [NSMutableArray array];
+
+    for (NSString *tracePath in tracePaths) {
+      NSArray *steps = replay_load_trace(tracePath);
+      if (steps == nil) {
+        fprintf(stderr, "douasreplay: cannot parse %s\n", [tracePath UTF8String]);
+        return 1;
+      }
+
+      NSMutableArray *runs = [NSMutableArray array];
+      for (NSString *name in policyNames) {
+        @autoreleasepool {
+          NSDictionary *run = replay_run(data, contentType, steps, [policies objectForKey:name], name, speed);
+          if (run == nil) {
+            fprintf(stderr, "douasreplay: failed to start the HTTP server\n");
+            return 1;
+          }
+
+          [runs addObject:run];
+
+          NSDictionary *total = [totals objectForKey:name];
+          [totals setObject:@{
+            @"rebuffer_count": @([[total objectForKey:@"rebuffer_count"] unsignedIntegerValue] + [[run objectForKey:@"rebuffer_count"] unsignedIntegerValue]),
+            @"rebuffer_time": @([[total objectForKey:@"rebuffer_time"] doubleValue] + [[run objectForKey:@"rebuffer_time"] doubleValue]),
+            @"startup_time": @([[total objectForKey:@"startup_time"] doubleValue] + MAX([[run objectForKey:@"startup_time"] doubleValue], 0.0))
+          } forKey:name];
+        }
+      }
+
+      [traces addObject:@{ @"trace": [tracePath lastPathComponent], @"runs": runs }];
+    }
+
+    NSDictionary *report = @{
+      @"file": filePath ?: @"(generated)",
+      @"speed": @(speed),
+      @"traces": traces,
+      @"policies": totals
+    };
+
+    NSData *json = [NSJSONSerialization dataWithJSONObject:report
+                                                   options:NSJSONWritingPrettyPrinted
+                                                     error:NULL];
+    fwrite([json bytes], 1, [json length], stdout);
+    fputc('\n', stdout);
+  }
+
+  return 0;
+}
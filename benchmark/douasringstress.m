@@ -0,0 +1,338 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+
+/*
+ * douasringstress - headless two-thread stress test of the renderer ring.
+ *
+ * DOUAudioRenderer is compiled into this file, and its render callback is
+ * installed on a generic output unit instead of the hardware one, so the
+ * ring is exercised exactly as in playback without an audio device.  A
+ * producer thread pushes a counting float32 pattern through
+ * -renderBytes:length: in random chunks and stalls at random, standing in
+ * for a preempted decode thread, while a consumer thread pulls the unit at
+ * a fixed period like the Core Audio I/O thread would:
+ *
+ *     douasringstress [--seconds seconds] [--speed factor] [--seed seed]
+ *
+ * An underrun is a cycle that rendered silence, lost bytes are pattern
+ * frames that never reached the consumer and corrupt bytes are frames that
+ * do not match the pattern at all.  The report is printed as JSON, and the
+ * exit status is non-zero if any byte was lost or corrupted.
+ *
+ * Build it from this directory with:
+ *
+ *     clang -fobjc-arc -O2 -I../src \
+ *       $(ls ../src/*.m | grep -v DOUAudioRenderer.m) douasringstress.m \
+ *       -o douasringstress \
+ *       -framework Foundation -framework Accelerate -framework CFNetwork \
+ *       -framework CoreAudio -framework AudioToolbox -framework AudioUnit \
+ *       -framework CoreServices
+ */
+
+#include "DOUAudioRenderer.m"
+
+static const NSUInteger kStressBufferTime = 200;
+static const UInt32 kStressFramesPerCycle = 512;
+static const UInt32 kStressPatternModulus = 1 << 24;
+static const NSUInteger kStressMaximumChunkFrames = 4096;
+
+@interface DOUAudioRenderer (RingStress)
+- (BOOL)stress_setUpGenericOutput;
+- (AudioComponentInstance)stress_outputAudioUnit;
+@end
+
+@implementation DOUAudioRenderer (RingStress)
+
+- (BOOL)stress_setUpGenericOutput
+{
+  AudioComponentDescription desc;
+  desc.componentType = kAudioUnitType_Output;
+  desc.componentSubType = kAudioUnitSubType_GenericOutput;
+  desc.componentManufacturer = kAudioUnitManufacturer_Apple;
+  desc.componentFlags = 0;
+  desc.componentFlagsMask = 0;
+
+  AudioComponent comp = AudioComponentFindNext(NULL, &desc);
+  if (comp == NULL ||
+      AudioComponentInstanceNew(comp, &_outputAudioUnit) != noErr) {
+    _outputAudioUnit = NULL;
+    return NO;
+  }
+
+  AURenderCallbackStruct input;
+  input.inputProc = au_render_callback;
+  input.inputProcRefCon = (__bridge void *)self;
+
+  if (AudioUnitSetProperty(_outputAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &_format, sizeof(_format)) != noErr ||
+      AudioUnitSetProperty(_outputAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Output, 0, &_format, sizeof(_format)) != noErr ||
+      AudioUnitSetProperty(_outputAudioUnit, kAudioUnitProperty_SetRenderCallback, kAudioUnitScope_Input, 0, &input, sizeof(input)) != noErr ||
+      AudioUnitInitialize(_outputAudioUnit) != noErr) {
+    AudioComponentInstanceDispose(_outputAudioUnit);
+    _outputAudioUnit = NULL;
+    return NO;
+  }
+
+  _bytesPerFrame = _format.mBytesPerFrame;
+  _channelCount = _format.mChannelsPerFrame;
+  dou_audio_gain_ramp_init(&_gainRamp, _format.mSampleRate * kDOUAudioRendererGainRampTime / 1000, _gainRamp.gain);
+
+  _bufferByteCount = (NSUInteger)(_bufferTime * _format.mSampleRate / 1000) * _format.mBytesPerFrame;
+  _buffer = (uint8_t *)calloc(1, _bufferByteCount);
+  renderer_publish_track_gain(self, dou_audio_gain_from_decibels(_trackGain), 0);
+
+  return YES;
+}
+
+- (AudioComponentInstance)stress_outputAudioUnit
+{
+  return _outputAudioUnit;
+}
+
+@end
+
+typedef struct {
+  __unsafe_unretained DOUAudioRenderer *renderer;
+  AudioStreamBasicDescription format;
+  double speed;
+  uint64_t cycleCount;
+  atomic_bool finished;
+
+  uint64_t producedFrames;
+  unsigned producerSeed;
+  uint64_t stallCount;
+
+  uint64_t renderedCycles;
+  uint64_t underrunCount;
+  uint64_t receivedFrames;
+  uint64_t lostBytes;
+  uint64_t corruptBytes;
+  double maximumLateness;
+} stress_context;
+
+static float stress_pattern_sample(uint64_t frame)
+{
+  return (float)(frame % kStressPatternModulus + 1);
+}
+
+static void *stress_producer(void *argument)
+{
+  stress_context *context = (stress_context *)argument;
+  UInt32 channelCount = context->format.mChannelsPerFrame;
+  float *chunk = (float *)malloc(kStressMaximumChunkFrames * context->format.mBytesPerFrame);
+
+  double cycleTime = kStressFramesPerCycle / context->format.mSampleRate / context->speed;
+  while (!atomic_load(&context->finished)) {
+    @autoreleasepool {
+      NSUInteger frameCount = 1 + (NSUInteger)rand_r(&context->producerSeed) % kStressMaximumChunkFrames;
+      for (NSUInteger i = 0; i < frameCount; ++i) {
+        float sample = stress_pattern_sample(context->producedFrames + i);
+        for (UInt32 channel = 0; channel < channelCount; ++channel) {
+          chunk[i * channelCount + channel] = sample;
+        }
+      }
+
+      [context->renderer renderBytes:chunk length:frameCount * context->format.mBytesPerFrame];
+      context->producedFrames += frameCount;
+
+      // Roughly one chunk in 64 stalls for up to 32 render cycles, which
+      // sometimes outlasts the whole ring.
+      if (rand_r(&context->producerSeed) % 64 == 0) {
+        context->stallCount++;
+        usleep((useconds_t)(cycleTime * (rand_r(&context->producerSeed) % 32) * 1.0e6));
+      }
+    }
+  }
+
+  free(chunk);
+  return NULL;
+}
+
+static void stress_check_cycle(stress_context *context, const float *samples, UInt32 frameCount, uint64_t *expectedFrame)
+{
+  UInt32 channelCount = context->format.mChannelsPerFrame;
+  UInt32 bytesPerFrame = context->format.mBytesPerFrame;
+
+  BOOL silent = YES;
+  for (UInt32 i = 0; i < frameCount * channelCount; ++i) {
+    if (samples[i] != 0.0f) {
+      silent = NO;
+      break;
+    }
+  }
+
+  if (silent) {
+    context->underrunCount++;
+    return;
+  }
+
+  for (UInt32 i = 0; i < frameCount; ++i) {
+    const float *frame = samples + i * channelCount;
+    BOOL consistent = frame[0] >= 1.0f && frame[0] <= kStressPatternModulus;
+    for (UInt32 channel = 1; channel < channelCount && consistent; ++channel) {
+      consistent = frame[channel] == frame[0];
+    }
+
+    if (!consistent) {
+      context->corruptBytes += bytesPerFrame;
+      continue;
+    }
+
+    uint64_t value = (uint64_t)frame[0] - 1;
+    uint64_t gap = (value + kStressPatternModulus - *expectedFrame % kStressPatternModulus) % kStressPatternModulus;
+    context->lostBytes += gap * bytesPerFrame;
+    *expectedFrame += gap + 1;
+    context->receivedFrames++;
+  }
+}
+
+static void *stress_consumer(void *argument)
+{
+  stress_context *context = (stress_context *)argument;
+  AudioComponentInstance unit = [context->renderer stress_outputAudioUnit];
+  UInt32 bytesPerFrame = context->format.mBytesPerFrame;
+  float *samples = (float *)malloc(kStressFramesPerCycle * bytesPerFrame);
+
+  while (![context->renderer isStarted]) {
+    usleep(1000);
+  }
+
+  double hostTimePerSecond = 1.0 / [DOUAudioRenderer timeIntervalForHostTime:1];
+  uint64_t period = (uint64_t)(kStressFramesPerCycle / context->format.mSampleRate / context->speed * hostTimePerSecond);
+  uint64_t deadline = mach_absolute_time();
+  uint64_t expectedFrame = 0;
+
+  AudioTimeStamp timeStamp;
+  memset(&timeStamp, 0, sizeof(timeStamp));
+  timeStamp.mFlags = kAudioTimeStampSampleTimeValid | kAudioTimeStampHostTimeValid;
+
+  for (uint64_t cycle = 0; cycle < context->cycleCount; ++cycle) {
+    mach_wait_until(deadline);
+    uint64_t now = mach_absolute_time();
+    if (now > deadline) {
+      context->maximumLateness = MAX(context->maximumLateness, (now - deadline) / hostTimePerSecond);
+    }
+
+    AudioBufferList bufferList;
+    bufferList.mNumberBuffers = 1;
+    bufferList.mBuffers[0].mNumberChannels = context->format.mChannelsPerFrame;
+    bufferList.mBuffers[0].mDataByteSize = kStressFramesPerCycle * bytesPerFrame;
+    bufferList.mBuffers[0].mData = samples;
+
+    timeStamp.mHostTime = now;
+    AudioUnitRenderActionFlags flags = 0;
+    if (AudioUnitRender(unit, &flags, &timeStamp, 0, kStressFramesPerCycle, &bufferList) == noErr) {
+      stress_check_cycle(context, samples, kStressFramesPerCycle, &expectedFrame);
+      context->renderedCycles++;
+    }
+
+    timeStamp.mSampleTime += kStressFramesPerCycle;
+    deadline += period;
+  }
+
+  atomic_store(&context->finished, true);
+  free(samples);
+  return NULL;
+}
+
+static void stress_usage(void)
+{
+  fprintf(stderr, "usage: douasringstress [--seconds seconds] [--speed factor] [--seed seed]\n");
+}
+
+int main(int argc, const char *argv[])
+{
+  @autoreleasepool {
+    double seconds = 60.0;
+    double speed = 4.0;
+    unsigned seed = 1;
+
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+        seconds = strtod(argv[++i], NULL);
+      }
+      else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+        speed = strtod(argv[++i], NULL);
+      }
+      else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+        seed = (unsigned)strtoul(argv[++i], NULL, 10);
+      }
+      else {
+        stress_usage();
+        return 1;
+      }
+    }
+
+    if (seconds <= 0.0 || speed <= 0.0) {
+      stress_usage();
+      return 1;
+    }
+
+    DOUAudioRenderer *renderer = [DOUAudioRenderer rendererWithBufferTime:kStressBufferTime];
+    if (![renderer stress_setUpGenericOutput]) {
+      fprintf(stderr, "douasringstress: failed to set up a generic output unit\n");
+      return 1;
+    }
+
+    stress_context context;
+    memset(&context, 0, sizeof(context));
+    context.renderer = renderer;
+    context.format = [renderer format];
+    context.speed = speed;
+    context.cycleCount = (uint64_t)(seconds * context.format.mSampleRate / kStressFramesPerCycle);
+    context.producerSeed = seed;
+    atomic_init(&context.finished, false);
+
+    pthread_t producer;
+    pthread_t consumer;
+    pthread_create(&producer, NULL, stress_producer, &context);
+    pthread_create(&consumer, NULL, stress_consumer, &context);
+
+    pthread_join(consumer, NULL);
+
+    // The producer may be waiting for room that will never come; an
+    // interrupted renderer gives up instead of restarting the unit.
+    [renderer setInterrupted:YES];
+    [renderer stop];
+    pthread_join(producer, NULL);
+
+    [renderer tearDown];
+
+    NSDictionary *report = @{
+      @"seconds": @(seconds),
+      @"speed": @(speed),
+      @"seed": @(seed),
+      @"buffer_time": @(kStressBufferTime),
+      @"frames_per_cycle": @(kStressFramesPerCycle),
+      @"cycles": @(context.renderedCycles),
+      @"producer_stalls": @(context.stallCount),
+      @"produced_bytes": @(context.producedFrames * context.format.mBytesPerFrame),
+      @"received_bytes": @(context.receivedFrames * context.format.mBytesPerFrame),
+      @"underruns": @(context.underrunCount),
+      @"lost_bytes": @(context.lostBytes),
+      @"corrupt_bytes": @(context.corruptBytes),
+      @"maximum_lateness": @(context.maximumLateness)
+    };
+
+    NSData *json = [NSJSONSerialization dataWithJSONObject:report
+                                                   options:NSJSONWritingPrettyPrinted
+                                                     error:NULL];
+    fwrite([json bytes], 1, [json length], stdout);
+    fputc('\n', stdout);
+
+    return context.lostBytes == 0 && context.corruptBytes == 0 ? 0 : 1;
+  }
+}
@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Generates the douasbench fixtures into the given directory (default
+# ./fixtures).  The source is a 60 second 44.1 kHz stereo sine sweep with
+# seeded noise, so every run produces the same PCM:
+#
+#     wav_pcm16.wav           uncompressed
+#     aac_cbr_128.m4a         AAC-LC, constant bit rate
+#     aac_vbr_q64.m4a         AAC-LC, variable bit rate
+#     aac_cbr_128.aac         AAC-LC in ADTS, as served by streaming sites
+#     alac.m4a                Apple Lossless
+#     mp3_cbr_128.mp3         MP3, constant bit rate (needs lame)
+#     mp3_vbr_v4.mp3          MP3, variable bit rate (needs lame)
+#
+# afconvert ships with macOS; it cannot encode MP3, so those two are
+# skipped with a warning when lame is not installed.
+
+set -e
+
+out=${1:-fixtures}
+mkdir -p "$out"
+
+source_wav="$out/wav_pcm16.wav"
+
+perl -e '
+  use strict;
+  my ($rate, $seconds) = (44100, 60);
+  my $frames = $rate * $seconds;
+  my $length = $frames * 4;
+  binmode STDOUT;
+  print "RIFF", pack("V", 36 + $length), "WAVE";
+  print "fmt ", pack("VvvVVvv", 16, 1, 2, $rate, $rate * 4, 4, 16);
+  print "data", pack("V", $length);
+  my ($phase, $seed) = (0.0, 1);
+  for my $i (0 .. $frames - 1) {
+    $phase += 2 * 3.14159265358979 * (110 + 3300 * $i / $frames) / $rate;
+    $seed = ($seed * 1103515245 + 12345) % 2147483648;
+    my $noise = ($seed / 2147483648 - 0.5) * 2000;
+    my $left = int(sin($phase) * 12000 + $noise);
+    my $right = int(sin($phase * 1.5) * 12000 - $noise);
+    print pack("vv", $left & 0xffff, $right & 0xffff);
+  }
+' > "$source_wav"
+
+afconvert -f m4af -d aac -s 0 -b 128000 "$source_wav" "$out/aac_cbr_128.m4a"
+afconvert -f m4af -d aac -s 3 -u vbrq 64 "$source_wav" "$out/aac_vbr_q64.m4a"
+afconvert -f adts -d aac -s 0 -b 128000 "$source_wav" "$out/aac_cbr_128.aac"
+afconvert -f m4af -d alac "$source_wav" "$out/alac.m4a"
+
+if command -v lame >/dev/null 2>&1; then
+  lame --quiet --cbr -b 128 "$source_wav" "$out/mp3_cbr_128.mp3"
+  lame --quiet -V 4 "$source_wav" "$out/mp3_vbr_v4.mp3"
+else
+  echo "make_fixtures.sh: lame not found, skipping the MP3 fixtures" >&2
+fi
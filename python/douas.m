@@ -16,6 +16,11 @@
 
 #import <Foundation/Foundation.h>
 #import "DOUAudioStreamer.h"
+#import "DOUAudioStreamer+Options.h"
+#import "DOUAudioFileProvider.h"
+#import "DOUAudioPlaybackItem.h"
+#import "DOUAudioDecoder.h"
+#import "DOUAudioLPCM.h"
 
 #include <Python.h>
 #include <structmember.h>
@@ -54,6 +59,195 @@ typedef struct {
 }
 @end
 
+@interface AudioFile : NSObject <DOUAudioFile> {
+@private
+  NSURL *_url;
+}
+- (instancetype)initWithURL:(NSString *)url;
+@end
+
+@implementation AudioFile
+- (instancetype)initWithURL:(NSString *)url
+{
+  self = [super init];
+  if (self) {
+    if (url == nil) {
+      return nil;
+    }
+
+    if ([url rangeOfString:@"://"].location != NSNotFound) {
+      _url = [NSURL URLWithString:url];
+    }
+    else {
+      _url = [NSURL fileURLWithPath:[url stringByExpandingTildeInPath]];
+    }
+
+    if (_url == nil) {
+      return nil;
+    }
+  }
+
+  return self;
+}
+
+- (NSURL *)audioFileURL
+{
+  return _url;
+}
+@end
+
+/*
+ * Offline decoding drives DOUAudioDecoder directly, with neither the event
+ * loop nor a renderer involved, so it runs as fast as the codec allows.
+ * Only local or completely cached files are accepted, like DOUAudioOverview
+ * does, so the decoder never waits for the network.  PCM is copied exactly
+ * once, out of the decoder's ring buffer into memory owned by a douas.PCM
+ * object, which exports it through the buffer protocol as a frames x
+ * channels float32 array that numpy.asarray() wraps in place.
+ */
+
+@interface PCMReader : NSObject {
+@private
+  DOUAudioPlaybackItem *_playbackItem;
+  DOUAudioDecoder *_decoder;
+  SInt64 _position;
+  BOOL _finished;
+  BOOL _failed;
+}
+
++ (instancetype)readerWithFileProvider:(DOUAudioFileProvider *)fileProvider
+                            sampleRate:(double)sampleRate;
+- (instancetype)initWithFileProvider:(DOUAudioFileProvider *)fileProvider
+                          sampleRate:(double)sampleRate;
+
+@property (nonatomic, readonly) double sampleRate;
+@property (nonatomic, readonly) NSUInteger channelCount;
+@property (nonatomic, readonly) NSUInteger bytesPerFrame;
+@property (nonatomic, readonly) NSTimeInterval duration;
+@property (nonatomic, readonly) SInt64 position;
+@property (nonatomic, readonly, getter=isFailed) BOOL failed;
+
+- (NSUInteger)readFrames:(NSUInteger)frameCount intoBuffer:(void *)buffer;
+- (void)seekToTime:(NSTimeInterval)time;
+
+@end
+
+@implementation PCMReader
+
+@synthesize position = _position;
+@synthesize failed = _failed;
+
++ (instancetype)readerWithFileProvider:(DOUAudioFileProvider *)fileProvider
+                            sampleRate:(double)sampleRate
+{
+  return [[[self class] alloc] initWithFileProvider:fileProvider
+                                         sampleRate:sampleRate];
+}
+
+- (instancetype)initWithFileProvider:(DOUAudioFileProvider *)fileProvider
+                          sampleRate:(double)sampleRate
+{
+  self = [super init];
+  if (self) {
+    _playbackItem = [DOUAudioPlaybackItem playbackItemWithFileProvider:fileProvider];
+    if (![_playbackItem open]) {
+      return nil;
+    }
+
+    if (sampleRate <= 0.0) {
+      sampleRate = [_playbackItem fileFormat].mSampleRate;
+    }
+    if (sampleRate <= 0.0) {
+      sampleRate = [DOUAudioDecoder defaultOutputFormat].mSampleRate;
+    }
+
+    AudioStreamBasicDescription outputFormat = [DOUAudioDecoder outputFormatWithSampleRate:sampleRate];
+    NSUInteger bufferSize = (NSUInteger)(kDOUAudioStreamerBufferTime * sampleRate / 1000) * outputFormat.mBytesPerFrame;
+
+    _decoder = [DOUAudioDecoder decoderWithPlaybackItem:_playbackItem
+                                           outputFormat:outputFormat
+                                             bufferSize:bufferSize];
+    if (![_decoder setUp]) {
+      return nil;
+    }
+  }
+
+  return self;
+}
+
+- (double)sampleRate
+{
+  return [_decoder outputFormat].mSampleRate;
+}
+
+- (NSUInteger)channelCount
+{
+  return [_decoder outputFormat].mChannelsPerFrame;
+}
+
+- (NSUInteger)bytesPerFrame
+{
+  return [_decoder outputFormat].mBytesPerFrame;
+}
+
+- (NSTimeInterval)duration
+{
+  return [_playbackItem estimatedDuration] / 1000.0;
+}
+
+- (NSUInteger)readFrames:(NSUInteger)frameCount intoBuffer:(void *)buffer
+{
+  NSUInteger bytesPerFrame = [self bytesPerFrame];
+  NSUInteger length = frameCount * bytesPerFrame;
+  NSUInteger filledLength = 0;
+
+  DOUAudioLPCM *lpcm = [_decoder lpcm];
+  while (filledLength < length) {
+    const void *bytes = NULL;
+    NSUInteger availableLength = 0;
+    if ([lpcm borrowBytes:&bytes length:&availableLength] && availableLength > 0) {
+      availableLength = MIN(availableLength, length - filledLength);
+      memcpy((uint8_t *)buffer + filledLength, bytes, availableLength);
+      [lpcm commitLength:availableLength];
+      filledLength += availableLength;
+      continue;
+    }
+
+    if (_finished) {
+      break;
+    }
+
+    switch ([_decoder decodeOnce]) {
+    case DOUAudioDecoderSucceeded:
+      break;
+
+    case DOUAudioDecoderEndEncountered:
+      _finished = YES;
+      break;
+
+    case DOUAudioDecoderWaiting:
+    case DOUAudioDecoderFailed:
+      _finished = YES;
+      _failed = YES;
+      break;
+    }
+  }
+
+  NSUInteger frames = filledLength / bytesPerFrame;
+  _position += frames;
+  return frames;
+}
+
+- (void)seekToTime:(NSTimeInterval)time
+{
+  [_decoder seekToTime:(NSUInteger)llround(MAX(time, 0.0) * 1000.0)];
+  _position = [_decoder outputPosition];
+  _finished = NO;
+  _failed = NO;
+}
+
+@end
+
 static void
 Streamer_dealloc(Streamer *self)
 {
@@ -231,6 +425,86 @@ Streamer_download_speed(Streamer *self)
   return Py_None;
 }
 
+static PyObject *
+py_object_from_ns_object(id object)
+{
+  if ([object isKindOfClass:[NSDictionary class]]) {
+    PyObject *dict = PyDict_New();
+    if (dict == NULL) {
+      return NULL;
+    }
+
+    for (NSString *key in object) {
+      PyObject *value = py_object_from_ns_object([object objectForKey:key]);
+      if (value == NULL ||
+          PyDict_SetItemString(dict, [key UTF8String], value) < 0) {
+        Py_XDECREF(value);
+        Py_DECREF(dict);
+        return NULL;
+      }
+      Py_DECREF(value);
+    }
+
+    return dict;
+  }
+  else if ([object isKindOfClass:[NSArray class]]) {
+    PyObject *list = PyList_New((Py_ssize_t)[object count]);
+    if (list == NULL) {
+      return NULL;
+    }
+
+    Py_ssize_t index = 0;
+    for (id item in object) {
+      PyObject *value = py_object_from_ns_object(item);
+      if (value == NULL) {
+        Py_DECREF(list);
+        return NULL;
+      }
+      PyList_SET_ITEM(list, index++, value);
+    }
+
+    return list;
+  }
+  else if ([object isKindOfClass:[NSNumber class]]) {
+    const char *type = [object objCType];
+    if (strcmp(type, @encode(float)) == 0 ||
+        strcmp(type, @encode(double)) == 0) {
+      return PyFloat_FromDouble([object doubleValue]);
+    }
+
+    return PyLong_FromUnsignedLongLong([object unsignedLongLongValue]);
+  }
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject *
+Streamer_time_to_first_audio(Streamer *self)
+{
+  if (self->streamer != NULL) {
+    @autoreleasepool {
+      return PyFloat_FromDouble([(__bridge AudioStreamer *)self->streamer timeToFirstAudio]);
+    }
+  }
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject *
+Streamer_metrics(Streamer *self)
+{
+  if (self->streamer != NULL) {
+    @autoreleasepool {
+      return py_object_from_ns_object([[(__bridge AudioStreamer *)self->streamer metrics] dictionaryRepresentation]);
+    }
+  }
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
 static PyObject *
 Streamer_play(Streamer *self)
 {
@@ -278,6 +552,8 @@ static PyMethodDef Streamer_methods[] = {
   { "duration", (PyCFunction)Streamer_duration, METH_NOARGS, "" },
   { "current_time", (PyCFunction)Streamer_current_time, METH_NOARGS, "" },
   { "download_speed", (PyCFunction)Streamer_download_speed, METH_NOARGS, "" },
+  { "time_to_first_audio", (PyCFunction)Streamer_time_to_first_audio, METH_NOARGS, "" },
+  { "metrics", (PyCFunction)Streamer_metrics, METH_NOARGS, "" },
   { "play", (PyCFunction)Streamer_play, METH_NOARGS, "" },
   { "pause", (PyCFunction)Streamer_pause, METH_NOARGS, "" },
   { "stop", (PyCFunction)Streamer_stop, METH_NOARGS, "" },
@@ -326,7 +602,684 @@ static PyTypeObject StreamerType = {
   Streamer_new,              /* tp_new */
 };
 
+static const Py_ssize_t kDouasDefaultChunkFrames = 65536;
+static const NSUInteger kDouasSegmentsPerThread = 4;
+static const NSTimeInterval kDouasMinimumSegmentDuration = 30.0;
+static const SInt64 kDouasPrerollFrames = 8192;
+
+typedef struct {
+  PyObject_HEAD
+  float *samples;
+  Py_ssize_t frames;
+  Py_ssize_t channels;
+  double sample_rate;
+  double time;
+  Py_ssize_t shape[2];
+  Py_ssize_t strides[2];
+} PCM;
+
+static void
+PCM_dealloc(PCM *self)
+{
+  free(self->samples);
+  self->ob_type->tp_free((PyObject *)self);
+}
+
+static Py_ssize_t
+PCM_length(PCM *self)
+{
+  return self->frames * self->channels * (Py_ssize_t)sizeof(float);
+}
+
+static Py_ssize_t
+PCM_getreadbuffer(PCM *self, Py_ssize_t segment, void **ptr)
+{
+  if (segment != 0) {
+    PyErr_SetString(PyExc_SystemError, "accessing non-existent PCM segment");
+    return -1;
+  }
+
+  *ptr = self->samples;
+  return PCM_length(self);
+}
+
+static Py_ssize_t
+PCM_getsegcount(PCM *self, Py_ssize_t *lenp)
+{
+  if (lenp != NULL) {
+    *lenp = PCM_length(self);
+  }
+
+  return 1;
+}
+
+/*
+ * The samples are a writable, C-contiguous frames x channels array.  A
+ * plain request gets them as bytes; the float32 format and the shape are
+ * only described when the consumer asks for them.  A Fortran-contiguous
+ * view is refused unless one of the dimensions is 1.
+ */
+
+static int
+PCM_getbuffer(PCM *self, Py_buffer *view, int flags)
+{
+  if ((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS &&
+      self->frames > 1 && self->channels > 1) {
+    PyErr_SetString(PyExc_BufferError, "PCM samples are interleaved, not Fortran contiguous");
+    return -1;
+  }
+
+  if ((flags & (PyBUF_ND | PyBUF_FORMAT)) == 0) {
+    return PyBuffer_FillInfo(view, (PyObject *)self, self->samples, PCM_length(self), 0, flags);
+  }
+
+  if (view == NULL) {
+    return 0;
+  }
+
+  view->obj = (PyObject *)self;
+  Py_INCREF(self);
+
+  view->buf = self->samples;
+  view->len = PCM_length(self);
+  view->readonly = 0;
+  view->itemsize = sizeof(float);
+  view->format = (flags & PyBUF_FORMAT) ? (char *)"f" : NULL;
+
+  if ((flags & PyBUF_ND) == PyBUF_ND) {
+    view->ndim = 2;
+    view->shape = self->shape;
+  }
+  else {
+    view->ndim = 1;
+    view->shape = NULL;
+  }
+
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+
+  return 0;
+}
+
+static PyBufferProcs PCM_as_buffer = {
+  (readbufferproc)PCM_getreadbuffer,  /* bf_getreadbuffer */
+  (writebufferproc)PCM_getreadbuffer, /* bf_getwritebuffer */
+  (segcountproc)PCM_getsegcount,      /* bf_getsegcount */
+  NULL,                               /* bf_getcharbuffer */
+  (getbufferproc)PCM_getbuffer,       /* bf_getbuffer */
+  NULL,                               /* bf_releasebuffer */
+};
+
+static PyMemberDef PCM_members[] = {
+  { "frames", T_PYSSIZET, offsetof(PCM, frames), READONLY, NULL },
+  { "channels", T_PYSSIZET, offsetof(PCM, channels), READONLY, NULL },
+  { "sample_rate", T_DOUBLE, offsetof(PCM, sample_rate), READONLY, NULL },
+  { "time", T_DOUBLE, offsetof(PCM, time), READONLY, NULL },
+  { NULL, 0, 0, 0, NULL }
+};
+
+static PyTypeObject PCMType = {
+  PyObject_HEAD_INIT(NULL)
+  0,                         /*ob_size*/
+  "douas.PCM",               /*tp_name*/
+  sizeof(PCM),               /*tp_basicsize*/
+  0,                         /*tp_itemsize*/
+  (destructor)PCM_dealloc,   /*tp_dealloc*/
+  0,                         /*tp_print*/
+  0,                         /*tp_getattr*/
+  0,                         /*tp_setattr*/
+  0,                         /*tp_compare*/
+  0,                         /*tp_repr*/
+  0,                         /*tp_as_number*/
+  0,                         /*tp_as_sequence*/
+  0,                         /*tp_as_mapping*/
+  0,                         /*tp_hash */
+  0,                         /*tp_call*/
+  0,                         /*tp_str*/
+  0,                         /*tp_getattro*/
+  0,                         /*tp_setattro*/
+  &PCM_as_buffer,            /*tp_as_buffer*/
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, /*tp_flags*/
+  "Interleaved float32 PCM, exported through the buffer protocol", /* tp_doc */
+  0,		                     /* tp_traverse */
+  0,		                     /* tp_clear */
+  0,		                     /* tp_richcompare */
+  0,		                     /* tp_weaklistoffset */
+  0,		                     /* tp_iter */
+  0,                         /* tp_iternext */
+  0,                         /* tp_methods */
+  PCM_members,               /* tp_members */
+};
+
+/* Takes ownership of samples, which must have been allocated with malloc(). */
+static PyObject *
+pcm_new(float *samples, Py_ssize_t frames, Py_ssize_t channels, double sampleRate, double time)
+{
+  PCM *pcm = PyObject_New(PCM, &PCMType);
+  if (pcm == NULL) {
+    free(samples);
+    return NULL;
+  }
+
+  pcm->samples = samples;
+  pcm->frames = frames;
+  pcm->channels = channels;
+  pcm->sample_rate = sampleRate;
+  pcm->time = time;
+
+  pcm->shape[0] = frames;
+  pcm->shape[1] = channels;
+  pcm->strides[0] = channels * (Py_ssize_t)sizeof(float);
+  pcm->strides[1] = sizeof(float);
+
+  return (PyObject *)pcm;
+}
+
+static DOUAudioFileProvider *
+file_provider_with_url(const char *url)
+{
+  AudioFile *audioFile = [[AudioFile alloc] initWithURL:@(url)];
+  if (audioFile == nil) {
+    PyErr_SetString(PyExc_ValueError, "url");
+    return nil;
+  }
+
+  DOUAudioFileProvider *provider = [DOUAudioFileProvider completedFileProviderWithAudioFile:audioFile];
+  if (provider == nil) {
+    PyErr_SetString(PyExc_IOError, "not a local or completely cached file");
+    return nil;
+  }
+
+  return provider;
+}
+
+typedef struct {
+  PyObject_HEAD
+  PyObject *url;
+  Py_ssize_t chunk_frames;
+  BOOL busy;
+  CFTypeRef reader;
+} Decoder;
+
+static void
+Decoder_dealloc(Decoder *self)
+{
+  Py_XDECREF(self->url);
+  if (self->reader != NULL) {
+    @autoreleasepool {
+      CFBridgingRelease(self->reader);
+    }
+  }
+  self->ob_type->tp_free((PyObject *)self);
+}
+
+static int
+Decoder_init(Decoder *self, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = { "url", "sample_rate", "chunk_frames", NULL };
+
+  const char *url = NULL;
+  double sampleRate = 0.0;
+  Py_ssize_t chunkFrames = kDouasDefaultChunkFrames;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|dn", kwlist, &url, &sampleRate, &chunkFrames)) {
+    return -1;
+  }
+
+  if (chunkFrames <= 0) {
+    PyErr_SetString(PyExc_ValueError, "chunk_frames");
+    return -1;
+  }
+
+  if (self->busy) {
+    PyErr_SetString(PyExc_RuntimeError, "decoder is busy");
+    return -1;
+  }
+
+  Py_XDECREF(self->url);
+  self->url = PyString_FromString(url);
+  self->chunk_frames = chunkFrames;
+
+  @autoreleasepool {
+    if (self->reader != NULL) {
+      CFBridgingRelease(self->reader);
+      self->reader = NULL;
+    }
+
+    DOUAudioFileProvider *provider = file_provider_with_url(url);
+    if (provider == nil) {
+      return -1;
+    }
+
+    PCMReader *reader = [PCMReader readerWithFileProvider:provider sampleRate:sampleRate];
+    if (reader == nil) {
+      PyErr_SetString(PyExc_IOError, "unable to decode");
+      return -1;
+    }
+
+    self->reader = CFBridgingRetain(reader);
+  }
+
+  return 0;
+}
+
+static PyMemberDef Decoder_members[] = {
+  { "url", T_OBJECT, offsetof(Decoder, url), READONLY, NULL },
+  { "chunk_frames", T_PYSSIZET, offsetof(Decoder, chunk_frames), READONLY, NULL },
+  { NULL, 0, 0, 0, NULL }
+};
+
+static PCMReader *
+decoder_reader(Decoder *self)
+{
+  if (self->reader == NULL) {
+    PyErr_SetString(PyExc_RuntimeError, "decoder is not initialized");
+    return nil;
+  }
+
+  if (self->busy) {
+    PyErr_SetString(PyExc_RuntimeError, "decoder is busy");
+    return nil;
+  }
+
+  return (__bridge PCMReader *)self->reader;
+}
+
+static PyObject *
+decoder_read(Decoder *self, Py_ssize_t frames)
+{
+  PCMReader *reader = decoder_reader(self);
+  if (reader == nil) {
+    return NULL;
+  }
+
+  Py_ssize_t channels = (Py_ssize_t)[reader channelCount];
+  double sampleRate = [reader sampleRate];
+  double time = [reader position] / sampleRate;
+
+  float *samples = (float *)malloc((size_t)frames * [reader bytesPerFrame]);
+  if (samples == NULL) {
+    return PyErr_NoMemory();
+  }
+
+  NSUInteger count = 0;
+  self->busy = YES;
+  Py_BEGIN_ALLOW_THREADS
+  @autoreleasepool {
+    count = [reader readFrames:(NSUInteger)frames intoBuffer:samples];
+  }
+  Py_END_ALLOW_THREADS
+  self->busy = NO;
+
+  if ([reader isFailed]) {
+    free(samples);
+    PyErr_SetString(PyExc_IOError, "decoding failed");
+    return NULL;
+  }
+
+  if (count == 0) {
+    free(samples);
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+
+  if ((Py_ssize_t)count < frames) {
+    float *shrunk = (float *)realloc(samples, count * [reader bytesPerFrame]);
+    if (shrunk != NULL) {
+      samples = shrunk;
+    }
+  }
+
+  return pcm_new(samples, (Py_ssize_t)count, channels, sampleRate, time);
+}
+
+static PyObject *
+Decoder_read(Decoder *self, PyObject *args)
+{
+  Py_ssize_t frames = self->chunk_frames;
+  if (!PyArg_ParseTuple(args, "|n", &frames)) {
+    return NULL;
+  }
+
+  if (frames <= 0) {
+    PyErr_SetString(PyExc_ValueError, "frames");
+    return NULL;
+  }
+
+  return decoder_read(self, frames);
+}
+
+static PyObject *
+Decoder_iternext(Decoder *self)
+{
+  PyObject *pcm = decoder_read(self, self->chunk_frames);
+  if (pcm == Py_None) {
+    Py_DECREF(pcm);
+    return NULL;
+  }
+
+  return pcm;
+}
+
+static PyObject *
+Decoder_seek(Decoder *self, PyObject *args)
+{
+  double time = 0.0;
+  if (!PyArg_ParseTuple(args, "d", &time)) {
+    return NULL;
+  }
+
+  PCMReader *reader = decoder_reader(self);
+  if (reader == nil) {
+    return NULL;
+  }
+
+  self->busy = YES;
+  Py_BEGIN_ALLOW_THREADS
+  @autoreleasepool {
+    [reader seekToTime:time];
+  }
+  Py_END_ALLOW_THREADS
+  self->busy = NO;
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject *
+Decoder_sample_rate(Decoder *self)
+{
+  if (self->reader != NULL) {
+    return PyFloat_FromDouble([(__bridge PCMReader *)self->reader sampleRate]);
+  }
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject *
+Decoder_channels(Decoder *self)
+{
+  if (self->reader != NULL) {
+    return PyInt_FromSsize_t((Py_ssize_t)[(__bridge PCMReader *)self->reader channelCount]);
+  }
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject *
+Decoder_duration(Decoder *self)
+{
+  if (self->reader != NULL) {
+    return PyFloat_FromDouble([(__bridge PCMReader *)self->reader duration]);
+  }
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject *
+Decoder_current_time(Decoder *self)
+{
+  if (self->reader != NULL) {
+    PCMReader *reader = (__bridge PCMReader *)self->reader;
+    return PyFloat_FromDouble([reader position] / [reader sampleRate]);
+  }
+
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyMethodDef Decoder_methods[] = {
+  { "read", (PyCFunction)Decoder_read, METH_VARARGS, "" },
+  { "seek", (PyCFunction)Decoder_seek, METH_VARARGS, "" },
+  { "sample_rate", (PyCFunction)Decoder_sample_rate, METH_NOARGS, "" },
+  { "channels", (PyCFunction)Decoder_channels, METH_NOARGS, "" },
+  { "duration", (PyCFunction)Decoder_duration, METH_NOARGS, "" },
+  { "current_time", (PyCFunction)Decoder_current_time, METH_NOARGS, "" },
+  { NULL, NULL, 0, NULL }
+};
+
+static PyTypeObject DecoderType = {
+  PyObject_HEAD_INIT(NULL)
+  0,                         /*ob_size*/
+  "douas.Decoder",           /*tp_name*/
+  sizeof(Decoder),           /*tp_basicsize*/
+  0,                         /*tp_itemsize*/
+  (destructor)Decoder_dealloc, /*tp_dealloc*/
+  0,                         /*tp_print*/
+  0,                         /*tp_getattr*/
+  0,                         /*tp_setattr*/
+  0,                         /*tp_compare*/
+  0,                         /*tp_repr*/
+  0,                         /*tp_as_number*/
+  0,                         /*tp_as_sequence*/
+  0,                         /*tp_as_mapping*/
+  0,                         /*tp_hash */
+  0,                         /*tp_call*/
+  0,                         /*tp_str*/
+  0,                         /*tp_getattro*/
+  0,                         /*tp_setattro*/
+  0,                         /*tp_as_buffer*/
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /*tp_flags*/
+  "Decoder objects",         /* tp_doc */
+  0,		                     /* tp_traverse */
+  0,		                     /* tp_clear */
+  0,		                     /* tp_richcompare */
+  0,		                     /* tp_weaklistoffset */
+  PyObject_SelfIter,         /* tp_iter */
+  (iternextfunc)Decoder_iternext, /* tp_iternext */
+  Decoder_methods,           /* tp_methods */
+  Decoder_members,           /* tp_members */
+  0,                         /* tp_getset */
+  0,                         /* tp_base */
+  0,                         /* tp_dict */
+  0,                         /* tp_descr_get */
+  0,                         /* tp_descr_set */
+  0,                         /* tp_dictoffset */
+  (initproc)Decoder_init,    /* tp_init */
+  0,                         /* tp_alloc */
+  0,                         /* tp_new */
+};
+
+/*
+ * Whole-file decoding can be split into segments that are decoded
+ * concurrently with dispatch_apply while the GIL is released, the same way
+ * DOUAudioOverview splits its analysis.  Every segment opens its own
+ * reader over the shared file provider, seeks a little ahead of its first
+ * frame so the codec has settled, and discards the preroll.  Segment
+ * boundaries are accurate to within the codec delay.
+ */
+
+typedef struct {
+  SInt64 startFrame;
+  SInt64 endFrame;
+
+  float *samples;
+  NSUInteger frames;
+  BOOL failed;
+} decode_segment;
+
+static void
+decode_segment_run(decode_segment *segment, PCMReader *reader)
+{
+  NSUInteger bytesPerFrame = [reader bytesPerFrame];
+  NSUInteger capacity;
+  if (segment->endFrame > segment->startFrame) {
+    capacity = (NSUInteger)(segment->endFrame - segment->startFrame);
+  }
+  else {
+    capacity = (NSUInteger)MAX((SInt64)llround([reader duration] * [reader sampleRate]) - segment->startFrame, 0) + (NSUInteger)[reader sampleRate];
+  }
+
+  segment->samples = (float *)malloc(capacity * bytesPerFrame);
+  if (segment->samples == NULL) {
+    segment->failed = YES;
+    return;
+  }
+
+  if (segment->startFrame > 0) {
+    [reader seekToTime:MAX(segment->startFrame - kDouasPrerollFrames, 0) / [reader sampleRate]];
+    while ([reader position] < segment->startFrame) {
+      NSUInteger skipFrames = (NSUInteger)MIN(segment->startFrame - [reader position], (SInt64)capacity);
+      if ([reader readFrames:skipFrames intoBuffer:segment->samples] == 0) {
+        break;
+      }
+    }
+  }
+
+  for (;;) {
+    if (segment->frames == capacity) {
+      if (segment->endFrame > segment->startFrame) {
+        break;
+      }
+
+      capacity *= 2;
+      float *samples = (float *)realloc(segment->samples, capacity * bytesPerFrame);
+      if (samples == NULL) {
+        segment->failed = YES;
+        return;
+      }
+      segment->samples = samples;
+    }
+
+    NSUInteger frames = [reader readFrames:capacity - segment->frames
+                                intoBuffer:(uint8_t *)segment->samples + segment->frames * bytesPerFrame];
+    if (frames == 0) {
+      break;
+    }
+
+    segment->frames += frames;
+  }
+
+  segment->failed = [reader isFailed];
+}
+
+static float *
+decode_file(DOUAudioFileProvider *provider, double sampleRate, NSUInteger threads,
+            NSUInteger *outFrames, NSUInteger *outChannels, double *outSampleRate)
+{
+  PCMReader *reader = [PCMReader readerWithFileProvider:provider sampleRate:sampleRate];
+  if (reader == nil) {
+    return NULL;
+  }
+
+  sampleRate = [reader sampleRate];
+  NSUInteger bytesPerFrame = [reader bytesPerFrame];
+  NSTimeInterval duration = [reader duration];
+
+  NSUInteger segmentCount = MIN(threads * kDouasSegmentsPerThread, (NSUInteger)(duration / kDouasMinimumSegmentDuration));
+  segmentCount = MAX(segmentCount, 1);
+
+  decode_segment *segments = (decode_segment *)calloc(segmentCount, sizeof(decode_segment));
+  for (NSUInteger i = 0; i < segmentCount; ++i) {
+    segments[i].startFrame = (SInt64)llround(duration * i / segmentCount * sampleRate);
+    segments[i].endFrame = i + 1 < segmentCount ? (SInt64)llround(duration * (i + 1) / segmentCount * sampleRate) : -1;
+  }
+
+  if (segmentCount == 1) {
+    decode_segment_run(&segments[0], reader);
+  }
+  else {
+    dispatch_apply(segmentCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+      @autoreleasepool {
+        PCMReader *segmentReader = index == 0 ? reader : [PCMReader readerWithFileProvider:provider sampleRate:sampleRate];
+        if (segmentReader == nil) {
+          segments[index].failed = YES;
+          return;
+        }
+
+        decode_segment_run(&segments[index], segmentReader);
+      }
+    });
+  }
+
+  BOOL failed = NO;
+  NSUInteger frames = 0;
+  for (NSUInteger i = 0; i < segmentCount; ++i) {
+    failed = failed || segments[i].failed;
+    frames += segments[i].frames;
+  }
+
+  float *samples = NULL;
+  if (!failed) {
+    if (segmentCount == 1) {
+      samples = segments[0].samples;
+      segments[0].samples = NULL;
+      if (frames > 0) {
+        float *shrunk = (float *)realloc(samples, frames * bytesPerFrame);
+        if (shrunk != NULL) {
+          samples = shrunk;
+        }
+      }
+    }
+    else {
+      samples = (float *)malloc(MAX(frames, 1) * bytesPerFrame);
+      if (samples != NULL) {
+        NSUInteger offset = 0;
+        for (NSUInteger i = 0; i < segmentCount; ++i) {
+          memcpy((uint8_t *)samples + offset * bytesPerFrame, segments[i].samples, segments[i].frames * bytesPerFrame);
+          offset += segments[i].frames;
+        }
+      }
+    }
+  }
+
+  for (NSUInteger i = 0; i < segmentCount; ++i) {
+    free(segments[i].samples);
+  }
+  free(segments);
+
+  *outFrames = frames;
+  *outChannels = [reader channelCount];
+  *outSampleRate = sampleRate;
+
+  return samples;
+}
+
+static PyObject *
+douas_decode(PyObject *module, PyObject *args, PyObject *kwds)
+{
+  static char *kwlist[] = { "url", "sample_rate", "threads", NULL };
+
+  const char *url = NULL;
+  double sampleRate = 0.0;
+  int threads = 1;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|di", kwlist, &url, &sampleRate, &threads)) {
+    return NULL;
+  }
+
+  @autoreleasepool {
+    if (threads <= 0) {
+      threads = (int)[[NSProcessInfo processInfo] activeProcessorCount];
+    }
+
+    DOUAudioFileProvider *provider = file_provider_with_url(url);
+    if (provider == nil) {
+      return NULL;
+    }
+
+    float *samples = NULL;
+    NSUInteger frames = 0;
+    NSUInteger channels = 0;
+    Py_BEGIN_ALLOW_THREADS
+    @autoreleasepool {
+      samples = decode_file(provider, sampleRate, (NSUInteger)threads, &frames, &channels, &sampleRate);
+    }
+    Py_END_ALLOW_THREADS
+
+    if (samples == NULL) {
+      PyErr_SetString(PyExc_IOError, "unable to decode");
+      return NULL;
+    }
+
+    return pcm_new(samples, (Py_ssize_t)frames, (Py_ssize_t)channels, sampleRate, 0.0);
+  }
+}
+
 static PyMethodDef module_methods[] = {
+  { "decode", (PyCFunction)douas_decode, METH_VARARGS | METH_KEYWORDS, "" },
   { NULL, NULL, 0, NULL }
 };
 
@@ -340,8 +1293,23 @@ initdouas(void)
     return;
   }
 
+  DecoderType.tp_new = PyType_GenericNew;
+  if (PyType_Ready(&DecoderType) < 0) {
+    return;
+  }
+
+  if (PyType_Ready(&PCMType) < 0) {
+    return;
+  }
+
   module = Py_InitModule("douas", module_methods);
 
   Py_INCREF(&StreamerType);
   PyModule_AddObject(module, "Streamer", (PyObject *)&StreamerType);
+
+  Py_INCREF(&DecoderType);
+  PyModule_AddObject(module, "Decoder", (PyObject *)&DecoderType);
+
+  Py_INCREF(&PCMType);
+  PyModule_AddObject(module, "PCM", (PyObject *)&PCMType);
 }
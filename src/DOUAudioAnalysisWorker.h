@@ -0,0 +1,33 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "DOUAudioBase.h"
+
+@class DOUAudioAnalysisWorker;
+
+DOUAS_EXTERN void dou_analysis_worker_publish_samples(__unsafe_unretained DOUAudioAnalysisWorker *worker,
+                                                      const float *samples,
+                                                      NSUInteger count);
+DOUAS_EXTERN void dou_analysis_worker_report_underrun(__unsafe_unretained DOUAudioAnalysisWorker *worker);
+
+@interface DOUAudioAnalysisWorker : NSObject
+
+@property (copy) NSArray *analyzers;
+
+- (void)flush;
+
+@end
@@ -0,0 +1,234 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioAnalysisWorker.h"
+#import "DOUAudioAnalyzer.h"
+#import "DOUAudioAnalyzer_Private.h"
+#include <stdatomic.h>
+#include <pthread.h>
+#include <mach/mach_time.h>
+
+#define kDOUAudioAnalysisTapSampleCount 8192
+
+/*
+ * The render callback publishes whatever it plays into the tap, a
+ * single-producer/single-consumer ring of interleaved samples.  Publishing is
+ * wait-free and drops the whole quantum when the worker falls behind.  The
+ * worker keeps the most recent kDOUAudioAnalyzerSampleCount samples, splits
+ * them once, and hands the shared vectors to every analyzer that is due.
+ */
+
+@interface DOUAudioAnalysisWorker () {
+@private
+  NSArray *_analyzers;
+
+  float _tap[kDOUAudioAnalysisTapSampleCount];
+  _Atomic(NSUInteger) _tapReadIndex;
+  _Atomic(NSUInteger) _tapWriteIndex;
+  atomic_bool _flushRequested;
+  atomic_bool _finalizing;
+
+  float _window[kDOUAudioAnalyzerSampleCount];
+  NSUInteger _windowCount;
+  BOOL _windowUpdated;
+
+  struct {
+    float left[kDOUAudioAnalyzerCount];
+    float right[kDOUAudioAnalyzerCount];
+  } _vectors;
+
+  dispatch_semaphore_t _semaphore;
+  pthread_t _thread;
+}
+@end
+
+@implementation DOUAudioAnalysisWorker
+
+@synthesize analyzers = _analyzers;
+
+void dou_analysis_worker_publish_samples(__unsafe_unretained DOUAudioAnalysisWorker *worker,
+                                         const float *samples,
+                                         NSUInteger count)
+{
+  if (worker == nil || samples == NULL || count == 0) {
+    return;
+  }
+
+  NSUInteger writeIndex = atomic_load_explicit(&worker->_tapWriteIndex, memory_order_relaxed);
+  NSUInteger readIndex = atomic_load_explicit(&worker->_tapReadIndex, memory_order_acquire);
+  if (kDOUAudioAnalysisTapSampleCount - (writeIndex - readIndex) < count) {
+    return;
+  }
+
+  NSUInteger offset = writeIndex & (kDOUAudioAnalysisTapSampleCount - 1);
+  NSUInteger firstFrag = MIN(count, kDOUAudioAnalysisTapSampleCount - offset);
+
+  memcpy(worker->_tap + offset, samples, sizeof(float) * firstFrag);
+  if (firstFrag < count) {
+    memcpy(worker->_tap, samples + firstFrag, sizeof(float) * (count - firstFrag));
+  }
+
+  atomic_store_explicit(&worker->_tapWriteIndex, writeIndex + count, memory_order_release);
+  dispatch_semaphore_signal(worker->_semaphore);
+}
+
+void dou_analysis_worker_report_underrun(__unsafe_unretained DOUAudioAnalysisWorker *worker)
+{
+  if (worker == nil) {
+    return;
+  }
+
+  if (!atomic_exchange_explicit(&worker->_flushRequested, true, memory_order_release)) {
+    dispatch_semaphore_signal(worker->_semaphore);
+  }
+}
+
+- (instancetype)init
+{
+  self = [super init];
+  if (self) {
+    atomic_init(&_tapReadIndex, 0);
+    atomic_init(&_tapWriteIndex, 0);
+    atomic_init(&_flushRequested, false);
+    atomic_init(&_finalizing, false);
+
+    _semaphore = dispatch_semaphore_create(0);
+    [self _createThread];
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  atomic_store(&_finalizing, true);
+  dispatch_semaphore_signal(_semaphore);
+  pthread_join(_thread, NULL);
+
+#if !OS_OBJECT_USE_OBJC
+  dispatch_release(_semaphore);
+#endif /* !OS_OBJECT_USE_OBJC */
+}
+
+- (void)flush
+{
+  dou_analysis_worker_report_underrun(self);
+}
+
+- (void)_appendSamples:(const float *)samples count:(NSUInteger)count
+{
+  if (count >= kDOUAudioAnalyzerSampleCount) {
+    memcpy(_window, samples + count - kDOUAudioAnalyzerSampleCount, sizeof(_window));
+    _windowCount = kDOUAudioAnalyzerSampleCount;
+  }
+  else {
+    NSUInteger keepCount = MIN(_windowCount, kDOUAudioAnalyzerSampleCount - count);
+    memmove(_window, _window + _windowCount - keepCount, sizeof(float) * keepCount);
+    memcpy(_window + keepCount, samples, sizeof(float) * count);
+    _windowCount = keepCount + count;
+  }
+
+  _windowUpdated = YES;
+}
+
+- (void)_drainTapShouldDiscard:(BOOL)shouldDiscard
+{
+  NSUInteger readIndex = atomic_load_explicit(&_tapReadIndex, memory_order_relaxed);
+  NSUInteger writeIndex = atomic_load_explicit(&_tapWriteIndex, memory_order_acquire);
+
+  while (!shouldDiscard && readIndex != writeIndex) {
+    NSUInteger offset = readIndex & (kDOUAudioAnalysisTapSampleCount - 1);
+    NSUInteger count = MIN(writeIndex - readIndex, kDOUAudioAnalysisTapSampleCount - offset);
+
+    [self _appendSamples:_tap + offset count:count];
+    readIndex += count;
+  }
+
+  atomic_store_explicit(&_tapReadIndex, writeIndex, memory_order_release);
+}
+
+- (void)_analyze
+{
+  NSArray *analyzers = [self analyzers];
+
+  if (atomic_exchange_explicit(&_flushRequested, false, memory_order_acquire)) {
+    [self _drainTapShouldDiscard:YES];
+    _windowCount = 0;
+    _windowUpdated = NO;
+
+    [analyzers makeObjectsPerformSelector:@selector(flush)];
+    return;
+  }
+
+  [self _drainTapShouldDiscard:NO];
+  if (!_windowUpdated ||
+      _windowCount < kDOUAudioAnalyzerSampleCount) {
+    return;
+  }
+
+  uint64_t currentTime = mach_absolute_time();
+  BOOL split = NO;
+
+  for (DOUAudioAnalyzer *analyzer in analyzers) {
+    if (![analyzer shouldAnalyzeAtTime:currentTime]) {
+      continue;
+    }
+
+    if (!split) {
+      [DOUAudioAnalyzer splitLPCMSamples:_window
+                             leftVectors:_vectors.left
+                            rightVectors:_vectors.right];
+      _windowUpdated = NO;
+      split = YES;
+    }
+
+    [analyzer analyzeLeftVectors:_vectors.left
+                    rightVectors:_vectors.right];
+  }
+}
+
+- (void)_workerLoop
+{
+  while (1) {
+    @autoreleasepool {
+      dispatch_semaphore_wait(_semaphore, DISPATCH_TIME_FOREVER);
+      if (atomic_load(&_finalizing)) {
+        return;
+      }
+
+      [self _analyze];
+    }
+  }
+}
+
+static void *analysis_worker_main(void *info)
+{
+  pthread_setname_np("com.douban.audio-streamer.analysis-worker");
+
+  __unsafe_unretained DOUAudioAnalysisWorker *worker = (__bridge DOUAudioAnalysisWorker *)info;
+  @autoreleasepool {
+    [worker _workerLoop];
+  }
+
+  return NULL;
+}
+
+- (void)_createThread
+{
+  pthread_create(&_thread, NULL, analysis_worker_main, (__bridge void *)self);
+}
+
+@end
@@ -22,7 +22,7 @@
 
 + (instancetype)analyzer;
 
-- (void)handleLPCMSamples:(int16_t *)samples count:(NSUInteger)count;
+- (void)handleLPCMSamples:(const float *)samples count:(NSUInteger)count;
 - (void)flush;
 
 - (void)copyLevels:(float *)levels;
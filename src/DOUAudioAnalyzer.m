@@ -18,13 +18,12 @@
 #import "DOUAudioAnalyzer_Private.h"
 #include <Accelerate/Accelerate.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <mach/mach_time.h>
 
 @interface DOUAudioAnalyzer () {
 @private
-  int16_t _sampleBuffer[kDOUAudioAnalyzerSampleCount];
   struct {
-    float sample[kDOUAudioAnalyzerSampleCount];
     float left[kDOUAudioAnalyzerCount];
     float right[kDOUAudioAnalyzerCount];
   } _vectors;
@@ -35,6 +34,9 @@
     float overall[kDOUAudioAnalyzerLevelCount];
   } _levels;
 
+  float _publishedLevels[kDOUAudioAnalyzerLevelCount];
+  atomic_uint _levelsSequence;
+
   uint64_t _interval;
   uint64_t _lastTime;
 
@@ -58,6 +60,7 @@
   if (self) {
     _enabled = NO;
     pthread_mutex_init(&_mutex, NULL);
+    atomic_init(&_levelsSequence, 0);
 
     _lastTime = 0;
     [self setInterval:0.1];
@@ -73,39 +76,74 @@
   pthread_mutex_destroy(&_mutex);
 }
 
-- (void)handleLPCMSamples:(int16_t *)samples count:(NSUInteger)count
++ (void)splitLPCMSamples:(const float *)samples
+            leftVectors:(float *)leftVectors
+           rightVectors:(float *)rightVectors
 {
-  pthread_mutex_lock(&_mutex);
+  DSPSplitComplex complexSplit;
+  complexSplit.realp = leftVectors;
+  complexSplit.imagp = rightVectors;
 
+  vDSP_ctoz((const DSPComplex *)samples, 2, &complexSplit, 1, kDOUAudioAnalyzerCount);
+}
+
+- (void)handleLPCMSamples:(const float *)samples count:(NSUInteger)count
+{
   if (samples == NULL ||
       count == 0) {
-    pthread_mutex_unlock(&_mutex);
     return;
   }
 
-  if (!_enabled) {
-    pthread_mutex_unlock(&_mutex);
+  if (![self shouldAnalyzeAtTime:mach_absolute_time()]) {
     return;
   }
 
-  uint64_t currentTime = mach_absolute_time();
-  if (currentTime - _lastTime < _interval) {
-    pthread_mutex_unlock(&_mutex);
-    return;
-  }
-  else {
-    _lastTime = currentTime;
+  float sampleBuffer[kDOUAudioAnalyzerSampleCount];
+  if (count < kDOUAudioAnalyzerSampleCount) {
+    memcpy(sampleBuffer, samples, sizeof(float) * count);
+    memset(sampleBuffer + count, 0, sizeof(float) * (kDOUAudioAnalyzerSampleCount - count));
+    samples = sampleBuffer;
   }
 
-  if (count >= kDOUAudioAnalyzerSampleCount) {
-    [self _analyzeLinearPCMSamples:samples];
-  }
-  else {
-    memcpy(_sampleBuffer, samples, sizeof(int16_t) * count);
-    memset(_sampleBuffer + count, 0, sizeof(int16_t) * (kDOUAudioAnalyzerSampleCount - count));
-    [self _analyzeLinearPCMSamples:_sampleBuffer];
+  float leftVectors[kDOUAudioAnalyzerCount];
+  float rightVectors[kDOUAudioAnalyzerCount];
+  [[self class] splitLPCMSamples:samples
+                     leftVectors:leftVectors
+                    rightVectors:rightVectors];
+
+  [self analyzeLeftVectors:leftVectors rightVectors:rightVectors];
+}
+
+- (BOOL)shouldAnalyzeAtTime:(uint64_t)time
+{
+  pthread_mutex_lock(&_mutex);
+
+  if (!_enabled ||
+      time - _lastTime < _interval) {
+    pthread_mutex_unlock(&_mutex);
+    return NO;
   }
 
+  _lastTime = time;
+  pthread_mutex_unlock(&_mutex);
+
+  return YES;
+}
+
+- (void)analyzeLeftVectors:(const float *)leftVectors
+              rightVectors:(const float *)rightVectors
+{
+  pthread_mutex_lock(&_mutex);
+
+  memcpy(_vectors.left, leftVectors, sizeof(_vectors.left));
+  memcpy(_vectors.right, rightVectors, sizeof(_vectors.right));
+
+  [self processChannelVectors:_vectors.left toLevels:_levels.left];
+  [self processChannelVectors:_vectors.right toLevels:_levels.right];
+
+  [self _updateLevels];
+  [self _publishLevels];
+
   pthread_mutex_unlock(&_mutex);
 }
 
@@ -113,6 +151,7 @@
 {
   pthread_mutex_lock(&_mutex);
   vDSP_vclr(_levels.overall, 1, kDOUAudioAnalyzerLevelCount);
+  [self _publishLevels];
   pthread_mutex_unlock(&_mutex);
 }
 
@@ -151,36 +190,34 @@
   }
 }
 
-- (void)copyLevels:(float *)levels
+- (void)_publishLevels
 {
-  pthread_mutex_lock(&_mutex);
-  if (levels != NULL) {
-    memcpy(levels, _levels.overall, sizeof(float) * kDOUAudioAnalyzerLevelCount);
-  }
-  pthread_mutex_unlock(&_mutex);
-}
-
-- (void)_analyzeLinearPCMSamples:(const int16_t *)samples
-{
-  [self _splitStereoSamples:samples];
+  unsigned int sequence = atomic_load_explicit(&_levelsSequence, memory_order_relaxed);
+  atomic_store_explicit(&_levelsSequence, sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
 
-  [self processChannelVectors:_vectors.left toLevels:_levels.left];
-  [self processChannelVectors:_vectors.right toLevels:_levels.right];
+  memcpy(_publishedLevels, _levels.overall, sizeof(_publishedLevels));
 
-  [self _updateLevels];
+  atomic_store_explicit(&_levelsSequence, sequence + 2, memory_order_release);
 }
 
-- (void)_splitStereoSamples:(const int16_t *)samples
+- (void)copyLevels:(float *)levels
 {
-  static const float scale = INT16_MAX;
-  vDSP_vflt16((int16_t *)samples, 1, _vectors.sample, 1, kDOUAudioAnalyzerSampleCount);
-  vDSP_vsdiv(_vectors.sample, 1, (float *)&scale, _vectors.sample, 1, kDOUAudioAnalyzerSampleCount);
-
-  DSPSplitComplex complexSplit;
-  complexSplit.realp = _vectors.left;
-  complexSplit.imagp = _vectors.right;
+  if (levels == NULL) {
+    return;
+  }
 
-  vDSP_ctoz((const DSPComplex *)_vectors.sample, 2, &complexSplit, 1, kDOUAudioAnalyzerCount);
+  unsigned int sequence;
+  do {
+    sequence = atomic_load_explicit(&_levelsSequence, memory_order_acquire);
+    if (sequence & 1) {
+      continue;
+    }
+
+    memcpy(levels, _publishedLevels, sizeof(float) * kDOUAudioAnalyzerLevelCount);
+    atomic_thread_fence(memory_order_acquire);
+  } while (sequence & 1 ||
+           sequence != atomic_load_explicit(&_levelsSequence, memory_order_relaxed));
 }
 
 - (void)_updateLevels
@@ -21,6 +21,14 @@
 
 @interface DOUAudioAnalyzer ()
 
++ (void)splitLPCMSamples:(const float *)samples
+            leftVectors:(float *)leftVectors
+           rightVectors:(float *)rightVectors;
+
+- (BOOL)shouldAnalyzeAtTime:(uint64_t)time;
+- (void)analyzeLeftVectors:(const float *)leftVectors
+              rightVectors:(const float *)rightVectors;
+
 - (void)processChannelVectors:(const float *)vectors toLevels:(float *)levels;
 
 @end
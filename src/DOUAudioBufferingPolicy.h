@@ -0,0 +1,38 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+@protocol DOUAudioBufferingPolicy <NSObject>
+
+- (BOOL)shouldBufferWithBufferedTime:(NSUInteger)bufferedTime
+                     remainingLength:(NSUInteger)remainingLength
+                          throughput:(double)throughput
+                           deviation:(double)deviation
+                             bitRate:(double)bitRate
+                           buffering:(BOOL)buffering;
+
+@end
+
+@interface DOUAudioWatermarkBufferingPolicy : NSObject <DOUAudioBufferingPolicy>
+
++ (instancetype)defaultPolicy;
+
+@property (assign) NSUInteger lowWatermark;
+@property (assign) NSUInteger highWatermark;
+@property (assign) double deviationFactor;
+
+@end
@@ -0,0 +1,75 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioBufferingPolicy.h"
+
+static const NSUInteger kDOUAudioBufferingPolicyDefaultLowWatermark = 1000;
+static const NSUInteger kDOUAudioBufferingPolicyDefaultHighWatermark = 3000;
+static const double kDOUAudioBufferingPolicyDefaultDeviationFactor = 1.0;
+
+@implementation DOUAudioWatermarkBufferingPolicy
+
+@synthesize lowWatermark = _lowWatermark;
+@synthesize highWatermark = _highWatermark;
+@synthesize deviationFactor = _deviationFactor;
+
++ (instancetype)defaultPolicy
+{
+  static DOUAudioWatermarkBufferingPolicy *defaultPolicy = nil;
+
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    defaultPolicy = [[self alloc] init];
+  });
+
+  return defaultPolicy;
+}
+
+- (instancetype)init
+{
+  self = [super init];
+  if (self) {
+    _lowWatermark = kDOUAudioBufferingPolicyDefaultLowWatermark;
+    _highWatermark = kDOUAudioBufferingPolicyDefaultHighWatermark;
+    _deviationFactor = kDOUAudioBufferingPolicyDefaultDeviationFactor;
+  }
+
+  return self;
+}
+
+- (BOOL)shouldBufferWithBufferedTime:(NSUInteger)bufferedTime
+                     remainingLength:(NSUInteger)remainingLength
+                          throughput:(double)throughput
+                           deviation:(double)deviation
+                             bitRate:(double)bitRate
+                           buffering:(BOOL)buffering
+{
+  double pessimisticThroughput = MAX(throughput - [self deviationFactor] * deviation, 0.0);
+  if (pessimisticThroughput > 0.0 &&
+      1000.0 * remainingLength / pessimisticThroughput <= bufferedTime) {
+    return NO;
+  }
+
+  BOOL sustainable = bitRate > 0.0 && pessimisticThroughput >= bitRate;
+  if (buffering) {
+    return bufferedTime < [self highWatermark] &&
+           (!sustainable || bufferedTime < [self lowWatermark]);
+  }
+
+  return !sustainable && bufferedTime < [self lowWatermark];
+}
+
+@end
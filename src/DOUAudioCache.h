@@ -0,0 +1,46 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+@interface DOUAudioCache : NSObject
+
++ (instancetype)sharedCache;
+
+@property (nonatomic, readonly) NSString *directory;
+@property (assign) unsigned long long maximumSize;
+@property (readonly) unsigned long long currentSize;
+
+- (NSString *)cachedPathForURL:(NSURL *)url;
+- (NSString *)rangesPathForURL:(NSURL *)url;
+- (NSString *)seekIndexPathForURL:(NSURL *)url;
+- (NSString *)completedPathForURL:(NSURL *)url;
+- (NSString *)mimeTypeForURL:(NSURL *)url;
+
+- (void)beginAccessForURL:(NSURL *)url;
+- (void)endAccessForURL:(NSURL *)url;
+
+- (void)updateEntryForURL:(NSURL *)url
+                   length:(NSUInteger)length
+                validator:(NSString *)validator
+                 mimeType:(NSString *)mimeType
+                completed:(BOOL)completed;
+- (void)removeEntryForURL:(NSURL *)url;
+- (void)removeAllEntries;
+
+- (void)trim;
+
+@end
@@ -0,0 +1,339 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioCache.h"
+#include <CommonCrypto/CommonDigest.h>
+
+static NSString *const kDOUAudioCacheIndexFilename = @"index.plist";
+static NSString *const kDOUAudioCacheFilenamePrefix = @"douas-";
+static const unsigned long long kDOUAudioCacheDefaultMaximumSize = 256ULL * 1024 * 1024;
+
+@interface DOUAudioCache () {
+@private
+  NSString *_directory;
+  NSString *_indexPath;
+  NSMutableDictionary *_entries;
+  NSCountedSet *_accessedKeys;
+  unsigned long long _maximumSize;
+}
+@end
+
+@implementation DOUAudioCache
+
+@synthesize directory = _directory;
+
++ (instancetype)sharedCache
+{
+  static DOUAudioCache *sharedCache = nil;
+
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    sharedCache = [[self alloc] init];
+  });
+
+  return sharedCache;
+}
+
+- (instancetype)init
+{
+  self = [super init];
+  if (self) {
+    NSArray *directories = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+    NSString *cachesDirectory = [directories count] > 0 ? [directories objectAtIndex:0] : NSTemporaryDirectory();
+
+    _directory = [cachesDirectory stringByAppendingPathComponent:@"com.douban.audio-streamer"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:_directory
+                              withIntermediateDirectories:YES
+                                               attributes:nil
+                                                    error:NULL];
+
+    _indexPath = [_directory stringByAppendingPathComponent:kDOUAudioCacheIndexFilename];
+    _entries = [NSMutableDictionary dictionary];
+    _accessedKeys = [NSCountedSet set];
+    _maximumSize = kDOUAudioCacheDefaultMaximumSize;
+
+    [self _loadIndex];
+  }
+
+  return self;
+}
+
++ (NSString *)_keyForURL:(NSURL *)url
+{
+  NSString *string = [url absoluteString];
+  unsigned char hash[CC_SHA256_DIGEST_LENGTH];
+  CC_SHA256([string UTF8String], (CC_LONG)[string lengthOfBytesUsingEncoding:NSUTF8StringEncoding], hash);
+
+  NSMutableString *result = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+  for (size_t i = 0; i < CC_SHA256_DIGEST_LENGTH; ++i) {
+    [result appendFormat:@"%02x", hash[i]];
+  }
+
+  return result;
+}
+
+- (NSString *)_cachedPathForKey:(NSString *)key
+{
+  NSString *filename = [NSString stringWithFormat:@"%@%@.cache", kDOUAudioCacheFilenamePrefix, key];
+  return [_directory stringByAppendingPathComponent:filename];
+}
+
+- (NSString *)_rangesPathForKey:(NSString *)key
+{
+  return [[self _cachedPathForKey:key] stringByAppendingPathExtension:@"ranges"];
+}
+
+- (NSString *)_seekIndexPathForKey:(NSString *)key
+{
+  return [[self _cachedPathForKey:key] stringByAppendingPathExtension:@"seek"];
+}
+
+- (void)_loadIndex
+{
+  NSDictionary *index = [NSDictionary dictionaryWithContentsOfFile:_indexPath];
+  NSDictionary *entries = [index objectForKey:@"entries"];
+
+  for (NSString *key in entries) {
+    NSDictionary *entry = [entries objectForKey:key];
+    if (![entry isKindOfClass:[NSDictionary class]] ||
+        ![[NSFileManager defaultManager] fileExistsAtPath:[self _cachedPathForKey:key]]) {
+      continue;
+    }
+
+    [_entries setObject:[entry mutableCopy] forKey:key];
+  }
+
+  NSArray *filenames = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:_directory error:NULL];
+  for (NSString *filename in filenames) {
+    if (![filename hasPrefix:kDOUAudioCacheFilenamePrefix]) {
+      continue;
+    }
+
+    NSString *key = [[filename substringFromIndex:[kDOUAudioCacheFilenamePrefix length]] stringByDeletingPathExtension];
+    key = [key stringByDeletingPathExtension];
+    if ([_entries objectForKey:key] == nil) {
+      [[NSFileManager defaultManager] removeItemAtPath:[_directory stringByAppendingPathComponent:filename] error:NULL];
+    }
+  }
+}
+
+- (void)_saveIndex
+{
+  [@{@"entries": _entries} writeToFile:_indexPath atomically:YES];
+}
+
+- (void)_touchEntryForKey:(NSString *)key
+{
+  NSMutableDictionary *entry = [_entries objectForKey:key];
+  [entry setObject:@(CFAbsoluteTimeGetCurrent()) forKey:@"lastAccess"];
+}
+
+- (void)_removeEntryForKey:(NSString *)key
+{
+  [[NSFileManager defaultManager] removeItemAtPath:[self _cachedPathForKey:key] error:NULL];
+  [[NSFileManager defaultManager] removeItemAtPath:[self _rangesPathForKey:key] error:NULL];
+  [[NSFileManager defaultManager] removeItemAtPath:[self _seekIndexPathForKey:key] error:NULL];
+  [_entries removeObjectForKey:key];
+}
+
+- (unsigned long long)_currentSize
+{
+  unsigned long long size = 0;
+  for (NSDictionary *entry in [_entries objectEnumerator]) {
+    size += [[entry objectForKey:@"length"] unsignedLongLongValue];
+  }
+
+  return size;
+}
+
+- (unsigned long long)maximumSize
+{
+  @synchronized(self) {
+    return _maximumSize;
+  }
+}
+
+- (void)setMaximumSize:(unsigned long long)maximumSize
+{
+  @synchronized(self) {
+    _maximumSize = maximumSize;
+  }
+
+  [self trim];
+}
+
+- (unsigned long long)currentSize
+{
+  @synchronized(self) {
+    return [self _currentSize];
+  }
+}
+
+- (NSString *)cachedPathForURL:(NSURL *)url
+{
+  return [self _cachedPathForKey:[[self class] _keyForURL:url]];
+}
+
+- (NSString *)rangesPathForURL:(NSURL *)url
+{
+  return [self _rangesPathForKey:[[self class] _keyForURL:url]];
+}
+
+- (NSString *)seekIndexPathForURL:(NSURL *)url
+{
+  return [self _seekIndexPathForKey:[[self class] _keyForURL:url]];
+}
+
+- (NSString *)completedPathForURL:(NSURL *)url
+{
+  NSString *key = [[self class] _keyForURL:url];
+  NSString *path = [self _cachedPathForKey:key];
+
+  @synchronized(self) {
+    NSDictionary *entry = [_entries objectForKey:key];
+    if (![[entry objectForKey:@"completed"] boolValue]) {
+      return nil;
+    }
+
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL];
+    if (attributes == nil ||
+        [attributes fileSize] != [[entry objectForKey:@"length"] unsignedLongLongValue]) {
+      [self _removeEntryForKey:key];
+      [self _saveIndex];
+      return nil;
+    }
+
+    [self _touchEntryForKey:key];
+    [self _saveIndex];
+  }
+
+  return path;
+}
+
+- (NSString *)mimeTypeForURL:(NSURL *)url
+{
+  @synchronized(self) {
+    return [[_entries objectForKey:[[self class] _keyForURL:url]] objectForKey:@"mimeType"];
+  }
+}
+
+- (void)beginAccessForURL:(NSURL *)url
+{
+  NSString *key = [[self class] _keyForURL:url];
+
+  @synchronized(self) {
+    [_accessedKeys addObject:key];
+    [self _touchEntryForKey:key];
+  }
+}
+
+- (void)endAccessForURL:(NSURL *)url
+{
+  NSString *key = [[self class] _keyForURL:url];
+
+  @synchronized(self) {
+    [_accessedKeys removeObject:key];
+    [self _touchEntryForKey:key];
+    [self _saveIndex];
+  }
+
+  [self trim];
+}
+
+- (void)updateEntryForURL:(NSURL *)url
+                   length:(NSUInteger)length
+                validator:(NSString *)validator
+                 mimeType:(NSString *)mimeType
+                completed:(BOOL)completed
+{
+  NSString *key = [[self class] _keyForURL:url];
+
+  @synchronized(self) {
+    NSMutableDictionary *entry = [_entries objectForKey:key];
+    if (entry == nil) {
+      entry = [NSMutableDictionary dictionary];
+      [_entries setObject:entry forKey:key];
+    }
+
+    [entry setObject:@(length) forKey:@"length"];
+    [entry setObject:@(completed) forKey:@"completed"];
+    if (validator != nil) {
+      [entry setObject:validator forKey:@"validator"];
+    }
+    if (mimeType != nil) {
+      [entry setObject:mimeType forKey:@"mimeType"];
+    }
+
+    [self _touchEntryForKey:key];
+    [self _saveIndex];
+  }
+
+  [self trim];
+}
+
+- (void)removeEntryForURL:(NSURL *)url
+{
+  NSString *key = [[self class] _keyForURL:url];
+
+  @synchronized(self) {
+    [self _removeEntryForKey:key];
+    [self _saveIndex];
+  }
+}
+
+- (void)removeAllEntries
+{
+  @synchronized(self) {
+    for (NSString *key in [_entries allKeys]) {
+      if ([_accessedKeys countForObject:key] == 0) {
+        [self _removeEntryForKey:key];
+      }
+    }
+
+    [self _saveIndex];
+  }
+}
+
+- (void)trim
+{
+  @synchronized(self) {
+    unsigned long long size = [self _currentSize];
+    if (size <= _maximumSize) {
+      return;
+    }
+
+    NSArray *keys = [_entries keysSortedByValueUsingComparator:^NSComparisonResult(NSDictionary *entry1, NSDictionary *entry2) {
+      return [[entry1 objectForKey:@"lastAccess"] compare:[entry2 objectForKey:@"lastAccess"]];
+    }];
+
+    for (NSString *key in keys) {
+      if (size <= _maximumSize) {
+        break;
+      }
+
+      if ([_accessedKeys countForObject:key] > 0) {
+        continue;
+      }
+
+      size -= [[[_entries objectForKey:key] objectForKey:@"length"] unsignedLongLongValue];
+      [self _removeEntryForKey:key];
+    }
+
+    [self _saveIndex];
+  }
+}
+
+@end
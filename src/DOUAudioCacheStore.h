@@ -0,0 +1,56 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+
+typedef void (^DOUAudioCacheStoreEnumerationBlock)(const void *bytes, NSRange byteRange, BOOL *stop);
+
+/*
+ * A file mapped in fixed-size segments.  Segments are mapped on first access
+ * and stay at the same address until the store goes away, is shrunk past
+ * them, or has all of them released, so the store can grow while readers
+ * hold pointers into it, and only the regions in use reserve address space.
+ * A pointer returned by the store is valid up to the end of its segment and
+ * only until that segment is released, so callers that need more should go
+ * through readBytes:offset:length: or the enumeration method.  The segment
+ * last returned by mutableBytesAtOffset:length: is never unmapped.
+ */
+
+@interface DOUAudioCacheStore : NSObject
+
++ (instancetype)storeWithContentsOfFile:(NSString *)path modifiable:(BOOL)modifiable;
+- (instancetype)initWithContentsOfFile:(NSString *)path modifiable:(BOOL)modifiable;
+
++ (NSUInteger)segmentLength;
+
+@property (nonatomic, readonly) NSString *path;
+@property (nonatomic, readonly, getter=isModifiable) BOOL modifiable;
+@property (readonly) NSUInteger length;
+
+- (BOOL)resizeToLength:(NSUInteger)length;
+
+- (const void *)bytesAtOffset:(NSUInteger)offset length:(NSUInteger *)length;
+- (void *)mutableBytesAtOffset:(NSUInteger)offset length:(NSUInteger *)length;
+- (NSUInteger)readBytes:(void *)buffer offset:(NSUInteger)offset length:(NSUInteger)length;
+- (void)enumerateBytesInRange:(NSRange)range usingBlock:(DOUAudioCacheStoreEnumerationBlock)block;
+
+- (void)synchronize;
+- (void)synchronizeRange:(NSRange)range;
+
+- (void)adviseSequentialAccessInRange:(NSRange)range;
+- (void)releaseRange:(NSRange)range;
+
+@end
@@ -0,0 +1,399 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioCacheStore.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+static const NSUInteger kDOUAudioCacheStoreSegmentLength = 4 * 1024 * 1024;
+
+typedef struct {
+  uint8_t *bytes;
+  NSUInteger pins;
+  NSUInteger releasedLength;
+} store_segment;
+
+@interface DOUAudioCacheStore () {
+@private
+  NSString *_path;
+  BOOL _modifiable;
+  int _fd;
+
+  pthread_mutex_t _mutex;
+  NSUInteger _length;
+  store_segment *_segments;
+  NSUInteger _segmentCapacity;
+  NSUInteger _writableSegment;
+}
+@end
+
+@implementation DOUAudioCacheStore
+
+@synthesize path = _path;
+@synthesize modifiable = _modifiable;
+
++ (instancetype)storeWithContentsOfFile:(NSString *)path modifiable:(BOOL)modifiable
+{
+  return [[[self class] alloc] initWithContentsOfFile:path modifiable:modifiable];
+}
+
+- (instancetype)initWithContentsOfFile:(NSString *)path modifiable:(BOOL)modifiable
+{
+  self = [super init];
+  if (self) {
+    _path = [path copy];
+    _modifiable = modifiable;
+
+    _fd = open([_path fileSystemRepresentation], modifiable ? O_RDWR : O_RDONLY);
+    if (_fd < 0) {
+      return nil;
+    }
+
+    struct stat st;
+    if (fstat(_fd, &st) != 0) {
+      close(_fd);
+      _fd = -1;
+      return nil;
+    }
+
+    _length = (NSUInteger)st.st_size;
+    _writableSegment = NSNotFound;
+    pthread_mutex_init(&_mutex, NULL);
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  if (_fd < 0) {
+    return;
+  }
+
+  for (NSUInteger i = 0; i < _segmentCapacity; ++i) {
+    if (_segments[i].bytes != NULL) {
+      munmap(_segments[i].bytes, kDOUAudioCacheStoreSegmentLength);
+    }
+  }
+
+  free(_segments);
+  pthread_mutex_destroy(&_mutex);
+  close(_fd);
+}
+
++ (NSUInteger)segmentLength
+{
+  return kDOUAudioCacheStoreSegmentLength;
+}
+
+- (NSUInteger)length
+{
+  pthread_mutex_lock(&_mutex);
+  NSUInteger length = _length;
+  pthread_mutex_unlock(&_mutex);
+
+  return length;
+}
+
+- (BOOL)resizeToLength:(NSUInteger)length
+{
+  if (!_modifiable) {
+    return NO;
+  }
+
+  pthread_mutex_lock(&_mutex);
+
+  BOOL succeeded = ftruncate(_fd, (off_t)length) == 0;
+  if (succeeded) {
+    NSUInteger firstUnusedSegment = (length + kDOUAudioCacheStoreSegmentLength - 1) / kDOUAudioCacheStoreSegmentLength;
+    for (NSUInteger i = firstUnusedSegment; i < _segmentCapacity; ++i) {
+      if (_segments[i].bytes != NULL) {
+        munmap(_segments[i].bytes, kDOUAudioCacheStoreSegmentLength);
+        _segments[i].bytes = NULL;
+      }
+      _segments[i].releasedLength = 0;
+    }
+
+    _length = length;
+  }
+
+  pthread_mutex_unlock(&_mutex);
+  return succeeded;
+}
+
+- (uint8_t *)_segmentAtIndex:(NSUInteger)index mapping:(BOOL)mapping
+{
+  if (index >= _segmentCapacity) {
+    if (!mapping) {
+      return NULL;
+    }
+
+    NSUInteger capacity = MAX(index + 1, _segmentCapacity * 2);
+    store_segment *segments = (store_segment *)realloc(_segments, sizeof(store_segment) * capacity);
+    if (segments == NULL) {
+      return NULL;
+    }
+
+    memset(segments + _segmentCapacity, 0, sizeof(store_segment) * (capacity - _segmentCapacity));
+    _segments = segments;
+    _segmentCapacity = capacity;
+  }
+
+  if (_segments[index].bytes == NULL && mapping) {
+    int protection = PROT_READ;
+    if (_modifiable) {
+      protection |= PROT_WRITE;
+    }
+
+    void *address = mmap(NULL, kDOUAudioCacheStoreSegmentLength, protection, MAP_FILE | MAP_SHARED, _fd, (off_t)(index * kDOUAudioCacheStoreSegmentLength));
+    if (address == MAP_FAILED) {
+      return NULL;
+    }
+
+    _segments[index].bytes = (uint8_t *)address;
+    _segments[index].releasedLength = 0;
+  }
+
+  return _segments[index].bytes;
+}
+
+/*
+ * Segments the reader has entirely released are unmapped, and mapped again
+ * if anything comes back to them.  A segment is kept while an enumeration
+ * is inside it or while it holds the pointer last handed to the writer,
+ * and goes away as soon as neither is the case any more.
+ */
+
+- (void)_unmapSegmentIfReleased:(NSUInteger)index
+{
+  if (index >= _segmentCapacity ||
+      _segments[index].bytes == NULL ||
+      _segments[index].pins > 0 ||
+      index == _writableSegment) {
+    return;
+  }
+
+  NSUInteger segmentBegin = index * kDOUAudioCacheStoreSegmentLength;
+  NSUInteger segmentLength = _length > segmentBegin ? MIN(kDOUAudioCacheStoreSegmentLength, _length - segmentBegin) : 0;
+  if (_segments[index].releasedLength < segmentLength) {
+    return;
+  }
+
+  munmap(_segments[index].bytes, kDOUAudioCacheStoreSegmentLength);
+  _segments[index].bytes = NULL;
+  _segments[index].releasedLength = 0;
+}
+
+- (uint8_t *)_bytesAtOffset:(NSUInteger)offset length:(NSUInteger *)length mapping:(BOOL)mapping pinning:(BOOL)pinning
+{
+  uint8_t *bytes = NULL;
+  *length = 0;
+
+  pthread_mutex_lock(&_mutex);
+
+  if (offset < _length) {
+    NSUInteger index = offset / kDOUAudioCacheStoreSegmentLength;
+    NSUInteger segmentOffset = offset % kDOUAudioCacheStoreSegmentLength;
+    uint8_t *segment = [self _segmentAtIndex:index mapping:mapping];
+    if (segment != NULL) {
+      bytes = segment + segmentOffset;
+      if (pinning) {
+        _segments[index].pins++;
+      }
+    }
+
+    *length = MIN(kDOUAudioCacheStoreSegmentLength - segmentOffset, _length - offset);
+  }
+
+  pthread_mutex_unlock(&_mutex);
+  return bytes;
+}
+
+- (void)_unpinBytesAtOffset:(NSUInteger)offset
+{
+  NSUInteger index = offset / kDOUAudioCacheStoreSegmentLength;
+
+  pthread_mutex_lock(&_mutex);
+  if (index < _segmentCapacity && _segments[index].pins > 0) {
+    _segments[index].pins--;
+    [self _unmapSegmentIfReleased:index];
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (const void *)bytesAtOffset:(NSUInteger)offset length:(NSUInteger *)length
+{
+  return [self _bytesAtOffset:offset length:length mapping:YES pinning:NO];
+}
+
+- (void *)mutableBytesAtOffset:(NSUInteger)offset length:(NSUInteger *)length
+{
+  if (!_modifiable) {
+    *length = 0;
+    return NULL;
+  }
+
+  uint8_t *bytes = [self _bytesAtOffset:offset length:length mapping:YES pinning:NO];
+  if (bytes != NULL) {
+    pthread_mutex_lock(&_mutex);
+    NSUInteger previousSegment = _writableSegment;
+    _writableSegment = offset / kDOUAudioCacheStoreSegmentLength;
+    if (previousSegment != _writableSegment) {
+      [self _unmapSegmentIfReleased:previousSegment];
+    }
+    pthread_mutex_unlock(&_mutex);
+  }
+
+  return bytes;
+}
+
+- (NSUInteger)readBytes:(void *)buffer offset:(NSUInteger)offset length:(NSUInteger)length
+{
+  __block NSUInteger bytesRead = 0;
+  [self enumerateBytesInRange:NSMakeRange(offset, length) usingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+    memcpy((uint8_t *)buffer + bytesRead, bytes, byteRange.length);
+    bytesRead += byteRange.length;
+  }];
+
+  return bytesRead;
+}
+
+- (void)enumerateBytesInRange:(NSRange)range usingBlock:(DOUAudioCacheStoreEnumerationBlock)block
+{
+  NSUInteger offset = range.location;
+  NSUInteger end = NSMaxRange(range);
+  BOOL stop = NO;
+
+  while (offset < end && !stop) {
+    NSUInteger length;
+    const uint8_t *bytes = [self _bytesAtOffset:offset length:&length mapping:YES pinning:YES];
+    if (bytes == NULL || length == 0) {
+      break;
+    }
+
+    length = MIN(length, end - offset);
+    block(bytes, NSMakeRange(offset, length), &stop);
+    [self _unpinBytesAtOffset:offset];
+    offset += length;
+  }
+}
+
+static void store_page_align(uint8_t **bytes, NSUInteger *length, BOOL inward)
+{
+  static uintptr_t pageSize = 0;
+  if (pageSize == 0) {
+    pageSize = (uintptr_t)getpagesize();
+  }
+
+  uintptr_t begin = (uintptr_t)*bytes;
+  uintptr_t end = begin + *length;
+
+  if (inward) {
+    begin = (begin + pageSize - 1) & ~(pageSize - 1);
+    end &= ~(pageSize - 1);
+  }
+  else {
+    begin &= ~(pageSize - 1);
+  }
+
+  *bytes = (uint8_t *)begin;
+  *length = end > begin ? (NSUInteger)(end - begin) : 0;
+}
+
+- (void)_enumerateMappedPagesInRange:(NSRange)range
+                              inward:(BOOL)inward
+                             mapping:(BOOL)mapping
+                          usingBlock:(void (^)(void *address, size_t length))block
+{
+  NSUInteger offset = range.location;
+  NSUInteger end = NSMaxRange(range);
+
+  while (offset < end) {
+    NSUInteger length;
+    uint8_t *bytes = [self _bytesAtOffset:offset length:&length mapping:mapping pinning:YES];
+    if (length == 0) {
+      break;
+    }
+
+    length = MIN(length, end - offset);
+
+    if (bytes != NULL) {
+      uint8_t *pages = bytes;
+      NSUInteger pagesLength = length;
+      store_page_align(&pages, &pagesLength, inward);
+      if (pagesLength > 0) {
+        block(pages, pagesLength);
+      }
+
+      [self _unpinBytesAtOffset:offset];
+    }
+
+    offset += length;
+  }
+}
+
+- (void)synchronize
+{
+  [self _enumerateMappedPagesInRange:NSMakeRange(0, [self length]) inward:NO mapping:NO usingBlock:^(void *address, size_t length) {
+    msync(address, length, MS_SYNC | MS_INVALIDATE);
+  }];
+}
+
+- (void)synchronizeRange:(NSRange)range
+{
+  [self _enumerateMappedPagesInRange:range inward:NO mapping:NO usingBlock:^(void *address, size_t length) {
+    msync(address, length, MS_ASYNC);
+  }];
+}
+
+- (void)adviseSequentialAccessInRange:(NSRange)range
+{
+  [self _enumerateMappedPagesInRange:range inward:NO mapping:YES usingBlock:^(void *address, size_t length) {
+    madvise(address, length, MADV_SEQUENTIAL);
+    madvise(address, length, MADV_WILLNEED);
+  }];
+}
+
+- (void)releaseRange:(NSRange)range
+{
+  [self _enumerateMappedPagesInRange:range inward:YES mapping:NO usingBlock:^(void *address, size_t length) {
+    madvise(address, length, MADV_DONTNEED);
+  }];
+
+  pthread_mutex_lock(&_mutex);
+
+  NSUInteger offset = range.location;
+  NSUInteger end = MIN(NSMaxRange(range), _length);
+  while (offset < end) {
+    NSUInteger index = offset / kDOUAudioCacheStoreSegmentLength;
+    NSUInteger length = MIN(kDOUAudioCacheStoreSegmentLength - offset % kDOUAudioCacheStoreSegmentLength, end - offset);
+
+    if (index < _segmentCapacity && _segments[index].bytes != NULL) {
+      _segments[index].releasedLength += length;
+      [self _unmapSegmentIfReleased:index];
+    }
+
+    offset += length;
+  }
+
+  pthread_mutex_unlock(&_mutex);
+}
+
+@end
@@ -0,0 +1,54 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "DOUAudioDecoder.h"
+
+typedef void (^DOUAudioDecodeWorkerEventBlock)(void);
+
+/*
+ * Decodes ahead of the event loop on a thread of its own.  The worker keeps
+ * calling -decodeOnce on the attached decoder until its LPCM holds at least
+ * the decode-ahead length, while the event loop only moves PCM from that
+ * LPCM into the renderer.  A slow decode therefore eats into the decoded
+ * slack instead of the renderer's headroom.
+ *
+ * The worker stops on anything but a successful decode and remembers the
+ * status until the event loop resumes it (after new data arrived) or resets
+ * it (after a seek), and it sleeps once the decode-ahead length is reached
+ * until the event loop signals that it took PCM out.  The event block is
+ * called from the worker thread when decoding ends or fails, and when a
+ * consumer that found the LPCM empty (see -starve) can carry on.
+ */
+
+@interface DOUAudioDecodeWorker : NSObject
+
+@property (nonatomic, copy) DOUAudioDecodeWorkerEventBlock eventBlock;
+
+@property (nonatomic, readonly) DOUAudioDecoder *decoder;
+@property (nonatomic, readonly) DOUAudioDecoderStatus status;
+@property (nonatomic, readonly, getter=isStarving) BOOL starving;
+
+- (void)setDecoder:(DOUAudioDecoder *)decoder decodeAheadLength:(NSUInteger)decodeAheadLength;
+
+- (void)signal;
+- (void)resume;
+- (void)reset;
+- (void)starve;
+
+- (void)invalidate;
+
+@end
@@ -0,0 +1,241 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioDecodeWorker.h"
+#import "DOUAudioLPCM.h"
+#include <pthread.h>
+
+@interface DOUAudioDecodeWorker () {
+@private
+  pthread_t _thread;
+  pthread_mutex_t _mutex;
+  pthread_cond_t _cond;
+  BOOL _invalidated;
+
+  DOUAudioDecoder *_decoder;
+  NSUInteger _decodeAheadLength;
+  NSUInteger _generation;
+  DOUAudioDecoderStatus _status;
+  BOOL _starving;
+
+  DOUAudioDecodeWorkerEventBlock _eventBlock;
+}
+@end
+
+@implementation DOUAudioDecodeWorker
+
+static void *decode_worker_main(void *info)
+{
+  pthread_setname_np("com.douban.audio-streamer.decode-worker");
+
+  __unsafe_unretained DOUAudioDecodeWorker *worker = (__bridge DOUAudioDecodeWorker *)info;
+  @autoreleasepool {
+    [worker _run];
+  }
+
+  return NULL;
+}
+
+- (instancetype)init
+{
+  self = [super init];
+  if (self) {
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_cond_init(&_cond, NULL);
+    _status = DOUAudioDecoderSucceeded;
+
+    if (pthread_create(&_thread, NULL, decode_worker_main, (__bridge void *)self) != 0) {
+      pthread_cond_destroy(&_cond);
+      pthread_mutex_destroy(&_mutex);
+      return nil;
+    }
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  [self invalidate];
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_mutex);
+}
+
+- (void)invalidate
+{
+  pthread_mutex_lock(&_mutex);
+  if (_invalidated) {
+    pthread_mutex_unlock(&_mutex);
+    return;
+  }
+
+  _invalidated = YES;
+  _decoder = nil;
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_mutex);
+
+  pthread_join(_thread, NULL);
+}
+
+- (DOUAudioDecodeWorkerEventBlock)eventBlock
+{
+  pthread_mutex_lock(&_mutex);
+  DOUAudioDecodeWorkerEventBlock eventBlock = _eventBlock;
+  pthread_mutex_unlock(&_mutex);
+
+  return eventBlock;
+}
+
+- (void)setEventBlock:(DOUAudioDecodeWorkerEventBlock)eventBlock
+{
+  pthread_mutex_lock(&_mutex);
+  _eventBlock = [eventBlock copy];
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (DOUAudioDecoder *)decoder
+{
+  pthread_mutex_lock(&_mutex);
+  DOUAudioDecoder *decoder = _decoder;
+  pthread_mutex_unlock(&_mutex);
+
+  return decoder;
+}
+
+- (DOUAudioDecoderStatus)status
+{
+  pthread_mutex_lock(&_mutex);
+  DOUAudioDecoderStatus status = _status;
+  pthread_mutex_unlock(&_mutex);
+
+  return status;
+}
+
+- (BOOL)isStarving
+{
+  pthread_mutex_lock(&_mutex);
+  BOOL starving = _starving;
+  pthread_mutex_unlock(&_mutex);
+
+  return starving;
+}
+
+- (void)setDecoder:(DOUAudioDecoder *)decoder decodeAheadLength:(NSUInteger)decodeAheadLength
+{
+  pthread_mutex_lock(&_mutex);
+  if (_decoder != decoder) {
+    _decoder = decoder;
+    _generation++;
+    _status = DOUAudioDecoderSucceeded;
+    _starving = NO;
+  }
+  _decodeAheadLength = decodeAheadLength;
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (void)signal
+{
+  pthread_mutex_lock(&_mutex);
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (void)resume
+{
+  pthread_mutex_lock(&_mutex);
+  if (_status == DOUAudioDecoderWaiting) {
+    _status = DOUAudioDecoderSucceeded;
+  }
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (void)reset
+{
+  pthread_mutex_lock(&_mutex);
+  _generation++;
+  _status = DOUAudioDecoderSucceeded;
+  _starving = NO;
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (void)starve
+{
+  pthread_mutex_lock(&_mutex);
+  _starving = YES;
+  pthread_cond_signal(&_cond);
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (BOOL)_shouldDecode
+{
+  return _decoder != nil &&
+         _status == DOUAudioDecoderSucceeded &&
+         [[_decoder lpcm] readableLength] < _decodeAheadLength;
+}
+
+/*
+ * A status is only stored when no seek or decoder change happened while
+ * -decodeOnce ran; otherwise it may describe a position that has already
+ * been flushed.
+ */
+
+- (void)_run
+{
+  pthread_mutex_lock(&_mutex);
+  while (!_invalidated) {
+    if (![self _shouldDecode]) {
+      pthread_cond_wait(&_cond, &_mutex);
+      continue;
+    }
+
+    DOUAudioDecoder *decoder = _decoder;
+    NSUInteger generation = _generation;
+    pthread_mutex_unlock(&_mutex);
+
+    DOUAudioDecoderStatus status;
+    @autoreleasepool {
+      status = [decoder decodeOnce];
+    }
+
+    pthread_mutex_lock(&_mutex);
+    if (generation != _generation) {
+      continue;
+    }
+
+    _status = status;
+    BOOL notify = (status == DOUAudioDecoderEndEncountered ||
+                   status == DOUAudioDecoderFailed);
+
+    if (_starving &&
+        (notify || status == DOUAudioDecoderWaiting || [[decoder lpcm] readableLength] > 0)) {
+      _starving = NO;
+      notify = YES;
+    }
+
+    DOUAudioDecodeWorkerEventBlock eventBlock = notify ? _eventBlock : NULL;
+    if (eventBlock != NULL) {
+      pthread_mutex_unlock(&_mutex);
+      eventBlock();
+      pthread_mutex_lock(&_mutex);
+    }
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+@end
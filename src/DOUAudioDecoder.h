@@ -30,20 +30,39 @@ typedef NS_ENUM(NSUInteger, DOUAudioDecoderStatus) {
 @interface DOUAudioDecoder : NSObject
 
 + (AudioStreamBasicDescription)defaultOutputFormat;
++ (AudioStreamBasicDescription)outputFormatWithSampleRate:(double)sampleRate;
 
 + (instancetype)decoderWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
                              bufferSize:(NSUInteger)bufferSize;
++ (instancetype)decoderWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+                           outputFormat:(AudioStreamBasicDescription)outputFormat
+                             bufferSize:(NSUInteger)bufferSize;
++ (instancetype)decoderWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+                           outputFormat:(AudioStreamBasicDescription)outputFormat
+                             bufferSize:(NSUInteger)bufferSize
+                      decodeAheadLength:(NSUInteger)decodeAheadLength;
 
 - (instancetype)initWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
                           bufferSize:(NSUInteger)bufferSize;
+- (instancetype)initWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+                        outputFormat:(AudioStreamBasicDescription)outputFormat
+                          bufferSize:(NSUInteger)bufferSize;
+- (instancetype)initWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+                        outputFormat:(AudioStreamBasicDescription)outputFormat
+                          bufferSize:(NSUInteger)bufferSize
+                   decodeAheadLength:(NSUInteger)decodeAheadLength;
 
 - (BOOL)setUp;
 - (void)tearDown;
 
 - (DOUAudioDecoderStatus)decodeOnce;
 - (void)seekToTime:(NSUInteger)milliseconds;
+- (void)rampUpFromBufferSize:(NSUInteger)bufferSize;
 
 @property (nonatomic, readonly) DOUAudioPlaybackItem *playbackItem;
 @property (nonatomic, readonly) DOUAudioLPCM *lpcm;
+@property (nonatomic, readonly) AudioStreamBasicDescription outputFormat;
+@property (nonatomic, readonly) NSUInteger bufferedTime;
+@property (nonatomic, readonly) SInt64 outputPosition;
 
 @end
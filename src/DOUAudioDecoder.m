@@ -18,17 +18,29 @@
 #import "DOUAudioFileProvider.h"
 #import "DOUAudioPlaybackItem.h"
 #import "DOUAudioLPCM.h"
+#import "DOUAudioSeekIndex.h"
+#import "DOUAudioPacketRing.h"
+#import "DOUAudioBufferingPolicy.h"
+#import "DOUAudioMetrics.h"
+#import "DOUAudioStreamer+Options.h"
 #include <AudioToolbox/AudioToolbox.h>
 #include <pthread.h>
+#include <mach/mach_time.h>
+
+static const OSStatus kDOUAudioDecoderUnderrunStatus = 'undr';
+static const UInt32 kDOUAudioDecoderFallbackPacketSize = 4096;
 
 typedef struct {
   AudioFileID afid;
+  void *item;
+  void *ring;
   SInt64 pos;
   void *srcBuffer;
   UInt32 srcBufferSize;
   AudioStreamBasicDescription srcFormat;
   UInt32 srcSizePerPacket;
   UInt32 numPacketsPerRead;
+  UInt32 maxPacketsPerRead;
   AudioStreamPacketDescription *pktDescs;
 } AudioFileIO;
 
@@ -44,7 +56,9 @@ typedef struct {
   UInt32 outputBufferSize;
   void *outputBuffer;
 
+  UInt32 readBufferSize;
   UInt32 numOutputPackets;
+  UInt32 maxOutputPackets;
   SInt64 outputPos;
 
   pthread_mutex_t mutex;
@@ -59,8 +73,14 @@ typedef struct {
   AudioConverterRef _audioConverter;
 
   NSUInteger _bufferSize;
+  NSUInteger _bufferedTime;
   DecodingContext _decodingContext;
   BOOL _decodingContextInitialized;
+
+  id <DOUAudioBufferingPolicy> _bufferingPolicy;
+  BOOL _buffering;
+
+  DOUAudioMetrics *_metrics;
 }
 @end
 
@@ -68,27 +88,39 @@ typedef struct {
 
 @synthesize playbackItem = _playbackItem;
 @synthesize lpcm = _lpcm;
+@synthesize outputFormat = _outputFormat;
+@synthesize bufferedTime = _bufferedTime;
+
+/*
+ * PCM is decoded to interleaved stereo float32 at whatever sample rate the
+ * event loop negotiated with the renderer, normally the hardware rate, so
+ * that a source at that rate is passed through without resampling and no
+ * later stage has to convert the samples again.
+ */
 
 + (AudioStreamBasicDescription)defaultOutputFormat
 {
-  static AudioStreamBasicDescription defaultOutputFormat;
+  return [self outputFormatWithSampleRate:44100];
+}
+
++ (AudioStreamBasicDescription)outputFormatWithSampleRate:(double)sampleRate
+{
+  AudioStreamBasicDescription outputFormat;
+  memset(&outputFormat, 0, sizeof(outputFormat));
 
-  static dispatch_once_t onceToken;
-  dispatch_once(&onceToken, ^{
-    defaultOutputFormat.mFormatID = kAudioFormatLinearPCM;
-    defaultOutputFormat.mSampleRate = 44100;
+  outputFormat.mFormatID = kAudioFormatLinearPCM;
+  outputFormat.mSampleRate = sampleRate;
 
-    defaultOutputFormat.mBitsPerChannel = 16;
-    defaultOutputFormat.mChannelsPerFrame = 2;
-    defaultOutputFormat.mBytesPerFrame = defaultOutputFormat.mChannelsPerFrame * (defaultOutputFormat.mBitsPerChannel / 8);
+  outputFormat.mBitsPerChannel = 32;
+  outputFormat.mChannelsPerFrame = 2;
+  outputFormat.mBytesPerFrame = outputFormat.mChannelsPerFrame * (outputFormat.mBitsPerChannel / 8);
 
-    defaultOutputFormat.mFramesPerPacket = 1;
-    defaultOutputFormat.mBytesPerPacket = defaultOutputFormat.mFramesPerPacket * defaultOutputFormat.mBytesPerFrame;
+  outputFormat.mFramesPerPacket = 1;
+  outputFormat.mBytesPerPacket = outputFormat.mFramesPerPacket * outputFormat.mBytesPerFrame;
 
-    defaultOutputFormat.mFormatFlags = kLinearPCMFormatFlagIsSignedInteger | kLinearPCMFormatFlagIsPacked;
-  });
+  outputFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
 
-  return defaultOutputFormat;
+  return outputFormat;
 }
 
 + (instancetype)decoderWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
@@ -98,16 +130,58 @@ typedef struct {
                                          bufferSize:bufferSize];
 }
 
++ (instancetype)decoderWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+                           outputFormat:(AudioStreamBasicDescription)outputFormat
+                             bufferSize:(NSUInteger)bufferSize
+{
+  return [[[self class] alloc] initWithPlaybackItem:playbackItem
+                                       outputFormat:outputFormat
+                                         bufferSize:bufferSize];
+}
+
++ (instancetype)decoderWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+                           outputFormat:(AudioStreamBasicDescription)outputFormat
+                             bufferSize:(NSUInteger)bufferSize
+                      decodeAheadLength:(NSUInteger)decodeAheadLength
+{
+  return [[[self class] alloc] initWithPlaybackItem:playbackItem
+                                       outputFormat:outputFormat
+                                         bufferSize:bufferSize
+                                  decodeAheadLength:decodeAheadLength];
+}
+
+- (instancetype)initWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+                          bufferSize:(NSUInteger)bufferSize
+{
+  return [self initWithPlaybackItem:playbackItem
+                       outputFormat:[[self class] defaultOutputFormat]
+                         bufferSize:bufferSize];
+}
+
 - (instancetype)initWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+                        outputFormat:(AudioStreamBasicDescription)outputFormat
                           bufferSize:(NSUInteger)bufferSize
+{
+  return [self initWithPlaybackItem:playbackItem
+                       outputFormat:outputFormat
+                         bufferSize:bufferSize
+                  decodeAheadLength:bufferSize];
+}
+
+- (instancetype)initWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+                        outputFormat:(AudioStreamBasicDescription)outputFormat
+                          bufferSize:(NSUInteger)bufferSize
+                   decodeAheadLength:(NSUInteger)decodeAheadLength
 {
   self = [super init];
   if (self) {
     _playbackItem = playbackItem;
     _bufferSize = bufferSize;
-    _lpcm = [[DOUAudioLPCM alloc] init];
+    _lpcm = [[DOUAudioLPCM alloc] initWithCapacity:bufferSize + MAX(decodeAheadLength, bufferSize)];
+    _bufferingPolicy = [DOUAudioStreamer bufferingPolicy];
+    _metrics = [[playbackItem fileProvider] metrics];
 
-    _outputFormat = [[self class] defaultOutputFormat];
+    _outputFormat = outputFormat;
     [self _createAudioConverter];
 
     if (_audioConverter == NULL) {
@@ -139,6 +213,16 @@ typedef struct {
   }
 }
 
+- (void)_fillMagicCookieForPacketRing:(DOUAudioPacketRing *)packetRing
+{
+  NSData *cookie = [packetRing magicCookie];
+  if ([cookie length] == 0) {
+    return;
+  }
+
+  AudioConverterSetProperty(_audioConverter, kAudioConverterDecompressionMagicCookie, (UInt32)[cookie length], [cookie bytes]);
+}
+
 - (void)_fillMagicCookieForAudioFileID:(AudioFileID)inputFile
 {
   UInt32 cookieSize = 0;
@@ -161,6 +245,23 @@ typedef struct {
   }
 }
 
+/*
+ * Each decodeOnce reads numPacketsPerRead packets and fills up to
+ * readBufferSize bytes of PCM.  Both normally span the whole buffer, but
+ * rampUpFromBufferSize: shrinks them so that the first reads after a start
+ * or a seek only wait for a few packets, and doubles them after every
+ * successful read until the steady-state size is reached again.
+ */
+
+static void decoder_set_read_buffer_size(DecodingContext *context, UInt32 readBufferSize)
+{
+  readBufferSize = MIN(MAX(readBufferSize, context->outputFormat.mBytesPerFrame), context->outputBufferSize);
+
+  context->readBufferSize = readBufferSize;
+  context->afio.numPacketsPerRead = MAX((UInt32)((UInt64)context->afio.maxPacketsPerRead * readBufferSize / context->outputBufferSize), 1);
+  context->numOutputPackets = MAX((UInt32)((UInt64)context->maxOutputPackets * readBufferSize / context->outputBufferSize), 1);
+}
+
 - (BOOL)setUp
 {
   if (_decodingContextInitialized) {
@@ -168,13 +269,19 @@ typedef struct {
   }
 
   AudioFileID inputFile = [_playbackItem fileID];
-  if (inputFile == NULL) {
+  DOUAudioPacketRing *packetRing = [_playbackItem packetRing];
+  if (inputFile == NULL && packetRing == nil) {
     return NO;
   }
 
   _decodingContext.inputFormat = [_playbackItem fileFormat];
   _decodingContext.outputFormat = _outputFormat;
-  [self _fillMagicCookieForAudioFileID:inputFile];
+  if (packetRing != nil) {
+    [self _fillMagicCookieForPacketRing:packetRing];
+  }
+  else {
+    [self _fillMagicCookieForAudioFileID:inputFile];
+  }
 
   UInt32 size;
   OSStatus status;
@@ -191,9 +298,11 @@ typedef struct {
     return NO;
   }
 
-  AudioStreamBasicDescription baseFormat;
-  UInt32 propertySize = sizeof(baseFormat);
-  AudioFileGetProperty(inputFile, kAudioFilePropertyDataFormat, &propertySize, &baseFormat);
+  AudioStreamBasicDescription baseFormat = _decodingContext.inputFormat;
+  if (inputFile != NULL) {
+    UInt32 propertySize = sizeof(baseFormat);
+    AudioFileGetProperty(inputFile, kAudioFilePropertyDataFormat, &propertySize, &baseFormat);
+  }
 
   double actualToBaseSampleRateRatio = 1.0;
   if (_decodingContext.inputFormat.mSampleRate != baseFormat.mSampleRate &&
@@ -210,7 +319,7 @@ typedef struct {
 
   _decodingContext.decodeValidFrames = 0;
   AudioFilePacketTableInfo srcPti;
-  if (_decodingContext.inputFormat.mBitsPerChannel == 0) {
+  if (inputFile != NULL && _decodingContext.inputFormat.mBitsPerChannel == 0) {
     size = sizeof(srcPti);
     status = AudioFileGetProperty(inputFile, kAudioFilePropertyPacketTableInfo, &size, &srcPti);
     if (status == noErr) {
@@ -228,12 +337,26 @@ typedef struct {
   }
 
   _decodingContext.afio.afid = inputFile;
+  _decodingContext.afio.item = (__bridge void *)_playbackItem;
+  _decodingContext.afio.ring = (__bridge void *)packetRing;
   _decodingContext.afio.srcBufferSize = (UInt32)_bufferSize;
   _decodingContext.afio.srcBuffer = malloc(_decodingContext.afio.srcBufferSize);
   _decodingContext.afio.pos = 0;
   _decodingContext.afio.srcFormat = _decodingContext.inputFormat;
 
-  if (_decodingContext.inputFormat.mBytesPerPacket == 0) {
+  if (packetRing != nil) {
+    _decodingContext.afio.srcSizePerPacket = [packetRing maximumPacketSize];
+    if (_decodingContext.afio.srcSizePerPacket == 0) {
+      _decodingContext.afio.srcSizePerPacket = _decodingContext.inputFormat.mBytesPerPacket;
+    }
+    if (_decodingContext.afio.srcSizePerPacket == 0) {
+      _decodingContext.afio.srcSizePerPacket = kDOUAudioDecoderFallbackPacketSize;
+    }
+
+    _decodingContext.afio.numPacketsPerRead = MAX(_decodingContext.afio.srcBufferSize / _decodingContext.afio.srcSizePerPacket, 1);
+    _decodingContext.afio.pktDescs = (AudioStreamPacketDescription *)malloc(sizeof(AudioStreamPacketDescription) * _decodingContext.afio.numPacketsPerRead);
+  }
+  else if (_decodingContext.inputFormat.mBytesPerPacket == 0) {
     size = sizeof(_decodingContext.afio.srcSizePerPacket);
     status = AudioFileGetProperty(inputFile, kAudioFilePropertyPacketSizeUpperBound, &size, &_decodingContext.afio.srcSizePerPacket);
     if (status != noErr) {
@@ -271,7 +394,9 @@ typedef struct {
     _decodingContext.outputPktDescs = (AudioStreamPacketDescription *)malloc(sizeof(AudioStreamPacketDescription) * _decodingContext.outputBufferSize / outputSizePerPacket);
   }
 
-  _decodingContext.numOutputPackets = _decodingContext.outputBufferSize / outputSizePerPacket;
+  _decodingContext.afio.maxPacketsPerRead = _decodingContext.afio.numPacketsPerRead;
+  _decodingContext.maxOutputPackets = _decodingContext.outputBufferSize / outputSizePerPacket;
+  decoder_set_read_buffer_size(&_decodingContext, _decodingContext.outputBufferSize);
   _decodingContext.outputPos = 0;
 
   pthread_mutex_init(&_decodingContext.mutex, NULL);
@@ -301,6 +426,87 @@ typedef struct {
   _decodingContextInitialized = NO;
 }
 
+static SInt64 decoder_output_frames(DecodingContext *context, SInt64 inputFrames)
+{
+  if (context->inputFormat.mSampleRate <= 0.0 ||
+      context->outputFormat.mSampleRate <= 0.0) {
+    return inputFrames;
+  }
+
+  return (SInt64)llround(inputFrames * context->outputFormat.mSampleRate / context->inputFormat.mSampleRate);
+}
+
+static SInt64 decoder_packet_data_offset(AudioFileIO *afio, SInt64 packet, BOOL *exact)
+{
+  __unsafe_unretained DOUAudioPlaybackItem *item = (__bridge DOUAudioPlaybackItem *)afio->item;
+  DOUAudioSeekIndex *seekIndex = [item seekIndex];
+
+  BOOL indexExact = NO;
+  SInt64 byteOffset = seekIndex != nil ? [seekIndex byteOffsetForPacket:packet exact:&indexExact] : -1;
+  if (byteOffset < 0) {
+    byteOffset = packet * afio->srcSizePerPacket;
+    indexExact = NO;
+  }
+
+  if (exact != NULL) {
+    *exact = indexExact;
+  }
+
+  return byteOffset;
+}
+
+static BOOL decoder_read_indexed_packets(AudioFileIO *afio, UInt32 *ioNumberDataPackets, UInt32 *outNumBytes)
+{
+  if (afio->pktDescs == NULL) {
+    return NO;
+  }
+
+  __unsafe_unretained DOUAudioPlaybackItem *item = (__bridge DOUAudioPlaybackItem *)afio->item;
+
+  SInt64 byteOffset = 0;
+  UInt32 byteCount = 0;
+  UInt32 numPackets = [[item seekIndex] getPacketDescriptions:afio->pktDescs
+                                                   fromPacket:afio->pos
+                                                        count:*ioNumberDataPackets
+                                                 maxByteCount:afio->srcBufferSize
+                                                   byteOffset:&byteOffset
+                                                    byteCount:&byteCount];
+  if (numPackets == 0 ||
+      [item readBytes:afio->srcBuffer offset:[item dataOffset] + (NSUInteger)byteOffset length:byteCount] != byteCount) {
+    return NO;
+  }
+
+  *ioNumberDataPackets = numPackets;
+  *outNumBytes = byteCount;
+  return YES;
+}
+
+/*
+ * Live streams are read from the packet ring.  Running out of packets there
+ * is not the end of the stream unless the provider has finished, so the
+ * converter is stopped with an underrun status instead and decodeOnce keeps
+ * whatever it produced and waits for more data.
+ */
+
+static OSStatus decoder_read_ring_packets(AudioFileIO *afio, UInt32 *ioNumberDataPackets, UInt32 *outNumBytes)
+{
+  __unsafe_unretained DOUAudioPacketRing *ring = (__bridge DOUAudioPacketRing *)afio->ring;
+  __unsafe_unretained DOUAudioPlaybackItem *item = (__bridge DOUAudioPlaybackItem *)afio->item;
+
+  *ioNumberDataPackets = [ring readPacketsFromPacket:&afio->pos
+                                               count:*ioNumberDataPackets
+                                              buffer:afio->srcBuffer
+                                          bufferSize:afio->srcBufferSize
+                                  packetDescriptions:afio->pktDescs
+                                           byteCount:outNumBytes];
+
+  if (*ioNumberDataPackets == 0 && ![[item fileProvider] isFinished]) {
+    return kDOUAudioDecoderUnderrunStatus;
+  }
+
+  return noErr;
+}
+
 static OSStatus decoder_data_proc(AudioConverterRef inAudioConverter, UInt32 *ioNumberDataPackets, AudioBufferList *ioData, AudioStreamPacketDescription **outDataPacketDescription, void *inUserData)
 {
   AudioFileIO *afio = (AudioFileIO *)inUserData;
@@ -310,9 +516,17 @@ static OSStatus decoder_data_proc(AudioConverterRef inAudioConverter, UInt32 *io
   }
 
   UInt32 outNumBytes;
-  OSStatus status = AudioFileReadPackets(afio->afid, FALSE, &outNumBytes, afio->pktDescs, afio->pos, ioNumberDataPackets, afio->srcBuffer);
-  if (status != noErr) {
-    return status;
+  if (afio->ring != NULL) {
+    OSStatus status = decoder_read_ring_packets(afio, ioNumberDataPackets, &outNumBytes);
+    if (status != noErr) {
+      return status;
+    }
+  }
+  else if (!decoder_read_indexed_packets(afio, ioNumberDataPackets, &outNumBytes)) {
+    OSStatus status = AudioFileReadPackets(afio->afid, FALSE, &outNumBytes, afio->pktDescs, afio->pos, ioNumberDataPackets, afio->srcBuffer);
+    if (status != noErr) {
+      return status;
+    }
   }
 
   afio->pos += *ioNumberDataPackets;
@@ -322,7 +536,7 @@ static OSStatus decoder_data_proc(AudioConverterRef inAudioConverter, UInt32 *io
   ioData->mBuffers[0].mNumberChannels = afio->srcFormat.mChannelsPerFrame;
 
   if (outDataPacketDescription != NULL) {
-    *outDataPacketDescription = afio->pktDescs;
+    *outDataPacketDescription = (afio->srcFormat.mBytesPerPacket == 0 ? afio->pktDescs : NULL);
   }
 
   return noErr;
@@ -336,49 +550,121 @@ static OSStatus decoder_data_proc(AudioConverterRef inAudioConverter, UInt32 *io
 
   pthread_mutex_lock(&_decodingContext.mutex);
 
+  if ([_lpcm writableLength] < _decodingContext.outputBufferSize) {
+    pthread_mutex_unlock(&_decodingContext.mutex);
+    return DOUAudioDecoderSucceeded;
+  }
+
+  uint64_t decodeStartHostTime = mach_absolute_time();
+
+  [_playbackItem updateSeekIndex];
+
   DOUAudioFileProvider *provider = [_playbackItem fileProvider];
   if ([provider isFailed]) {
     [_lpcm setEnd:YES];
     pthread_mutex_unlock(&_decodingContext.mutex);
     return DOUAudioDecoderFailed;
   }
-  if (![provider isFinished]) {
+
+  _bufferedTime = NSUIntegerMax;
+  DOUAudioPacketRing *packetRing = [_playbackItem packetRing];
+  if (packetRing != nil) {
+    SInt64 bufferedPackets = [packetRing endPacket] - MAX(_decodingContext.afio.pos, [packetRing firstPacket]);
+    if (![provider isFinished]) {
+      _bufferedTime = [packetRing timeForPacket:bufferedPackets];
+      if (bufferedPackets < (SInt64)_decodingContext.afio.numPacketsPerRead) {
+        _buffering = YES;
+        pthread_mutex_unlock(&_decodingContext.mutex);
+        return DOUAudioDecoderWaiting;
+      }
+    }
+
+    _buffering = NO;
+  }
+  else if (![provider isFinished]) {
     NSUInteger dataOffset = [_playbackItem dataOffset];
     NSUInteger expectedDataLength = [provider expectedLength];
-    NSInteger receivedDataLength  = (NSInteger)([provider receivedLength] - dataOffset);
-
-    SInt64 packetNumber = _decodingContext.afio.pos + _decodingContext.afio.numPacketsPerRead;
-    SInt64 packetDataOffset = packetNumber * _decodingContext.afio.srcSizePerPacket;
 
     SInt64 bytesPerPacket = _decodingContext.afio.srcSizePerPacket;
     SInt64 bytesPerRead = bytesPerPacket * _decodingContext.afio.numPacketsPerRead;
 
+    SInt64 readDataOffset = decoder_packet_data_offset(&_decodingContext.afio, _decodingContext.afio.pos, NULL);
+    NSInteger receivedDataLength = (NSInteger)(readDataOffset + [provider availableLengthFromOffset:dataOffset + (NSUInteger)readDataOffset]);
+
+    BOOL nextDataOffsetExact = NO;
+    SInt64 nextDataOffset = decoder_packet_data_offset(&_decodingContext.afio, _decodingContext.afio.pos + _decodingContext.afio.numPacketsPerRead, &nextDataOffsetExact);
+    if (nextDataOffsetExact && nextDataOffset > readDataOffset) {
+      bytesPerRead = nextDataOffset - readDataOffset;
+    }
+
+    SInt64 packetDataOffset = MIN(readDataOffset + bytesPerRead, (SInt64)expectedDataLength - (SInt64)dataOffset);
+
     SInt64 framesPerPacket = _decodingContext.inputFormat.mFramesPerPacket;
     double intervalPerPacket = 1000.0 / _decodingContext.inputFormat.mSampleRate * framesPerPacket;
-    double intervalPerRead = intervalPerPacket / bytesPerPacket * bytesPerRead;
+    SInt64 bytesRemaining = (SInt64)expectedDataLength - (SInt64)dataOffset - receivedDataLength;
 
-    double downloadTime = 1000.0 * (bytesPerRead - (receivedDataLength - packetDataOffset)) / [provider downloadSpeed];
-    SInt64 bytesRemaining = (SInt64)(expectedDataLength - (NSUInteger)receivedDataLength);
+    if (bytesRemaining > 0 && bytesPerPacket > 0) {
+      SInt64 receivedPacket = [[_playbackItem seekIndex] packetForByteOffset:receivedDataLength];
+      if (receivedPacket >= 0) {
+        _bufferedTime = (NSUInteger)(MAX(receivedPacket - _decodingContext.afio.pos, 0) * intervalPerPacket);
+      }
+      else {
+        _bufferedTime = (NSUInteger)MAX(0.0, (receivedDataLength - readDataOffset) * intervalPerPacket / bytesPerPacket);
+      }
+    }
 
-    if (receivedDataLength < packetDataOffset ||
-        (bytesRemaining > 0 &&
-        downloadTime > intervalPerRead)) {
+    if (receivedDataLength < packetDataOffset) {
+      _buffering = YES;
       pthread_mutex_unlock(&_decodingContext.mutex);
       return DOUAudioDecoderWaiting;
     }
+
+    if (bytesRemaining > 0 &&
+        _decodingContext.readBufferSize == _decodingContext.outputBufferSize) {
+      double bitRate = [_playbackItem bitRate] / 8.0;
+      if (bitRate <= 0.0 && bytesPerPacket > 0) {
+        bitRate = 1000.0 * bytesPerPacket / intervalPerPacket;
+      }
+
+      _buffering = [_bufferingPolicy shouldBufferWithBufferedTime:_bufferedTime
+                                                  remainingLength:(NSUInteger)bytesRemaining
+                                                       throughput:[provider estimatedThroughput]
+                                                        deviation:[provider throughputDeviation]
+                                                          bitRate:bitRate
+                                                        buffering:_buffering];
+      if (_buffering) {
+        pthread_mutex_unlock(&_decodingContext.mutex);
+        return DOUAudioDecoderWaiting;
+      }
+    }
+    else {
+      _buffering = NO;
+    }
   }
 
   AudioBufferList fillBufList;
   fillBufList.mNumberBuffers = 1;
   fillBufList.mBuffers[0].mNumberChannels = _decodingContext.inputFormat.mChannelsPerFrame;
-  fillBufList.mBuffers[0].mDataByteSize = _decodingContext.outputBufferSize;
+  fillBufList.mBuffers[0].mDataByteSize = _decodingContext.readBufferSize;
   fillBufList.mBuffers[0].mData = _decodingContext.outputBuffer;
 
   OSStatus status;
 
+  uint64_t converterStartHostTime = mach_absolute_time();
   UInt32 ioOutputDataPackets = _decodingContext.numOutputPackets;
   status = AudioConverterFillComplexBuffer(_audioConverter, decoder_data_proc, &_decodingContext.afio, &ioOutputDataPackets, &fillBufList, _decodingContext.outputPktDescs);
-  if (status != noErr) {
+  dou_audio_metrics_record_host_time(_metrics, DOUAudioMetricsConverterHistogram, mach_absolute_time() - converterStartHostTime);
+  if (status == kDOUAudioDecoderUnderrunStatus) {
+    if (ioOutputDataPackets > 0) {
+      [_lpcm writeBytes:_decodingContext.outputBuffer length:fillBufList.mBuffers[0].mDataByteSize];
+      _decodingContext.outputPos += ioOutputDataPackets;
+    }
+
+    _buffering = YES;
+    pthread_mutex_unlock(&_decodingContext.mutex);
+    return DOUAudioDecoderWaiting;
+  }
+  else if (status != noErr) {
     pthread_mutex_unlock(&_decodingContext.mutex);
     return DOUAudioDecoderFailed;
   }
@@ -408,12 +694,42 @@ static OSStatus decoder_data_proc(AudioConverterRef inAudioConverter, UInt32 *io
 
   UInt32 inNumBytes = fillBufList.mBuffers[0].mDataByteSize;
   [_lpcm writeBytes:_decodingContext.outputBuffer length:inNumBytes];
+  dou_audio_metrics_add_copied_length(_metrics, inNumBytes);
   _decodingContext.outputPos += ioOutputDataPackets;
 
+  if (_decodingContext.readBufferSize < _decodingContext.outputBufferSize) {
+    decoder_set_read_buffer_size(&_decodingContext, _decodingContext.readBufferSize * 2);
+  }
+
+  dou_audio_metrics_record_host_time(_metrics, DOUAudioMetricsDecodeHistogram, mach_absolute_time() - decodeStartHostTime);
   pthread_mutex_unlock(&_decodingContext.mutex);
   return DOUAudioDecoderSucceeded;
 }
 
+- (void)rampUpFromBufferSize:(NSUInteger)bufferSize
+{
+  if (!_decodingContextInitialized) {
+    return;
+  }
+
+  pthread_mutex_lock(&_decodingContext.mutex);
+  decoder_set_read_buffer_size(&_decodingContext, (UInt32)MIN(bufferSize, (NSUInteger)UINT32_MAX));
+  pthread_mutex_unlock(&_decodingContext.mutex);
+}
+
+- (SInt64)outputPosition
+{
+  if (!_decodingContextInitialized) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&_decodingContext.mutex);
+  SInt64 outputPosition = _decodingContext.outputPos;
+  pthread_mutex_unlock(&_decodingContext.mutex);
+
+  return outputPosition;
+}
+
 - (void)seekToTime:(NSUInteger)milliseconds
 {
   if (!_decodingContextInitialized) {
@@ -421,15 +737,46 @@ static OSStatus decoder_data_proc(AudioConverterRef inAudioConverter, UInt32 *io
   }
 
   pthread_mutex_lock(&_decodingContext.mutex);
+  [_lpcm flush];
+
+  if (_decodingContext.afio.ring != NULL) {
+    DOUAudioPacketRing *packetRing = (__bridge DOUAudioPacketRing *)_decodingContext.afio.ring;
+    SInt64 packet = [packetRing packetForTime:milliseconds];
+    packet = MIN(MAX(packet, [packetRing firstPacket]), [packetRing endPacket]);
+
+    _decodingContext.afio.pos = packet;
+    _decodingContext.outputPos = decoder_output_frames(&_decodingContext, packet * _decodingContext.inputFormat.mFramesPerPacket);
+
+    pthread_mutex_unlock(&_decodingContext.mutex);
+    return;
+  }
 
   double frames = (double)milliseconds * _decodingContext.inputFormat.mSampleRate / 1000.0;
-  double packets = frames / _decodingContext.inputFormat.mFramesPerPacket;
-  SInt64 packetNumebr = (SInt64)lrint(floor(packets));
+  SInt64 packetNumebr;
+  SInt64 packetFrame;
+  if (_decodingContext.inputFormat.mFramesPerPacket > 0) {
+    packetNumebr = (SInt64)lrint(floor(frames / _decodingContext.inputFormat.mFramesPerPacket));
+    packetFrame = packetNumebr * _decodingContext.inputFormat.mFramesPerPacket;
+  }
+  else {
+    AudioFramePacketTranslation translation;
+    memset(&translation, 0, sizeof(translation));
+    translation.mFrame = (SInt64)lrint(floor(frames));
+
+    UInt32 size = sizeof(translation);
+    AudioFileGetProperty(_decodingContext.afio.afid, kAudioFilePropertyFrameToPacket, &size, &translation);
+    packetNumebr = translation.mPacket;
+    packetFrame = translation.mFrame - translation.mFrameOffsetInPacket;
+  }
 
   _decodingContext.afio.pos = packetNumebr;
-  _decodingContext.outputPos = packetNumebr * _decodingContext.inputFormat.mFramesPerPacket / _decodingContext.outputFormat.mFramesPerPacket;
-  
+  _decodingContext.outputPos = decoder_output_frames(&_decodingContext, packetFrame);
+
+  NSUInteger dataOffset = [_playbackItem dataOffset] + (NSUInteger)MAX(decoder_packet_data_offset(&_decodingContext.afio, packetNumebr, NULL), 0);
+
   pthread_mutex_unlock(&_decodingContext.mutex);
+
+  [[_playbackItem fileProvider] seekToOffset:dataOffset];
 }
 
 @end
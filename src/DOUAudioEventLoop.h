@@ -17,20 +17,32 @@
 #import <Foundation/Foundation.h>
 
 @class DOUAudioStreamer;
+@protocol DOUAudioRendering;
 
 @interface DOUAudioEventLoop : NSObject
 
 + (instancetype)sharedEventLoop;
 
 @property (nonatomic, strong) DOUAudioStreamer *currentStreamer;
+@property (nonatomic, strong) DOUAudioStreamer *nextStreamer;
 
 @property (nonatomic, assign) NSTimeInterval currentTime;
 @property (nonatomic, assign) double volume;
+@property (nonatomic, assign) NSTimeInterval crossfadeDuration;
+@property (nonatomic, assign) NSTimeInterval fastStartThreshold;
+@property (nonatomic, assign) NSTimeInterval decodeAheadDuration;
 
+@property (nonatomic, strong) id <DOUAudioRendering> renderer;
 @property (nonatomic, copy) NSArray *analyzers;
 
 - (void)play;
 - (void)pause;
 - (void)stop;
 
+- (void)mixStreamer:(DOUAudioStreamer *)streamer afterDelay:(NSTimeInterval)delay;
+- (void)pauseMixingStreamer:(DOUAudioStreamer *)streamer;
+- (void)removeMixingStreamer:(DOUAudioStreamer *)streamer;
+- (BOOL)isMixingStreamer:(DOUAudioStreamer *)streamer;
+- (NSTimeInterval)currentTimeForMixingStreamer:(DOUAudioStreamer *)streamer;
+
 @end
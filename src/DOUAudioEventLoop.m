@@ -20,15 +20,27 @@
 #import "DOUAudioStreamer+Options.h"
 #import "DOUAudioFileProvider.h"
 #import "DOUAudioPlaybackItem.h"
+#import "DOUAudioPacketRing.h"
 #import "DOUAudioLPCM.h"
 #import "DOUAudioDecoder.h"
 #import "DOUAudioRenderer.h"
+#import "DOUAudioRendering.h"
+#import "DOUAudioPrefetcher.h"
+#import "DOUAudioMixer.h"
+#import "DOUAudioEventQueue.h"
+#import "DOUAudioDecodeWorker.h"
+#include <Accelerate/Accelerate.h>
 #include <sys/types.h>
-#include <sys/event.h>
 #include <sys/time.h>
 #include <pthread.h>
 #include <sched.h>
 
+static const NSTimeInterval kDOUAudioEventLoopPrimeTime = 5.0;
+static const NSTimeInterval kDOUAudioEventLoopDefaultFastStartThreshold = 0.03;
+static const NSTimeInterval kDOUAudioEventLoopDefaultDecodeAheadDuration = 1.0;
+static const NSUInteger kDOUAudioEventLoopRendererWaitTimeout = 1000;
+static const NSUInteger kDOUAudioEventLoopDrainInterval = 10;
+
 typedef NS_ENUM(uint64_t, event_type) {
   event_play,
   event_pause,
@@ -36,6 +48,9 @@ typedef NS_ENUM(uint64_t, event_type) {
   event_seek,
   event_streamer_changed,
   event_provider_events,
+  event_renderer_changed,
+  event_mixer_changed,
+  event_decoder_events,
   event_finalizing,
 #if TARGET_OS_IPHONE
   event_interruption_begin,
@@ -55,14 +70,34 @@ typedef NS_ENUM(uint64_t, event_type) {
 
 @interface DOUAudioEventLoop () {
 @private
-  DOUAudioRenderer *_renderer;
+  id <DOUAudioRendering> _renderer;
+  id <DOUAudioRendering> _pendingRenderer;
   DOUAudioStreamer *_currentStreamer;
+  DOUAudioStreamer *_nextStreamer;
+  DOUAudioStreamer *_unprimableStreamer;
+
+  NSTimeInterval _crossfadeDuration;
+  DOUAudioLPCM *_crossfadeBuffer;
+
+  NSTimeInterval _fastStartThreshold;
+
+  DOUAudioDecodeWorker *_decodeWorker;
+  NSTimeInterval _decodeAheadDuration;
 
+  __weak DOUAudioDecoder *_trackGainDecoder;
+
+  DOUAudioMixer *_mixer;
+  UInt64 _outputFrame;
+  BOOL _mixerOutput;
+  NSInteger _frozenTime;
+  BOOL _frozenNeedsSeek;
+
+  AudioStreamBasicDescription _outputFormat;
   NSUInteger _decoderBufferSize;
   DOUAudioFileProviderEventBlock _fileProviderEventBlock;
 
-  int _kq;
-  void *_lastKQUserData;
+  DOUAudioEventQueue *_eventQueue;
+  void *_lastEventUserData;
   pthread_mutex_t _mutex;
   pthread_t _thread;
 }
@@ -70,7 +105,6 @@ typedef NS_ENUM(uint64_t, event_type) {
 
 @implementation DOUAudioEventLoop
 
-@synthesize currentStreamer = _currentStreamer;
 @dynamic analyzers;
 
 + (instancetype)sharedEventLoop
@@ -89,7 +123,7 @@ typedef NS_ENUM(uint64_t, event_type) {
 {
   self = [super init];
   if (self) {
-    _kq = kqueue();
+    _eventQueue = [[DOUAudioEventQueue alloc] init];
     pthread_mutex_init(&_mutex, NULL);
 
 #if TARGET_OS_IPHONE
@@ -97,6 +131,7 @@ typedef NS_ENUM(uint64_t, event_type) {
 #endif /* TARGET_OS_IPHONE */
 
     _renderer = [DOUAudioRenderer rendererWithBufferTime:kDOUAudioStreamerBufferTime];
+    [self _setupWakeUpForRenderer:_renderer];
     [_renderer setUp];
 
     if ([[NSUserDefaults standardUserDefaults] objectForKey:kDOUAudioStreamerVolumeKey] != nil) {
@@ -106,9 +141,20 @@ typedef NS_ENUM(uint64_t, event_type) {
       [self setVolume:1.0];
     }
 
-    _decoderBufferSize = [[self class] _decoderBufferSize];
+    _outputFormat = [DOUAudioDecoder defaultOutputFormat];
+    _decoderBufferSize = [self _decoderBufferSize];
+    _fastStartThreshold = kDOUAudioEventLoopDefaultFastStartThreshold;
+    _frozenTime = -1;
     [self _setupFileProviderEventBlock];
-    [self _enableEvents];
+
+    _decodeAheadDuration = kDOUAudioEventLoopDefaultDecodeAheadDuration;
+    _decodeWorker = [[DOUAudioDecodeWorker alloc] init];
+    [self _setupDecodeWorkerEventBlock];
+
+    _mixer = [[DOUAudioMixer alloc] init];
+    [_mixer setOutputFormat:_outputFormat];
+    [_mixer setDecoderBufferSize:_decoderBufferSize];
+    [_mixer setFileProviderEventBlock:_fileProviderEventBlock];
     [self _createThread];
   }
 
@@ -120,14 +166,13 @@ typedef NS_ENUM(uint64_t, event_type) {
   [self _sendEvent:event_finalizing];
   pthread_join(_thread, NULL);
 
-  close(_kq);
+  [_decodeWorker invalidate];
   pthread_mutex_destroy(&_mutex);
 }
 
-+ (NSUInteger)_decoderBufferSize
+- (NSUInteger)_decoderBufferSize
 {
-  AudioStreamBasicDescription format = [DOUAudioDecoder defaultOutputFormat];
-  return kDOUAudioStreamerBufferTime * format.mSampleRate * format.mChannelsPerFrame * format.mBitsPerChannel / 8 / 1000;
+  return (NSUInteger)(kDOUAudioStreamerBufferTime * _outputFormat.mSampleRate / 1000) * _outputFormat.mBytesPerFrame;
 }
 
 #if TARGET_OS_IPHONE
@@ -135,8 +180,8 @@ typedef NS_ENUM(uint64_t, event_type) {
 - (void)_handleAudioSessionInterruptionWithState:(UInt32)state
 {
   if (state == kAudioSessionBeginInterruption) {
-    [_renderer setInterrupted:YES];
-    [_renderer stop];
+    [[self renderer] setInterrupted:YES];
+    [[self renderer] stop];
     [self _sendEvent:event_interruption_begin];
   }
   else if (state == kAudioSessionEndInterruption) {
@@ -230,12 +275,19 @@ static void audio_route_change_listener(void *inClientData,
   };
 }
 
-- (void)_enableEvents
+- (void)_setupDecodeWorkerEventBlock
+{
+  __unsafe_unretained DOUAudioEventLoop *eventLoop = self;
+  [_decodeWorker setEventBlock:^{
+    [eventLoop _sendEvent:event_decoder_events];
+  }];
+}
+
+- (void)_setupWakeUpForRenderer:(id <DOUAudioRendering>)renderer
 {
-  for (uint64_t event = event_first; event <= event_last; ++event) {
-    struct kevent kev;
-    EV_SET(&kev, event, EVFILT_USER, EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, NULL);
-    kevent(_kq, &kev, 1, NULL, 0, NULL);
+  if ([renderer respondsToSelector:@selector(setWakeUpFunction:context:)]) {
+    [renderer setWakeUpFunction:dou_audio_event_queue_wake_up
+                        context:(__bridge void *)_eventQueue];
   }
 }
 
@@ -246,9 +298,7 @@ static void audio_route_change_listener(void *inClientData,
 
 - (void)_sendEvent:(event_type)event userData:(void *)userData
 {
-  struct kevent kev;
-  EV_SET(&kev, event, EVFILT_USER, 0, NOTE_TRIGGER, 0, userData);
-  kevent(_kq, &kev, 1, NULL, 0, NULL);
+  [_eventQueue postEvent:(NSUInteger)event userData:userData];
 }
 
 - (event_type)_waitForEvent
@@ -258,32 +308,52 @@ static void audio_route_change_listener(void *inClientData,
 
 - (event_type)_waitForEventWithTimeout:(NSUInteger)timeout
 {
-  struct timespec _ts;
-  struct timespec *ts = NULL;
-  if (timeout != NSUIntegerMax) {
-    ts = &_ts;
+  NSUInteger event;
+  void *userData;
+  if ([_eventQueue waitForEvent:&event userData:&userData timeout:timeout] &&
+      event >= event_first &&
+      event <= event_last) {
+    _lastEventUserData = userData;
+    return (event_type)event;
+  }
+
+  return event_timeout;
+}
+
+/*
+ * While the current streamer (or a mixer voice) is playing, the loop would
+ * otherwise block inside renderBytes:length: once the renderer is full,
+ * where control events cannot reach it.  Instead it asks the renderer for
+ * room for another decoder buffer up front and, when there is none, sleeps
+ * on the event queue until either the renderer wakes it or an event
+ * arrives.  The timeout only guards against an output unit that silently
+ * stops pulling.
+ */
 
-    ts->tv_sec = timeout / 1000;
-    ts->tv_nsec = (timeout % 1000) * 1000;
+- (BOOL)_isRendererWritableForLength:(NSUInteger)length
+{
+  return ![_renderer respondsToSelector:@selector(isWritableForLength:)] ||
+         [_renderer isWritableForLength:length];
+}
+
+- (NSUInteger)_eventTimeoutWithStreamer:(DOUAudioStreamer *)streamer
+{
+  BOOL playing = (streamer != nil && [streamer status] == DOUAudioStreamerPlaying);
+  if (!playing && ![_mixer isActive]) {
+    return 0;
   }
 
-  while (1) {
-    struct kevent kev;
-    int n = kevent(_kq, NULL, 0, &kev, 1, ts);
-    if (n > 0) {
-      if (kev.filter == EVFILT_USER &&
-          kev.ident >= event_first &&
-          kev.ident <= event_last) {
-        _lastKQUserData = kev.udata;
-        return kev.ident;
-      }
-    }
-    else {
-      break;
-    }
+  if (playing &&
+      [_decodeWorker decoder] == [streamer decoder] &&
+      [_decodeWorker isStarving]) {
+    return kDOUAudioEventLoopRendererWaitTimeout;
   }
 
-  return event_timeout;
+  if ([self _isRendererWritableForLength:_decoderBufferSize]) {
+    return 0;
+  }
+
+  return kDOUAudioEventLoopRendererWaitTimeout;
 }
 
 - (BOOL)_handleEvent:(event_type)event withStreamer:(DOUAudioStreamer **)streamer
@@ -293,6 +363,13 @@ static void audio_route_change_listener(void *inClientData,
         ([*streamer status] == DOUAudioStreamerPaused ||
          [*streamer status] == DOUAudioStreamerIdle ||
          [*streamer status] == DOUAudioStreamerFinished)) {
+      if (_frozenNeedsSeek) {
+        [[*streamer decoder] seekToTime:(NSUInteger)_frozenTime];
+        [_decodeWorker reset];
+        _frozenNeedsSeek = NO;
+      }
+
+      [_renderer setStartThreshold:[self _fastStartTime]];
       if ([_renderer isInterrupted]) {
 #if TARGET_OS_IPHONE
 # pragma clang diagnostic push
@@ -317,39 +394,73 @@ static void audio_route_change_listener(void *inClientData,
         ([*streamer status] != DOUAudioStreamerPaused &&
          [*streamer status] != DOUAudioStreamerIdle &&
          [*streamer status] != DOUAudioStreamerFinished)) {
-      [_renderer stop];
+      if (![_mixer isActive]) {
+        [_renderer stop];
+      }
       [*streamer setStatus:DOUAudioStreamerPaused];
     }
   }
   else if (event == event_stop) {
     if (*streamer != nil &&
         [*streamer status] != DOUAudioStreamerIdle) {
-      if ([*streamer status] != DOUAudioStreamerPaused) {
-        [_renderer stop];
+      if (![_mixer isActive]) {
+        if ([*streamer status] != DOUAudioStreamerPaused) {
+          [_renderer stop];
+        }
+        [_renderer flush];
       }
-      [_renderer flush];
+      [self _setFrozenTime:-1 needsSeek:NO];
+      [_decodeWorker setDecoder:nil decodeAheadLength:0];
+      _crossfadeBuffer = nil;
       [*streamer setDecoder:nil];
       [*streamer setPlaybackItem:nil];
       [*streamer setStatus:DOUAudioStreamerIdle];
+      [[DOUAudioPrefetcher sharedPrefetcher] reportPlaybackBufferedTime:NSUIntegerMax];
     }
   }
   else if (event == event_seek) {
     if (*streamer != nil &&
         [*streamer decoder] != nil) {
-      NSUInteger milliseconds = MIN((NSUInteger)(uintptr_t)_lastKQUserData,
-                                    [[*streamer playbackItem] estimatedDuration]);
-      [*streamer setTimingOffset:(NSInteger)milliseconds - (NSInteger)[_renderer currentTime]];
+      NSUInteger milliseconds = (NSUInteger)(uintptr_t)_lastEventUserData;
+      DOUAudioPacketRing *packetRing = [[*streamer playbackItem] packetRing];
+      if (packetRing != nil) {
+        milliseconds = MIN(MAX(milliseconds, [packetRing timeForPacket:[packetRing firstPacket]]),
+                           [packetRing timeForPacket:[packetRing endPacket]]);
+      }
+      else {
+        milliseconds = MIN(milliseconds, [[*streamer playbackItem] estimatedDuration]);
+      }
+      if ([_mixer isActive]) {
+        [*streamer setTimingOffset:(NSInteger)milliseconds - (NSInteger)([_renderer currentTime] + [_renderer queuedTime])];
+        if (_frozenTime >= 0) {
+          [self _setFrozenTime:(NSInteger)milliseconds needsSeek:NO];
+        }
+      }
+      else {
+        [*streamer setTimingOffset:(NSInteger)milliseconds - (NSInteger)[_renderer currentTime]];
+        [_renderer flushShouldResetTiming:NO];
+      }
       [[*streamer decoder] seekToTime:milliseconds];
-      [_renderer flushShouldResetTiming:NO];
+      [_decodeWorker reset];
+      [self _rampUpDecoder:[*streamer decoder]];
+      _crossfadeBuffer = nil;
     }
   }
   else if (event == event_streamer_changed) {
-    [_renderer stop];
-    [_renderer flush];
+    if (![_mixer isActive]) {
+      [_renderer stop];
+      [_renderer flush];
+    }
+    [self _setFrozenTime:-1 needsSeek:NO];
+    [_decodeWorker setDecoder:nil decodeAheadLength:0];
+    _crossfadeBuffer = nil;
+    _unprimableStreamer = nil;
 
     [[*streamer fileProvider] setEventBlock:NULL];
-    *streamer = _currentStreamer;
+    *streamer = [self currentStreamer];
     [[*streamer fileProvider] setEventBlock:_fileProviderEventBlock];
+    [self _prepareTrackGainWithStreamer:*streamer];
+    [_renderer setMetrics:[[*streamer fileProvider] metrics]];
   }
   else if (event == event_provider_events) {
     if (*streamer != nil &&
@@ -357,7 +468,29 @@ static void audio_route_change_listener(void *inClientData,
       [*streamer setStatus:DOUAudioStreamerPlaying];
     }
 
-    [*streamer setBufferingRatio:(double)[[*streamer fileProvider] receivedLength] / [[*streamer fileProvider] expectedLength]];
+    [_decodeWorker resume];
+
+    NSUInteger expectedLength = [[*streamer fileProvider] expectedLength];
+    if (expectedLength > 0) {
+      [*streamer setBufferingRatio:(double)[[*streamer fileProvider] receivedLength] / expectedLength];
+    }
+
+    NSDictionary *metadata = [[*streamer fileProvider] metadata];
+    if (metadata != [*streamer metadata]) {
+      [*streamer setMetadata:metadata];
+    }
+  }
+  else if (event == event_renderer_changed) {
+    [self _replaceRendererWithStreamer:*streamer];
+  }
+  else if (event == event_decoder_events) {
+    if (*streamer != nil &&
+        [*streamer status] == DOUAudioStreamerBuffering) {
+      [*streamer setStatus:DOUAudioStreamerPlaying];
+    }
+  }
+  else if (event == event_mixer_changed) {
+    [_mixer updateWithFrame:_outputFrame queuedTime:[_renderer queuedTime]];
   }
   else if (event == event_finalizing) {
     return NO;
@@ -373,7 +506,7 @@ static void audio_route_change_listener(void *inClientData,
     }
   }
   else if (event == event_interruption_end) {
-    const AudioSessionInterruptionType interruptionType = (AudioSessionInterruptionType)(uintptr_t)_lastKQUserData;
+    const AudioSessionInterruptionType interruptionType = (AudioSessionInterruptionType)(uintptr_t)_lastEventUserData;
     NSAssert(interruptionType == kAudioSessionInterruptionType_ShouldResume ||
              interruptionType == kAudioSessionInterruptionType_ShouldNotResume,
              @"invalid interruption type");
@@ -418,84 +551,727 @@ static void audio_route_change_listener(void *inClientData,
   return YES;
 }
 
-- (void)_handleStreamer:(DOUAudioStreamer *)streamer
+static NSUInteger event_loop_length_for_time(const AudioStreamBasicDescription *format, double milliseconds)
+{
+  return (NSUInteger)(MAX(milliseconds, 0.0) * format->mSampleRate / 1000.0) * format->mBytesPerFrame;
+}
+
+static NSUInteger event_loop_time_for_length(const AudioStreamBasicDescription *format, NSUInteger length)
+{
+  return (NSUInteger)(1000.0 * (length / format->mBytesPerFrame) / format->mSampleRate);
+}
+
+static NSUInteger event_loop_read_lpcm(DOUAudioLPCM *lpcm, void *buffer, NSUInteger maxLength)
+{
+  NSUInteger readLength = 0;
+  const void *bytes = NULL;
+  NSUInteger length = 0;
+  while (readLength < maxLength &&
+         [lpcm borrowBytes:&bytes length:&length] && length > 0) {
+    length = MIN(length, maxLength - readLength);
+    memcpy((uint8_t *)buffer + readLength, bytes, length);
+    [lpcm commitLength:length];
+    readLength += length;
+  }
+
+  return readLength;
+}
+
+static void event_loop_crossfade(float *samples, const float *nextSamples, NSUInteger frameCount, NSUInteger channelCount)
+{
+  float *buffer = (float *)malloc(sizeof(float) * frameCount * 2);
+  float *difference = buffer;
+  float *ramp = buffer + frameCount;
+
+  float start = 0.0f;
+  float step = 1.0f / frameCount;
+  vDSP_vramp(&start, &step, ramp, 1, frameCount);
+
+  const vDSP_Stride stride = (vDSP_Stride)channelCount;
+  for (NSUInteger channel = 0; channel < channelCount; ++channel) {
+    vDSP_vsub(samples + channel, stride, nextSamples + channel, stride, difference, 1, frameCount);
+    vDSP_vma(difference, 1, ramp, 1, samples + channel, stride, samples + channel, stride, frameCount);
+  }
+
+  free(buffer);
+}
+
+/*
+ * Everything written to the renderer goes through _outputBytes:length:, where
+ * active mixer voices are decoded and added in.  _outputFrame counts the
+ * frames written so far and is the clock voices are scheduled against.
+ *
+ * While voices are active the renderer is neither stopped nor flushed for the
+ * current streamer: a pause, stop or seek takes effect after the audio that
+ * is already queued, and when the current streamer is not playing the mixer
+ * writes the voices on their own.  The time of a streamer that is paused or
+ * buffering meanwhile is frozen at the end of its queued audio and restored
+ * when it is rendered again.
+ */
+
+- (void)_outputBytes:(const void *)bytes length:(NSUInteger)length
+{
+  if ([_mixer isActive]) {
+    [_mixer updateWithFrame:_outputFrame queuedTime:[_renderer queuedTime]];
+    [_mixer decodeForLength:length];
+    bytes = [_mixer mixBytes:bytes length:length frame:_outputFrame trackGain:[_renderer trackGain]];
+  }
+
+  _outputFrame += length / _outputFormat.mBytesPerFrame;
+  if (bytes != NULL) {
+    [_renderer renderBytes:bytes length:length];
+  }
+}
+
+- (void)_setFrozenTime:(NSInteger)frozenTime needsSeek:(BOOL)needsSeek
+{
+  pthread_mutex_lock(&_mutex);
+  _frozenTime = frozenTime;
+  _frozenNeedsSeek = needsSeek;
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (void)_freezeStreamer:(DOUAudioStreamer *)streamer
+{
+  if (![_renderer isStarted]) {
+    if (streamer != nil &&
+        [streamer status] == DOUAudioStreamerPaused &&
+        _frozenTime < 0) {
+      [self _setFrozenTime:[streamer timingOffset] + (NSInteger)[_renderer currentTime] needsSeek:YES];
+    }
+
+    [_renderer flushShouldResetTiming:NO];
+    _crossfadeBuffer = nil;
+    return;
+  }
+
+  if (streamer != nil &&
+      ([streamer status] == DOUAudioStreamerPaused ||
+       [streamer status] == DOUAudioStreamerBuffering) &&
+      _frozenTime < 0) {
+    [self _setFrozenTime:[streamer timingOffset] + (NSInteger)([_renderer currentTime] + [_renderer queuedTime]) needsSeek:NO];
+  }
+}
+
+- (void)_thawStreamer:(DOUAudioStreamer *)streamer
+{
+  if (_frozenTime < 0) {
+    return;
+  }
+
+  [streamer setTimingOffset:_frozenTime - (NSInteger)([_renderer currentTime] + [_renderer queuedTime])];
+  [self _setFrozenTime:-1 needsSeek:NO];
+}
+
+- (NSUInteger)_mixerOutputLength
+{
+  NSUInteger length = _decoderBufferSize / 4;
+  return length - length % _outputFormat.mBytesPerFrame;
+}
+
+- (void)_handleMixerWithStreamer:(DOUAudioStreamer **)streamer
+{
+  if (*streamer != nil && [*streamer status] == DOUAudioStreamerPlaying) {
+    _mixerOutput = NO;
+    return;
+  }
+
+  if ([_mixer isActive]) {
+    if (!_mixerOutput) {
+      [self _freezeStreamer:*streamer];
+      _mixerOutput = YES;
+    }
+
+    [self _outputBytes:NULL length:[self _mixerOutputLength]];
+    return;
+  }
+
+  if (!_mixerOutput) {
+    return;
+  }
+
+  _mixerOutput = NO;
+  if (*streamer != nil && [*streamer status] == DOUAudioStreamerBuffering) {
+    return;
+  }
+
+  NSUInteger queuedTime = [_renderer queuedTime];
+  if (queuedTime > 0 &&
+      ![self _handleEvent:[self _waitForEventWithTimeout:queuedTime]
+             withStreamer:streamer]) {
+    return;
+  }
+
+  if (![_mixer isActive] &&
+      (*streamer == nil || [*streamer status] != DOUAudioStreamerPlaying)) {
+    [_renderer stop];
+  }
+}
+
+/*
+ * In gapless mode the next streamer is primed during the last seconds of the
+ * current one.  Once it is primed, the final crossfade duration of PCM is held
+ * back in _crossfadeBuffer, so that it can be mixed with the head of the next
+ * streamer when the current one ends, without stopping the output unit.
+ */
+
+- (void)_drainCrossfadeBufferToLength:(NSUInteger)length
+{
+  const void *bytes = NULL;
+  NSUInteger borrowedLength = 0;
+  while ([_crossfadeBuffer readableLength] > length &&
+         [_crossfadeBuffer borrowBytes:&bytes length:&borrowedLength] && borrowedLength > 0) {
+    borrowedLength = MIN(borrowedLength, [_crossfadeBuffer readableLength] - length);
+    [self _outputBytes:bytes length:borrowedLength];
+    [_crossfadeBuffer commitLength:borrowedLength];
+  }
+}
+
+- (void)_renderBytes:(const void *)bytes length:(NSUInteger)length holdbackLength:(NSUInteger)holdbackLength
+{
+  if (holdbackLength == 0) {
+    [self _drainCrossfadeBufferToLength:0];
+    [self _outputBytes:bytes length:length];
+    return;
+  }
+
+  if (_crossfadeBuffer == nil ||
+      [_crossfadeBuffer capacity] <= holdbackLength) {
+    [self _drainCrossfadeBufferToLength:0];
+    _crossfadeBuffer = [[DOUAudioLPCM alloc] initWithCapacity:holdbackLength + _decoderBufferSize];
+  }
+
+  while (length > 0) {
+    NSUInteger writableLength = [_crossfadeBuffer writableLength];
+    if (writableLength == 0) {
+      [self _drainCrossfadeBufferToLength:holdbackLength];
+      continue;
+    }
+
+    writableLength = MIN(writableLength, length);
+    [_crossfadeBuffer writeBytes:bytes length:writableLength];
+
+    bytes = (const uint8_t *)bytes + writableLength;
+    length -= writableLength;
+  }
+
+  [self _drainCrossfadeBufferToLength:holdbackLength];
+}
+
+/*
+ * In fast-start mode the output unit is started as soon as the fast-start
+ * threshold is queued instead of a whole renderer buffer, and the decoder
+ * ramps up from reads of that size, so that the first sound after a play or
+ * a seek does not wait for a full buffer to be downloaded and decoded.
+ */
+
+- (NSUInteger)_fastStartTime
+{
+  if (!([DOUAudioStreamer options] & DOUAudioStreamerFastStart)) {
+    return 0;
+  }
+
+  return (NSUInteger)lrint([self fastStartThreshold] * 1000.0);
+}
+
+- (void)_rampUpDecoder:(DOUAudioDecoder *)decoder
+{
+  NSUInteger fastStartTime = [self _fastStartTime];
+  if (fastStartTime > 0) {
+    [decoder rampUpFromBufferSize:event_loop_length_for_time(&_outputFormat, fastStartTime)];
+  }
+}
+
+- (void)_updateTimeToFirstAudioWithStreamer:(DOUAudioStreamer *)streamer
+{
+  uint64_t playRequestedHostTime = [streamer playRequestedHostTime];
+  if (playRequestedHostTime == 0) {
+    return;
+  }
+
+  uint64_t firstAudioHostTime = [_renderer firstAudioHostTime];
+  if (firstAudioHostTime < playRequestedHostTime) {
+    return;
+  }
+
+  [streamer setTimeToFirstAudio:[DOUAudioRenderer timeIntervalForHostTime:firstAudioHostTime - playRequestedHostTime]];
+  [streamer setPlayRequestedHostTime:0];
+}
+
+/*
+ * The loudness of a track can only be measured once the whole file is at
+ * hand, which for a streamed track happens well into playback.  The gain is
+ * therefore fixed when the first PCM of a decoding pass goes out, and one
+ * that arrives later only applies the next time the track is played, rather
+ * than jumping in the middle of it.  Files that are already complete when
+ * they become current or are primed get measured right away.
+ */
+
+- (void)_prepareTrackGainWithStreamer:(DOUAudioStreamer *)streamer
+{
+  if ([DOUAudioStreamer options] & DOUAudioStreamerLoudnessNormalization &&
+      [[streamer fileProvider] isFinished]) {
+    [streamer computeTrackGainIfNeeded];
+  }
+}
+
+- (void)_updateTrackGainWithStreamer:(DOUAudioStreamer *)streamer
+{
+  [self _prepareTrackGainWithStreamer:streamer];
+
+  DOUAudioDecoder *decoder = [streamer decoder];
+  if (decoder != nil && decoder == _trackGainDecoder) {
+    return;
+  }
+
+  double trackGain = [streamer trackGain];
+  if (trackGain != [_renderer trackGain]) {
+    [_renderer setTrackGain:trackGain];
+  }
+
+  if ([[decoder lpcm] readableLength] > 0) {
+    _trackGainDecoder = decoder;
+  }
+}
+
+/*
+ * The output format is negotiated whenever the current streamer starts
+ * decoding from scratch: the renderer picks the sample rate it can play with
+ * the least resampling, ideally the source rate itself, and every decoder
+ * then converts to it.  Streamers primed for gapless playback reuse the
+ * format of the one they follow, so that they can be spliced without
+ * reconfiguring the renderer.
+ */
+
+- (void)_negotiateOutputFormatWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+{
+  if ([_mixer isActive]) {
+    return;
+  }
+
+  double sampleRate = [_renderer sampleRateForSourceSampleRate:[playbackItem fileFormat].mSampleRate];
+  if (sampleRate <= 0.0 || sampleRate == _outputFormat.mSampleRate) {
+    return;
+  }
+
+  [_renderer stop];
+  [_renderer flush];
+  _crossfadeBuffer = nil;
+
+  _outputFormat = [DOUAudioDecoder outputFormatWithSampleRate:sampleRate];
+  _decoderBufferSize = [self _decoderBufferSize];
+  [_renderer setFormat:_outputFormat];
+  [_mixer setOutputFormat:_outputFormat];
+  [_mixer setDecoderBufferSize:_decoderBufferSize];
+}
+
+- (void)_drainRenderer:(id <DOUAudioRendering>)renderer
+{
+  NSUInteger queuedTime = [renderer queuedTime];
+  NSUInteger waitedTime = 0;
+  NSUInteger maximumWaitTime = queuedTime + kDOUAudioEventLoopDrainInterval;
+
+  // A remainder shorter than one I/O cycle may never be played.
+  while (queuedTime > 0 &&
+         waitedTime < maximumWaitTime &&
+         [renderer isStarted] &&
+         ![renderer isInterrupted]) {
+    NSUInteger interval = MIN(queuedTime, kDOUAudioEventLoopDrainInterval);
+    usleep((useconds_t)(interval * 1000));
+    waitedTime += interval;
+    queuedTime = [renderer queuedTime];
+  }
+}
+
+- (void)_replaceRendererWithStreamer:(DOUAudioStreamer *)streamer
+{
+  pthread_mutex_lock(&_mutex);
+  id <DOUAudioRendering> renderer = _pendingRenderer;
+  _pendingRenderer = nil;
+  pthread_mutex_unlock(&_mutex);
+
+  if (renderer == nil || renderer == _renderer) {
+    return;
+  }
+
+  [renderer setFormat:_outputFormat];
+  [self _setupWakeUpForRenderer:renderer];
+  if (![renderer setUp]) {
+    return;
+  }
+
+  [renderer setVolume:[_renderer volume]];
+  [renderer setTrackGain:[_renderer trackGain]];
+  [renderer setAnalyzers:[_renderer analyzers]];
+  [renderer setInterrupted:[_renderer isInterrupted]];
+  [renderer setStartThreshold:[_renderer startThreshold]];
+  [renderer setMetrics:[[streamer fileProvider] metrics]];
+
+  // A running renderer plays out what it has queued first, which takes no
+  // longer than its buffer time.  PCM queued in a stopped one cannot be
+  // played, so the decoder goes back to where playback actually stopped.
+  [self _drainRenderer:_renderer];
+
+  NSInteger playedTime = [streamer timingOffset] + (NSInteger)[_renderer currentTime];
+  [streamer setTimingOffset:playedTime];
+  if ([_renderer queuedTime] > 0 &&
+      [streamer decoder] != nil &&
+      ![streamer isLive] &&
+      ![_mixer isActive]) {
+    if ([streamer status] == DOUAudioStreamerPaused) {
+      if (_frozenTime < 0) {
+        [self _setFrozenTime:playedTime needsSeek:YES];
+      }
+    }
+    else {
+      [[streamer decoder] seekToTime:(NSUInteger)MAX(playedTime, 0)];
+      [_decodeWorker reset];
+      [self _rampUpDecoder:[streamer decoder]];
+    }
+  }
+  _crossfadeBuffer = nil;
+
+  [_renderer stop];
+  [_renderer flush];
+  [_renderer tearDown];
+
+  pthread_mutex_lock(&_mutex);
+  _renderer = renderer;
+  pthread_mutex_unlock(&_mutex);
+}
+
+/*
+ * With a decode-ahead duration set, the current streamer is decoded by
+ * _decodeWorker and this thread only feeds the renderer, never more than it
+ * can take without blocking, so that control events are handled promptly
+ * however slow the codec is.  The worker's status only takes effect once
+ * the PCM decoded before it has been rendered, except for failures.
+ * Streamers primed for gapless playback are still decoded here until they
+ * become current.
+ */
+
+- (NSUInteger)_decodeAheadLength
+{
+  return event_loop_length_for_time(&_outputFormat, [self decodeAheadDuration] * 1000.0);
+}
+
+- (DOUAudioDecoder *)_decoderWithPlaybackItem:(DOUAudioPlaybackItem *)playbackItem
+{
+  return [DOUAudioDecoder decoderWithPlaybackItem:playbackItem
+                                     outputFormat:_outputFormat
+                                       bufferSize:_decoderBufferSize
+                                decodeAheadLength:[self _decodeAheadLength]];
+}
+
+- (DOUAudioDecoderStatus)_decodeAheadWithStreamer:(DOUAudioStreamer *)streamer
+{
+  DOUAudioDecoder *decoder = [streamer decoder];
+  DOUAudioLPCM *lpcm = [decoder lpcm];
+  if ([_decodeWorker decoder] != decoder) {
+    NSUInteger decodeAheadLength = MIN([self _decodeAheadLength], [lpcm capacity] - _decoderBufferSize);
+    [_decodeWorker setDecoder:decoder decodeAheadLength:decodeAheadLength];
+  }
+
+  DOUAudioDecoderStatus status = [_decodeWorker status];
+  if (status == DOUAudioDecoderFailed) {
+    return status;
+  }
+
+  if ([lpcm readableLength] > 0) {
+    return DOUAudioDecoderSucceeded;
+  }
+
+  if (status != DOUAudioDecoderEndEncountered) {
+    [_decodeWorker starve];
+  }
+
+  return status;
+}
+
+- (BOOL)_primeStreamer:(DOUAudioStreamer *)streamer
+{
+  if ([streamer decoder] == nil) {
+    if (streamer == _unprimableStreamer ||
+        [[streamer fileProvider] isFailed] ||
+        ![[streamer fileProvider] isReady]) {
+      return NO;
+    }
+
+    if ([streamer playbackItem] == nil) {
+      DOUAudioPlaybackItem *playbackItem = [DOUAudioPlaybackItem playbackItemWithFileProvider:[streamer fileProvider]];
+      if (![playbackItem open]) {
+        _unprimableStreamer = streamer;
+        return NO;
+      }
+
+      [streamer setPlaybackItem:playbackItem];
+      [streamer setDuration:(NSTimeInterval)[playbackItem estimatedDuration] / 1000.0];
+    }
+
+    DOUAudioDecoder *decoder = [self _decoderWithPlaybackItem:[streamer playbackItem]];
+    if (![decoder setUp]) {
+      _unprimableStreamer = streamer;
+      return NO;
+    }
+
+    [streamer setDecoder:decoder];
+  }
+
+  [[streamer decoder] decodeOnce];
+  return YES;
+}
+
+- (DOUAudioStreamer *)_primeNextStreamerWithStreamer:(DOUAudioStreamer *)streamer
+{
+  if (!([DOUAudioStreamer options] & DOUAudioStreamerGapless)) {
+    return nil;
+  }
+
+  DOUAudioStreamer *nextStreamer = [self nextStreamer];
+  if (nextStreamer == nil) {
+    return nil;
+  }
+
+  if ([nextStreamer decoder] == nil && [streamer duration] > 0.0) {
+    NSTimeInterval remainingTime = [streamer duration] - [self _currentTimeWithStreamer:streamer];
+    if (remainingTime > kDOUAudioEventLoopPrimeTime + [self crossfadeDuration]) {
+      return nextStreamer;
+    }
+  }
+
+  [self _primeStreamer:nextStreamer];
+  [self _prepareTrackGainWithStreamer:nextStreamer];
+  return nextStreamer;
+}
+
+- (void)_spliceNextStreamer:(DOUAudioStreamer *)nextStreamer
+{
+  DOUAudioLPCM *lpcm = [[nextStreamer decoder] lpcm];
+  NSUInteger tailLength = [_crossfadeBuffer readableLength];
+
+  NSMutableData *head = [NSMutableData data];
+  while ([head length] < tailLength) {
+    NSUInteger headLength = [head length];
+    [head setLength:headLength + [lpcm readableLength]];
+    [head setLength:headLength + event_loop_read_lpcm(lpcm, (uint8_t *)[head mutableBytes] + headLength, [lpcm readableLength])];
+
+    if ([head length] >= tailLength ||
+        [[nextStreamer decoder] decodeOnce] != DOUAudioDecoderSucceeded ||
+        [lpcm readableLength] == 0) {
+      break;
+    }
+  }
+
+  NSUInteger fadeLength = MIN(tailLength, [head length]);
+  fadeLength -= fadeLength % _outputFormat.mBytesPerFrame;
+
+  NSUInteger startTime = [_renderer currentTime] + [_renderer queuedTime] + event_loop_time_for_length(&_outputFormat, tailLength - fadeLength);
+  [nextStreamer setTimingOffset:-(NSInteger)startTime];
+
+  [self _drainCrossfadeBufferToLength:fadeLength];
+  if (fadeLength > 0) {
+    NSMutableData *tail = [NSMutableData dataWithLength:fadeLength];
+    event_loop_read_lpcm(_crossfadeBuffer, [tail mutableBytes], fadeLength);
+    event_loop_crossfade((float *)[tail mutableBytes],
+                         (const float *)[head bytes],
+                         fadeLength / _outputFormat.mBytesPerFrame,
+                         _outputFormat.mChannelsPerFrame);
+    [self _outputBytes:[tail bytes] length:fadeLength];
+  }
+
+  if ([head length] > fadeLength) {
+    [self _outputBytes:(const uint8_t *)[head bytes] + fadeLength
+                length:[head length] - fadeLength];
+  }
+}
+
+- (BOOL)_advanceToNextStreamerWithStreamer:(DOUAudioStreamer **)streamer
+{
+  DOUAudioStreamer *nextStreamer = nil;
+  pthread_mutex_lock(&_mutex);
+  if (_currentStreamer == *streamer) {
+    nextStreamer = _nextStreamer;
+  }
+  pthread_mutex_unlock(&_mutex);
+
+  if (nextStreamer == nil) {
+    return NO;
+  }
+
+  BOOL gapless = ([DOUAudioStreamer options] & DOUAudioStreamerGapless) &&
+                 [self _primeStreamer:nextStreamer];
+
+  BOOL advanced = NO;
+  pthread_mutex_lock(&_mutex);
+  if (_currentStreamer == *streamer && _nextStreamer == nextStreamer) {
+    _currentStreamer = nextStreamer;
+    _nextStreamer = nil;
+    advanced = YES;
+  }
+  pthread_mutex_unlock(&_mutex);
+
+  if (!advanced) {
+    return NO;
+  }
+
+  if (gapless) {
+    [self _spliceNextStreamer:nextStreamer];
+  }
+  else if ([_mixer isActive]) {
+    [self _drainCrossfadeBufferToLength:0];
+    [nextStreamer setTimingOffset:-(NSInteger)([_renderer currentTime] + [_renderer queuedTime])];
+  }
+  else {
+    [_renderer stop];
+    [_renderer flush];
+    _crossfadeBuffer = nil;
+    [nextStreamer setTimingOffset:0];
+  }
+
+  [*streamer setDecoder:nil];
+  [*streamer setPlaybackItem:nil];
+  [[*streamer fileProvider] setEventBlock:NULL];
+  [*streamer setStatus:DOUAudioStreamerFinished];
+
+  *streamer = nextStreamer;
+  _unprimableStreamer = nil;
+  [[*streamer fileProvider] setEventBlock:_fileProviderEventBlock];
+  [_renderer setMetrics:[[*streamer fileProvider] metrics]];
+  [*streamer setStatus:DOUAudioStreamerPlaying];
+  return YES;
+}
+
+- (void)_handleStreamer:(DOUAudioStreamer **)streamer
 {
-  if (streamer == nil) {
+  if (*streamer == nil) {
     return;
   }
 
-  if ([streamer status] != DOUAudioStreamerPlaying) {
+  if ([*streamer status] != DOUAudioStreamerPlaying) {
     return;
   }
 
-  if ([[streamer fileProvider] isFailed]) {
-    [streamer setError:[NSError errorWithDomain:kDOUAudioStreamerErrorDomain
+  if ([[*streamer fileProvider] isFailed]) {
+    [*streamer setError:[NSError errorWithDomain:kDOUAudioStreamerErrorDomain
                                            code:DOUAudioStreamerNetworkError
                                        userInfo:nil]];
-    [streamer setStatus:DOUAudioStreamerError];
+    [*streamer setStatus:DOUAudioStreamerError];
     return;
   }
 
-  if (![[streamer fileProvider] isReady]) {
-    [streamer setStatus:DOUAudioStreamerBuffering];
+  if (![[*streamer fileProvider] isReady]) {
+    [[DOUAudioPrefetcher sharedPrefetcher] reportPlaybackBufferedTime:0];
+    [*streamer setStatus:DOUAudioStreamerBuffering];
     return;
   }
 
-  if ([streamer playbackItem] == nil) {
-    [streamer setPlaybackItem:[DOUAudioPlaybackItem playbackItemWithFileProvider:[streamer fileProvider]]];
-    if (![[streamer playbackItem] open]) {
-      [streamer setError:[NSError errorWithDomain:kDOUAudioStreamerErrorDomain
+  if ([*streamer playbackItem] == nil) {
+    [*streamer setPlaybackItem:[DOUAudioPlaybackItem playbackItemWithFileProvider:[*streamer fileProvider]]];
+    if (![[*streamer playbackItem] open]) {
+      [*streamer setError:[NSError errorWithDomain:kDOUAudioStreamerErrorDomain
                                              code:DOUAudioStreamerDecodingError
                                          userInfo:nil]];
-      [streamer setStatus:DOUAudioStreamerError];
+      [*streamer setStatus:DOUAudioStreamerError];
       return;
     }
 
-    [streamer setDuration:(NSTimeInterval)[[streamer playbackItem] estimatedDuration] / 1000.0];
+    [*streamer setDuration:(NSTimeInterval)[[*streamer playbackItem] estimatedDuration] / 1000.0];
   }
 
-  if ([streamer decoder] == nil) {
-    [streamer setDecoder:[DOUAudioDecoder decoderWithPlaybackItem:[streamer playbackItem]
-                                                       bufferSize:_decoderBufferSize]];
-    if (![[streamer decoder] setUp]) {
-      [streamer setError:[NSError errorWithDomain:kDOUAudioStreamerErrorDomain
+  if ([*streamer decoder] == nil) {
+    [self _negotiateOutputFormatWithPlaybackItem:[*streamer playbackItem]];
+    [*streamer setDecoder:[self _decoderWithPlaybackItem:[*streamer playbackItem]]];
+    if (![[*streamer decoder] setUp]) {
+      [*streamer setError:[NSError errorWithDomain:kDOUAudioStreamerErrorDomain
                                              code:DOUAudioStreamerDecodingError
                                          userInfo:nil]];
-      [streamer setStatus:DOUAudioStreamerError];
+      [*streamer setStatus:DOUAudioStreamerError];
       return;
     }
+
+    [self _rampUpDecoder:[*streamer decoder]];
   }
 
-  switch ([[streamer decoder] decodeOnce]) {
+  BOOL decodingAhead = [self _decodeAheadLength] > 0;
+  DOUAudioDecoderStatus status;
+  if (decodingAhead) {
+    status = [self _decodeAheadWithStreamer:*streamer];
+  }
+  else {
+    if ([_decodeWorker decoder] != nil) {
+      [_decodeWorker setDecoder:nil decodeAheadLength:0];
+    }
+
+    status = [[*streamer decoder] decodeOnce];
+  }
+
+  switch (status) {
   case DOUAudioDecoderSucceeded:
     break;
 
   case DOUAudioDecoderFailed:
-    [streamer setError:[NSError errorWithDomain:kDOUAudioStreamerErrorDomain
+    [*streamer setError:[NSError errorWithDomain:kDOUAudioStreamerErrorDomain
                                            code:DOUAudioStreamerDecodingError
                                        userInfo:nil]];
-    [streamer setStatus:DOUAudioStreamerError];
+    [*streamer setStatus:DOUAudioStreamerError];
     return;
 
   case DOUAudioDecoderEndEncountered:
-    [_renderer stop];
-    [streamer setDecoder:nil];
-    [streamer setPlaybackItem:nil];
-    [streamer setStatus:DOUAudioStreamerFinished];
+    [[DOUAudioPrefetcher sharedPrefetcher] reportPlaybackBufferedTime:NSUIntegerMax];
+    if ([self _advanceToNextStreamerWithStreamer:streamer]) {
+      return;
+    }
+
+    [self _drainCrossfadeBufferToLength:0];
+    if (![_mixer isActive]) {
+      [_renderer stop];
+    }
+    [_decodeWorker setDecoder:nil decodeAheadLength:0];
+    [*streamer setDecoder:nil];
+    [*streamer setPlaybackItem:nil];
+    [*streamer setStatus:DOUAudioStreamerFinished];
     return;
 
   case DOUAudioDecoderWaiting:
-    [streamer setStatus:DOUAudioStreamerBuffering];
+    [[DOUAudioPrefetcher sharedPrefetcher] reportPlaybackBufferedTime:0];
+    [*streamer setStatus:DOUAudioStreamerBuffering];
     return;
   }
 
-  void *bytes = NULL;
+  [[DOUAudioPrefetcher sharedPrefetcher] reportPlaybackBufferedTime:[[*streamer decoder] bufferedTime]];
+
+  DOUAudioStreamer *nextStreamer = [self _primeNextStreamerWithStreamer:*streamer];
+  NSUInteger holdbackLength = 0;
+  if (nextStreamer != nil && [nextStreamer decoder] != nil) {
+    holdbackLength = event_loop_length_for_time(&_outputFormat, [self crossfadeDuration] * 1000.0);
+  }
+
+  [self _updateTrackGainWithStreamer:*streamer];
+
+  DOUAudioLPCM *lpcm = [[*streamer decoder] lpcm];
+  if ([lpcm readableLength] > 0) {
+    [self _thawStreamer:*streamer];
+  }
+
+  const void *bytes = NULL;
   NSUInteger length = 0;
-  [[[streamer decoder] lpcm] readBytes:&bytes length:&length];
-  if (bytes != NULL) {
-    [_renderer renderBytes:bytes length:length];
-    free(bytes);
+  while ([lpcm borrowBytes:&bytes length:&length] && length > 0) {
+    if (decodingAhead) {
+      length = MIN(length, _decoderBufferSize);
+      if (![self _isRendererWritableForLength:length]) {
+        break;
+      }
+    }
+
+    [self _renderBytes:bytes length:length holdbackLength:holdbackLength];
+    [lpcm commitLength:length];
   }
+
+  if (decodingAhead) {
+    [_decodeWorker signal];
+  }
+
+  [self _updateTimeToFirstAudioWithStreamer:*streamer];
 }
 
 - (void)_eventLoop
@@ -504,6 +1280,7 @@ static void audio_route_change_listener(void *inClientData,
 
   while (1) {
     @autoreleasepool {
+      BOOL mixing = [_mixer isActive];
       if (streamer != nil) {
         switch ([streamer status]) {
         case DOUAudioStreamerPaused:
@@ -511,7 +1288,8 @@ static void audio_route_change_listener(void *inClientData,
         case DOUAudioStreamerFinished:
         case DOUAudioStreamerBuffering:
         case DOUAudioStreamerError:
-          if (![self _handleEvent:[self _waitForEvent]
+          if (!mixing &&
+              ![self _handleEvent:[self _waitForEvent]
                      withStreamer:&streamer]) {
             return;
           }
@@ -522,20 +1300,28 @@ static void audio_route_change_listener(void *inClientData,
         }
       }
       else {
-        if (![self _handleEvent:[self _waitForEvent]
+        if (!mixing &&
+            ![self _handleEvent:[self _waitForEvent]
                    withStreamer:&streamer]) {
           return;
         }
       }
 
-      if (![self _handleEvent:[self _waitForEventWithTimeout:0]
-                 withStreamer:&streamer]) {
+      NSUInteger timeout = [self _eventTimeoutWithStreamer:streamer];
+      event_type event = [self _waitForEventWithTimeout:timeout];
+      if (![self _handleEvent:event withStreamer:&streamer]) {
         return;
       }
 
+      if (timeout != 0 && event != event_timeout) {
+        continue;
+      }
+
       if (streamer != nil) {
-        [self _handleStreamer:streamer];
+        [self _handleStreamer:&streamer];
       }
+
+      [self _handleMixerWithStreamer:&streamer];
     }
   }
 }
@@ -568,17 +1354,134 @@ static void *event_loop_main(void *info)
   pthread_attr_destroy(&attr);
 }
 
+- (DOUAudioStreamer *)currentStreamer
+{
+  pthread_mutex_lock(&_mutex);
+  DOUAudioStreamer *currentStreamer = _currentStreamer;
+  pthread_mutex_unlock(&_mutex);
+
+  return currentStreamer;
+}
+
 - (void)setCurrentStreamer:(DOUAudioStreamer *)currentStreamer
 {
+  BOOL changed = NO;
+
+  pthread_mutex_lock(&_mutex);
   if (_currentStreamer != currentStreamer) {
     _currentStreamer = currentStreamer;
+    _nextStreamer = nil;
+    changed = YES;
+  }
+  pthread_mutex_unlock(&_mutex);
+
+  if (changed) {
     [self _sendEvent:event_streamer_changed];
   }
 }
 
+- (DOUAudioStreamer *)nextStreamer
+{
+  pthread_mutex_lock(&_mutex);
+  DOUAudioStreamer *nextStreamer = _nextStreamer;
+  pthread_mutex_unlock(&_mutex);
+
+  return nextStreamer;
+}
+
+- (void)setNextStreamer:(DOUAudioStreamer *)nextStreamer
+{
+  pthread_mutex_lock(&_mutex);
+  _nextStreamer = nextStreamer != _currentStreamer ? nextStreamer : nil;
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (NSTimeInterval)crossfadeDuration
+{
+  pthread_mutex_lock(&_mutex);
+  NSTimeInterval crossfadeDuration = _crossfadeDuration;
+  pthread_mutex_unlock(&_mutex);
+
+  return crossfadeDuration;
+}
+
+- (void)setCrossfadeDuration:(NSTimeInterval)crossfadeDuration
+{
+  pthread_mutex_lock(&_mutex);
+  _crossfadeDuration = MAX(crossfadeDuration, 0.0);
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (NSTimeInterval)fastStartThreshold
+{
+  pthread_mutex_lock(&_mutex);
+  NSTimeInterval fastStartThreshold = _fastStartThreshold;
+  pthread_mutex_unlock(&_mutex);
+
+  return fastStartThreshold;
+}
+
+- (void)setFastStartThreshold:(NSTimeInterval)fastStartThreshold
+{
+  pthread_mutex_lock(&_mutex);
+  _fastStartThreshold = MAX(fastStartThreshold, 0.0);
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (NSTimeInterval)decodeAheadDuration
+{
+  pthread_mutex_lock(&_mutex);
+  NSTimeInterval decodeAheadDuration = _decodeAheadDuration;
+  pthread_mutex_unlock(&_mutex);
+
+  return decodeAheadDuration;
+}
+
+- (void)setDecodeAheadDuration:(NSTimeInterval)decodeAheadDuration
+{
+  pthread_mutex_lock(&_mutex);
+  _decodeAheadDuration = MAX(decodeAheadDuration, 0.0);
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (id <DOUAudioRendering>)renderer
+{
+  pthread_mutex_lock(&_mutex);
+  id <DOUAudioRendering> renderer = _renderer;
+  pthread_mutex_unlock(&_mutex);
+
+  return renderer;
+}
+
+- (void)setRenderer:(id <DOUAudioRendering>)renderer
+{
+  if (renderer == nil) {
+    renderer = [DOUAudioRenderer rendererWithBufferTime:kDOUAudioStreamerBufferTime];
+  }
+
+  pthread_mutex_lock(&_mutex);
+  _pendingRenderer = renderer;
+  pthread_mutex_unlock(&_mutex);
+
+  [self _sendEvent:event_renderer_changed];
+}
+
+- (NSTimeInterval)_currentTimeWithStreamer:(DOUAudioStreamer *)streamer
+{
+  NSInteger milliseconds = [streamer timingOffset] + (NSInteger)[[self renderer] currentTime];
+
+  pthread_mutex_lock(&_mutex);
+  if (streamer == _currentStreamer && _frozenTime >= 0) {
+    milliseconds = MIN(milliseconds, _frozenTime);
+  }
+  pthread_mutex_unlock(&_mutex);
+
+  return (NSTimeInterval)MAX(milliseconds, 0) / 1000.0;
+}
+
 - (NSTimeInterval)currentTime
 {
-  return (NSTimeInterval)((NSUInteger)[[self currentStreamer] timingOffset] + [_renderer currentTime]) / 1000.0;
+  return [self _currentTimeWithStreamer:[self currentStreamer]];
 }
 
 - (void)setCurrentTime:(NSTimeInterval)currentTime
@@ -587,14 +1490,46 @@ static void *event_loop_main(void *info)
   [self _sendEvent:event_seek userData:(void *)(uintptr_t)milliseconds];
 }
 
+- (void)mixStreamer:(DOUAudioStreamer *)streamer afterDelay:(NSTimeInterval)delay
+{
+  if (streamer == nil || streamer == [self currentStreamer]) {
+    return;
+  }
+
+  [_mixer addStreamer:streamer delay:delay];
+  [self _sendEvent:event_mixer_changed];
+}
+
+- (void)pauseMixingStreamer:(DOUAudioStreamer *)streamer
+{
+  [_mixer pauseStreamer:streamer];
+  [self _sendEvent:event_mixer_changed];
+}
+
+- (void)removeMixingStreamer:(DOUAudioStreamer *)streamer
+{
+  [_mixer removeStreamer:streamer];
+  [self _sendEvent:event_mixer_changed];
+}
+
+- (BOOL)isMixingStreamer:(DOUAudioStreamer *)streamer
+{
+  return [_mixer containsStreamer:streamer];
+}
+
+- (NSTimeInterval)currentTimeForMixingStreamer:(DOUAudioStreamer *)streamer
+{
+  return [_mixer currentTimeForStreamer:streamer];
+}
+
 - (double)volume
 {
-  return [_renderer volume];
+  return [[self renderer] volume];
 }
 
 - (void)setVolume:(double)volume
 {
-  [_renderer setVolume:volume];
+  [[self renderer] setVolume:volume];
 
   if ([DOUAudioStreamer options] & DOUAudioStreamerKeepPersistentVolume) {
     [[NSUserDefaults standardUserDefaults] setDouble:volume
@@ -621,7 +1556,7 @@ static void *event_loop_main(void *info)
 {
   if (aSelector == @selector(analyzers) ||
       aSelector == @selector(setAnalyzers:)) {
-    return _renderer;
+    return [self renderer];
   }
 
   return [super forwardingTargetForSelector:aSelector];
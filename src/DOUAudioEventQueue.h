@@ -0,0 +1,51 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "DOUAudioBase.h"
+
+/*
+ * A queue of control events for a single consumer thread.  Events are small
+ * integers and carry one pointer-sized value.  An event that is posted again
+ * before it has been taken replaces the pending one and moves to the back
+ * of the queue, so a burst of seeks collapses into the last of them while
+ * the order between different events is kept.
+ *
+ * The consumer blocks on a single kernel object, a kqueue on Darwin and an
+ * epoll instance watching an eventfd on Linux, which is also signalled by
+ * dou_audio_event_queue_wake_up() when something other than an event (such
+ * as free space in the renderer) is worth waking up for.  That function is
+ * plain C and takes no lock, but it does make a non-blocking syscall
+ * (kevent on Darwin, write on Linux), so the render callback only calls it
+ * when the producer asked to be told.  Taking an event when one is already
+ * pending never enters the kernel.
+ */
+
+@interface DOUAudioEventQueue : NSObject
+
++ (NSUInteger)maximumEventCount;
+
+- (void)postEvent:(NSUInteger)event userData:(void *)userData;
+- (void)wakeUp;
+
+- (BOOL)takeEvent:(NSUInteger *)event userData:(void **)userData;
+- (BOOL)waitForEvent:(NSUInteger *)event
+            userData:(void **)userData
+             timeout:(NSUInteger)timeout;
+
+@end
+
+DOUAS_EXTERN void dou_audio_event_queue_wake_up(void *eventQueue);
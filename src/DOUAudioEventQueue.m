@@ -0,0 +1,308 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioEventQueue.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+
+#if defined(__linux__)
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#else /* defined(__linux__) */
+#include <sys/event.h>
+#include <mach/mach_time.h>
+#endif /* defined(__linux__) */
+
+#define kDOUAudioEventQueueMaximumEventCount 64
+
+typedef struct {
+  int fd;
+#if defined(__linux__)
+  int eventFD;
+#endif /* defined(__linux__) */
+} event_queue_backend;
+
+static BOOL event_queue_backend_open(event_queue_backend *backend)
+{
+#if defined(__linux__)
+  backend->fd = epoll_create1(EPOLL_CLOEXEC);
+  if (backend->fd < 0) {
+    return NO;
+  }
+
+  backend->eventFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (backend->eventFD < 0) {
+    close(backend->fd);
+    return NO;
+  }
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = backend->eventFD;
+  if (epoll_ctl(backend->fd, EPOLL_CTL_ADD, backend->eventFD, &ev) != 0) {
+    close(backend->eventFD);
+    close(backend->fd);
+    return NO;
+  }
+#else /* defined(__linux__) */
+  backend->fd = kqueue();
+  if (backend->fd < 0) {
+    return NO;
+  }
+
+  struct kevent kev;
+  EV_SET(&kev, 0, EVFILT_USER, EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, NULL);
+  if (kevent(backend->fd, &kev, 1, NULL, 0, NULL) != 0) {
+    close(backend->fd);
+    return NO;
+  }
+#endif /* defined(__linux__) */
+
+  return YES;
+}
+
+static void event_queue_backend_close(event_queue_backend *backend)
+{
+#if defined(__linux__)
+  close(backend->eventFD);
+#endif /* defined(__linux__) */
+  close(backend->fd);
+}
+
+static void event_queue_backend_signal(event_queue_backend *backend)
+{
+#if defined(__linux__)
+  uint64_t value = 1;
+  ssize_t written __attribute__((unused)) = write(backend->eventFD, &value, sizeof(value));
+#else /* defined(__linux__) */
+  struct kevent kev;
+  EV_SET(&kev, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, NULL);
+  kevent(backend->fd, &kev, 1, NULL, 0, NULL);
+#endif /* defined(__linux__) */
+}
+
+/*
+ * Returns NO only when the timeout (in milliseconds, NSUIntegerMax for none)
+ * expires.  Interrupted waits count as wake-ups and are sorted out by the
+ * caller.
+ */
+static BOOL event_queue_backend_wait(event_queue_backend *backend, NSUInteger timeout)
+{
+#if defined(__linux__)
+  int milliseconds = -1;
+  if (timeout != NSUIntegerMax) {
+    milliseconds = (int)MIN(timeout, (NSUInteger)INT32_MAX);
+  }
+
+  struct epoll_event ev;
+  int n = epoll_wait(backend->fd, &ev, 1, milliseconds);
+  if (n > 0) {
+    uint64_t value;
+    ssize_t count __attribute__((unused)) = read(backend->eventFD, &value, sizeof(value));
+    return YES;
+  }
+
+  return n < 0 && errno == EINTR;
+#else /* defined(__linux__) */
+  struct timespec _ts;
+  struct timespec *ts = NULL;
+  if (timeout != NSUIntegerMax) {
+    ts = &_ts;
+
+    ts->tv_sec = (time_t)(timeout / 1000);
+    ts->tv_nsec = (long)(timeout % 1000) * 1000000;
+  }
+
+  struct kevent kev;
+  int n = kevent(backend->fd, NULL, 0, &kev, 1, ts);
+  if (n > 0) {
+    return YES;
+  }
+
+  return n < 0 && errno == EINTR;
+#endif /* defined(__linux__) */
+}
+
+/*
+ * Milliseconds on a monotonic clock.  clock_gettime() only appeared in
+ * iOS 10 and OS X 10.12, so Darwin goes through the host time instead.
+ */
+
+static uint64_t event_queue_now(void)
+{
+#if defined(__linux__)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#else /* defined(__linux__) */
+  static double conversion;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    mach_timebase_info_data_t info;
+    mach_timebase_info(&info);
+    conversion = 1.0e-6 * info.numer / info.denom;
+  });
+
+  return (uint64_t)(mach_absolute_time() * conversion);
+#endif /* defined(__linux__) */
+}
+
+@interface DOUAudioEventQueue () {
+@private
+  pthread_mutex_t _mutex;
+  event_queue_backend _backend;
+  atomic_bool _wokenUp;
+
+  uint64_t _pendingMask;
+  NSUInteger _pendingEvents[kDOUAudioEventQueueMaximumEventCount];
+  NSUInteger _pendingCount;
+  void *_userData[kDOUAudioEventQueueMaximumEventCount];
+}
+@end
+
+@implementation DOUAudioEventQueue
+
++ (NSUInteger)maximumEventCount
+{
+  return kDOUAudioEventQueueMaximumEventCount;
+}
+
+- (instancetype)init
+{
+  self = [super init];
+  if (self) {
+    if (!event_queue_backend_open(&_backend)) {
+      return nil;
+    }
+
+    pthread_mutex_init(&_mutex, NULL);
+    atomic_init(&_wokenUp, false);
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  event_queue_backend_close(&_backend);
+  pthread_mutex_destroy(&_mutex);
+}
+
+- (void)postEvent:(NSUInteger)event userData:(void *)userData
+{
+  NSAssert(event < kDOUAudioEventQueueMaximumEventCount, @"event out of range");
+
+  pthread_mutex_lock(&_mutex);
+  const BOOL wasEmpty = (_pendingCount == 0);
+
+  if (_pendingMask & (1ULL << event)) {
+    for (NSUInteger i = 0; i < _pendingCount; ++i) {
+      if (_pendingEvents[i] == event) {
+        memmove(_pendingEvents + i, _pendingEvents + i + 1, (_pendingCount - i - 1) * sizeof(NSUInteger));
+        _pendingCount--;
+        break;
+      }
+    }
+  }
+
+  _pendingEvents[_pendingCount++] = event;
+  _pendingMask |= (1ULL << event);
+  _userData[event] = userData;
+  pthread_mutex_unlock(&_mutex);
+
+  if (wasEmpty) {
+    event_queue_backend_signal(&_backend);
+  }
+}
+
+- (void)wakeUp
+{
+  dou_audio_event_queue_wake_up((__bridge void *)self);
+}
+
+void dou_audio_event_queue_wake_up(void *eventQueue)
+{
+  __unsafe_unretained DOUAudioEventQueue *queue = (__bridge DOUAudioEventQueue *)eventQueue;
+  atomic_store_explicit(&queue->_wokenUp, true, memory_order_release);
+  event_queue_backend_signal(&queue->_backend);
+}
+
+- (BOOL)takeEvent:(NSUInteger *)event userData:(void **)userData
+{
+  pthread_mutex_lock(&_mutex);
+  if (_pendingCount == 0) {
+    pthread_mutex_unlock(&_mutex);
+    return NO;
+  }
+
+  NSUInteger first = _pendingEvents[0];
+  memmove(_pendingEvents, _pendingEvents + 1, (_pendingCount - 1) * sizeof(NSUInteger));
+  _pendingCount--;
+  _pendingMask &= ~(1ULL << first);
+
+  *event = first;
+  if (userData != NULL) {
+    *userData = _userData[first];
+  }
+  _userData[first] = NULL;
+  pthread_mutex_unlock(&_mutex);
+
+  return YES;
+}
+
+- (BOOL)waitForEvent:(NSUInteger *)event
+            userData:(void **)userData
+             timeout:(NSUInteger)timeout
+{
+  if ([self takeEvent:event userData:userData]) {
+    return YES;
+  }
+
+  if (timeout == 0) {
+    return NO;
+  }
+
+  uint64_t deadline = 0;
+  if (timeout != NSUIntegerMax) {
+    deadline = event_queue_now() + timeout;
+  }
+
+  while (1) {
+    NSUInteger remaining = NSUIntegerMax;
+    if (deadline != 0) {
+      uint64_t now = event_queue_now();
+      if (now >= deadline) {
+        return NO;
+      }
+      remaining = (NSUInteger)(deadline - now);
+    }
+
+    BOOL signalled = event_queue_backend_wait(&_backend, remaining);
+    if ([self takeEvent:event userData:userData]) {
+      return YES;
+    }
+
+    if (!signalled ||
+        atomic_exchange_explicit(&_wokenUp, false, memory_order_acquire)) {
+      return NO;
+    }
+  }
+}
+
+@end
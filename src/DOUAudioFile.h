@@ -28,5 +28,7 @@
 
 - (NSString *)audioFileHost;
 - (DOUAudioFilePreprocessor *)audioFilePreprocessor;
+- (double)audioFileReplayGain;
+- (BOOL)audioFileIsLive;
 
 @end
@@ -16,8 +16,25 @@
 
 #import <Foundation/Foundation.h>
 
+/*
+ * Transforms the bytes of an audio file as they are read, before Core Audio
+ * parses them.  Subclasses override -processBytes:length:offset:, which
+ * works in place on the caller's buffer; offset is the position of the
+ * first byte in the file, so stream ciphers can seek directly to it.  The
+ * default implementation forwards to -handleData:offset:, the older
+ * interface that returns a new NSData for every read.
+ *
+ * With cachesProcessedData set, the output is kept in memory, never on
+ * disk, in a bounded set of blocks around the reads, so repeated reads of
+ * the same region are served from there.  Blocks left behind by playback
+ * are dropped and processed again if they are ever read again.
+ */
+
 @interface DOUAudioFilePreprocessor : NSObject
 
+@property (nonatomic, assign) BOOL cachesProcessedData;
+
+- (void)processBytes:(void *)bytes length:(NSUInteger)length offset:(NSUInteger)offset;
 - (NSData *)handleData:(NSData *)data offset:(NSUInteger)offset;
 
 @end
@@ -18,6 +18,19 @@
 
 @implementation DOUAudioFilePreprocessor
 
+@synthesize cachesProcessedData = _cachesProcessedData;
+
+- (void)processBytes:(void *)bytes length:(NSUInteger)length offset:(NSUInteger)offset
+{
+  NSData *input = [NSData dataWithBytesNoCopy:bytes
+                                       length:length
+                                 freeWhenDone:NO];
+  NSData *output = [self handleData:input offset:offset];
+  if ([output bytes] != bytes) {
+    memcpy(bytes, [output bytes], MIN([output length], length));
+  }
+}
+
 - (NSData *)handleData:(NSData *)data offset:(NSUInteger)offset
 {
   [self doesNotRecognizeSelector:_cmd];
@@ -17,12 +17,20 @@
 #import <Foundation/Foundation.h>
 #import "DOUAudioFile.h"
 
+@class DOUAudioMetrics;
+@class DOUAudioCacheStore;
+@class DOUAudioPacketRing;
+
 typedef void (^DOUAudioFileProviderEventBlock)(void);
 
 @interface DOUAudioFileProvider : NSObject
 
 + (instancetype)fileProviderWithAudioFile:(id <DOUAudioFile>)audioFile;
++ (instancetype)completedFileProviderWithAudioFile:(id <DOUAudioFile>)audioFile;
++ (instancetype)prefetchingFileProviderWithAudioFile:(id <DOUAudioFile>)audioFile
+                                            duration:(NSTimeInterval)duration;
 + (void)setHintWithAudioFile:(id <DOUAudioFile>)audioFile;
++ (void)setHintsWithAudioFiles:(NSArray *)audioFiles;
 
 @property (nonatomic, readonly) id <DOUAudioFile> audioFile;
 @property (nonatomic, copy) DOUAudioFileProviderEventBlock eventBlock;
@@ -34,14 +42,33 @@ typedef void (^DOUAudioFileProviderEventBlock)(void);
 @property (nonatomic, readonly) NSString *fileExtension;
 @property (nonatomic, readonly) NSString *sha256;
 
-@property (nonatomic, readonly) NSData *mappedData;
+@property (nonatomic, readonly) DOUAudioCacheStore *store;
+
+@property (nonatomic, readonly, getter=isLive) BOOL live;
+@property (nonatomic, readonly) DOUAudioPacketRing *packetRing;
+@property (nonatomic, readonly) NSDictionary *metadata;
 
 @property (nonatomic, readonly) NSUInteger expectedLength;
 @property (nonatomic, readonly) NSUInteger receivedLength;
 @property (nonatomic, readonly) NSUInteger downloadSpeed;
+@property (nonatomic, readonly) double estimatedThroughput;
+@property (nonatomic, readonly) double throughputDeviation;
+
+@property (nonatomic, readonly) DOUAudioMetrics *metrics;
 
 @property (nonatomic, readonly, getter=isFailed) BOOL failed;
 @property (nonatomic, readonly, getter=isReady) BOOL ready;
 @property (nonatomic, readonly, getter=isFinished) BOOL finished;
 
+- (NSUInteger)availableLengthFromOffset:(NSUInteger)offset;
+- (void)seekToOffset:(NSUInteger)offset;
+
+@property (nonatomic, assign) NSTimeInterval prefetchDuration;
+@property (nonatomic, assign) NSUInteger maximumDownloadSpeed;
+@property (nonatomic, readonly, getter=isPrefetched) BOOL prefetched;
+@property (nonatomic, readonly, getter=isSuspended) BOOL suspended;
+
+- (void)suspend;
+- (void)resume;
+
 @end
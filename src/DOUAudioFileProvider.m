@@ -15,11 +15,17 @@
  */
 
 #import "DOUAudioFileProvider.h"
+#import "DOUAudioCache.h"
+#import "DOUAudioPrefetcher.h"
+#import "DOUAudioThroughputEstimator.h"
+#import "DOUAudioMetrics.h"
 #import "DOUSimpleHTTPRequest.h"
-#import "NSData+DOUAudioMappedFile.h"
+#import "DOUAudioCacheStore.h"
+#import "DOUAudioPacketRing.h"
 #import "DOUAudioStreamer+Options.h"
 #include <CommonCrypto/CommonDigest.h>
 #include <AudioToolbox/AudioToolbox.h>
+#include <mach/mach_time.h>
 
 #if TARGET_OS_IPHONE
 #include <MobileCoreServices/MobileCoreServices.h>
@@ -31,10 +37,6 @@
 #import "DOUMPMediaLibraryAssetLoader.h"
 #endif /* TARGET_OS_IPHONE */
 
-static id <DOUAudioFile> gHintFile = nil;
-static DOUAudioFileProvider *gHintProvider = nil;
-static BOOL gLastProviderIsFinished = NO;
-
 @interface DOUAudioFileProvider () {
 @protected
   id <DOUAudioFile> _audioFile;
@@ -44,9 +46,10 @@ static BOOL gLastProviderIsFinished = NO;
   NSString *_mimeType;
   NSString *_fileExtension;
   NSString *_sha256;
-  NSData *_mappedData;
+  DOUAudioCacheStore *_store;
   NSUInteger _expectedLength;
   NSUInteger _receivedLength;
+  DOUAudioMetrics *_metrics;
   BOOL _failed;
 }
 
@@ -55,6 +58,10 @@ static BOOL gLastProviderIsFinished = NO;
 @end
 
 @interface _DOUAudioLocalFileProvider : DOUAudioFileProvider
+- (instancetype)_initWithAudioFile:(id <DOUAudioFile>)audioFile cachedURL:(NSURL *)cachedURL;
+@end
+
+@interface _DOUAudioCachedFileProvider : _DOUAudioLocalFileProvider
 @end
 
 @interface _DOUAudioRemoteFileProvider : DOUAudioFileProvider {
@@ -63,15 +70,59 @@ static BOOL gLastProviderIsFinished = NO;
   NSURL *_audioFileURL;
   NSString *_audioFileHost;
 
+  NSString *_rangesPath;
+  NSMutableIndexSet *_receivedRanges;
+  NSString *_validator;
+  NSUInteger _writeOffset;
+  NSUInteger _syncOffset;
+  NSUInteger _retryCount;
+  BOOL _acceptsRanges;
+  BOOL _growable;
+  BOOL _entityValidated;
+
+  DOUAudioThroughputEstimator *_throughputEstimator;
+  uint64_t _requestStartHostTime;
+
+  NSTimeInterval _prefetchDuration;
+  NSUInteger _prefetchLength;
+  NSUInteger _maximumDownloadSpeed;
+  BOOL _prefetched;
+  BOOL _suspended;
+
+  dispatch_queue_t _consumerQueue;
+  NSUInteger _consumedLength;
+  BOOL _consumerScheduled;
+  BOOL _consumerNeedsReset;
+
   CC_SHA256_CTX *_sha256Ctx;
 
   AudioFileStreamID _audioFileStreamID;
+  SInt64 _audioDataOffset;
+  UInt32 _audioBitRate;
   BOOL _requiresCompleteFile;
   BOOL _readyToProducePackets;
   BOOL _requestCompleted;
 }
 @end
 
+@interface _DOUAudioLiveFileProvider : DOUAudioFileProvider {
+@private
+  DOUSimpleHTTPRequest *_request;
+  NSURL *_audioFileURL;
+  NSString *_audioFileHost;
+
+  NSUInteger _metadataInterval;
+  NSUInteger _audioBytesRemaining;
+  NSUInteger _metadataBytesRemaining;
+  NSMutableData *_metadataBuffer;
+  NSDictionary *_metadata;
+
+  AudioFileStreamID _audioFileStreamID;
+  DOUAudioPacketRing *_packetRing;
+  BOOL _requestCompleted;
+}
+@end
+
 #if TARGET_OS_IPHONE
 @interface _DOUAudioMediaLibraryFileProvider : DOUAudioFileProvider {
 @private
@@ -86,10 +137,15 @@ static BOOL gLastProviderIsFinished = NO;
 @implementation _DOUAudioLocalFileProvider
 
 - (instancetype)_initWithAudioFile:(id <DOUAudioFile>)audioFile
+{
+  return [self _initWithAudioFile:audioFile cachedURL:[audioFile audioFileURL]];
+}
+
+- (instancetype)_initWithAudioFile:(id <DOUAudioFile>)audioFile cachedURL:(NSURL *)cachedURL
 {
   self = [super _initWithAudioFile:audioFile];
   if (self) {
-    _cachedURL = [audioFile audioFileURL];
+    _cachedURL = cachedURL;
     _cachedPath = [_cachedURL path];
 
     BOOL isDirectory = NO;
@@ -99,9 +155,9 @@ static BOOL gLastProviderIsFinished = NO;
       return nil;
     }
 
-    _mappedData = [NSData dou_dataWithMappedContentsOfFile:_cachedPath];
-    _expectedLength = [_mappedData length];
-    _receivedLength = [_mappedData length];
+    _store = [DOUAudioCacheStore storeWithContentsOfFile:_cachedPath modifiable:NO];
+    _expectedLength = [_store length];
+    _receivedLength = [_store length];
   }
 
   return self;
@@ -134,9 +190,15 @@ static BOOL gLastProviderIsFinished = NO;
 {
   if (_sha256 == nil &&
       [DOUAudioStreamer options] & DOUAudioStreamerRequireSHA256 &&
-      [self mappedData] != nil) {
+      [self store] != nil) {
+    CC_SHA256_CTX ctx;
+    CC_SHA256_Init(&ctx);
+    [[self store] enumerateBytesInRange:NSMakeRange(0, [[self store] length]) usingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+      CC_SHA256_Update(&ctx, bytes, (CC_LONG)byteRange.length);
+    }];
+
     unsigned char hash[CC_SHA256_DIGEST_LENGTH];
-    CC_SHA256([[self mappedData] bytes], (CC_LONG)[[self mappedData] length], hash);
+    CC_SHA256_Final(hash, &ctx);
 
     NSMutableString *result = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
     for (size_t i = 0; i < CC_SHA256_DIGEST_LENGTH; ++i) {
@@ -166,8 +228,61 @@ static BOOL gLastProviderIsFinished = NO;
 
 @end
 
+#pragma mark - Concrete Audio Cached File Provider
+
+@implementation _DOUAudioCachedFileProvider
+
+- (instancetype)_initWithAudioFile:(id <DOUAudioFile>)audioFile
+{
+  NSURL *audioFileURL = [audioFile audioFileURL];
+  [[DOUAudioCache sharedCache] beginAccessForURL:audioFileURL];
+
+  NSString *cachedPath = [[DOUAudioCache sharedCache] completedPathForURL:audioFileURL];
+  if (cachedPath == nil) {
+    [[DOUAudioCache sharedCache] endAccessForURL:audioFileURL];
+    return nil;
+  }
+
+  self = [super _initWithAudioFile:audioFile cachedURL:[NSURL fileURLWithPath:cachedPath]];
+  if (self) {
+    _mimeType = [[DOUAudioCache sharedCache] mimeTypeForURL:audioFileURL];
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  if (_audioFile != nil) {
+    [[DOUAudioCache sharedCache] endAccessForURL:[_audioFile audioFileURL]];
+  }
+}
+
+@end
+
 #pragma mark - Concrete Audio Remote File Provider
 
+static const NSUInteger kDOUAudioRemoteFileProviderMaxRetries = 3;
+static const NSUInteger kDOUAudioRemoteFileProviderSeekThreshold = 64 * 1024;
+static const UInt32 kDOUAudioRemoteFileProviderFallbackBitRate = 320000;
+static const NSUInteger kDOUAudioRemoteFileProviderSyncLength = 1024 * 1024;
+
+static NSRange provider_range_containing_index(NSIndexSet *indexes, NSUInteger index)
+{
+  __block NSRange result = NSMakeRange(NSNotFound, 0);
+  [indexes enumerateRangesUsingBlock:^(NSRange range, BOOL *stop) {
+    if (NSLocationInRange(index, range)) {
+      result = range;
+      *stop = YES;
+    }
+    else if (range.location > index) {
+      *stop = YES;
+    }
+  }];
+
+  return result;
+}
+
 @implementation _DOUAudioRemoteFileProvider
 
 @synthesize finished = _requestCompleted;
@@ -181,14 +296,40 @@ static BOOL gLastProviderIsFinished = NO;
       _audioFileHost = [audioFile audioFileHost];
     }
 
+    _cachedPath = [[DOUAudioCache sharedCache] cachedPathForURL:_audioFileURL];
+    _cachedURL = [NSURL fileURLWithPath:_cachedPath];
+    _rangesPath = [[DOUAudioCache sharedCache] rangesPathForURL:_audioFileURL];
+    [[DOUAudioCache sharedCache] beginAccessForURL:_audioFileURL];
+    _receivedRanges = [NSMutableIndexSet indexSet];
+    _throughputEstimator = [[DOUAudioThroughputEstimator alloc] init];
+    _consumerQueue = dispatch_queue_create("com.douban.audio-streamer.remote-file-provider", DISPATCH_QUEUE_SERIAL);
+
     if ([DOUAudioStreamer options] & DOUAudioStreamerRequireSHA256) {
       _sha256Ctx = (CC_SHA256_CTX *)malloc(sizeof(CC_SHA256_CTX));
       CC_SHA256_Init(_sha256Ctx);
     }
 
     [self _openAudioFileStream];
-    [self _createRequest];
-    [_request start];
+
+    if ([self _loadCachedRanges]) {
+      @synchronized(self) {
+        _receivedLength = [self _contiguousLengthFromOffset:0];
+        [self _scheduleConsumer];
+
+        if ([_receivedRanges containsIndexesInRange:NSMakeRange(0, _expectedLength)]) {
+          [self _finishDownload];
+        }
+      }
+    }
+
+    if (!_requestCompleted) {
+      NSRange range;
+      @synchronized(self) {
+        range = [self _missingRangeFromOffset:_receivedLength];
+      }
+
+      [self _startRequestWithRange:range];
+    }
   }
 
   return self;
@@ -196,14 +337,7 @@ static BOOL gLastProviderIsFinished = NO;
 
 - (void)dealloc
 {
-  @synchronized(_request) {
-    [_request setCompletedBlock:NULL];
-    [_request setProgressBlock:NULL];
-    [_request setDidReceiveResponseBlock:NULL];
-    [_request setDidReceiveDataBlock:NULL];
-
-    [_request cancel];
-  }
+  [self _detachRequest:_request];
 
   if (_sha256Ctx != NULL) {
     free(_sha256Ctx);
@@ -212,150 +346,1360 @@ static BOOL gLastProviderIsFinished = NO;
   [self _closeAudioFileStream];
 
   if ([DOUAudioStreamer options] & DOUAudioStreamerRemoveCacheOnDeallocation) {
-    [[NSFileManager defaultManager] removeItemAtPath:_cachedPath error:NULL];
+    [[DOUAudioCache sharedCache] removeEntryForURL:_audioFileURL];
+  }
+  else {
+    [self _saveCachedRanges];
+    [self _updateCacheEntry];
   }
+
+  [[DOUAudioCache sharedCache] endAccessForURL:_audioFileURL];
 }
 
-+ (NSString *)_sha256ForAudioFileURL:(NSURL *)audioFileURL
+- (void)_invokeEventBlock
 {
-  NSString *string = [audioFileURL absoluteString];
-  unsigned char hash[CC_SHA256_DIGEST_LENGTH];
-  CC_SHA256([string UTF8String], (CC_LONG)[string lengthOfBytesUsingEncoding:NSUTF8StringEncoding], hash);
+  if (_eventBlock != NULL) {
+    _eventBlock();
+  }
+}
 
-  NSMutableString *result = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
-  for (size_t i = 0; i < CC_SHA256_DIGEST_LENGTH; ++i) {
-    [result appendFormat:@"%02x", hash[i]];
+- (BOOL)_loadCachedRanges
+{
+  NSDictionary *info = [NSDictionary dictionaryWithContentsOfFile:_rangesPath];
+  NSString *validator = [info objectForKey:@"validator"];
+  NSNumber *length = [info objectForKey:@"length"];
+  NSArray *ranges = [info objectForKey:@"ranges"];
+  if (validator == nil || length == nil || ranges == nil) {
+    return NO;
   }
 
-  return result;
+  NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:_cachedPath error:NULL];
+  if (attributes == nil ||
+      [attributes fileSize] != [length unsignedLongLongValue]) {
+    return NO;
+  }
+
+  DOUAudioCacheStore *store = [DOUAudioCacheStore storeWithContentsOfFile:_cachedPath modifiable:YES];
+  if (store == nil) {
+    return NO;
+  }
+
+  for (NSArray *range in ranges) {
+    if ([range count] != 2) {
+      continue;
+    }
+
+    NSUInteger location = [[range objectAtIndex:0] unsignedIntegerValue];
+    NSUInteger rangeLength = [[range objectAtIndex:1] unsignedIntegerValue];
+    if (location < [store length] &&
+        rangeLength <= [store length] - location) {
+      [_receivedRanges addIndexesInRange:NSMakeRange(location, rangeLength)];
+    }
+  }
+
+  _validator = validator;
+  _mimeType = [info objectForKey:@"mimeType"];
+  _store = store;
+  _expectedLength = [store length];
+  _acceptsRanges = YES;
+
+  return YES;
 }
 
-+ (NSString *)_cachedPathForAudioFileURL:(NSURL *)audioFileURL
+- (void)_saveCachedRanges
 {
-  NSString *filename = [NSString stringWithFormat:@"douas-%@.tmp", [self _sha256ForAudioFileURL:audioFileURL]];
-  return [NSTemporaryDirectory() stringByAppendingPathComponent:filename];
+  NSMutableArray *ranges = [NSMutableArray array];
+  NSMutableDictionary *info = [NSMutableDictionary dictionary];
+
+  @synchronized(self) {
+    if (_validator == nil || _store == nil || _growable) {
+      return;
+    }
+
+    [_receivedRanges enumerateRangesUsingBlock:^(NSRange range, BOOL *stop) {
+      [ranges addObject:@[@(range.location), @(range.length)]];
+    }];
+
+    [info setObject:_validator forKey:@"validator"];
+    [info setObject:@(_expectedLength) forKey:@"length"];
+    [info setObject:ranges forKey:@"ranges"];
+    if (_mimeType != nil) {
+      [info setObject:_mimeType forKey:@"mimeType"];
+    }
+  }
+
+  [info writeToFile:_rangesPath atomically:YES];
 }
 
-- (void)_invokeEventBlock
+- (void)_updateCacheEntry
 {
-  if (_eventBlock != NULL) {
-    _eventBlock();
+  if ([DOUAudioStreamer options] & DOUAudioStreamerRemoveCacheOnDeallocation) {
+    return;
+  }
+
+  NSUInteger length;
+  NSString *validator;
+  NSString *mimeType;
+  BOOL completed;
+
+  @synchronized(self) {
+    if (_store == nil) {
+      return;
+    }
+
+    length = (_growable ? _receivedLength : _expectedLength);
+    validator = _validator;
+    mimeType = _mimeType;
+    completed = _requestCompleted;
   }
+
+  [[DOUAudioCache sharedCache] updateEntryForURL:_audioFileURL
+                                          length:length
+                                       validator:validator
+                                        mimeType:mimeType
+                                       completed:completed];
 }
 
-- (void)_requestDidComplete
+- (NSUInteger)_contiguousLengthFromOffset:(NSUInteger)offset
 {
-  if ([_request isFailed] ||
-      !([_request statusCode] >= 200 && [_request statusCode] < 300)
-      || _receivedLength == 0) {
-    _failed = YES;
+  NSRange range = provider_range_containing_index(_receivedRanges, offset);
+  if (range.location == NSNotFound) {
+    return 0;
+  }
+
+  return NSMaxRange(range) - offset;
+}
+
+- (NSRange)_missingRangeFromOffset:(NSUInteger)offset
+{
+  if (_store == nil) {
+    return NSMakeRange(0, 0);
+  }
+
+  NSUInteger location = MIN(offset, _expectedLength);
+  location += [self _contiguousLengthFromOffset:location];
+
+  if (location >= _expectedLength) {
+    if (offset == 0) {
+      return NSMakeRange(NSNotFound, 0);
+    }
+
+    return [self _missingRangeFromOffset:0];
+  }
+
+  NSUInteger next = [_receivedRanges indexGreaterThanIndex:location];
+  if (next == NSNotFound || next > _expectedLength) {
+    next = _expectedLength;
+  }
+
+  return NSMakeRange(location, next - location);
+}
+
+/*
+ * Cached ranges loaded from a previous session are not trusted until the
+ * server has confirmed the entity, either by honoring If-Range with a 206 or
+ * by answering with the same validator and length.  Until then the provider
+ * does not report itself ready, so no playback item has opened the old bytes
+ * and a changed entity can simply replace them.  Once the entity has been
+ * validated and exposed, a later change is a failure.
+ */
+
+- (void)_resetCacheWithLength:(NSUInteger)length
+{
+  [[NSFileManager defaultManager] removeItemAtPath:[[DOUAudioCache sharedCache] seekIndexPathForURL:_audioFileURL] error:NULL];
+
+  if (_store != nil) {
+    if (_entityValidated && _readyToProducePackets) {
+      _failed = YES;
+      return;
+    }
+
+    if ([_store length] != length && ![_store resizeToLength:length]) {
+      _failed = YES;
+      return;
+    }
+
+    _readyToProducePackets = NO;
+    _requiresCompleteFile = NO;
+    _audioDataOffset = 0;
+    _audioBitRate = 0;
+    _prefetchLength = 0;
   }
   else {
-    _requestCompleted = YES;
-    [_mappedData dou_synchronizeMappedFile];
+    [[NSFileManager defaultManager] createFileAtPath:_cachedPath contents:nil attributes:nil];
+#if TARGET_OS_IPHONE
+    [[NSFileManager defaultManager] setAttributes:@{NSFileProtectionKey: NSFileProtectionNone}
+                                     ofItemAtPath:_cachedPath
+                                            error:NULL];
+#endif /* TARGET_OS_IPHONE */
+    [[NSFileHandle fileHandleForWritingAtPath:_cachedPath] truncateFileAtOffset:length];
+
+    _store = [DOUAudioCacheStore storeWithContentsOfFile:_cachedPath modifiable:YES];
   }
 
-  if (!_failed &&
-      _sha256Ctx != NULL) {
-    unsigned char hash[CC_SHA256_DIGEST_LENGTH];
-    CC_SHA256_Final(hash, _sha256Ctx);
+  [_receivedRanges removeAllIndexes];
+  _expectedLength = length;
+  _receivedLength = 0;
+  _consumerNeedsReset = YES;
+}
 
-    NSMutableString *result = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
-    for (size_t i = 0; i < CC_SHA256_DIGEST_LENGTH; ++i) {
-      [result appendFormat:@"%02x", hash[i]];
+/*
+ * Hashing and format probing only look at the contiguous prefix of the cache
+ * file, which is never rewritten once received.  They run on a private serial
+ * queue against a snapshot of _receivedLength rather than on the network
+ * thread under the provider lock.  The queue owns _sha256Ctx,
+ * _audioFileStreamID and _consumedLength.
+ */
+
+- (void)_scheduleConsumer
+{
+  if (_consumerScheduled) {
+    return;
+  }
+
+  _consumerScheduled = YES;
+  dispatch_async(_consumerQueue, ^{
+    [self _consumeReceivedBytes];
+  });
+}
+
+- (OSStatus)_parseBytesInStore:(DOUAudioCacheStore *)store range:(NSRange)range
+{
+  if (_audioFileStreamID == NULL) {
+    return kAudioFileStreamError_UnsupportedFileType;
+  }
+
+  __block OSStatus status = noErr;
+  [store enumerateBytesInRange:range usingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+    status = AudioFileStreamParseBytes(_audioFileStreamID, (UInt32)byteRange.length, bytes, 0);
+    if (status != noErr) {
+      *stop = YES;
     }
+  }];
 
-    _sha256 = [result copy];
+  return status;
+}
+
+- (void)_consumeReceivedBytes
+{
+  DOUAudioCacheStore *store;
+  NSUInteger receivedLength;
+  BOOL needsReset;
+  BOOL shouldProbe;
+
+  /*
+   * The strong local keeps the store, and with it the mapped segments, alive
+   * for the whole pass even if a reset replaces _store meanwhile; every raw
+   * byte pointer handed out by -enumerateBytesInRange:usingBlock: is only
+   * used inside that call.
+   */
+  @synchronized(self) {
+    _consumerScheduled = NO;
+    store = _store;
+    receivedLength = _receivedLength;
+    needsReset = _consumerNeedsReset;
+    _consumerNeedsReset = NO;
+    shouldProbe = !_readyToProducePackets && !_failed && !_requiresCompleteFile;
+  }
+
+  if (needsReset) {
+    [self _closeAudioFileStream];
+    [self _openAudioFileStream];
+
+    if (_sha256Ctx != NULL) {
+      CC_SHA256_Init(_sha256Ctx);
+    }
+
+    _consumedLength = 0;
   }
 
-  if (gHintFile != nil &&
-      gHintProvider == nil) {
-    gHintProvider = [[[self class] alloc] _initWithAudioFile:gHintFile];
+  if (store == nil || _consumedLength >= receivedLength) {
+    return;
   }
 
-  [self _invokeEventBlock];
+  NSUInteger offset = _consumedLength;
+  _consumedLength = receivedLength;
+
+  if (_sha256Ctx != NULL) {
+    CC_SHA256_CTX *ctx = _sha256Ctx;
+    [store enumerateBytesInRange:NSMakeRange(offset, receivedLength - offset) usingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+      CC_SHA256_Update(ctx, bytes, (CC_LONG)byteRange.length);
+    }];
+  }
+
+  if (!shouldProbe) {
+    return;
+  }
+
+  BOOL failed = NO;
+  BOOL requiresCompleteFile = NO;
+  OSStatus status = [self _parseBytesInStore:store range:NSMakeRange(offset, receivedLength - offset)];
+
+  if (status != noErr && status != kAudioFileStreamError_NotOptimized) {
+    NSArray *fallbackTypeIDs = [self _fallbackTypeIDs];
+    for (NSNumber *typeIDNumber in fallbackTypeIDs) {
+      AudioFileTypeID typeID = (AudioFileTypeID)[typeIDNumber unsignedLongValue];
+      [self _closeAudioFileStream];
+      [self _openAudioFileStreamWithFileTypeHint:typeID];
+
+      status = [self _parseBytesInStore:store range:NSMakeRange(0, receivedLength)];
+      if (status == noErr || status == kAudioFileStreamError_NotOptimized) {
+        break;
+      }
+    }
+
+    if (status != noErr && status != kAudioFileStreamError_NotOptimized) {
+      failed = YES;
+    }
+  }
+
+  if (status == kAudioFileStreamError_NotOptimized) {
+    [self _closeAudioFileStream];
+    requiresCompleteFile = YES;
+  }
+
+  DOUSimpleHTTPRequest *prefetchedRequest;
+  BOOL ready;
+
+  @synchronized(self) {
+    if (failed) {
+      _failed = YES;
+    }
+
+    if (requiresCompleteFile) {
+      _requiresCompleteFile = YES;
+    }
+
+    prefetchedRequest = [self _takeRequestIfPrefetched];
+    ready = _readyToProducePackets;
+  }
+
+  if (prefetchedRequest != nil) {
+    [self _saveCachedRanges];
+    [self _detachRequest:prefetchedRequest];
+  }
+
+  if (failed || ready || prefetchedRequest != nil) {
+    [self _invokeEventBlock];
+  }
 }
 
-- (void)_requestDidReportProgress:(double)progress
+- (void)_finalizeSHA256
 {
-  [self _invokeEventBlock];
+  if (_sha256Ctx == NULL) {
+    return;
+  }
+
+  unsigned char hash[CC_SHA256_DIGEST_LENGTH];
+  CC_SHA256_Final(hash, _sha256Ctx);
+
+  NSMutableString *result = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
+  for (size_t i = 0; i < CC_SHA256_DIGEST_LENGTH; ++i) {
+    [result appendFormat:@"%02x", hash[i]];
+  }
+
+  _sha256 = [result copy];
+}
+
+/*
+ * Received bytes are written back in ranges of kDOUAudioRemoteFileProviderSyncLength
+ * as they arrive, with an asynchronous msync issued from the consumer queue,
+ * so completing a download never blocks on flushing the whole file.
+ */
+
+- (void)_synchronizeRange:(NSRange)range
+{
+  DOUAudioCacheStore *store = _store;
+  if (store == nil || range.length == 0) {
+    return;
+  }
+
+  dispatch_async(_consumerQueue, ^{
+    [store synchronizeRange:range];
+  });
+}
+
+- (void)_synchronizePendingRange
+{
+  if (_writeOffset == NSNotFound || _writeOffset <= _syncOffset) {
+    return;
+  }
+
+  [self _synchronizeRange:NSMakeRange(_syncOffset, _writeOffset - _syncOffset)];
+  _syncOffset = _writeOffset;
+}
+
+- (void)_finishDownload
+{
+  _requestCompleted = YES;
+  [self _synchronizePendingRange];
+
+  if (_sha256Ctx != NULL) {
+    dispatch_async(_consumerQueue, ^{
+      [self _consumeReceivedBytes];
+      [self _finalizeSHA256];
+    });
+  }
+}
+
+- (NSString *)sha256
+{
+  if (_sha256Ctx == NULL) {
+    return [super sha256];
+  }
+
+  dispatch_sync(_consumerQueue, ^{});
+  return _sha256;
+}
+
+- (void)_requestDidComplete:(DOUSimpleHTTPRequest *)request
+{
+  NSRange nextRange = NSMakeRange(NSNotFound, 0);
+
+  @synchronized(self) {
+    if (request != _request) {
+      return;
+    }
+
+    BOOL succeeded = ![request isFailed] &&
+                     [request statusCode] >= 200 && [request statusCode] < 300 &&
+                     _writeOffset != NSNotFound;
+
+    if (_failed) {
+      nextRange = NSMakeRange(NSNotFound, 0);
+    }
+    else if (_growable && succeeded) {
+      [_store resizeToLength:_writeOffset];
+      _expectedLength = _writeOffset;
+      _growable = NO;
+      [self _finishDownload];
+    }
+    else if (_store != nil &&
+             _expectedLength > 0 &&
+             [_receivedRanges containsIndexesInRange:NSMakeRange(0, _expectedLength)]) {
+      [self _finishDownload];
+    }
+    else if (succeeded) {
+      if (_store == nil ||
+          [_receivedRanges count] == 0 ||
+          !_acceptsRanges) {
+        _failed = YES;
+      }
+      else {
+        _retryCount = 0;
+        nextRange = [self _missingRangeFromOffset:_writeOffset];
+      }
+    }
+    else if (_acceptsRanges &&
+             _store != nil &&
+             _retryCount < kDOUAudioRemoteFileProviderMaxRetries) {
+      _retryCount++;
+      nextRange = [self _missingRangeFromOffset:(_writeOffset != NSNotFound ? _writeOffset : 0)];
+    }
+    else {
+      _failed = YES;
+    }
+
+    if (!_requestCompleted && nextRange.location == NSNotFound) {
+      _failed = YES;
+    }
+  }
+
+  [self _saveCachedRanges];
+  [self _updateCacheEntry];
+
+  if (nextRange.location != NSNotFound) {
+    [self _startRequestWithRange:nextRange];
+  }
+
+  [self _invokeEventBlock];
+}
+
+- (void)_requestDidReportProgress:(double)progress
+{
+  [self _invokeEventBlock];
+}
+
+- (void)_requestDidReceiveResponse:(DOUSimpleHTTPRequest *)request
+{
+  @synchronized(self) {
+    if (request != _request) {
+      return;
+    }
+
+    NSDictionary *headers = [request responseHeaders];
+    NSInteger statusCode = [request statusCode];
+
+    NSString *validator = [headers objectForKey:@"ETag"];
+    if (validator == nil) {
+      validator = [headers objectForKey:@"Last-Modified"];
+    }
+
+    if ([[headers objectForKey:@"Accept-Ranges"] isEqualToString:@"bytes"]) {
+      _acceptsRanges = YES;
+    }
+
+    _writeOffset = NSNotFound;
+
+    if (statusCode == 206) {
+      if (_store != nil &&
+          !_growable &&
+          [request responseTotalLength] == _expectedLength &&
+          [request responseRangeOffset] < _expectedLength) {
+        _writeOffset = [request responseRangeOffset];
+        _syncOffset = _writeOffset;
+        _acceptsRanges = YES;
+        _entityValidated = YES;
+      }
+      else {
+        _failed = YES;
+      }
+    }
+    else if (statusCode >= 200 && statusCode < 300) {
+      NSString *contentEncoding = [headers objectForKey:@"Content-Encoding"];
+      BOOL growable = [headers objectForKey:@"Content-Length"] == nil ||
+                      (contentEncoding != nil && ![contentEncoding isEqualToString:@"identity"]);
+
+      BOOL sameEntity = _store != nil &&
+                        !growable &&
+                        [request responseContentLength] == _expectedLength &&
+                        (validator == nil || _validator == nil || [validator isEqualToString:_validator]);
+
+      if (growable) {
+        _growable = YES;
+        _acceptsRanges = NO;
+        [self _resetCacheWithLength:0];
+      }
+      else if (!sameEntity) {
+        [self _resetCacheWithLength:[request responseContentLength]];
+      }
+      else if ([request rangeOffset] > 0 || [request rangeLength] > 0) {
+        _acceptsRanges = NO;
+      }
+
+      _writeOffset = 0;
+      _syncOffset = 0;
+      _entityValidated = !_failed;
+    }
+
+    if (validator != nil) {
+      _validator = validator;
+    }
+
+    if (_mimeType == nil) {
+      _mimeType = [headers objectForKey:@"Content-Type"];
+    }
+  }
+
+  dou_audio_metrics_mark_event(_metrics, DOUAudioMetricsResponseReceived);
+  [self _updateCacheEntry];
+}
+
+/*
+ * The destination handed to the request is the cache store at the current
+ * write offset, up to the end of its segment.  All requests share one network
+ * thread, so a stale request can at worst fill the bytes of the same entity
+ * it was asked for; those bytes are only accounted for once
+ * _requestDidWriteDataWithLength: confirms the request is still current.
+ *
+ * Responses without a usable length (chunked or content-encoded) go into a
+ * growable store that is extended a segment at a time and trimmed to the
+ * received length on completion.  Until then the expected length follows
+ * the store, so the decoder waits for bytes inside the grown segments just
+ * as it does for a sized file, and such responses become ready as soon as
+ * the received prefix parses.  They are neither suspended nor stopped at
+ * the prefetch length since they cannot be resumed with a range request.
+ */
+
+- (void *)_destinationForRequest:(DOUSimpleHTTPRequest *)request capacity:(NSUInteger *)capacity
+{
+  @synchronized(self) {
+    if (request != _request ||
+        _store == nil ||
+        _failed ||
+        _writeOffset == NSNotFound ||
+        (!_growable && _writeOffset >= _expectedLength)) {
+      return NULL;
+    }
+
+    if (_growable && _writeOffset >= [_store length]) {
+      NSUInteger segmentLength = [DOUAudioCacheStore segmentLength];
+      if (![_store resizeToLength:(_writeOffset / segmentLength + 1) * segmentLength]) {
+        return NULL;
+      }
+
+      _expectedLength = [_store length];
+    }
+
+    return [_store mutableBytesAtOffset:_writeOffset length:capacity];
+  }
+}
+
+- (void)_requestDidWriteDataWithLength:(NSUInteger)length request:(DOUSimpleHTTPRequest *)request
+{
+  DOUSimpleHTTPRequest *prefetchedRequest;
+
+  @synchronized(self) {
+    if (request != _request ||
+        _store == nil ||
+        _failed ||
+        _writeOffset == NSNotFound ||
+        _writeOffset + length > [_store length]) {
+      return;
+    }
+
+    [_receivedRanges addIndexesInRange:NSMakeRange(_writeOffset, length)];
+    [_throughputEstimator addSampleWithLength:length];
+
+    if (_requestStartHostTime != 0) {
+      dou_audio_metrics_mark_event(_metrics, DOUAudioMetricsFirstByteReceived);
+      dou_audio_metrics_record_host_time(_metrics, DOUAudioMetricsRequestLatencyHistogram, mach_absolute_time() - _requestStartHostTime);
+      _requestStartHostTime = 0;
+    }
+    _writeOffset += length;
+
+    if (_writeOffset - _syncOffset >= kDOUAudioRemoteFileProviderSyncLength ||
+        _writeOffset == _expectedLength) {
+      [self _synchronizePendingRange];
+    }
+
+    NSUInteger previousReceivedLength = _receivedLength;
+    _receivedLength = [self _contiguousLengthFromOffset:0];
+    if (_receivedLength > previousReceivedLength) {
+      [self _scheduleConsumer];
+    }
+
+    prefetchedRequest = [self _takeRequestIfPrefetched];
+    if (prefetchedRequest == nil) {
+      return;
+    }
+  }
+
+  [self _saveCachedRanges];
+  [self _detachRequest:prefetchedRequest];
+  [self _invokeEventBlock];
+}
+
+- (DOUSimpleHTTPRequest *)_takeRequestIfPrefetched
+{
+  [self _updatePrefetchLength];
+  if (_request == nil ||
+      _growable ||
+      _prefetchLength == 0 ||
+      _receivedLength < _prefetchLength) {
+    return nil;
+  }
+
+  DOUSimpleHTTPRequest *request = _request;
+  _prefetched = YES;
+  _request = nil;
+  [self _synchronizePendingRange];
+  return request;
+}
+
+- (void)_updatePrefetchLength
+{
+  if (_prefetchDuration <= 0.0 ||
+      _prefetchLength > 0 ||
+      !_readyToProducePackets) {
+    return;
+  }
+
+  UInt32 bitRate = _audioBitRate;
+  if (bitRate == 0) {
+    bitRate = kDOUAudioRemoteFileProviderFallbackBitRate;
+  }
+
+  _prefetchLength = (NSUInteger)_audioDataOffset + (NSUInteger)(bitRate / 8 * _prefetchDuration);
+}
+
+- (DOUSimpleHTTPRequest *)_createRequestWithRange:(NSRange)range
+{
+  DOUSimpleHTTPRequest *request = [DOUSimpleHTTPRequest requestWithURL:_audioFileURL];
+  if (_audioFileHost != nil) {
+    [request setHost:_audioFileHost];
+  }
+
+  if (range.length > 0) {
+    [request setRangeOffset:range.location];
+    if (NSMaxRange(range) < _expectedLength) {
+      [request setRangeLength:range.length];
+    }
+    [request setRangeValidator:_validator];
+  }
+
+  [request setMaximumDownloadSpeed:_maximumDownloadSpeed];
+
+  __unsafe_unretained _DOUAudioRemoteFileProvider *_self = self;
+  __unsafe_unretained DOUSimpleHTTPRequest *_httpRequest = request;
+
+  [request setCompletedBlock:^{
+    [_self _requestDidComplete:_httpRequest];
+  }];
+
+  [request setProgressBlock:^(double downloadProgress) {
+    [_self _requestDidReportProgress:downloadProgress];
+  }];
+
+  [request setDidReceiveResponseBlock:^{
+    [_self _requestDidReceiveResponse:_httpRequest];
+  }];
+
+  [request setDestinationBlock:^void *(NSUInteger *capacity) {
+    return [_self _destinationForRequest:_httpRequest capacity:capacity];
+  }];
+
+  [request setDidWriteDataBlock:^(NSUInteger length) {
+    [_self _requestDidWriteDataWithLength:length request:_httpRequest];
+  }];
+
+  return request;
+}
+
+- (void)_startRequestWithRange:(NSRange)range
+{
+  DOUSimpleHTTPRequest *request;
+  DOUSimpleHTTPRequest *previousRequest;
+
+  @synchronized(self) {
+    request = [self _createRequestWithRange:range];
+    previousRequest = _request;
+    _request = request;
+    [self _synchronizePendingRange];
+    _writeOffset = NSNotFound;
+    _requestStartHostTime = mach_absolute_time();
+  }
+
+  [self _detachRequest:previousRequest];
+  [_throughputEstimator restart];
+  [request start];
+}
+
+/*
+ * Takes the request lock, so it must be called without holding ours; see
+ * -[DOUSimpleHTTPRequest _responseStreamHasBytesAvailable] for the order.
+ */
+
+- (void)_detachRequest:(DOUSimpleHTTPRequest *)request
+{
+  if (request == nil) {
+    return;
+  }
+
+  @synchronized(request) {
+    [request setCompletedBlock:NULL];
+    [request setProgressBlock:NULL];
+    [request setDidReceiveResponseBlock:NULL];
+    [request setDestinationBlock:NULL];
+    [request setDidWriteDataBlock:NULL];
+
+    [request cancel];
+  }
+}
+
+- (void)_handleAudioFileStreamProperty:(AudioFileStreamPropertyID)propertyID
+{
+  if (propertyID == kAudioFileStreamProperty_ReadyToProducePackets) {
+    SInt64 dataOffset = 0;
+    UInt32 size = sizeof(dataOffset);
+    if (AudioFileStreamGetProperty(_audioFileStreamID, kAudioFileStreamProperty_DataOffset, &size, &dataOffset) != noErr) {
+      dataOffset = 0;
+    }
+
+    UInt32 bitRate = 0;
+    size = sizeof(bitRate);
+    if (AudioFileStreamGetProperty(_audioFileStreamID, kAudioFileStreamProperty_BitRate, &size, &bitRate) != noErr) {
+      bitRate = 0;
+    }
+
+    @synchronized(self) {
+      _audioDataOffset = dataOffset;
+      _audioBitRate = bitRate;
+      _readyToProducePackets = YES;
+    }
+
+    dou_audio_metrics_mark_event(_metrics, DOUAudioMetricsReadyToProducePackets);
+  }
+}
+
+- (void)_handleAudioFileStreamPackets:(const void *)packets
+                        numberOfBytes:(UInt32)numberOfBytes
+                      numberOfPackets:(UInt32)numberOfPackets
+                   packetDescriptions:(AudioStreamPacketDescription *)packetDescriptioins
+{
+}
+
+static void audio_file_stream_property_listener_proc(void *inClientData,
+                                                AudioFileStreamID inAudioFileStream,
+                                                AudioFileStreamPropertyID inPropertyID,
+                                                UInt32 *ioFlags)
+{
+  __unsafe_unretained _DOUAudioRemoteFileProvider *fileProvider = (__bridge _DOUAudioRemoteFileProvider *)inClientData;
+  [fileProvider _handleAudioFileStreamProperty:inPropertyID];
+}
+
+static void audio_file_stream_packets_proc(void *inClientData,
+                                           UInt32 inNumberBytes,
+                                           UInt32 inNumberPackets,
+                                           const void *inInputData,
+                                           AudioStreamPacketDescription	*inPacketDescriptions)
+{
+  __unsafe_unretained _DOUAudioRemoteFileProvider *fileProvider = (__bridge _DOUAudioRemoteFileProvider *)inClientData;
+  [fileProvider _handleAudioFileStreamPackets:inInputData
+                                numberOfBytes:inNumberBytes
+                              numberOfPackets:inNumberPackets
+                           packetDescriptions:inPacketDescriptions];
+}
+
+- (void)_openAudioFileStream
+{
+  [self _openAudioFileStreamWithFileTypeHint:0];
+}
+
+- (void)_openAudioFileStreamWithFileTypeHint:(AudioFileTypeID)fileTypeHint
+{
+  OSStatus status = AudioFileStreamOpen((__bridge void *)self,
+                                        audio_file_stream_property_listener_proc,
+                                        audio_file_stream_packets_proc,
+                                        fileTypeHint,
+                                        &_audioFileStreamID);
+
+  if (status != noErr) {
+    _audioFileStreamID = NULL;
+  }
+}
+
+- (void)_closeAudioFileStream
+{
+  if (_audioFileStreamID != NULL) {
+    AudioFileStreamClose(_audioFileStreamID);
+    _audioFileStreamID = NULL;
+  }
+}
+
+- (NSArray *)_fallbackTypeIDs
+{
+  NSMutableArray *fallbackTypeIDs = [NSMutableArray array];
+  NSMutableSet *fallbackTypeIDSet = [NSMutableSet set];
+
+  struct {
+    CFStringRef specifier;
+    AudioFilePropertyID propertyID;
+  } properties[] = {
+    { (__bridge CFStringRef)[self mimeType], kAudioFileGlobalInfo_TypesForMIMEType },
+    { (__bridge CFStringRef)[self fileExtension], kAudioFileGlobalInfo_TypesForExtension }
+  };
+
+  const size_t numberOfProperties = sizeof(properties) / sizeof(properties[0]);
+
+  for (size_t i = 0; i < numberOfProperties; ++i) {
+    if (properties[i].specifier == NULL) {
+      continue;
+    }
+
+    UInt32 outSize = 0;
+    OSStatus status;
+
+    status = AudioFileGetGlobalInfoSize(properties[i].propertyID,
+                                        sizeof(properties[i].specifier),
+                                        &properties[i].specifier,
+                                        &outSize);
+    if (status != noErr) {
+      continue;
+    }
+
+    size_t count = outSize / sizeof(AudioFileTypeID);
+    AudioFileTypeID *buffer = (AudioFileTypeID *)malloc(outSize);
+    if (buffer == NULL) {
+      continue;
+    }
+
+    status = AudioFileGetGlobalInfo(properties[i].propertyID,
+                                    sizeof(properties[i].specifier),
+                                    &properties[i].specifier,
+                                    &outSize,
+                                    buffer);
+    if (status != noErr) {
+      free(buffer);
+      continue;
+    }
+
+    for (size_t j = 0; j < count; ++j) {
+      NSNumber *tid = [NSNumber numberWithUnsignedLong:buffer[j]];
+      if ([fallbackTypeIDSet containsObject:tid]) {
+        continue;
+      }
+
+      [fallbackTypeIDs addObject:tid];
+      [fallbackTypeIDSet addObject:tid];
+    }
+
+    free(buffer);
+  }
+
+  return fallbackTypeIDs;
+}
+
+- (NSString *)fileExtension
+{
+  if (_fileExtension == nil) {
+    _fileExtension = [[[[self audioFile] audioFileURL] path] pathExtension];
+  }
+
+  return _fileExtension;
+}
+
+- (NSUInteger)downloadSpeed
+{
+  @synchronized(self) {
+    return [_request downloadSpeed];
+  }
+}
+
+- (double)estimatedThroughput
+{
+  return [_throughputEstimator throughput];
+}
+
+- (double)throughputDeviation
+{
+  return [_throughputEstimator deviation];
+}
+
+- (NSUInteger)availableLengthFromOffset:(NSUInteger)offset
+{
+  @synchronized(self) {
+    return [self _contiguousLengthFromOffset:offset];
+  }
+}
+
+- (void)seekToOffset:(NSUInteger)offset
+{
+  NSRange range;
+
+  @synchronized(self) {
+    if (!_acceptsRanges ||
+        _store == nil ||
+        _suspended ||
+        _requestCompleted ||
+        _failed ||
+        offset >= _expectedLength) {
+      return;
+    }
+
+    range = [self _missingRangeFromOffset:offset];
+    if (range.location == NSNotFound ||
+        range.location < offset) {
+      return;
+    }
+
+    if (_writeOffset != NSNotFound &&
+        _writeOffset <= range.location &&
+        range.location - _writeOffset <= MAX([_request downloadSpeed], kDOUAudioRemoteFileProviderSeekThreshold)) {
+      return;
+    }
+
+    _retryCount = 0;
+  }
+
+  [self _startRequestWithRange:range];
+}
+
+- (NSTimeInterval)prefetchDuration
+{
+  @synchronized(self) {
+    return _prefetchDuration;
+  }
+}
+
+- (void)setPrefetchDuration:(NSTimeInterval)prefetchDuration
+{
+  BOOL shouldResume = NO;
+
+  @synchronized(self) {
+    _prefetchDuration = prefetchDuration;
+    _prefetchLength = 0;
+    [self _updatePrefetchLength];
+
+    if (_prefetched &&
+        (_prefetchLength == 0 || _receivedLength < _prefetchLength)) {
+      _prefetched = NO;
+      shouldResume = YES;
+    }
+  }
+
+  if (shouldResume) {
+    [self resume];
+  }
+}
+
+- (NSUInteger)maximumDownloadSpeed
+{
+  @synchronized(self) {
+    return _maximumDownloadSpeed;
+  }
+}
+
+- (void)setMaximumDownloadSpeed:(NSUInteger)maximumDownloadSpeed
+{
+  @synchronized(self) {
+    _maximumDownloadSpeed = maximumDownloadSpeed;
+    [_request setMaximumDownloadSpeed:maximumDownloadSpeed];
+  }
+}
+
+- (BOOL)isPrefetched
+{
+  @synchronized(self) {
+    return _prefetched || _requestCompleted;
+  }
+}
+
+- (BOOL)isSuspended
+{
+  @synchronized(self) {
+    return _suspended;
+  }
+}
+
+- (void)suspend
+{
+  DOUSimpleHTTPRequest *request;
+
+  @synchronized(self) {
+    if (_suspended || _growable) {
+      return;
+    }
+
+    _suspended = YES;
+    request = _request;
+    _request = nil;
+    [self _synchronizePendingRange];
+    _writeOffset = NSNotFound;
+  }
+
+  [self _saveCachedRanges];
+  [self _detachRequest:request];
+}
+
+- (void)resume
+{
+  NSRange range;
+
+  @synchronized(self) {
+    _suspended = NO;
+
+    if (_request != nil ||
+        _prefetched ||
+        _requestCompleted ||
+        _failed) {
+      return;
+    }
+
+    range = [self _missingRangeFromOffset:_receivedLength];
+    if (range.location == NSNotFound) {
+      return;
+    }
+
+    _retryCount = 0;
+  }
+
+  [self _startRequestWithRange:range];
+}
+
+- (BOOL)isReady
+{
+  if (!_requiresCompleteFile) {
+    return (_readyToProducePackets && _entityValidated) || _requestCompleted;
+  }
+
+  return _requestCompleted;
+}
+
+@end
+
+#pragma mark - Concrete Audio Live File Provider
+
+/*
+ * Live streams (Shoutcast/Icecast or any endless HTTP body) are never
+ * written to the cache.  The response is parsed by an AudioFileStream as it
+ * arrives and its packets go into a packet ring holding the last
+ * liveWindowDuration seconds, which the decoder reads from directly.  When
+ * the server interleaves ICY metadata every icy-metaint bytes, those blocks
+ * are cut out of the audio before parsing and published as metadata.
+ */
+
+@implementation _DOUAudioLiveFileProvider
+
+@synthesize finished = _requestCompleted;
+
+- (instancetype)_initWithAudioFile:(id <DOUAudioFile>)audioFile
+{
+  self = [super _initWithAudioFile:audioFile];
+  if (self) {
+    _audioFileURL = [audioFile audioFileURL];
+    if ([audioFile respondsToSelector:@selector(audioFileHost)]) {
+      _audioFileHost = [audioFile audioFileHost];
+    }
+
+    _metadataBuffer = [NSMutableData data];
+
+    [self _createRequest];
+    [_request start];
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  @synchronized(_request) {
+    [_request setCompletedBlock:NULL];
+    [_request setProgressBlock:NULL];
+    [_request setDidReceiveResponseBlock:NULL];
+    [_request setDidReceiveDataBlock:NULL];
+
+    [_request cancel];
+  }
+
+  if (_audioFileStreamID != NULL) {
+    AudioFileStreamClose(_audioFileStreamID);
+  }
+}
+
+- (void)_invokeEventBlock
+{
+  if (_eventBlock != NULL) {
+    _eventBlock();
+  }
+}
+
+- (void)_handleAudioFileStreamProperty:(AudioFileStreamPropertyID)propertyID
+{
+  if (propertyID != kAudioFileStreamProperty_ReadyToProducePackets) {
+    return;
+  }
+
+  AudioStreamBasicDescription format;
+  UInt32 size = sizeof(format);
+  if (AudioFileStreamGetProperty(_audioFileStreamID, kAudioFileStreamProperty_DataFormat, &size, &format) != noErr) {
+    return;
+  }
+
+  NSData *magicCookie = nil;
+  Boolean writable;
+  if (AudioFileStreamGetPropertyInfo(_audioFileStreamID, kAudioFileStreamProperty_MagicCookieData, &size, &writable) == noErr &&
+      size > 0) {
+    NSMutableData *data = [NSMutableData dataWithLength:size];
+    if (AudioFileStreamGetProperty(_audioFileStreamID, kAudioFileStreamProperty_MagicCookieData, &size, [data mutableBytes]) == noErr) {
+      magicCookie = data;
+    }
+  }
+
+  UInt32 maximumPacketSize = 0;
+  size = sizeof(maximumPacketSize);
+  if (AudioFileStreamGetProperty(_audioFileStreamID, kAudioFileStreamProperty_PacketSizeUpperBound, &size, &maximumPacketSize) != noErr ||
+      maximumPacketSize == 0) {
+    size = sizeof(maximumPacketSize);
+    if (AudioFileStreamGetProperty(_audioFileStreamID, kAudioFileStreamProperty_MaximumPacketSize, &size, &maximumPacketSize) != noErr) {
+      maximumPacketSize = 0;
+    }
+  }
+
+  UInt32 bitRate = 0;
+  size = sizeof(bitRate);
+  if (AudioFileStreamGetProperty(_audioFileStreamID, kAudioFileStreamProperty_BitRate, &size, &bitRate) != noErr) {
+    bitRate = 0;
+  }
+
+  DOUAudioPacketRing *packetRing = [DOUAudioPacketRing packetRingWithFormat:format
+                                                                magicCookie:magicCookie
+                                                          maximumPacketSize:maximumPacketSize
+                                                                   duration:[DOUAudioStreamer liveWindowDuration]
+                                                                    bitRate:bitRate];
+
+  @synchronized(self) {
+    if (packetRing == nil) {
+      _failed = YES;
+    }
+    else {
+      _packetRing = packetRing;
+    }
+  }
+
+  dou_audio_metrics_mark_event(_metrics, DOUAudioMetricsReadyToProducePackets);
+}
+
+static AudioFileTypeID live_stream_file_type_hint(NSString *mimeType)
+{
+  if ([mimeType hasPrefix:@"audio/mpeg"] ||
+      [mimeType hasPrefix:@"audio/mp3"]) {
+    return kAudioFileMP3Type;
+  }
+  else if ([mimeType hasPrefix:@"audio/aac"] ||
+           [mimeType hasPrefix:@"audio/x-aac"]) {
+    return kAudioFileAAC_ADTSType;
+  }
+
+  return 0;
+}
+
+static void live_stream_property_listener_proc(void *inClientData,
+                                               AudioFileStreamID inAudioFileStream,
+                                               AudioFileStreamPropertyID inPropertyID,
+                                               UInt32 *ioFlags)
+{
+  __unsafe_unretained _DOUAudioLiveFileProvider *fileProvider = (__bridge _DOUAudioLiveFileProvider *)inClientData;
+  [fileProvider _handleAudioFileStreamProperty:inPropertyID];
+}
+
+static void live_stream_packets_proc(void *inClientData,
+                                     UInt32 inNumberBytes,
+                                     UInt32 inNumberPackets,
+                                     const void *inInputData,
+                                     AudioStreamPacketDescription *inPacketDescriptions)
+{
+  __unsafe_unretained _DOUAudioLiveFileProvider *fileProvider = (__bridge _DOUAudioLiveFileProvider *)inClientData;
+  [[fileProvider packetRing] appendPackets:inInputData
+                             numberOfBytes:inNumberBytes
+                           numberOfPackets:inNumberPackets
+                        packetDescriptions:inPacketDescriptions];
+}
+
+- (void)_requestDidComplete
+{
+  @synchronized(self) {
+    if ([_request isFailed] ||
+        !([_request statusCode] >= 200 && [_request statusCode] < 300) ||
+        _packetRing == nil) {
+      _failed = YES;
+    }
+    else {
+      _requestCompleted = YES;
+    }
+  }
+
+  [self _invokeEventBlock];
+}
+
+- (void)_requestDidReceiveResponse
+{
+  NSDictionary *headers = [_request responseHeaders];
+
+  _mimeType = [headers objectForKey:@"Content-Type"];
+  _metadataInterval = (NSUInteger)MAX([[headers objectForKey:@"icy-metaint"] integerValue], 0);
+  _audioBytesRemaining = _metadataInterval;
+
+  OSStatus status = AudioFileStreamOpen((__bridge void *)self,
+                                        live_stream_property_listener_proc,
+                                        live_stream_packets_proc,
+                                        live_stream_file_type_hint(_mimeType),
+                                        &_audioFileStreamID);
+  if (status != noErr) {
+    _audioFileStreamID = NULL;
+    @synchronized(self) {
+      _failed = YES;
+    }
+  }
+
+  dou_audio_metrics_mark_event(_metrics, DOUAudioMetricsResponseReceived);
 }
 
-- (void)_requestDidReceiveResponse
+- (void)_parseAudioBytes:(const uint8_t *)bytes length:(NSUInteger)length
 {
-  _expectedLength = [_request responseContentLength];
-
-  _cachedPath = [[self class] _cachedPathForAudioFileURL:_audioFileURL];
-  _cachedURL = [NSURL fileURLWithPath:_cachedPath];
-
-  [[NSFileManager defaultManager] createFileAtPath:_cachedPath contents:nil attributes:nil];
-#if TARGET_OS_IPHONE
-  [[NSFileManager defaultManager] setAttributes:@{NSFileProtectionKey: NSFileProtectionNone}
-                                   ofItemAtPath:_cachedPath
-                                          error:NULL];
-#endif /* TARGET_OS_IPHONE */
-  [[NSFileHandle fileHandleForWritingAtPath:_cachedPath] truncateFileAtOffset:_expectedLength];
-
-  _mimeType = [[_request responseHeaders] objectForKey:@"Content-Type"];
+  if (_audioFileStreamID == NULL || length == 0) {
+    return;
+  }
 
-  _mappedData = [NSData dou_modifiableDataWithMappedContentsOfFile:_cachedPath];
+  _receivedLength += length;
+  if (AudioFileStreamParseBytes(_audioFileStreamID, (UInt32)length, bytes, 0) != noErr) {
+    @synchronized(self) {
+      if (_packetRing == nil) {
+        _failed = YES;
+      }
+    }
+  }
 }
 
 - (void)_requestDidReceiveData:(NSData *)data
 {
-  if (_mappedData == nil) {
+  const uint8_t *bytes = (const uint8_t *)[data bytes];
+  NSUInteger length = [data length];
+  NSUInteger offset = 0;
+
+  if (_metadataInterval == 0) {
+    [self _parseAudioBytes:bytes length:length];
     return;
   }
 
-  NSUInteger availableSpace = _expectedLength - _receivedLength;
-  NSUInteger bytesToWrite = MIN(availableSpace, [data length]);
+  while (offset < length) {
+    if (_metadataBytesRemaining > 0) {
+      NSUInteger count = MIN(_metadataBytesRemaining, length - offset);
+      [_metadataBuffer appendBytes:bytes + offset length:count];
+      _metadataBytesRemaining -= count;
+      offset += count;
+
+      if (_metadataBytesRemaining == 0) {
+        [self _handleMetadataBlock:_metadataBuffer];
+        [_metadataBuffer setLength:0];
+        _audioBytesRemaining = _metadataInterval;
+      }
+    }
+    else if (_audioBytesRemaining == 0) {
+      _metadataBytesRemaining = (NSUInteger)bytes[offset++] * 16;
+      if (_metadataBytesRemaining == 0) {
+        _audioBytesRemaining = _metadataInterval;
+      }
+    }
+    else {
+      NSUInteger count = MIN(_audioBytesRemaining, length - offset);
+      [self _parseAudioBytes:bytes + offset length:count];
+      _audioBytesRemaining -= count;
+      offset += count;
+    }
+  }
+}
 
-  memcpy((uint8_t *)[_mappedData bytes] + _receivedLength, [data bytes], bytesToWrite);
-  _receivedLength += bytesToWrite;
+- (void)_handleMetadataBlock:(NSData *)block
+{
+  NSString *string = [[NSString alloc] initWithData:block encoding:NSUTF8StringEncoding];
+  if (string == nil) {
+    string = [[NSString alloc] initWithData:block encoding:NSISOLatin1StringEncoding];
+  }
 
-  if (_sha256Ctx != NULL) {
-    CC_SHA256_Update(_sha256Ctx, [data bytes], (CC_LONG)[data length]);
+  string = [string stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"\0"]];
+  if ([string length] == 0) {
+    return;
   }
 
-  if (!_readyToProducePackets && !_failed && !_requiresCompleteFile) {
-    OSStatus status = kAudioFileStreamError_UnsupportedFileType;
+  NSMutableDictionary *metadata = [NSMutableDictionary dictionary];
+  NSScanner *scanner = [NSScanner scannerWithString:string];
+  [scanner setCharactersToBeSkipped:nil];
+
+  while (![scanner isAtEnd]) {
+    NSString *key = nil;
+    NSString *value = @"";
 
-    if (_audioFileStreamID != NULL) {
-      status = AudioFileStreamParseBytes(_audioFileStreamID,
-                                         (UInt32)[data length],
-                                         [data bytes],
-                                         0);
+    if (![scanner scanUpToString:@"='" intoString:&key] ||
+        ![scanner scanString:@"='" intoString:NULL]) {
+      break;
     }
 
-    if (status != noErr && status != kAudioFileStreamError_NotOptimized) {
-      NSArray *fallbackTypeIDs = [self _fallbackTypeIDs];
-      for (NSNumber *typeIDNumber in fallbackTypeIDs) {
-        AudioFileTypeID typeID = (AudioFileTypeID)[typeIDNumber unsignedLongValue];
-        [self _closeAudioFileStream];
-        [self _openAudioFileStreamWithFileTypeHint:typeID];
-
-        if (_audioFileStreamID != NULL) {
-          status = AudioFileStreamParseBytes(_audioFileStreamID,
-                                             (UInt32)_receivedLength,
-                                             [_mappedData bytes],
-                                             0);
-
-          if (status == noErr || status == kAudioFileStreamError_NotOptimized) {
-            break;
-          }
-        }
-      }
+    [scanner scanUpToString:@"';" intoString:&value];
+    [scanner scanString:@"';" intoString:NULL];
 
-      if (status != noErr && status != kAudioFileStreamError_NotOptimized) {
-        _failed = YES;
-      }
-    }
+    [metadata setObject:value forKey:key];
+  }
 
-    if (status == kAudioFileStreamError_NotOptimized) {
-      [self _closeAudioFileStream];
-      _requiresCompleteFile = YES;
+  @synchronized(self) {
+    if ([metadata count] == 0 || [metadata isEqualToDictionary:_metadata]) {
+      return;
     }
+
+    _metadata = [metadata copy];
   }
+
+  [self _invokeEventBlock];
 }
 
 - (void)_createRequest
@@ -364,14 +1708,16 @@ static BOOL gLastProviderIsFinished = NO;
   if (_audioFileHost != nil) {
     [_request setHost:_audioFileHost];
   }
-  __unsafe_unretained _DOUAudioRemoteFileProvider *_self = self;
+  [_request setValue:@"1" forHTTPHeaderField:@"Icy-MetaData"];
+
+  __unsafe_unretained _DOUAudioLiveFileProvider *_self = self;
 
   [_request setCompletedBlock:^{
     [_self _requestDidComplete];
   }];
 
   [_request setProgressBlock:^(double downloadProgress) {
-    [_self _requestDidReportProgress:downloadProgress];
+    [_self _invokeEventBlock];
   }];
 
   [_request setDidReceiveResponseBlock:^{
@@ -383,129 +1729,23 @@ static BOOL gLastProviderIsFinished = NO;
   }];
 }
 
-- (void)_handleAudioFileStreamProperty:(AudioFileStreamPropertyID)propertyID
-{
-  if (propertyID == kAudioFileStreamProperty_ReadyToProducePackets) {
-    _readyToProducePackets = YES;
-  }
-}
-
-- (void)_handleAudioFileStreamPackets:(const void *)packets
-                        numberOfBytes:(UInt32)numberOfBytes
-                      numberOfPackets:(UInt32)numberOfPackets
-                   packetDescriptions:(AudioStreamPacketDescription *)packetDescriptioins
-{
-}
-
-static void audio_file_stream_property_listener_proc(void *inClientData,
-                                                AudioFileStreamID inAudioFileStream,
-                                                AudioFileStreamPropertyID inPropertyID,
-                                                UInt32 *ioFlags)
-{
-  __unsafe_unretained _DOUAudioRemoteFileProvider *fileProvider = (__bridge _DOUAudioRemoteFileProvider *)inClientData;
-  [fileProvider _handleAudioFileStreamProperty:inPropertyID];
-}
-
-static void audio_file_stream_packets_proc(void *inClientData,
-                                           UInt32 inNumberBytes,
-                                           UInt32 inNumberPackets,
-                                           const void *inInputData,
-                                           AudioStreamPacketDescription	*inPacketDescriptions)
-{
-  __unsafe_unretained _DOUAudioRemoteFileProvider *fileProvider = (__bridge _DOUAudioRemoteFileProvider *)inClientData;
-  [fileProvider _handleAudioFileStreamPackets:inInputData
-                                numberOfBytes:inNumberBytes
-                              numberOfPackets:inNumberPackets
-                           packetDescriptions:inPacketDescriptions];
-}
-
-- (void)_openAudioFileStream
-{
-  [self _openAudioFileStreamWithFileTypeHint:0];
-}
-
-- (void)_openAudioFileStreamWithFileTypeHint:(AudioFileTypeID)fileTypeHint
+- (BOOL)isLive
 {
-  OSStatus status = AudioFileStreamOpen((__bridge void *)self,
-                                        audio_file_stream_property_listener_proc,
-                                        audio_file_stream_packets_proc,
-                                        fileTypeHint,
-                                        &_audioFileStreamID);
-
-  if (status != noErr) {
-    _audioFileStreamID = NULL;
-  }
+  return YES;
 }
 
-- (void)_closeAudioFileStream
+- (DOUAudioPacketRing *)packetRing
 {
-  if (_audioFileStreamID != NULL) {
-    AudioFileStreamClose(_audioFileStreamID);
-    _audioFileStreamID = NULL;
+  @synchronized(self) {
+    return _packetRing;
   }
 }
 
-- (NSArray *)_fallbackTypeIDs
+- (NSDictionary *)metadata
 {
-  NSMutableArray *fallbackTypeIDs = [NSMutableArray array];
-  NSMutableSet *fallbackTypeIDSet = [NSMutableSet set];
-
-  struct {
-    CFStringRef specifier;
-    AudioFilePropertyID propertyID;
-  } properties[] = {
-    { (__bridge CFStringRef)[self mimeType], kAudioFileGlobalInfo_TypesForMIMEType },
-    { (__bridge CFStringRef)[self fileExtension], kAudioFileGlobalInfo_TypesForExtension }
-  };
-
-  const size_t numberOfProperties = sizeof(properties) / sizeof(properties[0]);
-
-  for (size_t i = 0; i < numberOfProperties; ++i) {
-    if (properties[i].specifier == NULL) {
-      continue;
-    }
-
-    UInt32 outSize = 0;
-    OSStatus status;
-
-    status = AudioFileGetGlobalInfoSize(properties[i].propertyID,
-                                        sizeof(properties[i].specifier),
-                                        &properties[i].specifier,
-                                        &outSize);
-    if (status != noErr) {
-      continue;
-    }
-
-    size_t count = outSize / sizeof(AudioFileTypeID);
-    AudioFileTypeID *buffer = (AudioFileTypeID *)malloc(outSize);
-    if (buffer == NULL) {
-      continue;
-    }
-
-    status = AudioFileGetGlobalInfo(properties[i].propertyID,
-                                    sizeof(properties[i].specifier),
-                                    &properties[i].specifier,
-                                    &outSize,
-                                    buffer);
-    if (status != noErr) {
-      free(buffer);
-      continue;
-    }
-
-    for (size_t j = 0; j < count; ++j) {
-      NSNumber *tid = [NSNumber numberWithUnsignedLong:buffer[j]];
-      if ([fallbackTypeIDSet containsObject:tid]) {
-        continue;
-      }
-
-      [fallbackTypeIDs addObject:tid];
-      [fallbackTypeIDSet addObject:tid];
-    }
-
-    free(buffer);
+  @synchronized(self) {
+    return _metadata;
   }
-
-  return fallbackTypeIDs;
 }
 
 - (NSString *)fileExtension
@@ -522,13 +1762,15 @@ static void audio_file_stream_packets_proc(void *inClientData,
   return [_request downloadSpeed];
 }
 
-- (BOOL)isReady
+- (NSUInteger)availableLengthFromOffset:(NSUInteger)offset
 {
-  if (!_requiresCompleteFile) {
-    return _readyToProducePackets;
-  }
+  return 0;
+}
 
-  return _requestCompleted;
+- (BOOL)isReady
+{
+  DOUAudioPacketRing *packetRing = [self packetRing];
+  return packetRing != nil && [packetRing endPacket] > [packetRing firstPacket];
 }
 
 @end
@@ -581,9 +1823,9 @@ static void audio_file_stream_packets_proc(void *inClientData,
   _cachedPath = [_assetLoader cachedPath];
   _cachedURL = [NSURL fileURLWithPath:_cachedPath];
 
-  _mappedData = [NSData dou_dataWithMappedContentsOfFile:_cachedPath];
-  _expectedLength = [_mappedData length];
-  _receivedLength = [_mappedData length];
+  _store = [DOUAudioCacheStore storeWithContentsOfFile:_cachedPath modifiable:NO];
+  _expectedLength = [_store length];
+  _receivedLength = [_store length];
 
   _loaderCompleted = YES;
   [self _invokeEventBlock];
@@ -604,9 +1846,15 @@ static void audio_file_stream_packets_proc(void *inClientData,
 {
   if (_sha256 == nil &&
       [DOUAudioStreamer options] & DOUAudioStreamerRequireSHA256 &&
-      [self mappedData] != nil) {
+      [self store] != nil) {
+    CC_SHA256_CTX ctx;
+    CC_SHA256_Init(&ctx);
+    [[self store] enumerateBytesInRange:NSMakeRange(0, [[self store] length]) usingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+      CC_SHA256_Update(&ctx, bytes, (CC_LONG)byteRange.length);
+    }];
+
     unsigned char hash[CC_SHA256_DIGEST_LENGTH];
-    CC_SHA256([[self mappedData] bytes], (CC_LONG)[[self mappedData] length], hash);
+    CC_SHA256_Final(hash, &ctx);
 
     NSMutableString *result = [NSMutableString stringWithCapacity:CC_SHA256_DIGEST_LENGTH * 2];
     for (size_t i = 0; i < CC_SHA256_DIGEST_LENGTH; ++i) {
@@ -648,11 +1896,19 @@ static void audio_file_stream_packets_proc(void *inClientData,
 @synthesize mimeType = _mimeType;
 @synthesize fileExtension = _fileExtension;
 @synthesize sha256 = _sha256;
-@synthesize mappedData = _mappedData;
+@synthesize store = _store;
 @synthesize expectedLength = _expectedLength;
 @synthesize receivedLength = _receivedLength;
+@synthesize metrics = _metrics;
 @synthesize failed = _failed;
 
++ (BOOL)_isLiveAudioFile:(id <DOUAudioFile>)audioFile
+{
+  return [audioFile respondsToSelector:@selector(audioFileIsLive)] &&
+         [audioFile audioFileIsLive] &&
+         ![[audioFile audioFileURL] isFileURL];
+}
+
 + (instancetype)_fileProviderWithAudioFile:(id <DOUAudioFile>)audioFile
 {
   if (audioFile == nil) {
@@ -664,7 +1920,10 @@ static void audio_file_stream_packets_proc(void *inClientData,
     return nil;
   }
 
-  if ([audioFileURL isFileURL]) {
+  if ([self _isLiveAudioFile:audioFile]) {
+    return [[_DOUAudioLiveFileProvider alloc] _initWithAudioFile:audioFile];
+  }
+  else if ([audioFileURL isFileURL]) {
     return [[_DOUAudioLocalFileProvider alloc] _initWithAudioFile:audioFile];
   }
 #if TARGET_OS_IPHONE
@@ -673,58 +1932,74 @@ static void audio_file_stream_packets_proc(void *inClientData,
   }
 #endif /* TARGET_OS_IPHONE */
   else {
-    return [[_DOUAudioRemoteFileProvider alloc] _initWithAudioFile:audioFile];
+    DOUAudioFileProvider *provider = [[_DOUAudioCachedFileProvider alloc] _initWithAudioFile:audioFile];
+    if (provider == nil) {
+      provider = [[_DOUAudioRemoteFileProvider alloc] _initWithAudioFile:audioFile];
+    }
+
+    return provider;
   }
 }
 
 + (instancetype)fileProviderWithAudioFile:(id <DOUAudioFile>)audioFile
 {
-  if ((audioFile == gHintFile ||
-      [audioFile isEqual:gHintFile]) &&
-      gHintProvider != nil) {
-    DOUAudioFileProvider *provider = gHintProvider;
-    gHintFile = nil;
-    gHintProvider = nil;
-    gLastProviderIsFinished = [provider isFinished];
-
+  DOUAudioFileProvider *provider = [[DOUAudioPrefetcher sharedPrefetcher] takeFileProviderForAudioFile:audioFile];
+  if (provider != nil) {
     return provider;
   }
 
-  gHintFile = nil;
-  gHintProvider = nil;
-  gLastProviderIsFinished = NO;
-
   return [self _fileProviderWithAudioFile:audioFile];
 }
 
-+ (void)setHintWithAudioFile:(id <DOUAudioFile>)audioFile
++ (instancetype)completedFileProviderWithAudioFile:(id <DOUAudioFile>)audioFile
 {
-  if (audioFile == gHintFile ||
-      [audioFile isEqual:gHintFile]) {
-    return;
+  NSURL *audioFileURL = [audioFile audioFileURL];
+  if (audioFileURL == nil) {
+    return nil;
   }
 
-  gHintFile = nil;
-  gHintProvider = nil;
-
-  if (audioFile == nil) {
-    return;
+  if ([audioFileURL isFileURL]) {
+    return [[_DOUAudioLocalFileProvider alloc] _initWithAudioFile:audioFile];
+  }
+  else if ([self _isLiveAudioFile:audioFile]) {
+    return nil;
+  }
+#if TARGET_OS_IPHONE
+  else if ([[audioFileURL scheme] isEqualToString:@"ipod-library"]) {
+    return nil;
   }
+#endif /* TARGET_OS_IPHONE */
+
+  return [[_DOUAudioCachedFileProvider alloc] _initWithAudioFile:audioFile];
+}
 
++ (instancetype)prefetchingFileProviderWithAudioFile:(id <DOUAudioFile>)audioFile
+                                            duration:(NSTimeInterval)duration
+{
   NSURL *audioFileURL = [audioFile audioFileURL];
   if (audioFileURL == nil ||
 #if TARGET_OS_IPHONE
       [[audioFileURL scheme] isEqualToString:@"ipod-library"] ||
 #endif /* TARGET_OS_IPHONE */
-      [audioFileURL isFileURL]) {
-    return;
+      [audioFileURL isFileURL] ||
+      [self _isLiveAudioFile:audioFile]) {
+    return nil;
   }
 
-  gHintFile = audioFile;
+  DOUAudioFileProvider *provider = [self _fileProviderWithAudioFile:audioFile];
+  [provider setPrefetchDuration:duration];
 
-  if (gLastProviderIsFinished) {
-    gHintProvider = [self _fileProviderWithAudioFile:gHintFile];
-  }
+  return provider;
+}
+
++ (void)setHintWithAudioFile:(id <DOUAudioFile>)audioFile
+{
+  [self setHintsWithAudioFiles:(audioFile != nil ? @[audioFile] : nil)];
+}
+
++ (void)setHintsWithAudioFiles:(NSArray *)audioFiles
+{
+  [[DOUAudioPrefetcher sharedPrefetcher] setAudioFiles:(audioFiles != nil ? audioFiles : @[])];
 }
 
 - (instancetype)_initWithAudioFile:(id <DOUAudioFile>)audioFile
@@ -732,6 +2007,7 @@ static void audio_file_stream_packets_proc(void *inClientData,
   self = [super init];
   if (self) {
     _audioFile = audioFile;
+    _metrics = [[DOUAudioMetrics alloc] init];
   }
 
   return self;
@@ -743,6 +2019,21 @@ static void audio_file_stream_packets_proc(void *inClientData,
   return 0;
 }
 
+- (BOOL)isLive
+{
+  return NO;
+}
+
+- (DOUAudioPacketRing *)packetRing
+{
+  return nil;
+}
+
+- (NSDictionary *)metadata
+{
+  return nil;
+}
+
 - (BOOL)isReady
 {
   [self doesNotRecognizeSelector:_cmd];
@@ -755,4 +2046,63 @@ static void audio_file_stream_packets_proc(void *inClientData,
   return NO;
 }
 
+- (double)estimatedThroughput
+{
+  return [self downloadSpeed];
+}
+
+- (double)throughputDeviation
+{
+  return 0.0;
+}
+
+- (NSUInteger)availableLengthFromOffset:(NSUInteger)offset
+{
+  if (offset >= _receivedLength) {
+    return 0;
+  }
+
+  return _receivedLength - offset;
+}
+
+- (void)seekToOffset:(NSUInteger)offset
+{
+}
+
+- (NSTimeInterval)prefetchDuration
+{
+  return 0.0;
+}
+
+- (void)setPrefetchDuration:(NSTimeInterval)prefetchDuration
+{
+}
+
+- (NSUInteger)maximumDownloadSpeed
+{
+  return 0;
+}
+
+- (void)setMaximumDownloadSpeed:(NSUInteger)maximumDownloadSpeed
+{
+}
+
+- (BOOL)isPrefetched
+{
+  return [self isFinished];
+}
+
+- (BOOL)isSuspended
+{
+  return NO;
+}
+
+- (void)suspend
+{
+}
+
+- (void)resume
+{
+}
+
 @end
@@ -0,0 +1,33 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioNullRenderer.h"
+
+typedef NS_ENUM(NSUInteger, DOUAudioFileRendererType) {
+  DOUAudioFileRendererWAV,
+  DOUAudioFileRendererRawPCM
+};
+
+@interface DOUAudioFileRenderer : DOUAudioNullRenderer
+
++ (instancetype)rendererWithURL:(NSURL *)url type:(DOUAudioFileRendererType)type;
+- (instancetype)initWithURL:(NSURL *)url type:(DOUAudioFileRendererType)type;
+
+@property (nonatomic, readonly) NSURL *url;
+@property (nonatomic, readonly) DOUAudioFileRendererType type;
+@property (nonatomic, readonly) unsigned long long writtenLength;
+
+@end
@@ -0,0 +1,155 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioFileRenderer.h"
+#include <CoreAudio/CoreAudioTypes.h>
+#include <libkern/OSByteOrder.h>
+#include <stdio.h>
+
+static const long kDOUAudioFileRendererWAVHeaderLength = 44;
+
+@interface DOUAudioFileRenderer () {
+@private
+  NSURL *_url;
+  DOUAudioFileRendererType _type;
+  FILE *_file;
+  unsigned long long _writtenLength;
+}
+@end
+
+@implementation DOUAudioFileRenderer
+
+@synthesize url = _url;
+@synthesize type = _type;
+@synthesize writtenLength = _writtenLength;
+
++ (instancetype)rendererWithURL:(NSURL *)url type:(DOUAudioFileRendererType)type
+{
+  return [[[self class] alloc] initWithURL:url type:type];
+}
+
+- (instancetype)initWithURL:(NSURL *)url type:(DOUAudioFileRendererType)type
+{
+  if (![url isFileURL]) {
+    return nil;
+  }
+
+  self = [super init];
+  if (self) {
+    _url = url;
+    _type = type;
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  [self _closeFile];
+}
+
+static void file_renderer_write_uint32(uint8_t *header, NSUInteger offset, uint32_t value)
+{
+  OSWriteLittleInt32(header, offset, value);
+}
+
+static void file_renderer_write_uint16(uint8_t *header, NSUInteger offset, uint16_t value)
+{
+  OSWriteLittleInt16(header, offset, value);
+}
+
+- (void)_writeWAVHeader
+{
+  AudioStreamBasicDescription format = [self format];
+  uint32_t dataLength = (uint32_t)MIN(_writtenLength, (unsigned long long)UINT32_MAX - kDOUAudioFileRendererWAVHeaderLength);
+
+  uint8_t header[kDOUAudioFileRendererWAVHeaderLength];
+  memcpy(header, "RIFF", 4);
+  file_renderer_write_uint32(header, 4, dataLength + kDOUAudioFileRendererWAVHeaderLength - 8);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  file_renderer_write_uint32(header, 16, 16);
+  file_renderer_write_uint16(header, 20, (format.mFormatFlags & kAudioFormatFlagIsFloat) ? 3 : 1);
+  file_renderer_write_uint16(header, 22, (uint16_t)format.mChannelsPerFrame);
+  file_renderer_write_uint32(header, 24, (uint32_t)format.mSampleRate);
+  file_renderer_write_uint32(header, 28, (uint32_t)(format.mSampleRate * format.mBytesPerFrame));
+  file_renderer_write_uint16(header, 32, (uint16_t)format.mBytesPerFrame);
+  file_renderer_write_uint16(header, 34, (uint16_t)format.mBitsPerChannel);
+  memcpy(header + 36, "data", 4);
+  file_renderer_write_uint32(header, 40, dataLength);
+
+  fseek(_file, 0, SEEK_SET);
+  fwrite(header, 1, sizeof(header), _file);
+  fseek(_file, 0, SEEK_END);
+}
+
+- (BOOL)setUp
+{
+  if (_file != NULL) {
+    return YES;
+  }
+
+  _file = fopen([[_url path] fileSystemRepresentation], "wb");
+  if (_file == NULL) {
+    return NO;
+  }
+
+  _writtenLength = 0;
+  if (_type == DOUAudioFileRendererWAV) {
+    [self _writeWAVHeader];
+  }
+
+  return [super setUp];
+}
+
+- (double)sampleRateForSourceSampleRate:(double)sampleRate
+{
+  if (_writtenLength > 0) {
+    return [self format].mSampleRate;
+  }
+
+  return [super sampleRateForSourceSampleRate:sampleRate];
+}
+
+- (void)_closeFile
+{
+  if (_file == NULL) {
+    return;
+  }
+
+  if (_type == DOUAudioFileRendererWAV) {
+    [self _writeWAVHeader];
+  }
+
+  fclose(_file);
+  _file = NULL;
+}
+
+- (void)tearDown
+{
+  [super tearDown];
+  [self _closeFile];
+}
+
+- (void)consumeBytes:(const void *)bytes length:(NSUInteger)length
+{
+  if (_file == NULL) {
+    return;
+  }
+
+  _writtenLength += fwrite(bytes, 1, length, _file);
+}
+
+@end
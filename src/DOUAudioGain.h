@@ -0,0 +1,34 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "DOUAudioBase.h"
+
+typedef struct {
+  float gain;
+  float targetGain;
+  float step;
+  NSUInteger rampFrameCount;
+  NSUInteger remainingFrameCount;
+} DOUAudioGainRamp;
+
+DOUAS_EXTERN void dou_audio_gain_ramp_init(DOUAudioGainRamp *ramp, NSUInteger rampFrameCount, float gain);
+DOUAS_EXTERN void dou_audio_gain_ramp_set_target(DOUAudioGainRamp *ramp, float targetGain);
+DOUAS_EXTERN void dou_audio_gain_ramp_reset(DOUAudioGainRamp *ramp, float gain);
+
+DOUAS_EXTERN void dou_audio_gain_apply_float(DOUAudioGainRamp *ramp, float *samples, NSUInteger frameCount, NSUInteger channelCount);
+
+DOUAS_EXTERN float dou_audio_gain_from_decibels(double decibels);
@@ -0,0 +1,100 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioGain.h"
+#include <simd/simd.h>
+#include <math.h>
+
+/*
+ * The gain stage runs in place on the render thread, so it never allocates
+ * and never touches the stack beyond a few vector registers.  A change of
+ * target gain is spread linearly over rampFrameCount frames to avoid
+ * zipper noise, and once the ramp is over the remaining frames are scaled in
+ * a single vectorized pass, or not at all at unity gain.
+ */
+
+void dou_audio_gain_ramp_init(DOUAudioGainRamp *ramp, NSUInteger rampFrameCount, float gain)
+{
+  ramp->rampFrameCount = MAX(rampFrameCount, (NSUInteger)1);
+  dou_audio_gain_ramp_reset(ramp, gain);
+}
+
+void dou_audio_gain_ramp_set_target(DOUAudioGainRamp *ramp, float targetGain)
+{
+  if (targetGain == ramp->targetGain) {
+    return;
+  }
+
+  ramp->targetGain = targetGain;
+  ramp->remainingFrameCount = ramp->rampFrameCount;
+  ramp->step = (targetGain - ramp->gain) / ramp->rampFrameCount;
+}
+
+void dou_audio_gain_ramp_reset(DOUAudioGainRamp *ramp, float gain)
+{
+  ramp->gain = gain;
+  ramp->targetGain = gain;
+  ramp->step = 0.0f;
+  ramp->remainingFrameCount = 0;
+}
+
+static NSUInteger gain_ramp_float(DOUAudioGainRamp *ramp, float *samples, NSUInteger frameCount, NSUInteger channelCount)
+{
+  NSUInteger rampFrameCount = MIN(ramp->remainingFrameCount, frameCount);
+  float gain = ramp->gain;
+
+  for (NSUInteger i = 0; i < rampFrameCount; ++i) {
+    gain += ramp->step;
+    for (NSUInteger channel = 0; channel < channelCount; ++channel) {
+      samples[channel] *= gain;
+    }
+    samples += channelCount;
+  }
+
+  ramp->remainingFrameCount -= rampFrameCount;
+  ramp->gain = ramp->remainingFrameCount == 0 ? ramp->targetGain : gain;
+
+  return rampFrameCount;
+}
+
+void dou_audio_gain_apply_float(DOUAudioGainRamp *ramp, float *samples, NSUInteger frameCount, NSUInteger channelCount)
+{
+  NSUInteger rampFrameCount = gain_ramp_float(ramp, samples, frameCount, channelCount);
+  if (ramp->gain == 1.0f) {
+    return;
+  }
+
+  samples += rampFrameCount * channelCount;
+  NSUInteger count = (frameCount - rampFrameCount) * channelCount;
+  float gain = ramp->gain;
+
+  NSUInteger i = 0;
+  for (; i + 8 <= count; i += 8) {
+    simd_float8 vector;
+    memcpy(&vector, samples + i, sizeof(vector));
+    vector *= gain;
+    memcpy(samples + i, &vector, sizeof(vector));
+  }
+
+  for (; i < count; ++i) {
+    samples[i] *= gain;
+  }
+}
+
+float dou_audio_gain_from_decibels(double decibels)
+{
+  return (float)pow(10.0, decibels / 20.0);
+}
@@ -18,9 +18,19 @@
 
 @interface DOUAudioLPCM : NSObject
 
+- (instancetype)initWithCapacity:(NSUInteger)capacity;
+
+@property (nonatomic, readonly) NSUInteger capacity;
+@property (nonatomic, readonly) NSUInteger readableLength;
+@property (nonatomic, readonly) NSUInteger writableLength;
+
 @property (nonatomic, assign, getter=isEnd) BOOL end;
 
-- (BOOL)readBytes:(void **)bytes length:(NSUInteger *)length;
-- (void)writeBytes:(const void *)bytes length:(NSUInteger)length;
+- (BOOL)borrowBytes:(const void **)bytes length:(NSUInteger *)length;
+- (void)commitLength:(NSUInteger)length;
+
+- (BOOL)writeBytes:(const void *)bytes length:(NSUInteger)length;
+
+- (void)flush;
 
 @end
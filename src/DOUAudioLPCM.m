@@ -15,31 +15,56 @@
  */
 
 #import "DOUAudioLPCM.h"
-#include <libkern/OSAtomic.h>
+#include <stdatomic.h>
 
-typedef struct data_segment {
-  void *bytes;
-  NSUInteger length;
-  struct data_segment *next;
-} data_segment;
+/*
+ * Single-producer/single-consumer ring.  The read and write indices are free
+ * running counters, and the capacity is a power of two so that wrapping is a
+ * mask.  -flush drops everything and clears the end flag; the caller must
+ * make sure that the producer is not writing meanwhile.
+ */
 
 @interface DOUAudioLPCM () {
 @private
-  data_segment *_segments;
-  BOOL _end;
-  OSSpinLock _lock;
+  uint8_t *_buffer;
+  NSUInteger _capacity;
+  NSUInteger _mask;
+
+  _Atomic(NSUInteger) _readIndex;
+  _Atomic(NSUInteger) _writeIndex;
+  atomic_bool _end;
 }
 @end
 
 @implementation DOUAudioLPCM
 
-@synthesize end = _end;
+@synthesize capacity = _capacity;
+
+static NSUInteger lpcm_round_up_capacity(NSUInteger capacity)
+{
+  NSUInteger result = 1;
+  while (result < capacity) {
+    result <<= 1;
+  }
+
+  return result;
+}
 
-- (id)init
+- (instancetype)initWithCapacity:(NSUInteger)capacity
 {
   self = [super init];
   if (self) {
-    _lock = OS_SPINLOCK_INIT;
+    _capacity = lpcm_round_up_capacity(capacity);
+    _mask = _capacity - 1;
+
+    _buffer = (uint8_t *)malloc(_capacity);
+    if (_buffer == NULL) {
+      return nil;
+    }
+
+    atomic_init(&_readIndex, 0);
+    atomic_init(&_writeIndex, 0);
+    atomic_init(&_end, false);
   }
 
   return self;
@@ -47,78 +72,97 @@ typedef struct data_segment {
 
 - (void)dealloc
 {
-  while (_segments != NULL) {
-    data_segment *next = _segments->next;
-    free(_segments);
-    _segments = next;
+  if (_buffer != NULL) {
+    free(_buffer);
   }
 }
 
+- (BOOL)isEnd
+{
+  return atomic_load_explicit(&_end, memory_order_acquire);
+}
+
 - (void)setEnd:(BOOL)end
 {
-  OSSpinLockLock(&_lock);
-  if (end && !_end) {
-    _end = YES;
+  if (end) {
+    atomic_store_explicit(&_end, true, memory_order_release);
   }
-  OSSpinLockUnlock(&_lock);
 }
 
-- (BOOL)readBytes:(void **)bytes length:(NSUInteger *)length
+- (NSUInteger)readableLength
 {
-  *bytes = NULL;
-  *length = 0;
+  NSUInteger writeIndex = atomic_load_explicit(&_writeIndex, memory_order_acquire);
+  NSUInteger readIndex = atomic_load_explicit(&_readIndex, memory_order_acquire);
+  return writeIndex - readIndex;
+}
 
-  OSSpinLockLock(&_lock);
+- (NSUInteger)writableLength
+{
+  return _capacity - [self readableLength];
+}
 
-  if (_end && _segments == NULL) {
-    OSSpinLockUnlock(&_lock);
-    return NO;
-  }
+- (BOOL)borrowBytes:(const void **)bytes length:(NSUInteger *)length
+{
+  *bytes = NULL;
+  *length = 0;
 
-  if (_segments != NULL) {
-    *length = _segments->length;
-    *bytes = malloc(*length);
-    memcpy(*bytes, _segments->bytes, *length);
+  // The end flag must be observed before the write index, otherwise a final
+  // write racing with -setEnd: could be reported as end-of-stream.
+  BOOL end = atomic_load_explicit(&_end, memory_order_acquire);
+  NSUInteger writeIndex = atomic_load_explicit(&_writeIndex, memory_order_acquire);
+  NSUInteger readIndex = atomic_load_explicit(&_readIndex, memory_order_relaxed);
 
-    data_segment *next = _segments->next;
-    free(_segments);
-    _segments = next;
+  NSUInteger readableLength = writeIndex - readIndex;
+  if (readableLength == 0) {
+    return !end;
   }
 
-  OSSpinLockUnlock(&_lock);
+  NSUInteger offset = readIndex & _mask;
+  *bytes = _buffer + offset;
+  *length = MIN(readableLength, _capacity - offset);
 
   return YES;
 }
 
-- (void)writeBytes:(const void *)bytes length:(NSUInteger)length
+- (void)commitLength:(NSUInteger)length
 {
-  OSSpinLockLock(&_lock);
+  NSUInteger readIndex = atomic_load_explicit(&_readIndex, memory_order_relaxed);
+  atomic_store_explicit(&_readIndex, readIndex + length, memory_order_release);
+}
 
-  if (_end) {
-    OSSpinLockUnlock(&_lock);
-    return;
+- (BOOL)writeBytes:(const void *)bytes length:(NSUInteger)length
+{
+  if (atomic_load_explicit(&_end, memory_order_relaxed)) {
+    return NO;
   }
 
   if (bytes == NULL || length == 0) {
-    OSSpinLockUnlock(&_lock);
-    return;
+    return YES;
+  }
+
+  NSUInteger writeIndex = atomic_load_explicit(&_writeIndex, memory_order_relaxed);
+  NSUInteger readIndex = atomic_load_explicit(&_readIndex, memory_order_acquire);
+  if (_capacity - (writeIndex - readIndex) < length) {
+    return NO;
   }
 
-  data_segment *segment = (data_segment *)malloc(sizeof(data_segment) + length);
-  segment->bytes = segment + 1;
-  segment->length = length;
-  segment->next = NULL;
-  memcpy(segment->bytes, bytes, length);
+  NSUInteger offset = writeIndex & _mask;
+  NSUInteger firstFrag = MIN(length, _capacity - offset);
 
-  data_segment **link = &_segments;
-  while (*link != NULL) {
-    data_segment *current = *link;
-    link = &current->next;
+  memcpy(_buffer + offset, bytes, firstFrag);
+  if (firstFrag < length) {
+    memcpy(_buffer, (const uint8_t *)bytes + firstFrag, length - firstFrag);
   }
 
-  *link = segment;
+  atomic_store_explicit(&_writeIndex, writeIndex + length, memory_order_release);
+  return YES;
+}
 
-  OSSpinLockUnlock(&_lock);
+- (void)flush
+{
+  NSUInteger writeIndex = atomic_load_explicit(&_writeIndex, memory_order_acquire);
+  atomic_store_explicit(&_readIndex, writeIndex, memory_order_release);
+  atomic_store_explicit(&_end, false, memory_order_release);
 }
 
 @end
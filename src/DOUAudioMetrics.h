@@ -0,0 +1,99 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "DOUAudioBase.h"
+
+typedef NS_ENUM(NSUInteger, DOUAudioMetricsEvent) {
+  DOUAudioMetricsResponseReceived,
+  DOUAudioMetricsFirstByteReceived,
+  DOUAudioMetricsReadyToProducePackets,
+  DOUAudioMetricsFirstAudioRendered,
+
+  DOUAudioMetricsEventCount
+};
+
+typedef NS_ENUM(NSUInteger, DOUAudioMetricsHistogramType) {
+  DOUAudioMetricsRequestLatencyHistogram,
+  DOUAudioMetricsDecodeHistogram,
+  DOUAudioMetricsConverterHistogram,
+  DOUAudioMetricsUnderrunHistogram,
+
+  DOUAudioMetricsHistogramCount
+};
+
+DOUAS_EXTERN const NSUInteger kDOUAudioMetricsHistogramBucketCount;
+
+@class DOUAudioMetrics;
+
+DOUAS_EXTERN void dou_audio_metrics_mark_event(__unsafe_unretained DOUAudioMetrics *metrics,
+                                               DOUAudioMetricsEvent event);
+DOUAS_EXTERN void dou_audio_metrics_mark_event_at_host_time(__unsafe_unretained DOUAudioMetrics *metrics,
+                                                            DOUAudioMetricsEvent event,
+                                                            uint64_t hostTime);
+DOUAS_EXTERN void dou_audio_metrics_record_host_time(__unsafe_unretained DOUAudioMetrics *metrics,
+                                                     DOUAudioMetricsHistogramType histogram,
+                                                     uint64_t hostTime);
+DOUAS_EXTERN void dou_audio_metrics_record_time(__unsafe_unretained DOUAudioMetrics *metrics,
+                                                DOUAudioMetricsHistogramType histogram,
+                                                NSTimeInterval time);
+DOUAS_EXTERN void dou_audio_metrics_add_copied_length(__unsafe_unretained DOUAudioMetrics *metrics,
+                                                      NSUInteger length);
+DOUAS_EXTERN void dou_audio_metrics_set_buffer_fill_level(__unsafe_unretained DOUAudioMetrics *metrics,
+                                                          double bufferFillLevel);
+
+@interface DOUAudioMetricsHistogram : NSObject
+
+@property (nonatomic, readonly) NSUInteger count;
+@property (nonatomic, readonly) NSTimeInterval totalTime;
+@property (nonatomic, readonly) NSTimeInterval maximumTime;
+@property (nonatomic, readonly) NSTimeInterval averageTime;
+
+// Bucket i counts samples in [2^i, 2^(i+1)) microseconds, the first and the
+// last bucket also count everything below and above.
+@property (nonatomic, readonly) NSArray *buckets;
+
+@end
+
+@interface DOUAudioMetricsSnapshot : NSObject
+
+// Measured from the creation of the file provider, i.e. the first request.
+@property (nonatomic, readonly) NSTimeInterval timeToResponse;
+@property (nonatomic, readonly) NSTimeInterval timeToFirstByte;
+@property (nonatomic, readonly) NSTimeInterval timeToReadyToProducePackets;
+@property (nonatomic, readonly) NSTimeInterval timeToFirstRenderedSample;
+
+@property (nonatomic, readonly) DOUAudioMetricsHistogram *requestLatency;
+@property (nonatomic, readonly) DOUAudioMetricsHistogram *decodeTime;
+@property (nonatomic, readonly) DOUAudioMetricsHistogram *converterTime;
+@property (nonatomic, readonly) DOUAudioMetricsHistogram *underrunTime;
+
+@property (nonatomic, readonly) NSUInteger underrunCount;
+@property (nonatomic, readonly) NSTimeInterval underrunDuration;
+
+@property (nonatomic, readonly) double bufferFillLevel;
+@property (nonatomic, readonly) unsigned long long copiedLength;
+@property (nonatomic, readonly) double copiedLengthPerSecond;
+
+- (NSDictionary *)dictionaryRepresentation;
+
+@end
+
+@interface DOUAudioMetrics : NSObject
+
+- (DOUAudioMetricsSnapshot *)snapshot;
+
+@end
@@ -0,0 +1,364 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioMetrics.h"
+#include <stdatomic.h>
+#include <mach/mach_time.h>
+
+enum {
+  kDOUAudioMetricsBucketCount = 24
+};
+
+const NSUInteger kDOUAudioMetricsHistogramBucketCount = kDOUAudioMetricsBucketCount;
+
+/*
+ * Every counter is a relaxed atomic, so that recording from the network
+ * thread, the event loop and the Core Audio I/O thread never blocks, and a
+ * snapshot may be taken from any thread.  A snapshot is therefore not an
+ * atomic cut of all counters, but each value in it is consistent on its own.
+ */
+
+typedef struct {
+  _Atomic(uint64_t) count;
+  _Atomic(uint64_t) total;
+  _Atomic(uint64_t) maximum;
+  _Atomic(uint64_t) buckets[kDOUAudioMetricsBucketCount];
+} metrics_histogram;
+
+@interface DOUAudioMetricsHistogram () {
+@private
+  NSUInteger _count;
+  NSTimeInterval _totalTime;
+  NSTimeInterval _maximumTime;
+  NSArray *_buckets;
+}
+
+- (instancetype)_initWithHistogram:(metrics_histogram *)histogram;
+
+@end
+
+@interface DOUAudioMetricsSnapshot () {
+@private
+  NSTimeInterval _eventTimes[DOUAudioMetricsEventCount];
+  DOUAudioMetricsHistogram *_histograms[DOUAudioMetricsHistogramCount];
+
+  double _bufferFillLevel;
+  unsigned long long _copiedLength;
+  double _copiedLengthPerSecond;
+}
+
+- (instancetype)_initWithMetrics:(DOUAudioMetrics *)metrics;
+
+@end
+
+@interface DOUAudioMetrics () {
+@public
+  uint64_t _startHostTime;
+  _Atomic(uint64_t) _eventHostTimes[DOUAudioMetricsEventCount];
+  metrics_histogram _histograms[DOUAudioMetricsHistogramCount];
+
+  _Atomic(uint64_t) _bufferFillLevel;
+  _Atomic(uint64_t) _copiedLength;
+}
+@end
+
+static double metrics_seconds_per_host_time(void)
+{
+  static double conversion;
+
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    mach_timebase_info_data_t info;
+    mach_timebase_info(&info);
+    conversion = 1.0e-9 * info.numer / info.denom;
+  });
+
+  return conversion;
+}
+
+static void metrics_histogram_record(metrics_histogram *histogram, uint64_t nanoseconds)
+{
+  uint64_t microseconds = nanoseconds / 1000;
+  NSUInteger bucket = 0;
+  if (microseconds > 0) {
+    bucket = MIN((NSUInteger)(63 - __builtin_clzll(microseconds)), (NSUInteger)kDOUAudioMetricsBucketCount - 1);
+  }
+
+  atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->total, nanoseconds, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+
+  uint64_t maximum = atomic_load_explicit(&histogram->maximum, memory_order_relaxed);
+  while (nanoseconds > maximum &&
+         !atomic_compare_exchange_weak_explicit(&histogram->maximum, &maximum, nanoseconds,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+  }
+}
+
+void dou_audio_metrics_mark_event(__unsafe_unretained DOUAudioMetrics *metrics,
+                                  DOUAudioMetricsEvent event)
+{
+  dou_audio_metrics_mark_event_at_host_time(metrics, event, mach_absolute_time());
+}
+
+void dou_audio_metrics_mark_event_at_host_time(__unsafe_unretained DOUAudioMetrics *metrics,
+                                               DOUAudioMetricsEvent event,
+                                               uint64_t hostTime)
+{
+  if (metrics == nil || event >= DOUAudioMetricsEventCount) {
+    return;
+  }
+
+  uint64_t expected = 0;
+  atomic_compare_exchange_strong_explicit(&metrics->_eventHostTimes[event], &expected, hostTime,
+                                          memory_order_relaxed, memory_order_relaxed);
+}
+
+void dou_audio_metrics_record_host_time(__unsafe_unretained DOUAudioMetrics *metrics,
+                                        DOUAudioMetricsHistogramType histogram,
+                                        uint64_t hostTime)
+{
+  if (metrics == nil || histogram >= DOUAudioMetricsHistogramCount) {
+    return;
+  }
+
+  metrics_histogram_record(&metrics->_histograms[histogram],
+                           (uint64_t)(hostTime * metrics_seconds_per_host_time() * 1.0e9));
+}
+
+void dou_audio_metrics_record_time(__unsafe_unretained DOUAudioMetrics *metrics,
+                                   DOUAudioMetricsHistogramType histogram,
+                                   NSTimeInterval time)
+{
+  if (metrics == nil || histogram >= DOUAudioMetricsHistogramCount) {
+    return;
+  }
+
+  metrics_histogram_record(&metrics->_histograms[histogram], (uint64_t)(MAX(time, 0.0) * 1.0e9));
+}
+
+void dou_audio_metrics_add_copied_length(__unsafe_unretained DOUAudioMetrics *metrics,
+                                         NSUInteger length)
+{
+  if (metrics == nil) {
+    return;
+  }
+
+  atomic_fetch_add_explicit(&metrics->_copiedLength, length, memory_order_relaxed);
+}
+
+void dou_audio_metrics_set_buffer_fill_level(__unsafe_unretained DOUAudioMetrics *metrics,
+                                             double bufferFillLevel)
+{
+  if (metrics == nil) {
+    return;
+  }
+
+  uint64_t bits;
+  memcpy(&bits, &bufferFillLevel, sizeof(bits));
+  atomic_store_explicit(&metrics->_bufferFillLevel, bits, memory_order_relaxed);
+}
+
+@implementation DOUAudioMetricsHistogram
+
+@synthesize count = _count;
+@synthesize totalTime = _totalTime;
+@synthesize maximumTime = _maximumTime;
+@synthesize buckets = _buckets;
+
+- (instancetype)_initWithHistogram:(metrics_histogram *)histogram
+{
+  self = [super init];
+  if (self) {
+    _count = (NSUInteger)atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    _totalTime = atomic_load_explicit(&histogram->total, memory_order_relaxed) * 1.0e-9;
+    _maximumTime = atomic_load_explicit(&histogram->maximum, memory_order_relaxed) * 1.0e-9;
+
+    NSMutableArray *buckets = [NSMutableArray arrayWithCapacity:kDOUAudioMetricsBucketCount];
+    for (NSUInteger i = 0; i < kDOUAudioMetricsBucketCount; ++i) {
+      [buckets addObject:@(atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed))];
+    }
+    _buckets = [buckets copy];
+  }
+
+  return self;
+}
+
+- (NSTimeInterval)averageTime
+{
+  if (_count == 0) {
+    return 0.0;
+  }
+
+  return _totalTime / _count;
+}
+
+- (NSDictionary *)_dictionaryRepresentation
+{
+  return @{
+    @"count": @(_count),
+    @"total_time": @(_totalTime),
+    @"maximum_time": @(_maximumTime),
+    @"average_time": @([self averageTime]),
+    @"buckets": _buckets
+  };
+}
+
+@end
+
+@implementation DOUAudioMetricsSnapshot
+
+@synthesize bufferFillLevel = _bufferFillLevel;
+@synthesize copiedLength = _copiedLength;
+@synthesize copiedLengthPerSecond = _copiedLengthPerSecond;
+
+- (instancetype)_initWithMetrics:(DOUAudioMetrics *)metrics
+{
+  self = [super init];
+  if (self) {
+    double conversion = metrics_seconds_per_host_time();
+    uint64_t now = mach_absolute_time();
+
+    for (NSUInteger i = 0; i < DOUAudioMetricsEventCount; ++i) {
+      uint64_t hostTime = atomic_load_explicit(&metrics->_eventHostTimes[i], memory_order_relaxed);
+      if (hostTime > metrics->_startHostTime) {
+        _eventTimes[i] = (hostTime - metrics->_startHostTime) * conversion;
+      }
+    }
+
+    for (NSUInteger i = 0; i < DOUAudioMetricsHistogramCount; ++i) {
+      _histograms[i] = [[DOUAudioMetricsHistogram alloc] _initWithHistogram:&metrics->_histograms[i]];
+    }
+
+    uint64_t bits = atomic_load_explicit(&metrics->_bufferFillLevel, memory_order_relaxed);
+    memcpy(&_bufferFillLevel, &bits, sizeof(bits));
+
+    _copiedLength = atomic_load_explicit(&metrics->_copiedLength, memory_order_relaxed);
+
+    NSTimeInterval elapsed = (now - metrics->_startHostTime) * conversion;
+    if (elapsed > 0.0) {
+      _copiedLengthPerSecond = _copiedLength / elapsed;
+    }
+  }
+
+  return self;
+}
+
+- (NSTimeInterval)timeToResponse
+{
+  return _eventTimes[DOUAudioMetricsResponseReceived];
+}
+
+- (NSTimeInterval)timeToFirstByte
+{
+  return _eventTimes[DOUAudioMetricsFirstByteReceived];
+}
+
+- (NSTimeInterval)timeToReadyToProducePackets
+{
+  return _eventTimes[DOUAudioMetricsReadyToProducePackets];
+}
+
+- (NSTimeInterval)timeToFirstRenderedSample
+{
+  return _eventTimes[DOUAudioMetricsFirstAudioRendered];
+}
+
+- (DOUAudioMetricsHistogram *)requestLatency
+{
+  return _histograms[DOUAudioMetricsRequestLatencyHistogram];
+}
+
+- (DOUAudioMetricsHistogram *)decodeTime
+{
+  return _histograms[DOUAudioMetricsDecodeHistogram];
+}
+
+- (DOUAudioMetricsHistogram *)converterTime
+{
+  return _histograms[DOUAudioMetricsConverterHistogram];
+}
+
+- (DOUAudioMetricsHistogram *)underrunTime
+{
+  return _histograms[DOUAudioMetricsUnderrunHistogram];
+}
+
+- (NSUInteger)underrunCount
+{
+  return [[self underrunTime] count];
+}
+
+- (NSTimeInterval)underrunDuration
+{
+  return [[self underrunTime] totalTime];
+}
+
+- (NSDictionary *)dictionaryRepresentation
+{
+  return @{
+    @"time_to_response": @([self timeToResponse]),
+    @"time_to_first_byte": @([self timeToFirstByte]),
+    @"time_to_ready_to_produce_packets": @([self timeToReadyToProducePackets]),
+    @"time_to_first_rendered_sample": @([self timeToFirstRenderedSample]),
+    @"request_latency": [[self requestLatency] _dictionaryRepresentation],
+    @"decode_time": [[self decodeTime] _dictionaryRepresentation],
+    @"converter_time": [[self converterTime] _dictionaryRepresentation],
+    @"underrun_time": [[self underrunTime] _dictionaryRepresentation],
+    @"underrun_count": @([self underrunCount]),
+    @"underrun_duration": @([self underrunDuration]),
+    @"buffer_fill_level": @(_bufferFillLevel),
+    @"copied_length": @(_copiedLength),
+    @"copied_length_per_second": @(_copiedLengthPerSecond)
+  };
+}
+
+@end
+
+@implementation DOUAudioMetrics
+
+- (instancetype)init
+{
+  self = [super init];
+  if (self) {
+    _startHostTime = mach_absolute_time();
+
+    for (NSUInteger i = 0; i < DOUAudioMetricsEventCount; ++i) {
+      atomic_init(&_eventHostTimes[i], 0);
+    }
+
+    for (NSUInteger i = 0; i < DOUAudioMetricsHistogramCount; ++i) {
+      atomic_init(&_histograms[i].count, 0);
+      atomic_init(&_histograms[i].total, 0);
+      atomic_init(&_histograms[i].maximum, 0);
+      for (NSUInteger j = 0; j < kDOUAudioMetricsBucketCount; ++j) {
+        atomic_init(&_histograms[i].buckets[j], 0);
+      }
+    }
+
+    atomic_init(&_bufferFillLevel, 0);
+    atomic_init(&_copiedLength, 0);
+  }
+
+  return self;
+}
+
+- (DOUAudioMetricsSnapshot *)snapshot
+{
+  return [[DOUAudioMetricsSnapshot alloc] _initWithMetrics:self];
+}
+
+@end
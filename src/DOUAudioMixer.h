@@ -0,0 +1,53 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#include <CoreAudio/CoreAudioTypes.h>
+#import "DOUAudioFileProvider.h"
+
+@class DOUAudioStreamer;
+
+/*
+ * Voices are streamers played over the current one.  Each voice has its own
+ * playback item, decoder and LPCM queue; the event loop asks the mixer to
+ * decode them before every write to the renderer, which happens on a small
+ * worker pool, and then to add them into the PCM being written.  A voice
+ * starts at an exact frame of the output stream, so its delay is measured
+ * against the audio being heard rather than against the time of the call.
+ *
+ * The adding, pausing and removing of voices may happen on any thread; the
+ * rest is driven by the event loop thread.
+ */
+
+@interface DOUAudioMixer : NSObject
+
+@property (nonatomic, assign) AudioStreamBasicDescription outputFormat;
+@property (nonatomic, assign) NSUInteger decoderBufferSize;
+@property (nonatomic, copy) DOUAudioFileProviderEventBlock fileProviderEventBlock;
+
+@property (nonatomic, readonly, getter=isActive) BOOL active;
+
+- (void)addStreamer:(DOUAudioStreamer *)streamer delay:(NSTimeInterval)delay;
+- (void)pauseStreamer:(DOUAudioStreamer *)streamer;
+- (void)removeStreamer:(DOUAudioStreamer *)streamer;
+- (BOOL)containsStreamer:(DOUAudioStreamer *)streamer;
+- (NSTimeInterval)currentTimeForStreamer:(DOUAudioStreamer *)streamer;
+
+- (void)updateWithFrame:(UInt64)frame queuedTime:(NSUInteger)queuedTime;
+- (void)decodeForLength:(NSUInteger)length;
+- (const void *)mixBytes:(const void *)bytes length:(NSUInteger)length frame:(UInt64)frame trackGain:(double)trackGain;
+
+@end
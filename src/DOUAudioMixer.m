@@ -0,0 +1,458 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioMixer.h"
+#import "DOUAudioStreamer.h"
+#import "DOUAudioStreamer_Private.h"
+#import "DOUAudioPlaybackItem.h"
+#import "DOUAudioDecoder.h"
+#import "DOUAudioLPCM.h"
+#import "DOUAudioGain.h"
+#include <Accelerate/Accelerate.h>
+#include <pthread.h>
+
+@interface _DOUAudioMixerVoice : NSObject
+
+@property (nonatomic, strong) DOUAudioStreamer *streamer;
+@property (nonatomic, assign) NSTimeInterval delay;
+@property (nonatomic, assign) UInt64 startFrame;
+@property (nonatomic, assign) UInt64 mixedFrames;
+@property (nonatomic, assign) UInt64 mixEndFrame;
+@property (nonatomic, assign, getter=isScheduled) BOOL scheduled;
+@property (nonatomic, assign, getter=isPaused) BOOL paused;
+@property (nonatomic, assign, getter=isRemoved) BOOL removed;
+@property (nonatomic, assign, getter=isFinished) BOOL finished;
+
+@end
+
+@implementation _DOUAudioMixerVoice
+@end
+
+@interface DOUAudioMixer () {
+@private
+  AudioStreamBasicDescription _outputFormat;
+  NSUInteger _decoderBufferSize;
+  DOUAudioFileProviderEventBlock _fileProviderEventBlock;
+
+  pthread_mutex_t _mutex;
+  NSMutableArray *_voices;
+  UInt64 _heardFrame;
+
+  float *_mixBuffer;
+  NSUInteger _mixBufferSize;
+}
+@end
+
+@implementation DOUAudioMixer
+
+@synthesize outputFormat = _outputFormat;
+@synthesize decoderBufferSize = _decoderBufferSize;
+@synthesize fileProviderEventBlock = _fileProviderEventBlock;
+
+- (instancetype)init
+{
+  self = [super init];
+  if (self) {
+    _outputFormat = [DOUAudioDecoder defaultOutputFormat];
+    _voices = [NSMutableArray array];
+    pthread_mutex_init(&_mutex, NULL);
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  free(_mixBuffer);
+  pthread_mutex_destroy(&_mutex);
+}
+
+- (_DOUAudioMixerVoice *)_voiceForStreamer:(DOUAudioStreamer *)streamer
+{
+  for (_DOUAudioMixerVoice *voice in _voices) {
+    if ([voice streamer] == streamer && ![voice isRemoved]) {
+      return voice;
+    }
+  }
+
+  return nil;
+}
+
+- (NSArray *)_voicesPassingTest:(BOOL (^)(_DOUAudioMixerVoice *voice))predicate
+{
+  NSMutableArray *voices = [NSMutableArray array];
+
+  pthread_mutex_lock(&_mutex);
+  for (_DOUAudioMixerVoice *voice in _voices) {
+    if (predicate(voice)) {
+      [voices addObject:voice];
+    }
+  }
+  pthread_mutex_unlock(&_mutex);
+
+  return voices;
+}
+
+- (BOOL)isActive
+{
+  BOOL active = NO;
+
+  pthread_mutex_lock(&_mutex);
+  for (_DOUAudioMixerVoice *voice in _voices) {
+    if (![voice isPaused] && ![voice isRemoved]) {
+      active = YES;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&_mutex);
+
+  return active;
+}
+
+- (void)addStreamer:(DOUAudioStreamer *)streamer delay:(NSTimeInterval)delay
+{
+  if (streamer == nil) {
+    return;
+  }
+
+  pthread_mutex_lock(&_mutex);
+  _DOUAudioMixerVoice *voice = [self _voiceForStreamer:streamer];
+  if (voice == nil) {
+    voice = [[_DOUAudioMixerVoice alloc] init];
+    [voice setStreamer:streamer];
+    [voice setDelay:MAX(delay, 0.0)];
+    [_voices addObject:voice];
+  }
+  else if ([voice isPaused]) {
+    [voice setPaused:NO];
+  }
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (void)pauseStreamer:(DOUAudioStreamer *)streamer
+{
+  pthread_mutex_lock(&_mutex);
+  [[self _voiceForStreamer:streamer] setPaused:YES];
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (void)removeStreamer:(DOUAudioStreamer *)streamer
+{
+  pthread_mutex_lock(&_mutex);
+  [[self _voiceForStreamer:streamer] setRemoved:YES];
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (BOOL)containsStreamer:(DOUAudioStreamer *)streamer
+{
+  pthread_mutex_lock(&_mutex);
+  BOOL contains = [self _voiceForStreamer:streamer] != nil;
+  pthread_mutex_unlock(&_mutex);
+
+  return contains;
+}
+
+- (NSTimeInterval)_currentTimeForVoice:(_DOUAudioMixerVoice *)voice
+{
+  UInt64 lag = [voice mixEndFrame] > _heardFrame ? [voice mixEndFrame] - _heardFrame : 0;
+  UInt64 playedFrames = [voice mixedFrames] > lag ? [voice mixedFrames] - lag : 0;
+  return (NSTimeInterval)playedFrames / _outputFormat.mSampleRate;
+}
+
+- (NSTimeInterval)currentTimeForStreamer:(DOUAudioStreamer *)streamer
+{
+  NSTimeInterval currentTime = 0.0;
+
+  pthread_mutex_lock(&_mutex);
+  _DOUAudioMixerVoice *voice = [self _voiceForStreamer:streamer];
+  if (voice != nil) {
+    currentTime = [self _currentTimeForVoice:voice];
+  }
+  pthread_mutex_unlock(&_mutex);
+
+  return currentTime;
+}
+
+- (void)_finalizeVoice:(_DOUAudioMixerVoice *)voice status:(DOUAudioStreamerStatus)status
+{
+  DOUAudioStreamer *streamer = [voice streamer];
+  [streamer setDecoder:nil];
+  [streamer setPlaybackItem:nil];
+  [[streamer fileProvider] setEventBlock:NULL];
+  [streamer setStatus:status];
+
+  pthread_mutex_lock(&_mutex);
+  [_voices removeObjectIdenticalTo:voice];
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (void)_failVoice:(_DOUAudioMixerVoice *)voice code:(DOUAudioStreamerErrorCode)code
+{
+  [[voice streamer] setError:[NSError errorWithDomain:kDOUAudioStreamerErrorDomain
+                                                 code:code
+                                             userInfo:nil]];
+  [self _finalizeVoice:voice status:DOUAudioStreamerError];
+}
+
+- (void)_openVoice:(_DOUAudioMixerVoice *)voice
+{
+  DOUAudioStreamer *streamer = [voice streamer];
+  DOUAudioFileProvider *fileProvider = [streamer fileProvider];
+
+  [fileProvider setEventBlock:_fileProviderEventBlock];
+
+  if ([fileProvider isFailed]) {
+    [self _failVoice:voice code:DOUAudioStreamerNetworkError];
+    return;
+  }
+
+  if (![fileProvider isReady]) {
+    [streamer setStatus:DOUAudioStreamerBuffering];
+    return;
+  }
+
+  if ([streamer playbackItem] == nil) {
+    DOUAudioPlaybackItem *playbackItem = [DOUAudioPlaybackItem playbackItemWithFileProvider:fileProvider];
+    if (![playbackItem open]) {
+      [self _failVoice:voice code:DOUAudioStreamerDecodingError];
+      return;
+    }
+
+    [streamer setPlaybackItem:playbackItem];
+    [streamer setDuration:(NSTimeInterval)[playbackItem estimatedDuration] / 1000.0];
+  }
+
+  DOUAudioDecoder *decoder = [DOUAudioDecoder decoderWithPlaybackItem:[streamer playbackItem]
+                                                         outputFormat:_outputFormat
+                                                           bufferSize:_decoderBufferSize];
+  if (![decoder setUp]) {
+    [self _failVoice:voice code:DOUAudioStreamerDecodingError];
+    return;
+  }
+
+  if ([voice mixedFrames] > 0) {
+    [decoder seekToTime:(NSUInteger)llrint([self _currentTimeForVoice:voice] * 1000.0)];
+  }
+
+  [streamer setDecoder:decoder];
+  [streamer setStatus:DOUAudioStreamerPlaying];
+}
+
+- (void)updateWithFrame:(UInt64)frame queuedTime:(NSUInteger)queuedTime
+{
+  UInt64 queuedFrames = (UInt64)(queuedTime * _outputFormat.mSampleRate / 1000.0);
+
+  pthread_mutex_lock(&_mutex);
+  _heardFrame = frame > queuedFrames ? frame - queuedFrames : 0;
+  NSArray *voices = [_voices copy];
+  pthread_mutex_unlock(&_mutex);
+
+  for (_DOUAudioMixerVoice *voice in voices) {
+    DOUAudioStreamer *streamer = [voice streamer];
+
+    pthread_mutex_lock(&_mutex);
+    BOOL removed = [voice isRemoved];
+    BOOL paused = [voice isPaused];
+    BOOL finished = [voice isFinished];
+    if (!removed && !paused && ![voice isScheduled]) {
+      UInt64 delayFrames = (UInt64)llrint([voice delay] * _outputFormat.mSampleRate);
+      [voice setStartFrame:MAX(_heardFrame + delayFrames, frame)];
+      [voice setScheduled:YES];
+    }
+    pthread_mutex_unlock(&_mutex);
+
+    if (removed) {
+      [self _finalizeVoice:voice status:DOUAudioStreamerIdle];
+    }
+    else if (finished) {
+      [self _finalizeVoice:voice status:DOUAudioStreamerFinished];
+    }
+    else if (paused) {
+      if ([streamer status] != DOUAudioStreamerPaused) {
+        [streamer setStatus:DOUAudioStreamerPaused];
+      }
+    }
+    else {
+      DOUAudioDecoder *decoder = [streamer decoder];
+      if (decoder != nil && [decoder outputFormat].mSampleRate != _outputFormat.mSampleRate) {
+        [streamer setDecoder:nil];
+        decoder = nil;
+      }
+
+      if (decoder == nil) {
+        [self _openVoice:voice];
+      }
+      else if ([streamer status] == DOUAudioStreamerPaused) {
+        [streamer setStatus:DOUAudioStreamerPlaying];
+      }
+    }
+  }
+}
+
+/*
+ * Voices are decoded concurrently with dispatch_apply, each until its LPCM
+ * queue holds the length about to be mixed or its decoder has to wait.
+ * Statuses are only published afterwards, from the event loop thread.
+ */
+
+- (void)decodeForLength:(NSUInteger)length
+{
+  NSArray *voices = [self _voicesPassingTest:^BOOL(_DOUAudioMixerVoice *voice) {
+    return ![voice isPaused] && ![voice isRemoved] && ![voice isFinished] && [[voice streamer] decoder] != nil;
+  }];
+
+  NSUInteger count = [voices count];
+  if (count == 0) {
+    return;
+  }
+
+  DOUAudioDecoderStatus *statuses = (DOUAudioDecoderStatus *)malloc(sizeof(DOUAudioDecoderStatus) * count);
+  dispatch_apply(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^(size_t index) {
+    DOUAudioDecoder *decoder = [[[voices objectAtIndex:index] streamer] decoder];
+    DOUAudioLPCM *lpcm = [decoder lpcm];
+
+    DOUAudioDecoderStatus status = DOUAudioDecoderSucceeded;
+    while ([lpcm readableLength] < length && ![lpcm isEnd]) {
+      NSUInteger readableLength = [lpcm readableLength];
+      status = [decoder decodeOnce];
+      if (status != DOUAudioDecoderSucceeded || [lpcm readableLength] == readableLength) {
+        break;
+      }
+    }
+
+    statuses[index] = status;
+  });
+
+  for (NSUInteger i = 0; i < count; ++i) {
+    _DOUAudioMixerVoice *voice = [voices objectAtIndex:i];
+    DOUAudioStreamer *streamer = [voice streamer];
+
+    switch (statuses[i]) {
+    case DOUAudioDecoderFailed:
+      [self _failVoice:voice code:DOUAudioStreamerDecodingError];
+      break;
+
+    case DOUAudioDecoderWaiting:
+      if ([streamer status] != DOUAudioStreamerBuffering) {
+        [streamer setStatus:DOUAudioStreamerBuffering];
+      }
+      break;
+
+    case DOUAudioDecoderSucceeded:
+    case DOUAudioDecoderEndEncountered:
+      if ([streamer status] != DOUAudioStreamerPlaying) {
+        [streamer setStatus:DOUAudioStreamerPlaying];
+      }
+      break;
+    }
+  }
+
+  free(statuses);
+}
+
+- (float *)_mixBufferWithLength:(NSUInteger)length
+{
+  if (_mixBufferSize < length) {
+    free(_mixBuffer);
+    _mixBuffer = (float *)malloc(length);
+    _mixBufferSize = (_mixBuffer != NULL ? length : 0);
+  }
+
+  return _mixBuffer;
+}
+
+/*
+ * Voices are summed into a copy of the bytes on their way to the renderer.
+ * The renderer then applies the track gain of the current streamer to
+ * everything it plays, so voices are scaled by its inverse to keep their own
+ * level, and the sum is clipped to the inverse of full scale so that it is
+ * clipped at full scale once the gain is applied.  The caller passes the
+ * gain the renderer will apply to these bytes, which is the one it has been
+ * given last, since both latch it at the same write position.
+ */
+
+- (const void *)mixBytes:(const void *)bytes length:(NSUInteger)length frame:(UInt64)frame trackGain:(double)trackGain
+{
+  const NSUInteger bytesPerFrame = _outputFormat.mBytesPerFrame;
+  const NSUInteger channelCount = _outputFormat.mChannelsPerFrame;
+  const NSUInteger frameCount = length / bytesPerFrame;
+
+  NSArray *voices = [self _voicesPassingTest:^BOOL(_DOUAudioMixerVoice *voice) {
+    return ![voice isPaused] && ![voice isRemoved] && [voice isScheduled] && [voice startFrame] < frame + frameCount;
+  }];
+
+  if ([voices count] == 0 && bytes != NULL) {
+    return bytes;
+  }
+
+  float *buffer = [self _mixBufferWithLength:length];
+  if (buffer == NULL) {
+    return bytes;
+  }
+
+  if (bytes != NULL) {
+    memcpy(buffer, bytes, length);
+  }
+  else {
+    memset(buffer, 0, length);
+  }
+
+  if ([voices count] == 0) {
+    return buffer;
+  }
+
+  const float scale = 1.0f / dou_audio_gain_from_decibels(trackGain);
+
+  for (_DOUAudioMixerVoice *voice in voices) {
+    DOUAudioStreamer *streamer = [voice streamer];
+    DOUAudioLPCM *lpcm = [[streamer decoder] lpcm];
+    if (lpcm == nil) {
+      continue;
+    }
+
+    const float gain = (float)[streamer mixVolume] * scale;
+    NSUInteger offset = (NSUInteger)([voice startFrame] > frame ? [voice startFrame] - frame : 0);
+    NSUInteger position = offset;
+
+    const void *voiceBytes = NULL;
+    NSUInteger voiceLength = 0;
+    while (position < frameCount &&
+           [lpcm borrowBytes:&voiceBytes length:&voiceLength] && voiceLength >= bytesPerFrame) {
+      NSUInteger count = MIN(voiceLength / bytesPerFrame, frameCount - position);
+      float *samples = buffer + position * channelCount;
+      vDSP_vsma((const float *)voiceBytes, 1, &gain, samples, 1, samples, 1, count * channelCount);
+
+      [lpcm commitLength:count * bytesPerFrame];
+      position += count;
+    }
+
+    pthread_mutex_lock(&_mutex);
+    [voice setMixedFrames:[voice mixedFrames] + (position - offset)];
+    [voice setMixEndFrame:frame + position];
+    if ([lpcm isEnd] && [lpcm readableLength] == 0) {
+      [voice setFinished:YES];
+    }
+    pthread_mutex_unlock(&_mutex);
+  }
+
+  const float maximum = scale;
+  const float minimum = -maximum;
+  vDSP_vclip(buffer, 1, &minimum, &maximum, buffer, 1, frameCount * channelCount);
+
+  return buffer;
+}
+
+@end
@@ -15,16 +15,14 @@
  */
 
 #import <Foundation/Foundation.h>
+#import "DOUAudioRendering.h"
 
-@interface NSData (DOUAudioMappedFile)
+@interface DOUAudioNullRenderer : NSObject <DOUAudioRendering>
 
-+ (instancetype)dou_dataWithMappedContentsOfFile:(NSString *)path;
-+ (instancetype)dou_dataWithMappedContentsOfURL:(NSURL *)url;
++ (instancetype)renderer;
 
-+ (instancetype)dou_modifiableDataWithMappedContentsOfFile:(NSString *)path;
-+ (instancetype)dou_modifiableDataWithMappedContentsOfURL:(NSURL *)url;
-
-- (void)dou_synchronizeMappedFile;
+// Called with every rendered chunk of PCM, subclasses may override it to
+// consume the samples.  The default implementation drops them.
+- (void)consumeBytes:(const void *)bytes length:(NSUInteger)length;
 
 @end
-
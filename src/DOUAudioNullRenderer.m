@@ -0,0 +1,227 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioNullRenderer.h"
+#import "DOUAudioDecoder.h"
+#import "DOUAudioAnalysisWorker.h"
+#import "DOUAudioMetrics.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <mach/mach_time.h>
+
+/*
+ * The null renderer consumes PCM as soon as it is rendered, so the event loop
+ * decodes as fast as the provider and the decoder allow.  Its clock is the
+ * amount of PCM consumed rather than the wall clock, which keeps currentTime,
+ * seeking and gapless timing consistent at any speed.  Volume and track gain
+ * are recorded but never applied, and any source sample rate is accepted as
+ * it is.
+ */
+
+@interface DOUAudioNullRenderer () {
+@private
+  pthread_mutex_t _mutex;
+
+  _Atomic(uint64_t) _renderedLength;
+  _Atomic(uint64_t) _firstAudioHostTime;
+
+  AudioStreamBasicDescription _format;
+
+  BOOL _started;
+  BOOL _interrupted;
+  NSUInteger _startThreshold;
+  double _volume;
+  double _trackGain;
+
+  DOUAudioMetrics *_metrics;
+  NSArray *_analyzers;
+  DOUAudioAnalysisWorker *_analysisWorker;
+}
+@end
+
+@implementation DOUAudioNullRenderer
+
+@synthesize format = _format;
+@synthesize startThreshold = _startThreshold;
+@synthesize trackGain = _trackGain;
+@synthesize metrics = _metrics;
+@dynamic analyzers;
+
++ (instancetype)renderer
+{
+  return [[[self class] alloc] init];
+}
+
+- (instancetype)init
+{
+  self = [super init];
+  if (self) {
+    pthread_mutex_init(&_mutex, NULL);
+    atomic_init(&_renderedLength, 0);
+    atomic_init(&_firstAudioHostTime, 0);
+    _format = [DOUAudioDecoder defaultOutputFormat];
+    _volume = 1.0;
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  pthread_mutex_destroy(&_mutex);
+}
+
+- (BOOL)setUp
+{
+  return YES;
+}
+
+- (void)tearDown
+{
+  [self stop];
+}
+
+- (double)sampleRateForSourceSampleRate:(double)sampleRate
+{
+  return sampleRate;
+}
+
+- (void)consumeBytes:(const void *)bytes length:(NSUInteger)length
+{
+}
+
+- (void)renderBytes:(const void *)bytes length:(NSUInteger)length
+{
+  pthread_mutex_lock(&_mutex);
+  if (!_started) {
+    if (_interrupted) {
+      pthread_mutex_unlock(&_mutex);
+      return;
+    }
+
+    _started = YES;
+  }
+  pthread_mutex_unlock(&_mutex);
+
+  if (length == 0) {
+    return;
+  }
+
+  if (atomic_load(&_firstAudioHostTime) == 0) {
+    uint64_t hostTime = mach_absolute_time();
+    atomic_store(&_firstAudioHostTime, hostTime);
+    dou_audio_metrics_mark_event_at_host_time(_metrics, DOUAudioMetricsFirstAudioRendered, hostTime);
+  }
+
+  dou_analysis_worker_publish_samples(_analysisWorker, (const float *)bytes, length / sizeof(float));
+  [self consumeBytes:bytes length:length];
+  atomic_fetch_add(&_renderedLength, length);
+}
+
+- (void)stop
+{
+  [_analysisWorker flush];
+
+  pthread_mutex_lock(&_mutex);
+  _started = NO;
+  atomic_store(&_firstAudioHostTime, 0);
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (void)flush
+{
+  [self flushShouldResetTiming:YES];
+}
+
+- (void)flushShouldResetTiming:(BOOL)shouldResetTiming
+{
+  [_analysisWorker flush];
+
+  if (shouldResetTiming) {
+    atomic_store(&_renderedLength, 0);
+    atomic_store(&_firstAudioHostTime, 0);
+  }
+}
+
+- (NSUInteger)currentTime
+{
+  uint64_t frames = atomic_load(&_renderedLength) / _format.mBytesPerFrame;
+  return (NSUInteger)(frames * 1000 / (uint64_t)_format.mSampleRate);
+}
+
+- (NSUInteger)queuedTime
+{
+  return 0;
+}
+
+- (uint64_t)firstAudioHostTime
+{
+  return atomic_load(&_firstAudioHostTime);
+}
+
+- (BOOL)isStarted
+{
+  pthread_mutex_lock(&_mutex);
+  BOOL started = _started;
+  pthread_mutex_unlock(&_mutex);
+
+  return started;
+}
+
+- (BOOL)isInterrupted
+{
+  pthread_mutex_lock(&_mutex);
+  BOOL interrupted = _interrupted;
+  pthread_mutex_unlock(&_mutex);
+
+  return interrupted;
+}
+
+- (void)setInterrupted:(BOOL)interrupted
+{
+  pthread_mutex_lock(&_mutex);
+  _interrupted = interrupted;
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (double)volume
+{
+  return _volume;
+}
+
+- (void)setVolume:(double)volume
+{
+  _volume = volume;
+}
+
+- (NSArray *)analyzers
+{
+  return _analyzers;
+}
+
+- (void)setAnalyzers:(NSArray *)analyzers
+{
+  _analyzers = [analyzers copy];
+
+  if (_analysisWorker == nil && [_analyzers count] > 0) {
+    _analysisWorker = [[DOUAudioAnalysisWorker alloc] init];
+  }
+
+  [_analysisWorker setAnalyzers:_analyzers];
+  [_analysisWorker flush];
+}
+
+@end
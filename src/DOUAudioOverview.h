@@ -0,0 +1,55 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "DOUAudioFile.h"
+
+@class DOUAudioOverview;
+
+typedef void (^DOUAudioOverviewCompletionBlock)(DOUAudioOverview *overview);
+
+@interface DOUAudioOverview : NSObject
+
++ (instancetype)overviewWithAudioFile:(id <DOUAudioFile>)audioFile
+                           resolution:(NSUInteger)resolution;
+- (instancetype)initWithAudioFile:(id <DOUAudioFile>)audioFile
+                       resolution:(NSUInteger)resolution;
+
++ (void)computeOverviewWithAudioFile:(id <DOUAudioFile>)audioFile
+                          resolution:(NSUInteger)resolution
+                     completionBlock:(DOUAudioOverviewCompletionBlock)completionBlock;
+
+// The completion block is called on the given queue, or on the worker
+// queue when it is NULL; the variant above calls it on the main queue.
++ (void)computeOverviewWithAudioFile:(id <DOUAudioFile>)audioFile
+                          resolution:(NSUInteger)resolution
+                               queue:(dispatch_queue_t)queue
+                     completionBlock:(DOUAudioOverviewCompletionBlock)completionBlock;
+
+@property (nonatomic, readonly) id <DOUAudioFile> audioFile;
+@property (nonatomic, readonly) NSUInteger resolution;
+
+@property (nonatomic, readonly) NSTimeInterval duration;
+@property (nonatomic, readonly) double sampleRate;
+@property (nonatomic, readonly) NSUInteger channelCount;
+
+@property (nonatomic, readonly) NSData *peaks;
+@property (nonatomic, readonly) NSData *rms;
+@property (nonatomic, readonly) double integratedLoudness;
+
+- (double)gainForTargetLoudness:(double)targetLoudness;
+
+@end
@@ -0,0 +1,696 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioOverview.h"
+#import "DOUAudioFileProvider.h"
+#import "DOUAudioPlaybackItem.h"
+#import "DOUAudioSeekIndex.h"
+#include <AudioToolbox/AudioToolbox.h>
+#include <math.h>
+
+static const NSUInteger kDOUAudioOverviewChunksPerProcessor = 4;
+static const SInt64 kDOUAudioOverviewMinimumChunkFrames = 1 << 18;
+static const SInt64 kDOUAudioOverviewPrerollFrames = 8192;
+static const UInt32 kDOUAudioOverviewBufferFrames = 4096;
+static const UInt32 kDOUAudioOverviewSourceBufferSize = 64 * 1024;
+
+/*
+ * The file is split into packet-aligned chunks that are decoded concurrently
+ * with dispatch_apply.  Every chunk opens its own playback item, and thus its
+ * own AudioFileID, plus its own AudioConverter over the shared mapped data.
+ * The items all share the seek index of the first one, and every chunk
+ * starts decoding a few packets early so that both the codec and the
+ * K-weighting filters have settled by the time its first frame is reached.
+ * Chunks accumulate into the envelope bins and the 100ms loudness sub-blocks
+ * they overlap, and the partial results are merged once all of them are
+ * done.  Chunk boundaries are accurate to within the codec delay, which is
+ * far below any useful envelope resolution.
+ *
+ * Integrated loudness follows ITU-R BS.1770: K-weighted mean squares over
+ * 400ms blocks overlapping by 75%, an absolute gate at -70 LUFS and a
+ * relative gate 10 LU below the absolutely gated loudness.  The channel
+ * layout is not known here, so the first three channels get unity weight
+ * and any further ones are treated as surrounds.
+ */
+
+typedef struct {
+  double b0, b1, b2;
+  double a1, a2;
+} overview_biquad;
+
+typedef struct {
+  double x1, x2;
+  double y1, y2;
+} overview_biquad_state;
+
+typedef struct {
+  AudioStreamBasicDescription inputFormat;
+  AudioStreamBasicDescription outputFormat;
+
+  SInt64 packetCount;
+  SInt64 frameCount;
+  SInt64 primingFrames;
+
+  SInt64 chunkPackets;
+  SInt64 prerollPackets;
+
+  NSUInteger resolution;
+  SInt64 subblockFrames;
+  NSUInteger subblockCount;
+
+  overview_biquad shelf;
+  overview_biquad highpass;
+} overview_layout;
+
+typedef struct {
+  BOOL succeeded;
+
+  NSUInteger firstBin;
+  NSUInteger binCount;
+  float *peaks;
+  double *squares;
+  SInt64 *samples;
+
+  NSUInteger firstSubblock;
+  NSUInteger subblockCount;
+  double *energies;
+} overview_chunk;
+
+typedef struct {
+  AudioFileID fileID;
+  void *item;
+  void *seekIndex;
+
+  SInt64 packet;
+  SInt64 endPacket;
+
+  void *buffer;
+  UInt32 bufferSize;
+  UInt32 maxPacketsPerRead;
+  AudioStreamPacketDescription *packetDescriptions;
+} overview_reader;
+
+@interface DOUAudioOverview () {
+@private
+  id <DOUAudioFile> _audioFile;
+  NSUInteger _resolution;
+
+  NSTimeInterval _duration;
+  double _sampleRate;
+  NSUInteger _channelCount;
+
+  NSData *_peaks;
+  NSData *_rms;
+  double _integratedLoudness;
+}
+@end
+
+@implementation DOUAudioOverview
+
+@synthesize audioFile = _audioFile;
+@synthesize resolution = _resolution;
+@synthesize duration = _duration;
+@synthesize sampleRate = _sampleRate;
+@synthesize channelCount = _channelCount;
+@synthesize peaks = _peaks;
+@synthesize rms = _rms;
+@synthesize integratedLoudness = _integratedLoudness;
+
++ (instancetype)overviewWithAudioFile:(id <DOUAudioFile>)audioFile
+                           resolution:(NSUInteger)resolution
+{
+  return [[[self class] alloc] initWithAudioFile:audioFile
+                                      resolution:resolution];
+}
+
+- (instancetype)initWithAudioFile:(id <DOUAudioFile>)audioFile
+                       resolution:(NSUInteger)resolution
+{
+  self = [super init];
+  if (self) {
+    _audioFile = audioFile;
+    _resolution = resolution;
+    _integratedLoudness = -INFINITY;
+
+    if (_resolution == 0 || ![self _compute]) {
+      return nil;
+    }
+  }
+
+  return self;
+}
+
++ (void)computeOverviewWithAudioFile:(id <DOUAudioFile>)audioFile
+                          resolution:(NSUInteger)resolution
+                     completionBlock:(DOUAudioOverviewCompletionBlock)completionBlock
+{
+  [self computeOverviewWithAudioFile:audioFile
+                          resolution:resolution
+                               queue:dispatch_get_main_queue()
+                     completionBlock:completionBlock];
+}
+
++ (void)computeOverviewWithAudioFile:(id <DOUAudioFile>)audioFile
+                          resolution:(NSUInteger)resolution
+                               queue:(dispatch_queue_t)queue
+                     completionBlock:(DOUAudioOverviewCompletionBlock)completionBlock
+{
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+    DOUAudioOverview *overview = [[self class] overviewWithAudioFile:audioFile resolution:resolution];
+    if (completionBlock == nil) {
+      return;
+    }
+
+    if (queue == NULL) {
+      completionBlock(overview);
+    }
+    else {
+      dispatch_async(queue, ^{
+        completionBlock(overview);
+      });
+    }
+  });
+}
+
+#pragma mark - Filters
+
+static void overview_make_k_weighting(double sampleRate, overview_biquad *shelf, overview_biquad *highpass)
+{
+  double f0 = 1681.974450955533;
+  double gain = 3.999843853973347;
+  double q = 0.7071752369554196;
+
+  double k = tan(M_PI * f0 / sampleRate);
+  double vh = pow(10.0, gain / 20.0);
+  double vb = pow(vh, 0.4996667741545416);
+  double a0 = 1.0 + k / q + k * k;
+
+  shelf->b0 = (vh + vb * k / q + k * k) / a0;
+  shelf->b1 = 2.0 * (k * k - vh) / a0;
+  shelf->b2 = (vh - vb * k / q + k * k) / a0;
+  shelf->a1 = 2.0 * (k * k - 1.0) / a0;
+  shelf->a2 = (1.0 - k / q + k * k) / a0;
+
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+
+  k = tan(M_PI * f0 / sampleRate);
+  a0 = 1.0 + k / q + k * k;
+
+  highpass->b0 = 1.0;
+  highpass->b1 = -2.0;
+  highpass->b2 = 1.0;
+  highpass->a1 = 2.0 * (k * k - 1.0) / a0;
+  highpass->a2 = (1.0 - k / q + k * k) / a0;
+}
+
+static inline double overview_biquad_process(const overview_biquad *biquad, overview_biquad_state *state, double x)
+{
+  double y = biquad->b0 * x + biquad->b1 * state->x1 + biquad->b2 * state->x2 - biquad->a1 * state->y1 - biquad->a2 * state->y2;
+
+  state->x2 = state->x1;
+  state->x1 = x;
+  state->y2 = state->y1;
+  state->y1 = y;
+
+  return y;
+}
+
+#pragma mark - Decoding
+
+static BOOL overview_read_indexed_packets(overview_reader *reader, UInt32 *ioNumberDataPackets, UInt32 *outNumBytes)
+{
+  if (reader->seekIndex == NULL || reader->packetDescriptions == NULL) {
+    return NO;
+  }
+
+  __unsafe_unretained DOUAudioPlaybackItem *item = (__bridge DOUAudioPlaybackItem *)reader->item;
+  __unsafe_unretained DOUAudioSeekIndex *seekIndex = (__bridge DOUAudioSeekIndex *)reader->seekIndex;
+
+  SInt64 byteOffset = 0;
+  UInt32 byteCount = 0;
+  UInt32 numPackets = [seekIndex getPacketDescriptions:reader->packetDescriptions
+                                            fromPacket:reader->packet
+                                                 count:*ioNumberDataPackets
+                                          maxByteCount:reader->bufferSize
+                                            byteOffset:&byteOffset
+                                             byteCount:&byteCount];
+  if (numPackets == 0 ||
+      [item readBytes:reader->buffer offset:[item dataOffset] + (NSUInteger)byteOffset length:byteCount] != byteCount) {
+    return NO;
+  }
+
+  *ioNumberDataPackets = numPackets;
+  *outNumBytes = byteCount;
+  return YES;
+}
+
+static OSStatus overview_data_proc(AudioConverterRef inAudioConverter, UInt32 *ioNumberDataPackets, AudioBufferList *ioData, AudioStreamPacketDescription **outDataPacketDescription, void *inUserData)
+{
+  overview_reader *reader = (overview_reader *)inUserData;
+
+  UInt32 numPackets = (UInt32)MIN((SInt64)MIN(*ioNumberDataPackets, reader->maxPacketsPerRead), reader->endPacket - reader->packet);
+  UInt32 numBytes = 0;
+
+  if (numPackets > 0 &&
+      !overview_read_indexed_packets(reader, &numPackets, &numBytes)) {
+    numBytes = reader->bufferSize;
+    OSStatus status = AudioFileReadPacketData(reader->fileID, false, &numBytes, reader->packetDescriptions, reader->packet, &numPackets, reader->buffer);
+    if (status != noErr && status != kAudioFileEndOfFileError) {
+      return status;
+    }
+  }
+
+  reader->packet += numPackets;
+
+  *ioNumberDataPackets = numPackets;
+  ioData->mBuffers[0].mData = numPackets > 0 ? reader->buffer : NULL;
+  ioData->mBuffers[0].mDataByteSize = numPackets > 0 ? numBytes : 0;
+
+  if (outDataPacketDescription != NULL) {
+    *outDataPacketDescription = reader->packetDescriptions;
+  }
+
+  return noErr;
+}
+
+static NSUInteger overview_bin_for_frame(const overview_layout *layout, SInt64 frame)
+{
+  return (NSUInteger)((UInt64)frame * layout->resolution / (UInt64)layout->frameCount);
+}
+
+static void overview_fill_magic_cookie(AudioConverterRef converter, AudioFileID fileID)
+{
+  UInt32 cookieSize = 0;
+  if (AudioFileGetPropertyInfo(fileID, kAudioFilePropertyMagicCookieData, &cookieSize, NULL) != noErr ||
+      cookieSize == 0) {
+    return;
+  }
+
+  void *cookie = malloc(cookieSize);
+  if (AudioFileGetProperty(fileID, kAudioFilePropertyMagicCookieData, &cookieSize, cookie) == noErr) {
+    AudioConverterSetProperty(converter, kAudioConverterDecompressionMagicCookie, cookieSize, cookie);
+  }
+
+  free(cookie);
+}
+
+static BOOL overview_decode_chunk(const overview_layout *layout, DOUAudioPlaybackItem *sharedItem, NSUInteger index, overview_chunk *chunk)
+{
+  SInt64 framesPerPacket = layout->inputFormat.mFramesPerPacket;
+  SInt64 startPacket = (SInt64)index * layout->chunkPackets;
+  SInt64 endPacket = MIN(startPacket + layout->chunkPackets, layout->packetCount);
+
+  SInt64 startFrame = MAX(startPacket * framesPerPacket - layout->primingFrames, 0);
+  SInt64 endFrame = endPacket < layout->packetCount ? endPacket * framesPerPacket - layout->primingFrames : layout->frameCount;
+  endFrame = MIN(endFrame, layout->frameCount);
+  if (startFrame >= endFrame) {
+    return YES;
+  }
+
+  chunk->firstBin = overview_bin_for_frame(layout, startFrame);
+  chunk->binCount = overview_bin_for_frame(layout, endFrame - 1) - chunk->firstBin + 1;
+  chunk->peaks = (float *)calloc(chunk->binCount, sizeof(float));
+  chunk->squares = (double *)calloc(chunk->binCount, sizeof(double));
+  chunk->samples = (SInt64 *)calloc(chunk->binCount, sizeof(SInt64));
+
+  chunk->firstSubblock = (NSUInteger)(startFrame / layout->subblockFrames);
+  chunk->subblockCount = (NSUInteger)((endFrame - 1) / layout->subblockFrames) - chunk->firstSubblock + 1;
+  chunk->energies = (double *)calloc(chunk->subblockCount, sizeof(double));
+
+  DOUAudioPlaybackItem *item = [DOUAudioPlaybackItem playbackItemWithFileProvider:[sharedItem fileProvider]];
+  if (![item openWithSharedSeekIndex:[sharedItem seekIndex]]) {
+    return NO;
+  }
+
+  AudioConverterRef converter = NULL;
+  if (AudioConverterNew(&layout->inputFormat, &layout->outputFormat, &converter) != noErr) {
+    [item close];
+    return NO;
+  }
+
+  overview_fill_magic_cookie(converter, [item fileID]);
+
+  SInt64 readPacket = MAX(startPacket - layout->prerollPackets, 0);
+  SInt64 position = readPacket * framesPerPacket - layout->primingFrames;
+
+  if (layout->inputFormat.mBitsPerChannel == 0) {
+    AudioConverterPrimeInfo primeInfo;
+    primeInfo.leadingFrames = readPacket == 0 ? (UInt32)layout->primingFrames : 0;
+    primeInfo.trailingFrames = 0;
+    AudioConverterSetProperty(converter, kAudioConverterPrimeInfo, sizeof(primeInfo), &primeInfo);
+
+    if (readPacket == 0) {
+      position = 0;
+    }
+  }
+
+  overview_reader reader;
+  memset(&reader, 0, sizeof(reader));
+  reader.fileID = [item fileID];
+  reader.item = (__bridge void *)item;
+  reader.seekIndex = (__bridge void *)[sharedItem seekIndex];
+  reader.packet = readPacket;
+  reader.endPacket = endPacket;
+
+  UInt32 packetSize = layout->inputFormat.mBytesPerPacket;
+  if (packetSize == 0) {
+    UInt32 size = sizeof(packetSize);
+    if (AudioFileGetProperty(reader.fileID, kAudioFilePropertyPacketSizeUpperBound, &size, &packetSize) != noErr ||
+        packetSize == 0) {
+      AudioConverterDispose(converter);
+      [item close];
+      return NO;
+    }
+  }
+
+  reader.bufferSize = MAX(kDOUAudioOverviewSourceBufferSize, packetSize);
+  reader.buffer = malloc(reader.bufferSize);
+  reader.maxPacketsPerRead = reader.bufferSize / packetSize;
+  if (layout->inputFormat.mBytesPerPacket == 0) {
+    reader.packetDescriptions = (AudioStreamPacketDescription *)malloc(sizeof(AudioStreamPacketDescription) * reader.maxPacketsPerRead);
+  }
+
+  UInt32 channelCount = layout->outputFormat.mChannelsPerFrame;
+  float *output = (float *)malloc(layout->outputFormat.mBytesPerFrame * kDOUAudioOverviewBufferFrames);
+  overview_biquad_state *states = (overview_biquad_state *)calloc(channelCount * 2, sizeof(overview_biquad_state));
+
+  BOOL succeeded = YES;
+  while (position < endFrame) {
+    AudioBufferList bufferList;
+    bufferList.mNumberBuffers = 1;
+    bufferList.mBuffers[0].mNumberChannels = channelCount;
+    bufferList.mBuffers[0].mDataByteSize = layout->outputFormat.mBytesPerFrame * kDOUAudioOverviewBufferFrames;
+    bufferList.mBuffers[0].mData = output;
+
+    UInt32 numFrames = kDOUAudioOverviewBufferFrames;
+    if (AudioConverterFillComplexBuffer(converter, overview_data_proc, &reader, &numFrames, &bufferList, NULL) != noErr) {
+      succeeded = NO;
+      break;
+    }
+
+    if (numFrames == 0) {
+      break;
+    }
+
+    for (UInt32 i = 0; i < numFrames && position < endFrame; ++i, ++position) {
+      const float *frame = output + i * channelCount;
+
+      BOOL accumulating = position >= startFrame;
+      NSUInteger bin = accumulating ? overview_bin_for_frame(layout, position) - chunk->firstBin : 0;
+      NSUInteger subblock = accumulating ? (NSUInteger)(position / layout->subblockFrames) - chunk->firstSubblock : 0;
+
+      for (UInt32 channel = 0; channel < channelCount; ++channel) {
+        double sample = frame[channel];
+        double weighted = overview_biquad_process(&layout->shelf, &states[channel * 2], sample);
+        weighted = overview_biquad_process(&layout->highpass, &states[channel * 2 + 1], weighted);
+
+        if (!accumulating) {
+          continue;
+        }
+
+        float magnitude = fabsf(frame[channel]);
+        if (magnitude > chunk->peaks[bin]) {
+          chunk->peaks[bin] = magnitude;
+        }
+
+        chunk->squares[bin] += sample * sample;
+        chunk->energies[subblock] += (channel < 3 ? 1.0 : 1.41) * weighted * weighted;
+      }
+
+      if (accumulating) {
+        chunk->samples[bin] += channelCount;
+      }
+    }
+  }
+
+  free(states);
+  free(output);
+  free(reader.buffer);
+  if (reader.packetDescriptions != NULL) {
+    free(reader.packetDescriptions);
+  }
+
+  AudioConverterDispose(converter);
+  [item close];
+
+  return succeeded;
+}
+
+#pragma mark - Computation
+
+- (BOOL)_fillLayout:(overview_layout *)layout withPlaybackItem:(DOUAudioPlaybackItem *)item
+{
+  memset(layout, 0, sizeof(overview_layout));
+
+  layout->inputFormat = [item fileFormat];
+  if (layout->inputFormat.mFramesPerPacket == 0 ||
+      layout->inputFormat.mChannelsPerFrame == 0 ||
+      layout->inputFormat.mSampleRate <= 0.0) {
+    return NO;
+  }
+
+  DOUAudioSeekIndex *seekIndex = [item seekIndex];
+  NSUInteger scannedLength;
+  do {
+    scannedLength = [seekIndex scannedLength];
+    [item updateSeekIndex];
+  } while (seekIndex != nil && ![seekIndex isFinished] && [seekIndex scannedLength] > scannedLength);
+
+  if ([seekIndex isFinished] && [seekIndex packetCount] > 0) {
+    layout->packetCount = (SInt64)[seekIndex packetCount];
+  }
+  else {
+    UInt64 packetCount = 0;
+    UInt32 size = sizeof(packetCount);
+    if (AudioFileGetProperty([item fileID], kAudioFilePropertyAudioDataPacketCount, &size, &packetCount) != noErr) {
+      return NO;
+    }
+    layout->packetCount = (SInt64)packetCount;
+  }
+
+  if (layout->packetCount <= 0) {
+    return NO;
+  }
+
+  SInt64 framesPerPacket = layout->inputFormat.mFramesPerPacket;
+  layout->frameCount = layout->packetCount * framesPerPacket;
+
+  if (layout->inputFormat.mBitsPerChannel == 0) {
+    AudioStreamBasicDescription baseFormat;
+    UInt32 size = sizeof(baseFormat);
+    double ratio = 1.0;
+    if (AudioFileGetProperty([item fileID], kAudioFilePropertyDataFormat, &size, &baseFormat) == noErr &&
+        baseFormat.mSampleRate > 0.0) {
+      ratio = layout->inputFormat.mSampleRate / baseFormat.mSampleRate;
+    }
+
+    AudioFilePacketTableInfo packetTableInfo;
+    size = sizeof(packetTableInfo);
+    if (AudioFileGetProperty([item fileID], kAudioFilePropertyPacketTableInfo, &size, &packetTableInfo) == noErr) {
+      layout->primingFrames = (SInt64)(packetTableInfo.mPrimingFrames * ratio + 0.5);
+      if (packetTableInfo.mNumberValidFrames > 0) {
+        layout->frameCount = MIN((SInt64)(packetTableInfo.mNumberValidFrames * ratio + 0.5), layout->frameCount);
+      }
+      else {
+        layout->frameCount -= layout->primingFrames;
+      }
+    }
+  }
+
+  if (layout->frameCount <= 0) {
+    return NO;
+  }
+
+  layout->outputFormat.mFormatID = kAudioFormatLinearPCM;
+  layout->outputFormat.mFormatFlags = kAudioFormatFlagsNativeFloatPacked;
+  layout->outputFormat.mSampleRate = layout->inputFormat.mSampleRate;
+  layout->outputFormat.mChannelsPerFrame = layout->inputFormat.mChannelsPerFrame;
+  layout->outputFormat.mBitsPerChannel = 32;
+  layout->outputFormat.mFramesPerPacket = 1;
+  layout->outputFormat.mBytesPerFrame = layout->outputFormat.mChannelsPerFrame * sizeof(float);
+  layout->outputFormat.mBytesPerPacket = layout->outputFormat.mBytesPerFrame;
+
+  SInt64 chunkCount = (SInt64)[[NSProcessInfo processInfo] activeProcessorCount] * kDOUAudioOverviewChunksPerProcessor;
+  layout->chunkPackets = MAX((layout->packetCount + chunkCount - 1) / chunkCount,
+                             (kDOUAudioOverviewMinimumChunkFrames + framesPerPacket - 1) / framesPerPacket);
+  layout->prerollPackets = (kDOUAudioOverviewPrerollFrames + framesPerPacket - 1) / framesPerPacket;
+
+  layout->resolution = _resolution;
+  layout->subblockFrames = MAX((SInt64)(layout->inputFormat.mSampleRate * 0.1 + 0.5), 1);
+  layout->subblockCount = (NSUInteger)((layout->frameCount + layout->subblockFrames - 1) / layout->subblockFrames);
+
+  overview_make_k_weighting(layout->inputFormat.mSampleRate, &layout->shelf, &layout->highpass);
+
+  return YES;
+}
+
+static double overview_integrated_loudness(const overview_layout *layout, const double *energies)
+{
+  if (layout->subblockCount < 4) {
+    return -INFINITY;
+  }
+
+  NSUInteger blockCount = layout->subblockCount - 3;
+  double *blocks = (double *)malloc(sizeof(double) * blockCount);
+
+  for (NSUInteger i = 0; i < blockCount; ++i) {
+    double energy = 0.0;
+    SInt64 frames = 0;
+    for (NSUInteger j = i; j < i + 4; ++j) {
+      energy += energies[j];
+      frames += MIN(layout->subblockFrames, layout->frameCount - (SInt64)j * layout->subblockFrames);
+    }
+
+    blocks[i] = energy / frames;
+  }
+
+  double threshold = pow(10.0, (-70.0 + 0.691) / 10.0);
+  double loudness = -INFINITY;
+
+  for (NSUInteger pass = 0; pass < 2; ++pass) {
+    double sum = 0.0;
+    NSUInteger count = 0;
+    for (NSUInteger i = 0; i < blockCount; ++i) {
+      if (blocks[i] > threshold) {
+        sum += blocks[i];
+        ++count;
+      }
+    }
+
+    if (count == 0) {
+      break;
+    }
+
+    double mean = sum / count;
+    if (pass == 0) {
+      threshold = MAX(threshold, mean * 0.1);
+    }
+    else {
+      loudness = -0.691 + 10.0 * log10(mean);
+    }
+  }
+
+  free(blocks);
+  return loudness;
+}
+
+- (BOOL)_computeWithLayout:(const overview_layout *)layout playbackItem:(DOUAudioPlaybackItem *)item
+{
+  NSUInteger chunkCount = (NSUInteger)((layout->packetCount + layout->chunkPackets - 1) / layout->chunkPackets);
+  overview_chunk *chunks = (overview_chunk *)calloc(chunkCount, sizeof(overview_chunk));
+
+  dispatch_apply(chunkCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+    @autoreleasepool {
+      chunks[index].succeeded = overview_decode_chunk(layout, item, index, &chunks[index]);
+    }
+  });
+
+  float *peaks = (float *)calloc(layout->resolution, sizeof(float));
+  double *squares = (double *)calloc(layout->resolution, sizeof(double));
+  SInt64 *samples = (SInt64 *)calloc(layout->resolution, sizeof(SInt64));
+  double *energies = (double *)calloc(layout->subblockCount, sizeof(double));
+
+  BOOL succeeded = YES;
+  for (NSUInteger i = 0; i < chunkCount; ++i) {
+    overview_chunk *chunk = &chunks[i];
+    succeeded = succeeded && chunk->succeeded;
+
+    for (NSUInteger j = 0; succeeded && j < chunk->binCount; ++j) {
+      NSUInteger bin = chunk->firstBin + j;
+      peaks[bin] = MAX(peaks[bin], chunk->peaks[j]);
+      squares[bin] += chunk->squares[j];
+      samples[bin] += chunk->samples[j];
+    }
+
+    for (NSUInteger j = 0; succeeded && j < chunk->subblockCount; ++j) {
+      energies[chunk->firstSubblock + j] += chunk->energies[j];
+    }
+
+    free(chunk->peaks);
+    free(chunk->squares);
+    free(chunk->samples);
+    free(chunk->energies);
+  }
+
+  free(chunks);
+
+  if (succeeded) {
+    float *rms = (float *)malloc(sizeof(float) * layout->resolution);
+    for (NSUInteger i = 0; i < layout->resolution; ++i) {
+      rms[i] = samples[i] > 0 ? (float)sqrt(squares[i] / samples[i]) : 0.0f;
+    }
+
+    _duration = layout->frameCount / layout->inputFormat.mSampleRate;
+    _sampleRate = layout->inputFormat.mSampleRate;
+    _channelCount = layout->inputFormat.mChannelsPerFrame;
+
+    _peaks = [NSData dataWithBytesNoCopy:peaks length:sizeof(float) * layout->resolution freeWhenDone:YES];
+    _rms = [NSData dataWithBytesNoCopy:rms length:sizeof(float) * layout->resolution freeWhenDone:YES];
+    _integratedLoudness = overview_integrated_loudness(layout, energies);
+  }
+  else {
+    free(peaks);
+  }
+
+  free(squares);
+  free(samples);
+  free(energies);
+
+  return succeeded;
+}
+
+- (double)gainForTargetLoudness:(double)targetLoudness
+{
+  if (isinf(_integratedLoudness)) {
+    return 0.0;
+  }
+
+  float peak = 0.0f;
+  const float *peaks = (const float *)[_peaks bytes];
+  for (NSUInteger i = 0; i < _resolution; ++i) {
+    peak = MAX(peak, peaks[i]);
+  }
+
+  double gain = targetLoudness - _integratedLoudness;
+  if (peak > 0.0f) {
+    gain = MIN(gain, -20.0 * log10(peak));
+  }
+
+  return gain;
+}
+
+- (BOOL)_compute
+{
+  DOUAudioFileProvider *provider = [DOUAudioFileProvider completedFileProviderWithAudioFile:_audioFile];
+  if (provider == nil || [provider store] == nil) {
+    return NO;
+  }
+
+  DOUAudioPlaybackItem *item = [DOUAudioPlaybackItem playbackItemWithFileProvider:provider];
+  if (![item open]) {
+    return NO;
+  }
+
+  overview_layout layout;
+  BOOL succeeded = [self _fillLayout:&layout withPlaybackItem:item] &&
+                   [self _computeWithLayout:&layout playbackItem:item];
+
+  [item close];
+  return succeeded;
+}
+
+@end
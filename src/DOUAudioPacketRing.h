@@ -0,0 +1,67 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#include <CoreAudio/CoreAudioTypes.h>
+
+/*
+ * A bounded window of compressed packets from a live stream.  Packets are
+ * numbered from the start of the stream and appended at the live edge; once
+ * the byte capacity or the packet capacity is reached, the oldest packets
+ * are dropped, so memory use does not depend on how long the stream runs.
+ * One thread appends while another reads.
+ */
+
+@interface DOUAudioPacketRing : NSObject
+
++ (instancetype)packetRingWithFormat:(AudioStreamBasicDescription)format
+                         magicCookie:(NSData *)magicCookie
+                   maximumPacketSize:(UInt32)maximumPacketSize
+                            duration:(NSTimeInterval)duration
+                             bitRate:(UInt32)bitRate;
+- (instancetype)initWithFormat:(AudioStreamBasicDescription)format
+                   magicCookie:(NSData *)magicCookie
+             maximumPacketSize:(UInt32)maximumPacketSize
+                      duration:(NSTimeInterval)duration
+                       bitRate:(UInt32)bitRate;
+
+@property (nonatomic, readonly) AudioStreamBasicDescription format;
+@property (nonatomic, readonly) NSData *magicCookie;
+@property (nonatomic, readonly) UInt32 maximumPacketSize;
+@property (nonatomic, readonly) UInt32 bitRate;
+
+@property (nonatomic, readonly) NSUInteger byteCapacity;
+@property (nonatomic, readonly) NSUInteger packetCapacity;
+
+@property (readonly) SInt64 firstPacket;
+@property (readonly) SInt64 endPacket;
+
+- (void)appendPackets:(const void *)packets
+        numberOfBytes:(UInt32)numberOfBytes
+      numberOfPackets:(UInt32)numberOfPackets
+   packetDescriptions:(const AudioStreamPacketDescription *)packetDescriptions;
+
+- (UInt32)readPacketsFromPacket:(SInt64 *)packet
+                          count:(UInt32)count
+                         buffer:(void *)buffer
+                     bufferSize:(UInt32)bufferSize
+             packetDescriptions:(AudioStreamPacketDescription *)packetDescriptions
+                      byteCount:(UInt32 *)byteCount;
+
+- (SInt64)packetForTime:(NSUInteger)milliseconds;
+- (NSUInteger)timeForPacket:(SInt64)packet;
+
+@end
@@ -0,0 +1,271 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioPacketRing.h"
+#include <pthread.h>
+
+static const UInt32 kDOUAudioPacketRingFallbackBitRate = 320000;
+static const NSUInteger kDOUAudioPacketRingMinimumByteCapacity = 64 * 1024;
+static const NSUInteger kDOUAudioPacketRingMaximumPacketCapacity = 1024 * 1024;
+
+typedef struct {
+  SInt64 byteOffset;
+  UInt32 size;
+  UInt32 variableFrames;
+} packet_ring_entry;
+
+@interface DOUAudioPacketRing () {
+@private
+  AudioStreamBasicDescription _format;
+  NSData *_magicCookie;
+  UInt32 _maximumPacketSize;
+  UInt32 _bitRate;
+
+  uint8_t *_bytes;
+  NSUInteger _byteCapacity;
+  packet_ring_entry *_entries;
+  NSUInteger _packetCapacity;
+
+  pthread_mutex_t _mutex;
+  SInt64 _firstPacket;
+  SInt64 _endPacket;
+  SInt64 _firstByte;
+  SInt64 _endByte;
+}
+@end
+
+@implementation DOUAudioPacketRing
+
+@synthesize format = _format;
+@synthesize magicCookie = _magicCookie;
+@synthesize maximumPacketSize = _maximumPacketSize;
+@synthesize bitRate = _bitRate;
+@synthesize byteCapacity = _byteCapacity;
+@synthesize packetCapacity = _packetCapacity;
+
++ (instancetype)packetRingWithFormat:(AudioStreamBasicDescription)format
+                         magicCookie:(NSData *)magicCookie
+                   maximumPacketSize:(UInt32)maximumPacketSize
+                            duration:(NSTimeInterval)duration
+                             bitRate:(UInt32)bitRate
+{
+  return [[[self class] alloc] initWithFormat:format
+                                  magicCookie:magicCookie
+                            maximumPacketSize:maximumPacketSize
+                                     duration:duration
+                                      bitRate:bitRate];
+}
+
+- (instancetype)initWithFormat:(AudioStreamBasicDescription)format
+                   magicCookie:(NSData *)magicCookie
+             maximumPacketSize:(UInt32)maximumPacketSize
+                      duration:(NSTimeInterval)duration
+                       bitRate:(UInt32)bitRate
+{
+  self = [super init];
+  if (self) {
+    _format = format;
+    _magicCookie = [magicCookie copy];
+    _maximumPacketSize = maximumPacketSize;
+    _bitRate = (bitRate > 0 ? bitRate : kDOUAudioPacketRingFallbackBitRate);
+
+    _byteCapacity = (NSUInteger)(MAX(duration, 0.0) * _bitRate / 8.0 * 1.25) + (NSUInteger)_maximumPacketSize * 4;
+    _byteCapacity = MAX(_byteCapacity, kDOUAudioPacketRingMinimumByteCapacity);
+
+    if (_format.mFramesPerPacket > 0 && _format.mSampleRate > 0.0) {
+      _packetCapacity = (NSUInteger)(MAX(duration, 0.0) * _format.mSampleRate / _format.mFramesPerPacket * 1.25) + 64;
+    }
+    else {
+      _packetCapacity = _byteCapacity / 64;
+    }
+    _packetCapacity = MIN(MAX(_packetCapacity, (NSUInteger)64), kDOUAudioPacketRingMaximumPacketCapacity);
+
+    _bytes = (uint8_t *)malloc(_byteCapacity);
+    _entries = (packet_ring_entry *)malloc(sizeof(packet_ring_entry) * _packetCapacity);
+    if (_bytes == NULL || _entries == NULL) {
+      free(_bytes);
+      free(_entries);
+      _bytes = NULL;
+      _entries = NULL;
+      return nil;
+    }
+
+    pthread_mutex_init(&_mutex, NULL);
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  if (_bytes == NULL) {
+    return;
+  }
+
+  free(_bytes);
+  free(_entries);
+  pthread_mutex_destroy(&_mutex);
+}
+
+- (SInt64)firstPacket
+{
+  pthread_mutex_lock(&_mutex);
+  SInt64 firstPacket = _firstPacket;
+  pthread_mutex_unlock(&_mutex);
+
+  return firstPacket;
+}
+
+- (SInt64)endPacket
+{
+  pthread_mutex_lock(&_mutex);
+  SInt64 endPacket = _endPacket;
+  pthread_mutex_unlock(&_mutex);
+
+  return endPacket;
+}
+
+static void packet_ring_copy_in(uint8_t *bytes, NSUInteger capacity, SInt64 byteOffset, const void *source, UInt32 size)
+{
+  NSUInteger location = (NSUInteger)(byteOffset % (SInt64)capacity);
+  NSUInteger firstLength = MIN((NSUInteger)size, capacity - location);
+
+  memcpy(bytes + location, source, firstLength);
+  if (firstLength < size) {
+    memcpy(bytes, (const uint8_t *)source + firstLength, size - firstLength);
+  }
+}
+
+static void packet_ring_copy_out(const uint8_t *bytes, NSUInteger capacity, SInt64 byteOffset, void *destination, UInt32 size)
+{
+  NSUInteger location = (NSUInteger)(byteOffset % (SInt64)capacity);
+  NSUInteger firstLength = MIN((NSUInteger)size, capacity - location);
+
+  memcpy(destination, bytes + location, firstLength);
+  if (firstLength < size) {
+    memcpy((uint8_t *)destination + firstLength, bytes, size - firstLength);
+  }
+}
+
+- (void)appendPackets:(const void *)packets
+        numberOfBytes:(UInt32)numberOfBytes
+      numberOfPackets:(UInt32)numberOfPackets
+   packetDescriptions:(const AudioStreamPacketDescription *)packetDescriptions
+{
+  pthread_mutex_lock(&_mutex);
+
+  for (UInt32 i = 0; i < numberOfPackets; ++i) {
+    SInt64 offset;
+    UInt32 size;
+    UInt32 variableFrames = 0;
+
+    if (packetDescriptions != NULL) {
+      offset = packetDescriptions[i].mStartOffset;
+      size = packetDescriptions[i].mDataByteSize;
+      variableFrames = packetDescriptions[i].mVariableFramesInPacket;
+    }
+    else {
+      size = (_format.mBytesPerPacket > 0 ? _format.mBytesPerPacket : numberOfBytes / numberOfPackets);
+      offset = (SInt64)i * size;
+    }
+
+    if (size == 0 ||
+        size > _byteCapacity ||
+        offset < 0 ||
+        offset + size > numberOfBytes) {
+      continue;
+    }
+
+    while (_endPacket > _firstPacket &&
+           (_endByte - _firstByte + size > (SInt64)_byteCapacity ||
+            _endPacket - _firstPacket >= (SInt64)_packetCapacity)) {
+      _firstPacket++;
+      _firstByte = (_firstPacket < _endPacket ? _entries[_firstPacket % (SInt64)_packetCapacity].byteOffset : _endByte);
+    }
+
+    packet_ring_copy_in(_bytes, _byteCapacity, _endByte, (const uint8_t *)packets + offset, size);
+
+    packet_ring_entry *entry = &_entries[_endPacket % (SInt64)_packetCapacity];
+    entry->byteOffset = _endByte;
+    entry->size = size;
+    entry->variableFrames = variableFrames;
+
+    _endByte += size;
+    _endPacket++;
+  }
+
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (UInt32)readPacketsFromPacket:(SInt64 *)packet
+                          count:(UInt32)count
+                         buffer:(void *)buffer
+                     bufferSize:(UInt32)bufferSize
+             packetDescriptions:(AudioStreamPacketDescription *)packetDescriptions
+                      byteCount:(UInt32 *)byteCount
+{
+  UInt32 numberOfPackets = 0;
+  UInt32 numberOfBytes = 0;
+
+  pthread_mutex_lock(&_mutex);
+
+  if (*packet < _firstPacket) {
+    *packet = _firstPacket;
+  }
+
+  for (SInt64 p = *packet; p < _endPacket && numberOfPackets < count; ++p) {
+    const packet_ring_entry *entry = &_entries[p % (SInt64)_packetCapacity];
+    if (numberOfBytes + entry->size > bufferSize) {
+      break;
+    }
+
+    packet_ring_copy_out(_bytes, _byteCapacity, entry->byteOffset, (uint8_t *)buffer + numberOfBytes, entry->size);
+
+    if (packetDescriptions != NULL) {
+      packetDescriptions[numberOfPackets].mStartOffset = numberOfBytes;
+      packetDescriptions[numberOfPackets].mVariableFramesInPacket = entry->variableFrames;
+      packetDescriptions[numberOfPackets].mDataByteSize = entry->size;
+    }
+
+    numberOfBytes += entry->size;
+    numberOfPackets++;
+  }
+
+  pthread_mutex_unlock(&_mutex);
+
+  *byteCount = numberOfBytes;
+  return numberOfPackets;
+}
+
+- (SInt64)packetForTime:(NSUInteger)milliseconds
+{
+  if (_format.mFramesPerPacket == 0 || _format.mSampleRate <= 0.0) {
+    return 0;
+  }
+
+  return (SInt64)floor((double)milliseconds * _format.mSampleRate / 1000.0 / _format.mFramesPerPacket);
+}
+
+- (NSUInteger)timeForPacket:(SInt64)packet
+{
+  if (_format.mSampleRate <= 0.0 || packet <= 0) {
+    return 0;
+  }
+
+  return (NSUInteger)((double)packet * _format.mFramesPerPacket * 1000.0 / _format.mSampleRate);
+}
+
+@end
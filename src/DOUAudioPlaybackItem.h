@@ -20,6 +20,9 @@
 
 @class DOUAudioFileProvider;
 @class DOUAudioFilePreprocessor;
+@class DOUAudioSeekIndex;
+@class DOUAudioCacheStore;
+@class DOUAudioPacketRing;
 @protocol DOUAudioFile;
 
 @interface DOUAudioPlaybackItem : NSObject
@@ -32,7 +35,8 @@
 @property (nonatomic, readonly) id <DOUAudioFile> audioFile;
 
 @property (nonatomic, readonly) NSURL *cachedURL;
-@property (nonatomic, readonly) NSData *mappedData;
+@property (nonatomic, readonly) DOUAudioCacheStore *store;
+@property (nonatomic, readonly) DOUAudioPacketRing *packetRing;
 
 @property (nonatomic, readonly) AudioFileID fileID;
 @property (nonatomic, readonly) AudioStreamBasicDescription fileFormat;
@@ -40,9 +44,18 @@
 @property (nonatomic, readonly) NSUInteger dataOffset;
 @property (nonatomic, readonly) NSUInteger estimatedDuration;
 
+@property (nonatomic, readonly) DOUAudioSeekIndex *seekIndex;
+
 @property (nonatomic, readonly, getter=isOpened) BOOL opened;
 
 - (BOOL)open;
 - (void)close;
 
+// Opens the item over a seek index built by another item of the same file.
+// The index is read-only to this item, which neither scans nor saves it.
+- (BOOL)openWithSharedSeekIndex:(DOUAudioSeekIndex *)seekIndex;
+
+- (NSUInteger)readBytes:(void *)buffer offset:(NSUInteger)offset length:(NSUInteger)length;
+- (void)updateSeekIndex;
+
 @end
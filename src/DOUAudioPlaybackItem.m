@@ -17,6 +17,23 @@
 #import "DOUAudioPlaybackItem.h"
 #import "DOUAudioFileProvider.h"
 #import "DOUAudioFilePreprocessor.h"
+#import "DOUAudioSeekIndex.h"
+#import "DOUAudioCache.h"
+#import "DOUAudioMetrics.h"
+#import "DOUAudioCacheStore.h"
+#import "DOUAudioPacketRing.h"
+
+static const NSUInteger kDOUAudioPlaybackItemReadAheadLength = 1024 * 1024;
+static const NSUInteger kDOUAudioPlaybackItemReleaseLag = 2 * 1024 * 1024;
+static const NSUInteger kDOUAudioPlaybackItemReleaseThreshold = 16 * 1024 * 1024;
+static const NSUInteger kDOUAudioPlaybackItemProcessedBlockLength = 64 * 1024;
+static const NSUInteger kDOUAudioPlaybackItemProcessedBlockCount = 64;
+
+typedef struct {
+  uint8_t *bytes;
+  NSUInteger index;
+  NSUInteger length;
+} playback_item_block;
 
 @interface DOUAudioPlaybackItem () {
 @private
@@ -27,6 +44,14 @@
   NSUInteger _bitRate;
   NSUInteger _dataOffset;
   NSUInteger _estimatedDuration;
+  DOUAudioSeekIndex *_seekIndex;
+  BOOL _sharesSeekIndex;
+  DOUAudioPacketRing *_packetRing;
+
+  NSUInteger _readAheadOffset;
+  NSUInteger _releasedOffset;
+
+  playback_item_block *_processedBlocks;
 }
 @end
 
@@ -39,6 +64,8 @@
 @synthesize bitRate = _bitRate;
 @synthesize dataOffset = _dataOffset;
 @synthesize estimatedDuration = _estimatedDuration;
+@synthesize seekIndex = _seekIndex;
+@synthesize packetRing = _packetRing;
 
 - (id <DOUAudioFile>)audioFile
 {
@@ -50,30 +77,199 @@
   return [_fileProvider cachedURL];
 }
 
-- (NSData *)mappedData
+- (DOUAudioCacheStore *)store
 {
-  return [_fileProvider mappedData];
+  return [_fileProvider store];
 }
 
 - (BOOL)isOpened
 {
-  return _fileID != NULL;
+  return _fileID != NULL || _packetRing != nil;
 }
 
-static OSStatus audio_file_read(void *inClientData,
-                                SInt64 inPosition,
-                                UInt32 requestCount,
-                                void *buffer, 
-                                UInt32 *actualCount)
+/*
+ * Packet reads follow the decoder.  Pages ahead of them are requested before
+ * the decoder faults on them, and for long files pages far enough behind are
+ * handed back.  Seek index scans read the file independently and leave these
+ * hints alone.
+ */
+
+- (void)_adviseReadAtOffset:(NSUInteger)offset length:(NSUInteger)length
 {
-  __unsafe_unretained DOUAudioPlaybackItem *item = (__bridge DOUAudioPlaybackItem *)inClientData;
+  DOUAudioCacheStore *store = [self store];
+  NSUInteger end = offset + length;
+
+  if (end + kDOUAudioPlaybackItemReadAheadLength / 2 > _readAheadOffset ||
+      _readAheadOffset > end + kDOUAudioPlaybackItemReadAheadLength) {
+    [store adviseSequentialAccessInRange:NSMakeRange(end, kDOUAudioPlaybackItemReadAheadLength)];
+    _readAheadOffset = end + kDOUAudioPlaybackItemReadAheadLength;
+  }
+
+  if ([store length] < kDOUAudioPlaybackItemReleaseThreshold) {
+    return;
+  }
+
+  if (offset < _releasedOffset) {
+    _releasedOffset = offset;
+  }
+  else if (offset - _releasedOffset > kDOUAudioPlaybackItemReleaseLag + kDOUAudioPlaybackItemReadAheadLength) {
+    NSUInteger releaseEnd = offset - kDOUAudioPlaybackItemReleaseLag;
+    [store releaseRange:NSMakeRange(_releasedOffset, releaseEnd - _releasedOffset)];
+    [self _releaseProcessedBlocksBeforeOffset:releaseEnd];
+    _releasedOffset = releaseEnd;
+  }
+}
+
+/*
+ * When the preprocessor asks for it, processed bytes are kept in fixed-size
+ * blocks, each in the slot given by its block index modulo the slot count,
+ * so the cache never holds more than a few megabytes and a read only ever
+ * processes the blocks it touches.  A block is cached once the provider has
+ * received all of it; until then its bytes are processed directly.  Blocks
+ * behind the play position are freed along with the store pages they came
+ * from.  All reads happen on whichever thread holds the decoder, so no
+ * locking is needed.
+ */
+
+- (void)_createProcessedBlocks
+{
+  if (![_filePreprocessor cachesProcessedData]) {
+    return;
+  }
+
+  _processedBlocks = (playback_item_block *)calloc(kDOUAudioPlaybackItemProcessedBlockCount, sizeof(playback_item_block));
+  for (NSUInteger i = 0; i < kDOUAudioPlaybackItemProcessedBlockCount; ++i) {
+    _processedBlocks[i].index = NSNotFound;
+  }
+}
+
+- (void)_destroyProcessedBlocks
+{
+  if (_processedBlocks == NULL) {
+    return;
+  }
 
-  if (inPosition + requestCount > [[item mappedData] length]) {
-    if (inPosition >= [[item mappedData] length]) {
+  for (NSUInteger i = 0; i < kDOUAudioPlaybackItemProcessedBlockCount; ++i) {
+    free(_processedBlocks[i].bytes);
+  }
+
+  free(_processedBlocks);
+  _processedBlocks = NULL;
+}
+
+- (void)_releaseProcessedBlocksBeforeOffset:(NSUInteger)offset
+{
+  if (_processedBlocks == NULL) {
+    return;
+  }
+
+  NSUInteger endIndex = offset / kDOUAudioPlaybackItemProcessedBlockLength;
+  for (NSUInteger i = 0; i < kDOUAudioPlaybackItemProcessedBlockCount; ++i) {
+    playback_item_block *block = &_processedBlocks[i];
+    if (block->index != NSNotFound && block->index < endIndex) {
+      free(block->bytes);
+      block->bytes = NULL;
+      block->index = NSNotFound;
+      block->length = 0;
+    }
+  }
+}
+
+- (const uint8_t *)_processedBlockAtIndex:(NSUInteger)index length:(NSUInteger *)length
+{
+  playback_item_block *block = &_processedBlocks[index % kDOUAudioPlaybackItemProcessedBlockCount];
+  if (block->index == index) {
+    *length = block->length;
+    return block->bytes;
+  }
+
+  NSUInteger offset = index * kDOUAudioPlaybackItemProcessedBlockLength;
+  NSUInteger storeLength = [[self store] length];
+  if (offset >= storeLength) {
+    return NULL;
+  }
+
+  NSUInteger blockLength = MIN(kDOUAudioPlaybackItemProcessedBlockLength, storeLength - offset);
+  if ([_fileProvider availableLengthFromOffset:offset] < blockLength) {
+    return NULL;
+  }
+
+  if (block->bytes == NULL) {
+    block->bytes = (uint8_t *)malloc(kDOUAudioPlaybackItemProcessedBlockLength);
+    if (block->bytes == NULL) {
+      return NULL;
+    }
+  }
+
+  block->index = NSNotFound;
+  block->length = [[self store] readBytes:block->bytes offset:offset length:blockLength];
+  if (block->length != blockLength) {
+    return NULL;
+  }
+
+  [_filePreprocessor processBytes:block->bytes length:blockLength offset:offset];
+  block->index = index;
+
+  *length = blockLength;
+  return block->bytes;
+}
+
+static NSUInteger playback_item_read_processed_directly(__unsafe_unretained DOUAudioPlaybackItem *item,
+                                                        void *buffer,
+                                                        NSUInteger offset,
+                                                        NSUInteger length)
+{
+  length = [[item store] readBytes:buffer offset:offset length:length];
+  [[item filePreprocessor] processBytes:buffer length:length offset:offset];
+  return length;
+}
+
+static NSUInteger playback_item_read_processed(__unsafe_unretained DOUAudioPlaybackItem *item,
+                                               void *buffer,
+                                               NSUInteger offset,
+                                               NSUInteger length)
+{
+  if (item->_processedBlocks == NULL) {
+    return playback_item_read_processed_directly(item, buffer, offset, length);
+  }
+
+  NSUInteger bytesRead = 0;
+  while (bytesRead < length) {
+    NSUInteger blockOffset = offset % kDOUAudioPlaybackItemProcessedBlockLength;
+    NSUInteger blockLength = 0;
+    const uint8_t *block = [item _processedBlockAtIndex:offset / kDOUAudioPlaybackItemProcessedBlockLength length:&blockLength];
+    if (block == NULL) {
+      return bytesRead + playback_item_read_processed_directly(item, (uint8_t *)buffer + bytesRead, offset, length - bytesRead);
+    }
+
+    if (blockOffset >= blockLength) {
+      break;
+    }
+
+    NSUInteger chunkLength = MIN(length - bytesRead, blockLength - blockOffset);
+    memcpy((uint8_t *)buffer + bytesRead, block + blockOffset, chunkLength);
+    bytesRead += chunkLength;
+    offset += chunkLength;
+  }
+
+  return bytesRead;
+}
+
+static OSStatus playback_item_read(__unsafe_unretained DOUAudioPlaybackItem *item,
+                                   SInt64 inPosition,
+                                   UInt32 requestCount,
+                                   void *buffer,
+                                   UInt32 *actualCount)
+{
+  DOUAudioCacheStore *store = [item store];
+  NSUInteger length = [store length];
+
+  if (inPosition + requestCount > length) {
+    if (inPosition >= length) {
       *actualCount = 0;
     }
     else {
-      *actualCount = (UInt32)((SInt64)[[item mappedData] length] - inPosition);
+      *actualCount = (UInt32)((SInt64)length - inPosition);
     }
   }
   else {
@@ -84,24 +280,36 @@ static OSStatus audio_file_read(void *inClientData,
     return noErr;
   }
 
-  if ([item filePreprocessor] == nil) {
-    memcpy(buffer, (uint8_t *)[[item mappedData] bytes] + inPosition, *actualCount);
+  if ([item filePreprocessor] != nil) {
+    *actualCount = (UInt32)playback_item_read_processed(item, buffer, (NSUInteger)inPosition, *actualCount);
   }
   else {
-    NSData *input = [NSData dataWithBytesNoCopy:(uint8_t *)[[item mappedData] bytes] + inPosition
-                                         length:*actualCount
-                                   freeWhenDone:NO];
-    NSData *output = [[item filePreprocessor] handleData:input offset:(NSUInteger)inPosition];
-    memcpy(buffer, [output bytes], [output length]);
+    *actualCount = (UInt32)[store readBytes:buffer offset:(NSUInteger)inPosition length:*actualCount];
   }
 
   return noErr;
 }
 
+static OSStatus audio_file_read(void *inClientData,
+                                SInt64 inPosition,
+                                UInt32 requestCount,
+                                void *buffer, 
+                                UInt32 *actualCount)
+{
+  __unsafe_unretained DOUAudioPlaybackItem *item = (__bridge DOUAudioPlaybackItem *)inClientData;
+
+  OSStatus status = playback_item_read(item, inPosition, requestCount, buffer, actualCount);
+  if (status == noErr && *actualCount > 0) {
+    [item _adviseReadAtOffset:(NSUInteger)inPosition length:*actualCount];
+  }
+
+  return status;
+}
+
 static SInt64 audio_file_get_size(void *inClientData)
 {
   __unsafe_unretained DOUAudioPlaybackItem *item = (__bridge DOUAudioPlaybackItem *)inClientData;
-  return (SInt64)[[item mappedData] length];
+  return (SInt64)[[item store] length];
 }
 
 - (BOOL)_openWithFileTypeHint:(AudioFileTypeID)fileTypeHint
@@ -194,15 +402,42 @@ static SInt64 audio_file_get_size(void *inClientData)
   return fallbackTypeIDs;
 }
 
+- (BOOL)_openPacketRing
+{
+  _packetRing = [_fileProvider packetRing];
+  if (_packetRing == nil) {
+    return NO;
+  }
+
+  _fileFormat = [_packetRing format];
+  _bitRate = [_packetRing bitRate];
+  _dataOffset = 0;
+  _estimatedDuration = 0;
+
+  return YES;
+}
+
 - (BOOL)open
+{
+  return [self openWithSharedSeekIndex:nil];
+}
+
+- (BOOL)openWithSharedSeekIndex:(DOUAudioSeekIndex *)seekIndex
 {
   if ([self isOpened]) {
     return YES;
   }
 
+  if ([_fileProvider isLive]) {
+    return [self _openPacketRing];
+  }
+
+  [self _createProcessedBlocks];
+
   if (![self _openWithFileTypeHint:0] &&
       ![self _openWithFallbacks]) {
     _fileID = NULL;
+    [self _destroyProcessedBlocks];
     return NO;
   }
 
@@ -210,12 +445,74 @@ static SInt64 audio_file_get_size(void *inClientData)
       ![self _fillMiscProperties]) {
     AudioFileClose(_fileID);
     _fileID = NULL;
+    [self _destroyProcessedBlocks];
     return NO;
   }
 
+  if (seekIndex != nil) {
+    _seekIndex = seekIndex;
+    _sharesSeekIndex = YES;
+  }
+  else {
+    [self _createSeekIndex];
+  }
+
+  dou_audio_metrics_mark_event([_fileProvider metrics], DOUAudioMetricsReadyToProducePackets);
   return YES;
 }
 
+- (void)_createSeekIndex
+{
+  NSUInteger dataLength = [[self store] length] - MIN(_dataOffset, [[self store] length]);
+
+  UInt64 byteCount = 0;
+  UInt32 size = sizeof(byteCount);
+  if (AudioFileGetProperty(_fileID, kAudioFilePropertyAudioDataByteCount, &size, &byteCount) == noErr &&
+      byteCount > 0 && byteCount < dataLength) {
+    dataLength = (NSUInteger)byteCount;
+  }
+
+  NSString *path = nil;
+  NSURL *audioFileURL = [[self audioFile] audioFileURL];
+  if (audioFileURL != nil && ![audioFileURL isFileURL]) {
+    path = [[DOUAudioCache sharedCache] seekIndexPathForURL:audioFileURL];
+  }
+
+  _seekIndex = [DOUAudioSeekIndex seekIndexWithFileID:_fileID
+                                           dataOffset:_dataOffset
+                                           dataLength:dataLength
+                                                 path:path];
+}
+
+- (NSUInteger)readBytes:(void *)buffer offset:(NSUInteger)offset length:(NSUInteger)length
+{
+  UInt32 actualCount = 0;
+  if (audio_file_read((__bridge void *)self, (SInt64)offset, (UInt32)length, buffer, &actualCount) != noErr) {
+    return 0;
+  }
+
+  return actualCount;
+}
+
+- (void)updateSeekIndex
+{
+  if (_seekIndex == nil || _sharesSeekIndex || [_seekIndex isFinished]) {
+    return;
+  }
+
+  NSUInteger availableLength = [_fileProvider availableLengthFromOffset:_dataOffset];
+
+  __unsafe_unretained DOUAudioPlaybackItem *item = self;
+  [_seekIndex scanToLength:availableLength readBlock:^NSUInteger(void *buffer, NSUInteger offset, NSUInteger length) {
+    UInt32 actualCount = 0;
+    if (playback_item_read(item, (SInt64)offset, (UInt32)length, buffer, &actualCount) != noErr) {
+      return 0;
+    }
+
+    return actualCount;
+  }];
+}
+
 - (BOOL)_fillFileFormat
 {
   UInt32 size;
@@ -324,8 +621,21 @@ static SInt64 audio_file_get_size(void *inClientData)
     return;
   }
 
+  if (_packetRing != nil) {
+    _packetRing = nil;
+    return;
+  }
+
+  if (!_sharesSeekIndex) {
+    [_seekIndex save];
+  }
+  _seekIndex = nil;
+  _sharesSeekIndex = NO;
+
   AudioFileClose(_fileID);
   _fileID = NULL;
+
+  [self _destroyProcessedBlocks];
 }
 
 + (instancetype)playbackItemWithFileProvider:(DOUAudioFileProvider *)fileProvider
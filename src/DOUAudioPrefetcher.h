@@ -0,0 +1,36 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#import "DOUAudioFile.h"
+
+@class DOUAudioFileProvider;
+
+@interface DOUAudioPrefetcher : NSObject
+
++ (instancetype)sharedPrefetcher;
+
+@property (nonatomic, assign) NSUInteger maximumConcurrentPrefetches;
+@property (nonatomic, assign) NSUInteger maximumBandwidth;
+@property (nonatomic, assign) NSTimeInterval prefetchDuration;
+@property (nonatomic, assign) NSUInteger lowWaterTime;
+
+@property (nonatomic, copy) NSArray *audioFiles;
+
+- (DOUAudioFileProvider *)takeFileProviderForAudioFile:(id <DOUAudioFile>)audioFile;
+- (void)reportPlaybackBufferedTime:(NSUInteger)bufferedTime;
+
+@end
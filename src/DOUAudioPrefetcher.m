@@ -0,0 +1,309 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioPrefetcher.h"
+#import "DOUAudioFileProvider.h"
+#include <stdatomic.h>
+
+static const NSUInteger kDOUAudioPrefetcherDefaultConcurrency = 2;
+static const NSTimeInterval kDOUAudioPrefetcherDefaultDuration = 15.0;
+static const NSUInteger kDOUAudioPrefetcherDefaultLowWaterTime = 5000;
+
+@interface _DOUAudioPrefetchItem : NSObject
+@property (nonatomic, strong) id <DOUAudioFile> audioFile;
+@property (nonatomic, strong) DOUAudioFileProvider *fileProvider;
+@end
+
+@implementation _DOUAudioPrefetchItem
+@end
+
+/*
+ * Upcoming files are prefetched in list order, so the first file has the
+ * highest priority.  The bandwidth limit is split evenly between the
+ * running prefetches and enforced by each request as it reads, so the
+ * playing file keeps the rest of the link.  Every decision is made on a
+ * private serial queue:
+ * provider events arrive on the HTTP controller thread with the request
+ * locked, and suspending a provider has to take that lock as well.
+ */
+
+@interface DOUAudioPrefetcher () {
+@private
+  dispatch_queue_t _queue;
+  NSMutableArray *_items;
+
+  NSUInteger _maximumConcurrentPrefetches;
+  NSUInteger _maximumBandwidth;
+  NSTimeInterval _prefetchDuration;
+  NSUInteger _lowWaterTime;
+
+  atomic_bool _playbackBufferLow;
+  atomic_bool _schedulePending;
+}
+@end
+
+@implementation DOUAudioPrefetcher
+
++ (instancetype)sharedPrefetcher
+{
+  static DOUAudioPrefetcher *sharedPrefetcher = nil;
+
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    sharedPrefetcher = [[self alloc] init];
+  });
+
+  return sharedPrefetcher;
+}
+
+- (instancetype)init
+{
+  self = [super init];
+  if (self) {
+    _queue = dispatch_queue_create("com.douban.audio-streamer.prefetcher", DISPATCH_QUEUE_SERIAL);
+    _items = [NSMutableArray array];
+
+    _maximumConcurrentPrefetches = kDOUAudioPrefetcherDefaultConcurrency;
+    _maximumBandwidth = 0;
+    _prefetchDuration = kDOUAudioPrefetcherDefaultDuration;
+    _lowWaterTime = kDOUAudioPrefetcherDefaultLowWaterTime;
+
+    atomic_init(&_playbackBufferLow, false);
+    atomic_init(&_schedulePending, false);
+  }
+
+  return self;
+}
+
+- (NSUInteger)maximumConcurrentPrefetches
+{
+  @synchronized(self) {
+    return _maximumConcurrentPrefetches;
+  }
+}
+
+- (void)setMaximumConcurrentPrefetches:(NSUInteger)maximumConcurrentPrefetches
+{
+  @synchronized(self) {
+    _maximumConcurrentPrefetches = maximumConcurrentPrefetches;
+  }
+
+  [self _setNeedsSchedule];
+}
+
+- (NSUInteger)maximumBandwidth
+{
+  @synchronized(self) {
+    return _maximumBandwidth;
+  }
+}
+
+- (void)setMaximumBandwidth:(NSUInteger)maximumBandwidth
+{
+  @synchronized(self) {
+    _maximumBandwidth = maximumBandwidth;
+  }
+
+  [self _setNeedsSchedule];
+}
+
+- (NSTimeInterval)prefetchDuration
+{
+  @synchronized(self) {
+    return _prefetchDuration;
+  }
+}
+
+- (void)setPrefetchDuration:(NSTimeInterval)prefetchDuration
+{
+  @synchronized(self) {
+    _prefetchDuration = prefetchDuration;
+  }
+}
+
+- (NSUInteger)lowWaterTime
+{
+  @synchronized(self) {
+    return _lowWaterTime;
+  }
+}
+
+- (void)setLowWaterTime:(NSUInteger)lowWaterTime
+{
+  @synchronized(self) {
+    _lowWaterTime = lowWaterTime;
+  }
+}
+
+- (NSArray *)audioFiles
+{
+  NSMutableArray *audioFiles = [NSMutableArray array];
+  dispatch_sync(_queue, ^{
+    for (_DOUAudioPrefetchItem *item in _items) {
+      [audioFiles addObject:[item audioFile]];
+    }
+  });
+
+  return audioFiles;
+}
+
+- (void)setAudioFiles:(NSArray *)audioFiles
+{
+  NSArray *files = [audioFiles copy];
+  dispatch_async(_queue, ^{
+    NSMutableArray *items = [NSMutableArray arrayWithCapacity:[files count]];
+    for (id <DOUAudioFile> audioFile in files) {
+      _DOUAudioPrefetchItem *item = [self _itemForAudioFile:audioFile];
+      if (item == nil) {
+        item = [[_DOUAudioPrefetchItem alloc] init];
+        [item setAudioFile:audioFile];
+      }
+
+      [items addObject:item];
+    }
+
+    [_items setArray:items];
+    [self _schedule];
+  });
+}
+
+- (_DOUAudioPrefetchItem *)_itemForAudioFile:(id <DOUAudioFile>)audioFile
+{
+  for (_DOUAudioPrefetchItem *item in _items) {
+    if ([item audioFile] == audioFile ||
+        [[item audioFile] isEqual:audioFile]) {
+      return item;
+    }
+  }
+
+  return nil;
+}
+
+- (DOUAudioFileProvider *)takeFileProviderForAudioFile:(id <DOUAudioFile>)audioFile
+{
+  if (audioFile == nil) {
+    return nil;
+  }
+
+  __block DOUAudioFileProvider *fileProvider = nil;
+  dispatch_sync(_queue, ^{
+    _DOUAudioPrefetchItem *item = [self _itemForAudioFile:audioFile];
+    if (item == nil) {
+      return;
+    }
+
+    fileProvider = [item fileProvider];
+    [_items removeObject:item];
+    if (fileProvider == nil) {
+      return;
+    }
+
+    [fileProvider setEventBlock:NULL];
+    [fileProvider setPrefetchDuration:0.0];
+    [fileProvider setMaximumDownloadSpeed:0];
+    [fileProvider resume];
+  });
+
+  [self _setNeedsSchedule];
+  return fileProvider;
+}
+
+- (void)reportPlaybackBufferedTime:(NSUInteger)bufferedTime
+{
+  bool low;
+  @synchronized(self) {
+    low = bufferedTime < _lowWaterTime;
+  }
+
+  if (atomic_exchange_explicit(&_playbackBufferLow, low, memory_order_relaxed) != low) {
+    [self _setNeedsSchedule];
+  }
+}
+
+- (void)_setNeedsSchedule
+{
+  if (atomic_exchange(&_schedulePending, true)) {
+    return;
+  }
+
+  dispatch_async(_queue, ^{
+    atomic_store(&_schedulePending, false);
+    [self _schedule];
+  });
+}
+
+- (void)_schedule
+{
+  NSUInteger maximumConcurrentPrefetches;
+  NSUInteger maximumBandwidth;
+  NSTimeInterval prefetchDuration;
+  @synchronized(self) {
+    maximumConcurrentPrefetches = _maximumConcurrentPrefetches;
+    maximumBandwidth = _maximumBandwidth;
+    prefetchDuration = _prefetchDuration;
+  }
+
+  BOOL playbackBufferLow = atomic_load_explicit(&_playbackBufferLow, memory_order_relaxed);
+  NSMutableArray *runningFileProviders = [NSMutableArray array];
+
+  for (_DOUAudioPrefetchItem *item in _items) {
+    DOUAudioFileProvider *fileProvider = [item fileProvider];
+    if (fileProvider != nil &&
+        ([fileProvider isFailed] || [fileProvider isPrefetched])) {
+      continue;
+    }
+
+    if (playbackBufferLow ||
+        [runningFileProviders count] >= maximumConcurrentPrefetches) {
+      [fileProvider suspend];
+      continue;
+    }
+
+    if (fileProvider == nil) {
+      fileProvider = [DOUAudioFileProvider prefetchingFileProviderWithAudioFile:[item audioFile]
+                                                                        duration:prefetchDuration];
+      if (fileProvider == nil) {
+        continue;
+      }
+
+      __unsafe_unretained DOUAudioPrefetcher *_self = self;
+      [fileProvider setEventBlock:^{
+        [_self _setNeedsSchedule];
+      }];
+      [item setFileProvider:fileProvider];
+
+      if ([fileProvider isPrefetched]) {
+        continue;
+      }
+    }
+    else {
+      [fileProvider resume];
+    }
+
+    [runningFileProviders addObject:fileProvider];
+  }
+
+  NSUInteger maximumDownloadSpeed = 0;
+  if (maximumBandwidth > 0 && [runningFileProviders count] > 0) {
+    maximumDownloadSpeed = MAX(maximumBandwidth / [runningFileProviders count], 1);
+  }
+
+  for (DOUAudioFileProvider *fileProvider in runningFileProviders) {
+    [fileProvider setMaximumDownloadSpeed:maximumDownloadSpeed];
+  }
+}
+
+@end
@@ -15,25 +15,13 @@
  */
 
 #import <Foundation/Foundation.h>
+#import "DOUAudioRendering.h"
 
-@interface DOUAudioRenderer : NSObject
+@interface DOUAudioRenderer : NSObject <DOUAudioRendering>
 
 + (instancetype)rendererWithBufferTime:(NSUInteger)bufferTime;
 - (instancetype)initWithBufferTime:(NSUInteger)bufferTime;
 
-- (BOOL)setUp;
-- (void)tearDown;
-
-- (void)renderBytes:(const void *)bytes length:(NSUInteger)length;
-- (void)stop;
-- (void)flush;
-- (void)flushShouldResetTiming:(BOOL)shouldResetTiming;
-
-@property (nonatomic, readonly) NSUInteger currentTime;
-@property (nonatomic, readonly, getter=isStarted) BOOL started;
-@property (nonatomic, assign, getter=isInterrupted) BOOL interrupted;
-@property (nonatomic, assign) double volume;
-
-@property (nonatomic, copy) NSArray *analyzers;
++ (NSTimeInterval)timeIntervalForHostTime:(uint64_t)hostTime;
 
 @end
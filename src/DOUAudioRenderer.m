@@ -17,52 +17,125 @@
 #import "DOUAudioRenderer.h"
 #import "DOUAudioDecoder.h"
 #import "DOUAudioAnalyzer.h"
+#import "DOUAudioAnalysisWorker.h"
+#import "DOUAudioMetrics.h"
+#import "DOUAudioGain.h"
 #include <CoreAudio/CoreAudioTypes.h>
 #include <AudioUnit/AudioUnit.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <mach/mach_time.h>
 
-#if !TARGET_OS_IPHONE
-#include <CoreAudio/CoreAudio.h>
-#endif /* !TARGET_OS_IPHONE */
-
 #if TARGET_OS_IPHONE
-#include <Accelerate/Accelerate.h>
+#include <AudioToolbox/AudioToolbox.h>
+#else /* TARGET_OS_IPHONE */
+#include <CoreAudio/CoreAudio.h>
 #endif /* TARGET_OS_IPHONE */
 
+static const NSUInteger kDOUAudioRendererGainRampTime = 10;
+
+/*
+ * The buffer is a single-producer/single-consumer ring shared between the
+ * event loop (producer) and the Core Audio I/O thread (consumer).  Indices
+ * run over [0, 2 * _bufferByteCount) so that a full ring can be told apart
+ * from an empty one without restricting the capacity to a power of two.
+ *
+ * The render callback must never block, allocate or send Objective-C
+ * messages.  Flushes requested by the producer while the output unit is
+ * running are therefore applied by the consumer on its next cycle, the
+ * producer is woken through a dispatch semaphore only when it is waiting,
+ * or through the plain C wake-up function when it asked to be told about
+ * free space with isWritableForLength:, and analyzers only ever see the
+ * played samples through the lock-free tap of DOUAudioAnalysisWorker.
+ *
+ * The output unit is started once startThreshold milliseconds are queued,
+ * or once the ring is full when no threshold is set.
+ *
+ * The ring holds PCM in whatever format the event loop negotiated, and is
+ * sized for _bufferTime milliseconds of it.  Changing the format tears the
+ * output unit down and sets it up again with an empty ring.
+ *
+ * The render callback reaches the current metrics through a raw pointer.
+ * Every replacement bumps a generation, and the callback acknowledges the
+ * generation it started with once it returns.  A replaced metrics object is
+ * kept alive until its replacement has been acknowledged, or until the
+ * output unit is stopped, since no later cycle can still be using it.  The
+ * analysis worker is created the first time analyzers are set and published
+ * to the callback the same way, with a release store once it is set up; it
+ * is never replaced, so it needs no retiring.
+ *
+ * Volume and track gain are applied by the render callback itself on every
+ * platform, in place and with a short ramp on every change.  A track gain
+ * takes effect at the ring position the producer had reached when it was
+ * set, so that it follows the PCM it belongs to rather than the PCM still
+ * queued from the previous track.  The position and the gain are published
+ * together under a sequence counter, which the callback only ever reads.
+ */
+
 @interface DOUAudioRenderer () {
 @private
   pthread_mutex_t _mutex;
-  pthread_cond_t _cond;
+  dispatch_semaphore_t _semaphore;
 
   AudioComponentInstance _outputAudioUnit;
+  AudioStreamBasicDescription _format;
 
   uint8_t *_buffer;
   NSUInteger _bufferByteCount;
-  NSUInteger _firstValidByteOffset;
-  NSUInteger _validByteCount;
+  _Atomic(NSUInteger) _readIndex;
+  _Atomic(NSUInteger) _writeIndex;
+  _Atomic(NSUInteger) _flushIndex;
+  atomic_bool _flushRequested;
+  atomic_bool _producerWaiting;
+  _Atomic(NSUInteger) _writableLength;
+  DOUAudioRenderingWakeUpFunction _wakeUpFunction;
+  void *_wakeUpContext;
 
   NSUInteger _bufferTime;
+  NSUInteger _startThreshold;
   BOOL _started;
 
   NSArray *_analyzers;
-
-  uint64_t _startedTime;
-  uint64_t _interruptedTime;
-  uint64_t _totalInterruptedInterval;
-
-#if TARGET_OS_IPHONE
-  double _volume;
-#endif /* TARGET_OS_IPHONE */
+  DOUAudioAnalysisWorker *_analysisWorker;
+  _Atomic(void *) _analysisWorkerRef;
+
+  _Atomic(uint64_t) _startedTime;
+  _Atomic(uint64_t) _interruptedTime;
+  _Atomic(uint64_t) _totalInterruptedInterval;
+  _Atomic(uint64_t) _firstAudioHostTime;
+  uint64_t _underrunHostTime;
+
+  DOUAudioMetrics *_metrics;
+  NSMutableArray *_retiredMetrics;
+  _Atomic(void *) _metricsRef;
+  _Atomic(NSUInteger) _metricsGeneration;
+  _Atomic(NSUInteger) _acknowledgedMetricsGeneration;
+
+  NSUInteger _bytesPerFrame;
+  NSUInteger _channelCount;
+
+  DOUAudioGainRamp _gainRamp;
+  _Atomic(float) _volume;
+  double _trackGain;
+
+  _Atomic(NSUInteger) _trackGainSequence;
+  _Atomic(NSUInteger) _trackGainIndex;
+  _Atomic(float) _trackGainFactor;
+  NSUInteger _appliedTrackGainSequence;
+  float _appliedTrackGainFactor;
 }
 @end
 
 @implementation DOUAudioRenderer
 
+@synthesize format = _format;
 @synthesize started = _started;
-@synthesize analyzers = _analyzers;
+@synthesize interrupted = _interrupted;
+@synthesize startThreshold = _startThreshold;
+@synthesize trackGain = _trackGain;
+@dynamic analyzers;
 
 + (instancetype)rendererWithBufferTime:(NSUInteger)bufferTime
 {
@@ -74,12 +147,34 @@
   self = [super init];
   if (self) {
     pthread_mutex_init(&_mutex, NULL);
-    pthread_cond_init(&_cond, NULL);
+    _semaphore = dispatch_semaphore_create(0);
+
+    atomic_init(&_readIndex, 0);
+    atomic_init(&_writeIndex, 0);
+    atomic_init(&_flushIndex, 0);
+    atomic_init(&_flushRequested, false);
+    atomic_init(&_producerWaiting, false);
+    atomic_init(&_writableLength, 0);
+
+    atomic_init(&_startedTime, 0);
+    atomic_init(&_interruptedTime, 0);
+    atomic_init(&_totalInterruptedInterval, 0);
+    atomic_init(&_firstAudioHostTime, 0);
+    atomic_init(&_analysisWorkerRef, NULL);
+    atomic_init(&_metricsRef, NULL);
+    atomic_init(&_metricsGeneration, 0);
+    atomic_init(&_acknowledgedMetricsGeneration, 0);
+    _retiredMetrics = [NSMutableArray array];
+
+    atomic_init(&_volume, 1.0f);
+    atomic_init(&_trackGainSequence, 0);
+    atomic_init(&_trackGainIndex, 0);
+    atomic_init(&_trackGainFactor, 1.0f);
+    _appliedTrackGainFactor = 1.0f;
+    dou_audio_gain_ramp_init(&_gainRamp, 1, 1.0f);
 
     _bufferTime = bufferTime;
-#if TARGET_OS_IPHONE
-    _volume = 1.0;
-#endif /* TARGET_OS_IPHONE */
+    _format = [DOUAudioDecoder defaultOutputFormat];
 
 #if !TARGET_OS_IPHONE
     [self _setupPropertyListenerForDefaultOutputDevice];
@@ -103,109 +198,209 @@
     free(_buffer);
   }
 
+#if !OS_OBJECT_USE_OBJC
+  dispatch_release(_semaphore);
+#endif /* !OS_OBJECT_USE_OBJC */
+
   pthread_mutex_destroy(&_mutex);
-  pthread_cond_destroy(&_cond);
 }
 
-- (void)_setShouldInterceptTiming:(BOOL)shouldInterceptTiming
+static void renderer_set_should_intercept_timing(__unsafe_unretained DOUAudioRenderer *renderer, BOOL shouldInterceptTiming)
 {
-  if (_startedTime == 0) {
-    _startedTime = mach_absolute_time();
+  if (atomic_load_explicit(&renderer->_startedTime, memory_order_relaxed) == 0) {
+    atomic_store_explicit(&renderer->_startedTime, mach_absolute_time(), memory_order_relaxed);
   }
 
-  if ((_interruptedTime != 0) == shouldInterceptTiming) {
+  uint64_t interruptedTime = atomic_load_explicit(&renderer->_interruptedTime, memory_order_relaxed);
+  if ((interruptedTime != 0) == shouldInterceptTiming) {
     return;
   }
 
   if (shouldInterceptTiming) {
-    _interruptedTime = mach_absolute_time();
+    atomic_store_explicit(&renderer->_interruptedTime, mach_absolute_time(), memory_order_relaxed);
   }
   else {
-    _totalInterruptedInterval += mach_absolute_time() - _interruptedTime;
-    _interruptedTime = 0;
+    atomic_fetch_add_explicit(&renderer->_totalInterruptedInterval, mach_absolute_time() - interruptedTime, memory_order_relaxed);
+    atomic_store_explicit(&renderer->_interruptedTime, 0, memory_order_relaxed);
   }
 }
 
-static OSStatus au_render_callback(void *inRefCon,
-                                   AudioUnitRenderActionFlags *inActionFlags,
-                                   const AudioTimeStamp *inTimeStamp,
-                                   UInt32 inBusNumber,
-                                   UInt32 inNumberFrames,
-                                   AudioBufferList *ioData)
+static NSUInteger renderer_ring_count(NSUInteger capacity, NSUInteger readIndex, NSUInteger writeIndex)
 {
-  __unsafe_unretained DOUAudioRenderer *renderer = (__bridge DOUAudioRenderer *)inRefCon;
-  pthread_mutex_lock(&renderer->_mutex);
+  if (writeIndex >= readIndex) {
+    return writeIndex - readIndex;
+  }
 
-  NSUInteger totalBytesToCopy = ioData->mBuffers[0].mDataByteSize;
-  NSUInteger validByteCount = renderer->_validByteCount;
+  return writeIndex + 2 * capacity - readIndex;
+}
 
-  if (validByteCount < totalBytesToCopy) {
-    [renderer->_analyzers makeObjectsPerformSelector:@selector(flush)];
-    [renderer _setShouldInterceptTiming:YES];
+static NSUInteger renderer_ring_offset(NSUInteger capacity, NSUInteger index)
+{
+  return index >= capacity ? index - capacity : index;
+}
 
-    *inActionFlags = kAudioUnitRenderAction_OutputIsSilence;
-    bzero(ioData->mBuffers[0].mData, ioData->mBuffers[0].mDataByteSize);
-    pthread_mutex_unlock(&renderer->_mutex);
-    return noErr;
+static NSUInteger renderer_ring_advance(NSUInteger capacity, NSUInteger index, NSUInteger length)
+{
+  index += length;
+  return index >= 2 * capacity ? index - 2 * capacity : index;
+}
+
+static void renderer_wake_producer(__unsafe_unretained DOUAudioRenderer *renderer, NSUInteger readIndex, NSUInteger writeIndex)
+{
+  if (atomic_exchange_explicit(&renderer->_producerWaiting, false, memory_order_acq_rel)) {
+    dispatch_semaphore_signal(renderer->_semaphore);
   }
-  else {
-    [renderer _setShouldInterceptTiming:NO];
+
+  atomic_thread_fence(memory_order_seq_cst);
+  NSUInteger writableLength = atomic_load_explicit(&renderer->_writableLength, memory_order_relaxed);
+  if (writableLength > 0 &&
+      renderer->_bufferByteCount - renderer_ring_count(renderer->_bufferByteCount, readIndex, writeIndex) >= writableLength &&
+      atomic_exchange_explicit(&renderer->_writableLength, 0, memory_order_acq_rel) != 0) {
+    renderer->_wakeUpFunction(renderer->_wakeUpContext);
   }
+}
 
-  uint8_t *bytes = renderer->_buffer + renderer->_firstValidByteOffset;
-  uint8_t *outBuffer = (uint8_t *)ioData->mBuffers[0].mData;
-  NSUInteger outBufSize = ioData->mBuffers[0].mDataByteSize;
-  NSUInteger bytesToCopy = MIN(outBufSize, validByteCount);
-  NSUInteger firstFrag = bytesToCopy;
+static void renderer_publish_track_gain(__unsafe_unretained DOUAudioRenderer *renderer, float factor, NSUInteger index)
+{
+  NSUInteger sequence = atomic_load_explicit(&renderer->_trackGainSequence, memory_order_relaxed);
+  atomic_store_explicit(&renderer->_trackGainSequence, sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  atomic_store_explicit(&renderer->_trackGainIndex, index, memory_order_relaxed);
+  atomic_store_explicit(&renderer->_trackGainFactor, factor, memory_order_relaxed);
+
+  atomic_store_explicit(&renderer->_trackGainSequence, sequence + 2, memory_order_release);
+}
 
-  if (renderer->_firstValidByteOffset + bytesToCopy > renderer->_bufferByteCount) {
-    firstFrag = renderer->_bufferByteCount - renderer->_firstValidByteOffset;
+static void renderer_apply_gain(__unsafe_unretained DOUAudioRenderer *renderer, void *bytes, NSUInteger readIndex, NSUInteger length, BOOL firstAudio)
+{
+  NSUInteger sequence = atomic_load_explicit(&renderer->_trackGainSequence, memory_order_acquire);
+  if ((sequence & 1) == 0 && sequence != renderer->_appliedTrackGainSequence) {
+    NSUInteger index = atomic_load_explicit(&renderer->_trackGainIndex, memory_order_relaxed);
+    float factor = atomic_load_explicit(&renderer->_trackGainFactor, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+
+    if (atomic_load_explicit(&renderer->_trackGainSequence, memory_order_relaxed) == sequence &&
+        renderer_ring_count(renderer->_bufferByteCount, readIndex, index) <= length) {
+      renderer->_appliedTrackGainFactor = factor;
+      renderer->_appliedTrackGainSequence = sequence;
+    }
   }
 
-  if (firstFrag < bytesToCopy) {
-    memcpy(outBuffer, bytes, firstFrag);
-    memcpy(outBuffer + firstFrag, renderer->_buffer, bytesToCopy - firstFrag);
+  float gain = atomic_load_explicit(&renderer->_volume, memory_order_relaxed) * renderer->_appliedTrackGainFactor;
+  if (firstAudio) {
+    dou_audio_gain_ramp_reset(&renderer->_gainRamp, gain);
   }
   else {
-    memcpy(outBuffer, bytes, bytesToCopy);
+    dou_audio_gain_ramp_set_target(&renderer->_gainRamp, gain);
   }
 
-  NSArray *analyzers = renderer->_analyzers;
-  if (analyzers != nil) {
-    for (DOUAudioAnalyzer *analyzer in analyzers) {
-      [analyzer handleLPCMSamples:(int16_t *)outBuffer
-                            count:bytesToCopy / sizeof(int16_t)];
+  dou_audio_gain_apply_float(&renderer->_gainRamp,
+                             (float *)bytes,
+                             length / renderer->_bytesPerFrame,
+                             renderer->_channelCount);
+}
+
+static OSStatus renderer_render(__unsafe_unretained DOUAudioRenderer *renderer,
+                                __unsafe_unretained DOUAudioMetrics *metrics,
+                                AudioUnitRenderActionFlags *inActionFlags,
+                                const AudioTimeStamp *inTimeStamp,
+                                AudioBufferList *ioData)
+{
+  uint64_t hostTime = (inTimeStamp->mFlags & kAudioTimeStampHostTimeValid) ? inTimeStamp->mHostTime : mach_absolute_time();
+  __unsafe_unretained DOUAudioAnalysisWorker *analysisWorker = (__bridge DOUAudioAnalysisWorker *)atomic_load_explicit(&renderer->_analysisWorkerRef, memory_order_acquire);
+
+  const NSUInteger capacity = renderer->_bufferByteCount;
+  const BOOL flushRequested = atomic_exchange_explicit(&renderer->_flushRequested, false, memory_order_acquire);
+  NSUInteger readIndex = atomic_load_explicit(&renderer->_readIndex, memory_order_relaxed);
+  NSUInteger writeIndex = atomic_load_explicit(&renderer->_writeIndex, memory_order_acquire);
+
+  if (flushRequested) {
+    NSUInteger flushIndex = atomic_load_explicit(&renderer->_flushIndex, memory_order_relaxed);
+    if (renderer_ring_count(capacity, readIndex, flushIndex) <= renderer_ring_count(capacity, readIndex, writeIndex)) {
+      readIndex = flushIndex;
+      atomic_store_explicit(&renderer->_readIndex, readIndex, memory_order_release);
     }
   }
 
-#if TARGET_OS_IPHONE
-  if (renderer->_volume != 1.0) {
-    int16_t *samples = (int16_t *)outBuffer;
-    size_t samplesCount = bytesToCopy / sizeof(int16_t);
+  uint8_t *outBuffer = (uint8_t *)ioData->mBuffers[0].mData;
+  NSUInteger outBufSize = ioData->mBuffers[0].mDataByteSize;
+  NSUInteger validByteCount = renderer_ring_count(capacity, readIndex, writeIndex);
 
-    float floatSamples[samplesCount];
-    vDSP_vflt16(samples, 1, floatSamples, 1, samplesCount);
+  if (capacity > 0) {
+    dou_audio_metrics_set_buffer_fill_level(metrics, (double)validByteCount / capacity);
+  }
+
+  if (validByteCount < outBufSize) {
+    if (renderer->_underrunHostTime == 0 &&
+        atomic_load_explicit(&renderer->_firstAudioHostTime, memory_order_relaxed) != 0) {
+      renderer->_underrunHostTime = hostTime;
+    }
 
-    float volume = renderer->_volume;
-    vDSP_vsmul(floatSamples, 1, &volume, floatSamples, 1, samplesCount);
+    dou_analysis_worker_report_underrun(analysisWorker);
+    renderer_set_should_intercept_timing(renderer, YES);
 
-    vDSP_vfix16(floatSamples, 1, samples, 1, samplesCount);
+    *inActionFlags = kAudioUnitRenderAction_OutputIsSilence;
+    bzero(outBuffer, outBufSize);
+    renderer_wake_producer(renderer, readIndex, writeIndex);
+    return noErr;
   }
-#endif /* TARGET_OS_IPHONE */
+  else {
+    renderer_set_should_intercept_timing(renderer, NO);
+  }
+
+  NSUInteger offset = renderer_ring_offset(capacity, readIndex);
+  NSUInteger bytesToCopy = outBufSize;
+  NSUInteger firstFrag = MIN(bytesToCopy, capacity - offset);
 
-  if (bytesToCopy < outBufSize) {
-    bzero(outBuffer + bytesToCopy, outBufSize - bytesToCopy);
+  memcpy(outBuffer, renderer->_buffer + offset, firstFrag);
+  if (firstFrag < bytesToCopy) {
+    memcpy(outBuffer + firstFrag, renderer->_buffer, bytesToCopy - firstFrag);
+  }
+  dou_audio_metrics_add_copied_length(metrics, bytesToCopy);
+
+  if (renderer->_underrunHostTime != 0) {
+    if (hostTime > renderer->_underrunHostTime) {
+      dou_audio_metrics_record_host_time(metrics, DOUAudioMetricsUnderrunHistogram, hostTime - renderer->_underrunHostTime);
+    }
+    renderer->_underrunHostTime = 0;
+  }
+
+  dou_analysis_worker_publish_samples(analysisWorker,
+                                      (const float *)outBuffer,
+                                      bytesToCopy / sizeof(float));
+
+  BOOL firstAudio = atomic_load_explicit(&renderer->_firstAudioHostTime, memory_order_relaxed) == 0;
+  if (firstAudio) {
+    atomic_store_explicit(&renderer->_firstAudioHostTime, hostTime, memory_order_relaxed);
+    dou_audio_metrics_mark_event_at_host_time(metrics, DOUAudioMetricsFirstAudioRendered, hostTime);
   }
 
-  renderer->_validByteCount -= bytesToCopy;
-  renderer->_firstValidByteOffset = (renderer->_firstValidByteOffset + bytesToCopy) % renderer->_bufferByteCount;
+  renderer_apply_gain(renderer, outBuffer, readIndex, bytesToCopy, firstAudio);
 
-  pthread_mutex_unlock(&renderer->_mutex);
-  pthread_cond_signal(&renderer->_cond);
+  readIndex = renderer_ring_advance(capacity, readIndex, bytesToCopy);
+  atomic_store_explicit(&renderer->_readIndex, readIndex, memory_order_release);
+  renderer_wake_producer(renderer, readIndex, writeIndex);
 
   return noErr;
 }
 
+static OSStatus au_render_callback(void *inRefCon,
+                                   AudioUnitRenderActionFlags *inActionFlags,
+                                   const AudioTimeStamp *inTimeStamp,
+                                   UInt32 inBusNumber,
+                                   UInt32 inNumberFrames,
+                                   AudioBufferList *ioData)
+{
+  __unsafe_unretained DOUAudioRenderer *renderer = (__bridge DOUAudioRenderer *)inRefCon;
+  const NSUInteger metricsGeneration = atomic_load_explicit(&renderer->_metricsGeneration, memory_order_acquire);
+  __unsafe_unretained DOUAudioMetrics *metrics = (__bridge DOUAudioMetrics *)atomic_load_explicit(&renderer->_metricsRef, memory_order_acquire);
+  OSStatus status = renderer_render(renderer, metrics, inActionFlags, inTimeStamp, ioData);
+  atomic_store_explicit(&renderer->_acknowledgedMetricsGeneration, metricsGeneration, memory_order_release);
+
+  return status;
+}
+
 - (BOOL)setUp
 {
   if (_outputAudioUnit != NULL) {
@@ -249,7 +444,7 @@ static OSStatus au_render_callback(void *inRefCon,
     return NO;
   }
 
-  AudioStreamBasicDescription requestedDesc = [DOUAudioDecoder defaultOutputFormat];
+  AudioStreamBasicDescription requestedDesc = _format;
 
   status = AudioUnitSetProperty(_outputAudioUnit, kAudioUnitProperty_StreamFormat, kAudioUnitScope_Input, 0, &requestedDesc, sizeof(requestedDesc));
   if (status != noErr) {
@@ -284,11 +479,17 @@ static OSStatus au_render_callback(void *inRefCon,
     return NO;
   }
 
+  _bytesPerFrame = requestedDesc.mBytesPerFrame;
+  _channelCount = requestedDesc.mChannelsPerFrame;
+  dou_audio_gain_ramp_init(&_gainRamp, requestedDesc.mSampleRate * kDOUAudioRendererGainRampTime / 1000, _gainRamp.gain);
+
   if (_buffer == NULL) {
-    _bufferByteCount = (_bufferTime * requestedDesc.mSampleRate / 1000) * (requestedDesc.mChannelsPerFrame * requestedDesc.mBitsPerChannel / 8);
-    _firstValidByteOffset = 0;
-    _validByteCount = 0;
+    _bufferByteCount = (NSUInteger)(_bufferTime * requestedDesc.mSampleRate / 1000) * requestedDesc.mBytesPerFrame;
+    atomic_store(&_readIndex, 0);
+    atomic_store(&_writeIndex, 0);
+    atomic_store(&_flushRequested, false);
     _buffer = (uint8_t *)calloc(1, _bufferByteCount);
+    renderer_publish_track_gain(self, dou_audio_gain_from_decibels(_trackGain), 0);
   }
 
   return YES;
@@ -304,6 +505,66 @@ static OSStatus au_render_callback(void *inRefCon,
   [self _tearDownWithoutStop];
 }
 
+- (void)setFormat:(AudioStreamBasicDescription)format
+{
+  if (memcmp(&format, &_format, sizeof(format)) == 0) {
+    return;
+  }
+
+  BOOL wasSetUp = _outputAudioUnit != NULL;
+  if (wasSetUp) {
+    [self tearDown];
+  }
+
+  _format = format;
+  if (_buffer != NULL) {
+    free(_buffer);
+    _buffer = NULL;
+  }
+
+  if (wasSetUp) {
+    [self setUp];
+  }
+}
+
+- (double)sampleRateForSourceSampleRate:(double)sampleRate
+{
+#if TARGET_OS_IPHONE
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated"
+
+  Float64 preferredSampleRate = sampleRate;
+  AudioSessionSetProperty(kAudioSessionProperty_PreferredHardwareSampleRate, sizeof(preferredSampleRate), &preferredSampleRate);
+
+  Float64 hardwareSampleRate = 0.0;
+  UInt32 size = sizeof(hardwareSampleRate);
+  if (AudioSessionGetProperty(kAudioSessionProperty_CurrentHardwareSampleRate, &size, &hardwareSampleRate) != noErr) {
+    hardwareSampleRate = 0.0;
+  }
+
+#pragma clang diagnostic pop
+#else /* TARGET_OS_IPHONE */
+  AudioObjectPropertyAddress address = {
+    kAudioHardwarePropertyDefaultOutputDevice,
+    kAudioObjectPropertyScopeGlobal,
+    kAudioObjectPropertyElementMaster
+  };
+
+  AudioObjectID device = kAudioObjectUnknown;
+  UInt32 size = sizeof(device);
+  Float64 hardwareSampleRate = 0.0;
+  if (AudioObjectGetPropertyData(kAudioObjectSystemObject, &address, 0, NULL, &size, &device) == noErr) {
+    address.mSelector = kAudioDevicePropertyNominalSampleRate;
+    size = sizeof(hardwareSampleRate);
+    if (AudioObjectGetPropertyData(device, &address, 0, NULL, &size, &hardwareSampleRate) != noErr) {
+      hardwareSampleRate = 0.0;
+    }
+  }
+#endif /* TARGET_OS_IPHONE */
+
+  return hardwareSampleRate > 0.0 ? hardwareSampleRate : sampleRate;
+}
+
 - (void)_tearDownWithoutStop
 {
   AudioUnitUninitialize(_outputAudioUnit);
@@ -377,60 +638,102 @@ static OSStatus property_listener_default_output_device(AudioObjectID inObjectID
 
 #endif /* !TARGET_OS_IPHONE */
 
+- (BOOL)_startIfNeeded
+{
+  pthread_mutex_lock(&_mutex);
+  if (!_started) {
+    if (_interrupted) {
+      pthread_mutex_unlock(&_mutex);
+      return NO;
+    }
+
+    AudioOutputUnitStart(_outputAudioUnit);
+    _started = YES;
+  }
+  pthread_mutex_unlock(&_mutex);
+
+  return YES;
+}
+
 - (void)renderBytes:(const void *)bytes length:(NSUInteger)length
 {
   if (_outputAudioUnit == NULL) {
     return;
   }
 
+  NSUInteger startByteCount = _bufferByteCount;
+  if (_startThreshold > 0 && _startThreshold < _bufferTime) {
+    startByteCount = _startThreshold * _bufferByteCount / _bufferTime;
+  }
+
   while (length > 0) {
-    pthread_mutex_lock(&_mutex);
-
-    NSUInteger emptyByteCount = _bufferByteCount - _validByteCount;
-    while (emptyByteCount == 0) {
-      if (!_started) {
-        if (_interrupted) {
-          pthread_mutex_unlock(&_mutex);
-          return;
-        }
-
-        pthread_mutex_unlock(&_mutex);
-        AudioOutputUnitStart(_outputAudioUnit);
-        pthread_mutex_lock(&_mutex);
-        _started = YES;
+    NSUInteger writeIndex = atomic_load_explicit(&_writeIndex, memory_order_relaxed);
+    NSUInteger readIndex = atomic_load_explicit(&_readIndex, memory_order_acquire);
+    NSUInteger emptyByteCount = _bufferByteCount - renderer_ring_count(_bufferByteCount, readIndex, writeIndex);
+
+    if (emptyByteCount == 0) {
+      if (![self _startIfNeeded]) {
+        return;
       }
 
-      struct timeval tv;
-      struct timespec ts;
-      gettimeofday(&tv, NULL);
-      ts.tv_sec = tv.tv_sec + 1;
-      ts.tv_nsec = 0;
-      pthread_cond_timedwait(&_cond, &_mutex, &ts);
-      emptyByteCount = _bufferByteCount - _validByteCount;
+      atomic_store_explicit(&_producerWaiting, true, memory_order_seq_cst);
+      readIndex = atomic_load_explicit(&_readIndex, memory_order_seq_cst);
+      if (renderer_ring_count(_bufferByteCount, readIndex, writeIndex) == _bufferByteCount) {
+        dispatch_semaphore_wait(_semaphore, dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC));
+      }
+      atomic_store_explicit(&_producerWaiting, false, memory_order_relaxed);
+      continue;
     }
 
-    NSUInteger firstEmptyByteOffset = (_firstValidByteOffset + _validByteCount) % _bufferByteCount;
-    NSUInteger bytesToCopy;
-    if (firstEmptyByteOffset + emptyByteCount > _bufferByteCount) {
-      bytesToCopy = MIN(length, _bufferByteCount - firstEmptyByteOffset);
-    }
-    else {
-      bytesToCopy = MIN(length, emptyByteCount);
-    }
+    NSUInteger firstEmptyByteOffset = renderer_ring_offset(_bufferByteCount, writeIndex);
+    NSUInteger bytesToCopy = MIN(length, MIN(emptyByteCount, _bufferByteCount - firstEmptyByteOffset));
 
     memcpy(_buffer + firstEmptyByteOffset, bytes, bytesToCopy);
+    dou_audio_metrics_add_copied_length(_metrics, bytesToCopy);
+    atomic_store_explicit(&_writeIndex,
+                          renderer_ring_advance(_bufferByteCount, writeIndex, bytesToCopy),
+                          memory_order_release);
 
     length -= bytesToCopy;
     bytes = (const uint8_t *)bytes + bytesToCopy;
-    _validByteCount += bytesToCopy;
 
-    pthread_mutex_unlock(&_mutex);
+    if (!_started &&
+        _bufferByteCount - emptyByteCount + bytesToCopy >= startByteCount &&
+        ![self _startIfNeeded]) {
+      return;
+    }
   }
 }
 
+- (void)setWakeUpFunction:(DOUAudioRenderingWakeUpFunction)function context:(void *)context
+{
+  atomic_store_explicit(&_writableLength, 0, memory_order_relaxed);
+  _wakeUpFunction = function;
+  _wakeUpContext = context;
+}
+
+- (BOOL)isWritableForLength:(NSUInteger)length
+{
+  if (_outputAudioUnit == NULL || !_started || _wakeUpFunction == NULL) {
+    return YES;
+  }
+
+  length = MAX(MIN(length, _bufferByteCount), 1);
+  atomic_store_explicit(&_writableLength, length, memory_order_seq_cst);
+
+  NSUInteger writeIndex = atomic_load_explicit(&_writeIndex, memory_order_relaxed);
+  NSUInteger readIndex = atomic_load_explicit(&_readIndex, memory_order_seq_cst);
+  if (_bufferByteCount - renderer_ring_count(_bufferByteCount, readIndex, writeIndex) >= length) {
+    atomic_store_explicit(&_writableLength, 0, memory_order_relaxed);
+    return YES;
+  }
+
+  return NO;
+}
+
 - (void)stop
 {
-  [_analyzers makeObjectsPerformSelector:@selector(flush)];
+  [_analysisWorker flush];
 
   if (_outputAudioUnit == NULL) {
     return;
@@ -438,15 +741,16 @@ static OSStatus property_listener_default_output_device(AudioObjectID inObjectID
 
   pthread_mutex_lock(&_mutex);
   if (_started) {
-    pthread_mutex_unlock(&_mutex);
     AudioOutputUnitStop(_outputAudioUnit);
-    pthread_mutex_lock(&_mutex);
 
-    [self _setShouldInterceptTiming:YES];
+    renderer_set_should_intercept_timing(self, YES);
     _started = NO;
   }
+  [self _releaseRetiredMetrics];
+  atomic_store(&_firstAudioHostTime, 0);
+  _underrunHostTime = 0;
   pthread_mutex_unlock(&_mutex);
-  pthread_cond_signal(&_cond);
+  dispatch_semaphore_signal(_semaphore);
 }
 
 - (void)flush
@@ -456,7 +760,7 @@ static OSStatus property_listener_default_output_device(AudioObjectID inObjectID
 
 - (void)flushShouldResetTiming:(BOOL)shouldResetTiming
 {
-  [_analyzers makeObjectsPerformSelector:@selector(flush)];
+  [_analysisWorker flush];
 
   if (_outputAudioUnit == NULL) {
     return;
@@ -464,14 +768,24 @@ static OSStatus property_listener_default_output_device(AudioObjectID inObjectID
 
   pthread_mutex_lock(&_mutex);
 
-  _firstValidByteOffset = 0;
-  _validByteCount = 0;
+  NSUInteger writeIndex = atomic_load_explicit(&_writeIndex, memory_order_relaxed);
+  if (_started) {
+    atomic_store_explicit(&_flushIndex, writeIndex, memory_order_relaxed);
+    atomic_store_explicit(&_flushRequested, true, memory_order_release);
+  }
+  else {
+    atomic_store_explicit(&_flushRequested, false, memory_order_relaxed);
+    atomic_store_explicit(&_readIndex, writeIndex, memory_order_release);
+  }
+
+  renderer_publish_track_gain(self, dou_audio_gain_from_decibels(_trackGain), writeIndex);
+
   if (shouldResetTiming) {
     [self _resetTiming];
   }
 
+  [self _releaseRetiredMetrics];
   pthread_mutex_unlock(&_mutex);
-  pthread_cond_signal(&_cond);
 }
 
 + (double)_absoluteTimeConversion
@@ -490,65 +804,136 @@ static OSStatus property_listener_default_output_device(AudioObjectID inObjectID
 
 - (void)_resetTiming
 {
-  _startedTime = 0;
-  _interruptedTime = 0;
-  _totalInterruptedInterval = 0;
+  atomic_store(&_startedTime, 0);
+  atomic_store(&_interruptedTime, 0);
+  atomic_store(&_totalInterruptedInterval, 0);
+  atomic_store(&_firstAudioHostTime, 0);
+}
+
++ (NSTimeInterval)timeIntervalForHostTime:(uint64_t)hostTime
+{
+  return [self _absoluteTimeConversion] * hostTime;
+}
+
+- (uint64_t)firstAudioHostTime
+{
+  return atomic_load(&_firstAudioHostTime);
 }
 
 - (NSUInteger)currentTime
 {
-  if (_startedTime == 0) {
+  uint64_t startedTime = atomic_load(&_startedTime);
+  if (startedTime == 0) {
     return 0;
   }
 
   double base = [[self class] _absoluteTimeConversion] * 1000.0;
 
+  uint64_t interruptedTime = atomic_load(&_interruptedTime);
+  uint64_t totalInterruptedInterval = atomic_load(&_totalInterruptedInterval);
+
   uint64_t interval;
-  if (_interruptedTime == 0) {
-    interval = mach_absolute_time() - _startedTime - _totalInterruptedInterval;
+  if (interruptedTime == 0) {
+    interval = mach_absolute_time() - startedTime - totalInterruptedInterval;
   }
   else {
-    interval = _interruptedTime - _startedTime - _totalInterruptedInterval;
+    interval = interruptedTime - startedTime - totalInterruptedInterval;
   }
 
   return base * interval;
 }
 
-- (void)setInterrupted:(BOOL)interrupted
+- (NSUInteger)queuedTime
+{
+  if (_bufferByteCount == 0) {
+    return 0;
+  }
+
+  NSUInteger readIndex = atomic_load_explicit(&_readIndex, memory_order_acquire);
+  NSUInteger writeIndex = atomic_load_explicit(&_writeIndex, memory_order_relaxed);
+  return renderer_ring_count(_bufferByteCount, readIndex, writeIndex) * _bufferTime / _bufferByteCount;
+}
+
+- (DOUAudioMetrics *)metrics
 {
+  return _metrics;
+}
+
+- (void)setMetrics:(DOUAudioMetrics *)metrics
+{
+  if (_metrics == metrics) {
+    return;
+  }
+
   pthread_mutex_lock(&_mutex);
-  _interrupted = interrupted;
+  if (_metrics != nil) {
+    [_retiredMetrics addObject:_metrics];
+  }
+
+  _metrics = metrics;
+  atomic_store_explicit(&_metricsRef, (__bridge void *)_metrics, memory_order_release);
+  atomic_fetch_add_explicit(&_metricsGeneration, 1, memory_order_release);
+  [self _releaseRetiredMetrics];
   pthread_mutex_unlock(&_mutex);
 }
 
-- (double)volume
+// Must be called with _mutex held.
+- (void)_releaseRetiredMetrics
 {
-#if TARGET_OS_IPHONE
-  return _volume;
-#else /* TARGET_OS_IPHONE */
-  if (_outputAudioUnit == NULL) {
-    return 0.0;
+  if ([_retiredMetrics count] == 0) {
+    return;
   }
 
-  AudioUnitParameterValue volume = 0.0;
-  AudioUnitGetParameter(_outputAudioUnit, kHALOutputParam_Volume, kAudioUnitScope_Output, 1, &volume);
+  NSUInteger generation = atomic_load_explicit(&_metricsGeneration, memory_order_relaxed);
+  if (!_started ||
+      atomic_load_explicit(&_acknowledgedMetricsGeneration, memory_order_acquire) == generation) {
+    [_retiredMetrics removeAllObjects];
+  }
+}
 
-  return volume;
-#endif /* TARGET_OS_IPHONE */
+- (NSArray *)analyzers
+{
+  return _analyzers;
 }
 
-- (void)setVolume:(double)volume
+- (void)setAnalyzers:(NSArray *)analyzers
 {
-#if TARGET_OS_IPHONE
-  _volume = volume;
-#else /* TARGET_OS_IPHONE */
-  if (_outputAudioUnit == NULL) {
-    return;
+  _analyzers = [analyzers copy];
+
+  if (_analysisWorker == nil && [_analyzers count] > 0) {
+    _analysisWorker = [[DOUAudioAnalysisWorker alloc] init];
+    atomic_store_explicit(&_analysisWorkerRef, (__bridge void *)_analysisWorker, memory_order_release);
   }
 
-  volume = fmin(fmax(volume, 0.0), 1.0);
-  AudioUnitSetParameter(_outputAudioUnit, kHALOutputParam_Volume, kAudioUnitScope_Output, 1, volume, 0);
-#endif /* TARGET_OS_IPHONE */
+  [_analysisWorker setAnalyzers:_analyzers];
+  [_analysisWorker flush];
+}
+
+- (void)setInterrupted:(BOOL)interrupted
+{
+  pthread_mutex_lock(&_mutex);
+  _interrupted = interrupted;
+  pthread_mutex_unlock(&_mutex);
+}
+
+- (double)volume
+{
+  return atomic_load_explicit(&_volume, memory_order_relaxed);
+}
+
+- (void)setVolume:(double)volume
+{
+  atomic_store_explicit(&_volume, (float)fmin(fmax(volume, 0.0), 1.0), memory_order_relaxed);
+}
+
+- (void)setTrackGain:(double)trackGain
+{
+  pthread_mutex_lock(&_mutex);
+  _trackGain = trackGain;
+  renderer_publish_track_gain(self,
+                              dou_audio_gain_from_decibels(_trackGain),
+                              atomic_load_explicit(&_writeIndex, memory_order_relaxed));
+  pthread_mutex_unlock(&_mutex);
 }
 
 @end
@@ -0,0 +1,63 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#include <CoreAudio/CoreAudioTypes.h>
+
+@class DOUAudioMetrics;
+
+typedef void (*DOUAudioRenderingWakeUpFunction)(void *context);
+
+@protocol DOUAudioRendering <NSObject>
+
+@required
+
+- (BOOL)setUp;
+- (void)tearDown;
+
+- (double)sampleRateForSourceSampleRate:(double)sampleRate;
+
+- (void)renderBytes:(const void *)bytes length:(NSUInteger)length;
+- (void)stop;
+- (void)flush;
+- (void)flushShouldResetTiming:(BOOL)shouldResetTiming;
+
+@property (nonatomic, assign) AudioStreamBasicDescription format;
+
+@property (nonatomic, readonly) NSUInteger currentTime;
+@property (nonatomic, readonly) NSUInteger queuedTime;
+@property (nonatomic, readonly) uint64_t firstAudioHostTime;
+@property (nonatomic, readonly, getter=isStarted) BOOL started;
+@property (nonatomic, assign, getter=isInterrupted) BOOL interrupted;
+@property (nonatomic, assign) NSUInteger startThreshold;
+@property (nonatomic, assign) double volume;
+@property (nonatomic, assign) double trackGain;
+
+@property (nonatomic, strong) DOUAudioMetrics *metrics;
+@property (nonatomic, copy) NSArray *analyzers;
+
+@optional
+
+/*
+ * Renderers that can tell when they have room let the event loop sleep
+ * instead of blocking in renderBytes:length:.  When length bytes cannot be
+ * rendered without blocking, isWritableForLength: returns NO and the wake-up
+ * function is called once, from any thread, as soon as they can.
+ */
+- (void)setWakeUpFunction:(DOUAudioRenderingWakeUpFunction)function context:(void *)context;
+- (BOOL)isWritableForLength:(NSUInteger)length;
+
+@end
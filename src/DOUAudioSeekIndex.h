@@ -0,0 +1,51 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import <Foundation/Foundation.h>
+#include <AudioToolbox/AudioToolbox.h>
+
+typedef NSUInteger (^DOUAudioSeekIndexReadBlock)(void *buffer, NSUInteger offset, NSUInteger length);
+
+@interface DOUAudioSeekIndex : NSObject
+
++ (instancetype)seekIndexWithFileID:(AudioFileID)fileID
+                         dataOffset:(NSUInteger)dataOffset
+                         dataLength:(NSUInteger)dataLength
+                               path:(NSString *)path;
+- (instancetype)initWithFileID:(AudioFileID)fileID
+                    dataOffset:(NSUInteger)dataOffset
+                    dataLength:(NSUInteger)dataLength
+                          path:(NSString *)path;
+
+@property (nonatomic, readonly) NSUInteger packetCount;
+@property (nonatomic, readonly) NSUInteger scannedLength;
+@property (nonatomic, readonly, getter=isFinished) BOOL finished;
+
+- (void)scanToLength:(NSUInteger)length readBlock:(DOUAudioSeekIndexReadBlock)readBlock;
+
+- (SInt64)byteOffsetForPacket:(SInt64)packet exact:(BOOL *)exact;
+- (SInt64)packetForByteOffset:(SInt64)byteOffset;
+
+- (UInt32)getPacketDescriptions:(AudioStreamPacketDescription *)packetDescriptions
+                     fromPacket:(SInt64)packet
+                          count:(UInt32)count
+                   maxByteCount:(UInt32)maxByteCount
+                     byteOffset:(SInt64 *)byteOffset
+                      byteCount:(UInt32 *)byteCount;
+
+- (void)save;
+
+@end
@@ -0,0 +1,620 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioSeekIndex.h"
+
+static const uint32_t kDOUAudioSeekIndexMagic = 0x31495344; /* 'DSI1' */
+static const NSUInteger kDOUAudioSeekIndexChunkSize = 64 * 1024;
+static const NSUInteger kDOUAudioSeekIndexMaximumScanLength = 1024 * 1024;
+
+typedef NS_ENUM(NSUInteger, seek_index_scanner) {
+  seek_index_scanner_none,
+  seek_index_scanner_mpeg,
+  seek_index_scanner_adts
+};
+
+typedef struct {
+  uint32_t magic;
+  uint32_t fileType;
+  uint64_t dataOffset;
+  uint64_t dataLength;
+  uint64_t packetCount;
+  uint64_t scannedLength;
+  uint64_t tocCount;
+  uint32_t referenceHeader;
+  uint32_t finished;
+} seek_index_file_header;
+
+/*
+ * Packets are numbered the way AudioFile numbers them, and byte offsets are
+ * relative to the audio data offset, so that the index can be used wherever
+ * kAudioFilePropertyPacketToByte would be.  Offsets below _packetCount come
+ * from scanning frame headers and are exact; anything beyond is estimated
+ * from the Xing/VBRI table of contents when the file has one.
+ */
+
+@interface DOUAudioSeekIndex () {
+@private
+  AudioFileID _fileID;
+  AudioFileTypeID _fileType;
+  NSUInteger _dataOffset;
+  NSUInteger _dataLength;
+  NSString *_path;
+
+  seek_index_scanner _scanner;
+  uint32_t _referenceHeader;
+  SInt64 _tagPacketCount;
+
+  UInt32 *_offsets;
+  NSUInteger _packetCount;
+  NSUInteger _capacity;
+  NSUInteger _scannedLength;
+  BOOL _finished;
+  BOOL _dirty;
+
+  SInt64 *_tocPackets;
+  SInt64 *_tocOffsets;
+  NSUInteger _tocCount;
+}
+@end
+
+@implementation DOUAudioSeekIndex
+
+@synthesize packetCount = _packetCount;
+@synthesize scannedLength = _scannedLength;
+@synthesize finished = _finished;
+
++ (instancetype)seekIndexWithFileID:(AudioFileID)fileID
+                         dataOffset:(NSUInteger)dataOffset
+                         dataLength:(NSUInteger)dataLength
+                               path:(NSString *)path
+{
+  return [[[self class] alloc] initWithFileID:fileID
+                                   dataOffset:dataOffset
+                                   dataLength:dataLength
+                                         path:path];
+}
+
+- (instancetype)initWithFileID:(AudioFileID)fileID
+                    dataOffset:(NSUInteger)dataOffset
+                    dataLength:(NSUInteger)dataLength
+                          path:(NSString *)path
+{
+  self = [super init];
+  if (self) {
+    _fileID = fileID;
+    _dataOffset = dataOffset;
+    _dataLength = dataLength;
+    _path = [path copy];
+
+    UInt32 size = sizeof(_fileType);
+    if (AudioFileGetProperty(_fileID, kAudioFilePropertyFileFormat, &size, &_fileType) != noErr) {
+      _fileType = 0;
+    }
+
+    if (_dataLength > UINT32_MAX) {
+      _scanner = seek_index_scanner_none;
+    }
+    else if (_fileType == kAudioFileMP3Type ||
+             _fileType == kAudioFileMP2Type ||
+             _fileType == kAudioFileMP1Type) {
+      _scanner = seek_index_scanner_mpeg;
+    }
+    else if (_fileType == kAudioFileAAC_ADTSType) {
+      _scanner = seek_index_scanner_adts;
+    }
+    else {
+      _scanner = seek_index_scanner_none;
+    }
+
+    _tagPacketCount = -1;
+    if (_scanner != seek_index_scanner_none) {
+      [self _load];
+    }
+  }
+
+  return self;
+}
+
+- (void)dealloc
+{
+  if (_offsets != NULL) {
+    free(_offsets);
+  }
+
+  if (_tocPackets != NULL) {
+    free(_tocPackets);
+    free(_tocOffsets);
+  }
+}
+
+#pragma mark - Persistence
+
+- (void)_load
+{
+  NSData *data = [NSData dataWithContentsOfFile:_path options:NSDataReadingMappedIfSafe error:NULL];
+  if ([data length] < sizeof(seek_index_file_header)) {
+    return;
+  }
+
+  seek_index_file_header header;
+  memcpy(&header, [data bytes], sizeof(header));
+  if (header.magic != kDOUAudioSeekIndexMagic ||
+      header.fileType != _fileType ||
+      header.dataOffset != _dataOffset ||
+      header.dataLength != _dataLength ||
+      header.scannedLength > _dataLength) {
+    return;
+  }
+
+  NSUInteger expectedLength = sizeof(header) +
+                              (NSUInteger)header.packetCount * sizeof(UInt32) +
+                              (NSUInteger)header.tocCount * sizeof(SInt64) * 2;
+  if ([data length] != expectedLength) {
+    return;
+  }
+
+  const uint8_t *bytes = (const uint8_t *)[data bytes] + sizeof(header);
+
+  _packetCount = (NSUInteger)header.packetCount;
+  _capacity = MAX(_packetCount, (NSUInteger)1);
+  _offsets = (UInt32 *)malloc(sizeof(UInt32) * _capacity);
+  memcpy(_offsets, bytes, sizeof(UInt32) * _packetCount);
+  bytes += sizeof(UInt32) * _packetCount;
+
+  _tocCount = (NSUInteger)header.tocCount;
+  if (_tocCount > 0) {
+    _tocPackets = (SInt64 *)malloc(sizeof(SInt64) * _tocCount);
+    _tocOffsets = (SInt64 *)malloc(sizeof(SInt64) * _tocCount);
+    memcpy(_tocPackets, bytes, sizeof(SInt64) * _tocCount);
+    bytes += sizeof(SInt64) * _tocCount;
+    memcpy(_tocOffsets, bytes, sizeof(SInt64) * _tocCount);
+  }
+
+  _scannedLength = (NSUInteger)header.scannedLength;
+  _referenceHeader = header.referenceHeader;
+  _finished = header.finished != 0;
+  _tagPacketCount = 0;
+}
+
+- (void)save
+{
+  if (!_dirty || _path == nil || _scanner == seek_index_scanner_none) {
+    return;
+  }
+
+  seek_index_file_header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kDOUAudioSeekIndexMagic;
+  header.fileType = _fileType;
+  header.dataOffset = _dataOffset;
+  header.dataLength = _dataLength;
+  header.packetCount = _packetCount;
+  header.scannedLength = _scannedLength;
+  header.tocCount = _tocCount;
+  header.referenceHeader = _referenceHeader;
+  header.finished = _finished;
+
+  NSMutableData *data = [NSMutableData dataWithCapacity:sizeof(header) + sizeof(UInt32) * _packetCount + sizeof(SInt64) * _tocCount * 2];
+  [data appendBytes:&header length:sizeof(header)];
+  [data appendBytes:_offsets length:sizeof(UInt32) * _packetCount];
+  if (_tocCount > 0) {
+    [data appendBytes:_tocPackets length:sizeof(SInt64) * _tocCount];
+    [data appendBytes:_tocOffsets length:sizeof(SInt64) * _tocCount];
+  }
+
+  if ([data writeToFile:_path atomically:YES]) {
+    _dirty = NO;
+  }
+}
+
+#pragma mark - Frame Headers
+
+static NSUInteger seek_index_mpeg_frame_length(const uint8_t *header, uint32_t *reference)
+{
+  static const uint16_t bitRates[2][3][16] = {
+    {
+      { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+      { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+      { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 }
+    },
+    {
+      { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+      { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+      { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 }
+    }
+  };
+  static const uint32_t sampleRates[3] = { 44100, 48000, 32000 };
+
+  if (header[0] != 0xff || (header[1] & 0xe0) != 0xe0) {
+    return 0;
+  }
+
+  uint32_t version = (header[1] >> 3) & 0x03;
+  uint32_t layer = (header[1] >> 1) & 0x03;
+  uint32_t bitRateIndex = header[2] >> 4;
+  uint32_t sampleRateIndex = (header[2] >> 2) & 0x03;
+  uint32_t padding = (header[2] >> 1) & 0x01;
+
+  if (version == 1 || layer == 0 || bitRateIndex == 0 || bitRateIndex == 15 || sampleRateIndex == 3) {
+    return 0;
+  }
+
+  uint32_t frameReference = ((uint32_t)(header[1] & 0xfe) << 8) | (header[2] & 0x0c);
+  if (*reference == 0) {
+    *reference = frameReference;
+  }
+  else if (*reference != frameReference) {
+    return 0;
+  }
+
+  BOOL mpeg1 = (version == 3);
+  uint32_t layerIndex = 3 - layer;
+  uint32_t bitRate = bitRates[mpeg1 ? 0 : 1][layerIndex][bitRateIndex] * 1000;
+  uint32_t sampleRate = sampleRates[sampleRateIndex] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+
+  if (layerIndex == 0) {
+    return (12 * bitRate / sampleRate + padding) * 4;
+  }
+  else if (layerIndex == 2 && !mpeg1) {
+    return 72 * bitRate / sampleRate + padding;
+  }
+  else {
+    return 144 * bitRate / sampleRate + padding;
+  }
+}
+
+static NSUInteger seek_index_adts_frame_length(const uint8_t *header, uint32_t *reference)
+{
+  if (header[0] != 0xff || (header[1] & 0xf6) != 0xf0) {
+    return 0;
+  }
+
+  if ((header[6] & 0x03) != 0) {
+    return 0;
+  }
+
+  uint32_t frameReference = ((uint32_t)header[1] << 8) | (header[2] & 0xfc);
+  if (*reference == 0) {
+    *reference = frameReference;
+  }
+  else if (*reference != frameReference) {
+    return 0;
+  }
+
+  NSUInteger frameLength = ((NSUInteger)(header[3] & 0x03) << 11) | ((NSUInteger)header[4] << 3) | (header[5] >> 5);
+  return frameLength >= 7 ? frameLength : 0;
+}
+
+static uint32_t seek_index_read_uint32(const uint8_t *bytes)
+{
+  return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+static uint16_t seek_index_read_uint16(const uint8_t *bytes)
+{
+  return (uint16_t)(((uint16_t)bytes[0] << 8) | bytes[1]);
+}
+
+- (void)_allocateTOCWithCount:(NSUInteger)count
+{
+  _tocCount = count;
+  _tocPackets = (SInt64 *)malloc(sizeof(SInt64) * count);
+  _tocOffsets = (SInt64 *)malloc(sizeof(SInt64) * count);
+}
+
+- (BOOL)_parseTagWithFrame:(const uint8_t *)frame length:(NSUInteger)length
+{
+  BOOL mpeg1 = ((frame[1] >> 3) & 0x03) == 3;
+  BOOL mono = (frame[3] >> 6) == 3;
+  NSUInteger xingOffset = 4 + (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+
+  if (xingOffset + 8 <= length &&
+      (memcmp(frame + xingOffset, "Xing", 4) == 0 ||
+       memcmp(frame + xingOffset, "Info", 4) == 0)) {
+    const uint8_t *p = frame + xingOffset + 4;
+    uint32_t flags = seek_index_read_uint32(p);
+    p += 4;
+
+    uint32_t frames = 0;
+    uint32_t bytes = 0;
+    if ((flags & 0x01) && p + 4 <= frame + length) {
+      frames = seek_index_read_uint32(p);
+      p += 4;
+    }
+    if ((flags & 0x02) && p + 4 <= frame + length) {
+      bytes = seek_index_read_uint32(p);
+      p += 4;
+    }
+
+    if ((flags & 0x04) && p + 100 <= frame + length && frames > 0 && bytes > 0) {
+      [self _allocateTOCWithCount:101];
+      for (NSUInteger i = 0; i < 100; ++i) {
+        _tocPackets[i] = (SInt64)frames * (SInt64)i / 100;
+        _tocOffsets[i] = (SInt64)bytes * p[i] / 256;
+      }
+      _tocPackets[100] = frames;
+      _tocOffsets[100] = bytes;
+    }
+
+    [self _resolveTagPacketCountWithFrameCount:frames];
+    return YES;
+  }
+
+  const NSUInteger vbriOffset = 4 + 32;
+  if (vbriOffset + 26 <= length &&
+      memcmp(frame + vbriOffset, "VBRI", 4) == 0) {
+    const uint8_t *p = frame + vbriOffset;
+    uint32_t frames = seek_index_read_uint32(p + 14);
+    uint16_t entryCount = seek_index_read_uint16(p + 18);
+    uint16_t scale = seek_index_read_uint16(p + 20);
+    uint16_t entrySize = seek_index_read_uint16(p + 22);
+    uint16_t framesPerEntry = seek_index_read_uint16(p + 24);
+
+    p += 26;
+    if (entryCount > 0 && entrySize >= 1 && entrySize <= 4 &&
+        p + (NSUInteger)entryCount * entrySize <= frame + length) {
+      [self _allocateTOCWithCount:(NSUInteger)entryCount + 1];
+      _tocPackets[0] = 0;
+      _tocOffsets[0] = 0;
+      for (NSUInteger i = 0; i < entryCount; ++i) {
+        uint32_t entry = 0;
+        for (uint16_t j = 0; j < entrySize; ++j) {
+          entry = (entry << 8) | *p++;
+        }
+
+        _tocPackets[i + 1] = _tocPackets[i] + framesPerEntry;
+        _tocOffsets[i + 1] = _tocOffsets[i] + (SInt64)entry * scale;
+      }
+    }
+
+    [self _resolveTagPacketCountWithFrameCount:frames];
+    return YES;
+  }
+
+  return NO;
+}
+
+- (void)_resolveTagPacketCountWithFrameCount:(uint32_t)frameCount
+{
+  /*
+   * The tag frame decodes to silence and is normally not counted as a packet,
+   * but follow AudioFile if it reports one packet more than the tag does.
+   */
+  UInt64 packetCount = 0;
+  UInt32 size = sizeof(packetCount);
+  if (frameCount > 0 &&
+      AudioFileGetProperty(_fileID, kAudioFilePropertyAudioDataPacketCount, &size, &packetCount) == noErr &&
+      packetCount == (UInt64)frameCount + 1) {
+    _tagPacketCount = 1;
+  }
+  else {
+    _tagPacketCount = 0;
+  }
+}
+
+- (void)_appendPacketWithOffset:(NSUInteger)offset
+{
+  if (_packetCount == _capacity) {
+    _capacity = MAX(_capacity * 2, (NSUInteger)1024);
+    _offsets = (UInt32 *)realloc(_offsets, sizeof(UInt32) * _capacity);
+  }
+
+  _offsets[_packetCount++] = (UInt32)offset;
+}
+
+#pragma mark - Scanning
+
+- (void)scanToLength:(NSUInteger)length readBlock:(DOUAudioSeekIndexReadBlock)readBlock
+{
+  if (_finished || _scanner == seek_index_scanner_none) {
+    return;
+  }
+
+  const NSUInteger headerSize = _scanner == seek_index_scanner_mpeg ? 4 : 7;
+  length = MIN(length, _dataLength);
+  NSUInteger limit = MIN(length, _scannedLength + kDOUAudioSeekIndexMaximumScanLength);
+
+  uint8_t *chunk = NULL;
+  while (!_finished && _scannedLength + headerSize <= limit) {
+    if (chunk == NULL) {
+      chunk = (uint8_t *)malloc(kDOUAudioSeekIndexChunkSize);
+    }
+
+    NSUInteger chunkLength = readBlock(chunk, _dataOffset + _scannedLength, MIN(kDOUAudioSeekIndexChunkSize, length - _scannedLength));
+    if (chunkLength < headerSize) {
+      break;
+    }
+
+    NSUInteger position = 0;
+    while (position + headerSize <= chunkLength) {
+      NSUInteger frameLength;
+      if (_scanner == seek_index_scanner_mpeg) {
+        frameLength = seek_index_mpeg_frame_length(chunk + position, &_referenceHeader);
+      }
+      else {
+        frameLength = seek_index_adts_frame_length(chunk + position, &_referenceHeader);
+      }
+
+      if (frameLength == 0 || _scannedLength + position + frameLength > _dataLength) {
+        _finished = YES;
+        break;
+      }
+
+      BOOL tag = NO;
+      if (_tagPacketCount < 0) {
+        _tagPacketCount = 0;
+        if (_scanner == seek_index_scanner_mpeg && _packetCount == 0) {
+          tag = [self _parseTagWithFrame:chunk + position length:MIN(frameLength, chunkLength - position)];
+          tag = tag && _tagPacketCount == 0;
+        }
+      }
+
+      if (!tag) {
+        [self _appendPacketWithOffset:_scannedLength + position];
+      }
+
+      position += frameLength;
+    }
+
+    _scannedLength += MIN(position, _dataLength - _scannedLength);
+    _dirty = YES;
+  }
+
+  if (chunk != NULL) {
+    free(chunk);
+  }
+
+  if (_scannedLength + headerSize > _dataLength) {
+    _finished = YES;
+  }
+
+  if (_finished) {
+    [self save];
+  }
+}
+
+#pragma mark - Lookups
+
+static NSUInteger seek_index_search(const SInt64 *values, NSUInteger count, SInt64 value)
+{
+  NSUInteger low = 0;
+  NSUInteger high = count;
+  while (high - low > 1) {
+    NSUInteger middle = low + (high - low) / 2;
+    if (values[middle] <= value) {
+      low = middle;
+    }
+    else {
+      high = middle;
+    }
+  }
+
+  return low;
+}
+
+static SInt64 seek_index_interpolate(const SInt64 *xs, const SInt64 *ys, NSUInteger count, SInt64 x)
+{
+  NSUInteger i = seek_index_search(xs, count, x);
+  if (i + 1 >= count || xs[i + 1] == xs[i]) {
+    return ys[i];
+  }
+
+  return ys[i] + (ys[i + 1] - ys[i]) * (x - xs[i]) / (xs[i + 1] - xs[i]);
+}
+
+- (SInt64)byteOffsetForPacket:(SInt64)packet exact:(BOOL *)exact
+{
+  *exact = YES;
+  if (packet < 0) {
+    return -1;
+  }
+
+  if ((NSUInteger)packet < _packetCount) {
+    return _offsets[packet];
+  }
+  else if (_packetCount > 0 && (NSUInteger)packet == _packetCount) {
+    return _scannedLength;
+  }
+
+  AudioBytePacketTranslation translation;
+  memset(&translation, 0, sizeof(translation));
+  translation.mPacket = packet;
+
+  UInt32 size = sizeof(translation);
+  BOOL translated = AudioFileGetProperty(_fileID, kAudioFilePropertyPacketToByte, &size, &translation) == noErr;
+  if (translated && !(translation.mFlags & kBytePacketTranslationFlag_IsEstimate)) {
+    return translation.mByte;
+  }
+
+  *exact = NO;
+  if (_tocCount > 0) {
+    return seek_index_interpolate(_tocPackets, _tocOffsets, _tocCount, packet);
+  }
+  else if (translated) {
+    return translation.mByte;
+  }
+
+  return -1;
+}
+
+- (SInt64)packetForByteOffset:(SInt64)byteOffset
+{
+  if (byteOffset < 0) {
+    return -1;
+  }
+
+  if (_packetCount > 0 && (NSUInteger)byteOffset < _scannedLength) {
+    NSUInteger low = 0;
+    NSUInteger high = _packetCount;
+    while (high - low > 1) {
+      NSUInteger middle = low + (high - low) / 2;
+      if ((SInt64)_offsets[middle] <= byteOffset) {
+        low = middle;
+      }
+      else {
+        high = middle;
+      }
+    }
+
+    return (SInt64)low;
+  }
+  else if (_packetCount > 0 && (NSUInteger)byteOffset == _scannedLength) {
+    return (SInt64)_packetCount;
+  }
+
+  if (_tocCount > 0) {
+    return seek_index_interpolate(_tocOffsets, _tocPackets, _tocCount, byteOffset);
+  }
+
+  return -1;
+}
+
+- (UInt32)getPacketDescriptions:(AudioStreamPacketDescription *)packetDescriptions
+                     fromPacket:(SInt64)packet
+                          count:(UInt32)count
+                   maxByteCount:(UInt32)maxByteCount
+                     byteOffset:(SInt64 *)byteOffset
+                      byteCount:(UInt32 *)byteCount
+{
+  if (packet < 0 || (NSUInteger)packet >= _packetCount || packetDescriptions == NULL) {
+    return 0;
+  }
+
+  count = (UInt32)MIN((NSUInteger)count, _packetCount - (NSUInteger)packet);
+  NSUInteger start = _offsets[packet];
+
+  UInt32 i;
+  NSUInteger end = start;
+  for (i = 0; i < count; ++i) {
+    NSUInteger index = (NSUInteger)packet + i;
+    NSUInteger packetEnd = index + 1 < _packetCount ? _offsets[index + 1] : _scannedLength;
+    if (packetEnd - start > maxByteCount) {
+      break;
+    }
+
+    packetDescriptions[i].mStartOffset = (SInt64)(_offsets[index] - start);
+    packetDescriptions[i].mVariableFramesInPacket = 0;
+    packetDescriptions[i].mDataByteSize = (UInt32)(packetEnd - _offsets[index]);
+    end = packetEnd;
+  }
+
+  *byteOffset = (SInt64)start;
+  *byteCount = (UInt32)(end - start);
+  return i;
+}
+
+@end
@@ -15,14 +15,20 @@
  */
 
 #import "DOUAudioStreamer.h"
+#import "DOUAudioBufferingPolicy.h"
+#import "DOUAudioRendering.h"
 
 DOUAS_EXTERN NSString *const kDOUAudioStreamerVolumeKey;
 DOUAS_EXTERN const NSUInteger kDOUAudioStreamerBufferTime;
+DOUAS_EXTERN const double kDOUAudioStreamerReplayGainReferenceLoudness;
 
 typedef NS_OPTIONS(NSUInteger, DOUAudioStreamerOptions) {
   DOUAudioStreamerKeepPersistentVolume = 1 << 0,
   DOUAudioStreamerRemoveCacheOnDeallocation = 1 << 1,
   DOUAudioStreamerRequireSHA256 = 1 << 2,
+  DOUAudioStreamerGapless = 1 << 3,
+  DOUAudioStreamerFastStart = 1 << 4,
+  DOUAudioStreamerLoudnessNormalization = 1 << 5,
 
   DOUAudioStreamerDefaultOptions = DOUAudioStreamerKeepPersistentVolume |
                                    DOUAudioStreamerRemoveCacheOnDeallocation
@@ -33,4 +39,38 @@ typedef NS_OPTIONS(NSUInteger, DOUAudioStreamerOptions) {
 + (DOUAudioStreamerOptions)options;
 + (void)setOptions:(DOUAudioStreamerOptions)options;
 
++ (unsigned long long)maximumCacheSize;
++ (void)setMaximumCacheSize:(unsigned long long)maximumCacheSize;
++ (void)removeAllCachedFiles;
+
++ (NSUInteger)maximumConcurrentPrefetches;
++ (void)setMaximumConcurrentPrefetches:(NSUInteger)maximumConcurrentPrefetches;
+
++ (NSUInteger)maximumPrefetchBandwidth;
++ (void)setMaximumPrefetchBandwidth:(NSUInteger)maximumPrefetchBandwidth;
+
++ (NSTimeInterval)prefetchDuration;
++ (void)setPrefetchDuration:(NSTimeInterval)prefetchDuration;
+
++ (NSTimeInterval)crossfadeDuration;
++ (void)setCrossfadeDuration:(NSTimeInterval)crossfadeDuration;
+
++ (NSTimeInterval)fastStartThreshold;
++ (void)setFastStartThreshold:(NSTimeInterval)fastStartThreshold;
+
++ (NSTimeInterval)decodeAheadDuration;
++ (void)setDecodeAheadDuration:(NSTimeInterval)decodeAheadDuration;
+
++ (id <DOUAudioBufferingPolicy>)bufferingPolicy;
++ (void)setBufferingPolicy:(id <DOUAudioBufferingPolicy>)bufferingPolicy;
+
++ (id <DOUAudioRendering>)renderer;
++ (void)setRenderer:(id <DOUAudioRendering>)renderer;
+
++ (double)targetLoudness;
++ (void)setTargetLoudness:(double)targetLoudness;
+
++ (NSTimeInterval)liveWindowDuration;
++ (void)setLiveWindowDuration:(NSTimeInterval)liveWindowDuration;
+
 @end
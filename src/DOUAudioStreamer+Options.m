@@ -15,11 +15,18 @@
  */
 
 #import "DOUAudioStreamer+Options.h"
+#import "DOUAudioCache.h"
+#import "DOUAudioPrefetcher.h"
+#import "DOUAudioEventLoop.h"
 
 NSString *const kDOUAudioStreamerVolumeKey = @"DOUAudioStreamerVolume";
 const NSUInteger kDOUAudioStreamerBufferTime = 200;
+const double kDOUAudioStreamerReplayGainReferenceLoudness = -18.0;
 
 static DOUAudioStreamerOptions gOptions = DOUAudioStreamerDefaultOptions;
+static id <DOUAudioBufferingPolicy> gBufferingPolicy = nil;
+static double gTargetLoudness = kDOUAudioStreamerReplayGainReferenceLoudness;
+static NSTimeInterval gLiveWindowDuration = 60.0;
 
 @implementation DOUAudioStreamer (Options)
 
@@ -38,4 +45,135 @@ static DOUAudioStreamerOptions gOptions = DOUAudioStreamerDefaultOptions;
   gOptions = options;
 }
 
++ (unsigned long long)maximumCacheSize
+{
+  return [[DOUAudioCache sharedCache] maximumSize];
+}
+
++ (void)setMaximumCacheSize:(unsigned long long)maximumCacheSize
+{
+  [[DOUAudioCache sharedCache] setMaximumSize:maximumCacheSize];
+}
+
++ (void)removeAllCachedFiles
+{
+  [[DOUAudioCache sharedCache] removeAllEntries];
+}
+
++ (NSUInteger)maximumConcurrentPrefetches
+{
+  return [[DOUAudioPrefetcher sharedPrefetcher] maximumConcurrentPrefetches];
+}
+
++ (void)setMaximumConcurrentPrefetches:(NSUInteger)maximumConcurrentPrefetches
+{
+  [[DOUAudioPrefetcher sharedPrefetcher] setMaximumConcurrentPrefetches:maximumConcurrentPrefetches];
+}
+
++ (NSUInteger)maximumPrefetchBandwidth
+{
+  return [[DOUAudioPrefetcher sharedPrefetcher] maximumBandwidth];
+}
+
++ (void)setMaximumPrefetchBandwidth:(NSUInteger)maximumPrefetchBandwidth
+{
+  [[DOUAudioPrefetcher sharedPrefetcher] setMaximumBandwidth:maximumPrefetchBandwidth];
+}
+
++ (NSTimeInterval)prefetchDuration
+{
+  return [[DOUAudioPrefetcher sharedPrefetcher] prefetchDuration];
+}
+
++ (void)setPrefetchDuration:(NSTimeInterval)prefetchDuration
+{
+  [[DOUAudioPrefetcher sharedPrefetcher] setPrefetchDuration:prefetchDuration];
+}
+
++ (NSTimeInterval)crossfadeDuration
+{
+  return [[DOUAudioEventLoop sharedEventLoop] crossfadeDuration];
+}
+
++ (void)setCrossfadeDuration:(NSTimeInterval)crossfadeDuration
+{
+  [[DOUAudioEventLoop sharedEventLoop] setCrossfadeDuration:crossfadeDuration];
+}
+
++ (NSTimeInterval)fastStartThreshold
+{
+  return [[DOUAudioEventLoop sharedEventLoop] fastStartThreshold];
+}
+
++ (void)setFastStartThreshold:(NSTimeInterval)fastStartThreshold
+{
+  [[DOUAudioEventLoop sharedEventLoop] setFastStartThreshold:fastStartThreshold];
+}
+
++ (NSTimeInterval)decodeAheadDuration
+{
+  return [[DOUAudioEventLoop sharedEventLoop] decodeAheadDuration];
+}
+
++ (void)setDecodeAheadDuration:(NSTimeInterval)decodeAheadDuration
+{
+  [[DOUAudioEventLoop sharedEventLoop] setDecodeAheadDuration:decodeAheadDuration];
+}
+
++ (id <DOUAudioRendering>)renderer
+{
+  return [[DOUAudioEventLoop sharedEventLoop] renderer];
+}
+
++ (void)setRenderer:(id <DOUAudioRendering>)renderer
+{
+  [[DOUAudioEventLoop sharedEventLoop] setRenderer:renderer];
+}
+
++ (double)targetLoudness
+{
+  @synchronized(self) {
+    return gTargetLoudness;
+  }
+}
+
++ (void)setTargetLoudness:(double)targetLoudness
+{
+  @synchronized(self) {
+    gTargetLoudness = targetLoudness;
+  }
+}
+
++ (NSTimeInterval)liveWindowDuration
+{
+  @synchronized(self) {
+    return gLiveWindowDuration;
+  }
+}
+
++ (void)setLiveWindowDuration:(NSTimeInterval)liveWindowDuration
+{
+  @synchronized(self) {
+    gLiveWindowDuration = MAX(liveWindowDuration, 0.0);
+  }
+}
+
++ (id <DOUAudioBufferingPolicy>)bufferingPolicy
+{
+  @synchronized(self) {
+    if (gBufferingPolicy == nil) {
+      return [DOUAudioWatermarkBufferingPolicy defaultPolicy];
+    }
+
+    return gBufferingPolicy;
+  }
+}
+
++ (void)setBufferingPolicy:(id <DOUAudioBufferingPolicy>)bufferingPolicy
+{
+  @synchronized(self) {
+    gBufferingPolicy = bufferingPolicy;
+  }
+}
+
 @end
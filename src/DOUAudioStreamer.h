@@ -19,6 +19,7 @@
 #import "DOUAudioFile.h"
 #import "DOUAudioFilePreprocessor.h"
 #import "DOUAudioAnalyzer+Default.h"
+#import "DOUAudioMetrics.h"
 
 DOUAS_EXTERN NSString *const kDOUAudioStreamerErrorDomain;
 
@@ -48,6 +49,7 @@ typedef NS_ENUM(NSInteger, DOUAudioStreamerErrorCode) {
 + (void)setAnalyzers:(NSArray *)analyzers;
 
 + (void)setHintWithAudioFile:(id <DOUAudioFile>)audioFile;
++ (void)setHintsWithAudioFiles:(NSArray *)audioFiles;
 
 @property (assign, readonly) DOUAudioStreamerStatus status;
 @property (strong, readonly) NSError *error;
@@ -58,6 +60,7 @@ typedef NS_ENUM(NSInteger, DOUAudioStreamerErrorCode) {
 @property (nonatomic, assign, readonly) NSTimeInterval duration;
 @property (nonatomic, assign) NSTimeInterval currentTime;
 @property (nonatomic, assign) double volume;
+@property (assign) double mixVolume;
 
 @property (nonatomic, copy) NSArray *analyzers;
 
@@ -71,8 +74,20 @@ typedef NS_ENUM(NSInteger, DOUAudioStreamerErrorCode) {
 @property (nonatomic, readonly) NSUInteger downloadSpeed;
 @property (nonatomic, assign, readonly) double bufferingRatio;
 
+@property (nonatomic, readonly, getter=isLive) BOOL live;
+@property (strong, readonly) NSDictionary *metadata;
+
+@property (assign, readonly) NSTimeInterval timeToFirstAudio;
+@property (readonly) double trackGain;
+@property (nonatomic, readonly) DOUAudioMetricsSnapshot *metrics;
+
 - (void)play;
 - (void)pause;
 - (void)stop;
 
+- (void)enqueue;
+
+- (void)mix;
+- (void)mixAfterDelay:(NSTimeInterval)delay;
+
 @end
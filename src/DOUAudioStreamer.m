@@ -16,8 +16,11 @@
 
 #import "DOUAudioStreamer.h"
 #import "DOUAudioStreamer_Private.h"
+#import "DOUAudioStreamer+Options.h"
+#import "DOUAudioOverview.h"
 #import "DOUAudioFileProvider.h"
 #import "DOUAudioEventLoop.h"
+#include <mach/mach_time.h>
 
 NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error-domain";
 
@@ -36,6 +39,16 @@ NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error
   DOUAudioDecoder *_decoder;
 
   double _bufferingRatio;
+  NSDictionary *_metadata;
+
+  NSTimeInterval _timeToFirstAudio;
+  uint64_t _playRequestedHostTime;
+
+  double _replayGain;
+  DOUAudioOverview *_loudnessOverview;
+  BOOL _loudnessOverviewRequested;
+
+  double _mixVolume;
 
 #if TARGET_OS_IPHONE
   BOOL _pausedByInterruption;
@@ -56,6 +69,12 @@ NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error
 @synthesize decoder = _decoder;
 
 @synthesize bufferingRatio = _bufferingRatio;
+@synthesize metadata = _metadata;
+
+@synthesize timeToFirstAudio = _timeToFirstAudio;
+@synthesize playRequestedHostTime = _playRequestedHostTime;
+
+@synthesize mixVolume = _mixVolume;
 
 #if TARGET_OS_IPHONE
 @synthesize pausedByInterruption = _pausedByInterruption;
@@ -78,7 +97,16 @@ NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error
       return nil;
     }
 
-    _bufferingRatio = (double)[_fileProvider receivedLength] / [_fileProvider expectedLength];
+    if ([_fileProvider expectedLength] > 0) {
+      _bufferingRatio = (double)[_fileProvider receivedLength] / [_fileProvider expectedLength];
+    }
+
+    _mixVolume = 1.0;
+
+    _replayGain = NAN;
+    if ([_audioFile respondsToSelector:@selector(audioFileReplayGain)]) {
+      _replayGain = [_audioFile audioFileReplayGain];
+    }
   }
 
   return self;
@@ -109,6 +137,11 @@ NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error
   [DOUAudioFileProvider setHintWithAudioFile:audioFile];
 }
 
++ (void)setHintsWithAudioFiles:(NSArray *)audioFiles
+{
+  [DOUAudioFileProvider setHintsWithAudioFiles:audioFiles];
+}
+
 - (id <DOUAudioFile>)audioFile
 {
   return _audioFile;
@@ -121,6 +154,10 @@ NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error
 
 - (NSTimeInterval)currentTime
 {
+  if ([[DOUAudioEventLoop sharedEventLoop] isMixingStreamer:self]) {
+    return [[DOUAudioEventLoop sharedEventLoop] currentTimeForMixingStreamer:self];
+  }
+
   if ([[DOUAudioEventLoop sharedEventLoop] currentStreamer] != self) {
     return 0.0;
   }
@@ -187,6 +224,75 @@ NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error
   return [_fileProvider downloadSpeed];
 }
 
+- (BOOL)isLive
+{
+  return [_fileProvider isLive];
+}
+
+- (DOUAudioMetricsSnapshot *)metrics
+{
+  return [[_fileProvider metrics] snapshot];
+}
+
+- (double)trackGain
+{
+  if (!([DOUAudioStreamer options] & DOUAudioStreamerLoudnessNormalization)) {
+    return 0.0;
+  }
+
+  @synchronized(self) {
+    // A measured overview knows the peak, so the gain for the actual target
+    // is limited against full scale; a tagged gain can only be shifted.
+    if (_loudnessOverview != nil) {
+      return [_loudnessOverview gainForTargetLoudness:[DOUAudioStreamer targetLoudness]];
+    }
+
+    if (isnan(_replayGain)) {
+      return 0.0;
+    }
+
+    return _replayGain + [DOUAudioStreamer targetLoudness] - kDOUAudioStreamerReplayGainReferenceLoudness;
+  }
+}
+
+static dispatch_queue_t streamer_track_gain_queue(void)
+{
+  static dispatch_queue_t queue = NULL;
+
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    queue = dispatch_queue_create("com.douban.audio-streamer.track-gain", DISPATCH_QUEUE_SERIAL);
+  });
+
+  return queue;
+}
+
+- (void)computeTrackGainIfNeeded
+{
+  @synchronized(self) {
+    if (!isnan(_replayGain) || _loudnessOverviewRequested) {
+      return;
+    }
+
+    _loudnessOverviewRequested = YES;
+  }
+
+  __weak typeof(self) weakSelf = self;
+  [DOUAudioOverview computeOverviewWithAudioFile:_audioFile
+                                      resolution:1
+                                           queue:streamer_track_gain_queue()
+                                 completionBlock:^(DOUAudioOverview *overview) {
+    __strong typeof(weakSelf) strongSelf = weakSelf;
+    if (strongSelf == nil) {
+      return;
+    }
+
+    @synchronized(strongSelf) {
+      strongSelf->_loudnessOverview = overview;
+    }
+  }];
+}
+
 - (void)play
 {
   @synchronized(self) {
@@ -196,6 +302,14 @@ NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error
       return;
     }
 
+    if ([[DOUAudioEventLoop sharedEventLoop] isMixingStreamer:self]) {
+      [[DOUAudioEventLoop sharedEventLoop] mixStreamer:self afterDelay:0.0];
+      return;
+    }
+
+    [self setTimeToFirstAudio:0.0];
+    [self setPlayRequestedHostTime:mach_absolute_time()];
+
     if ([[DOUAudioEventLoop sharedEventLoop] currentStreamer] != self) {
       [[DOUAudioEventLoop sharedEventLoop] pause];
       [[DOUAudioEventLoop sharedEventLoop] setCurrentStreamer:self];
@@ -214,6 +328,11 @@ NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error
       return;
     }
 
+    if ([[DOUAudioEventLoop sharedEventLoop] isMixingStreamer:self]) {
+      [[DOUAudioEventLoop sharedEventLoop] pauseMixingStreamer:self];
+      return;
+    }
+
     if ([[DOUAudioEventLoop sharedEventLoop] currentStreamer] != self) {
       return;
     }
@@ -225,6 +344,11 @@ NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error
 - (void)stop
 {
   @synchronized(self) {
+    if ([[DOUAudioEventLoop sharedEventLoop] isMixingStreamer:self]) {
+      [[DOUAudioEventLoop sharedEventLoop] removeMixingStreamer:self];
+      return;
+    }
+
     if (_status == DOUAudioStreamerIdle) {
       return;
     }
@@ -238,4 +362,49 @@ NSString *const kDOUAudioStreamerErrorDomain = @"com.douban.audio-streamer.error
   }
 }
 
+- (void)enqueue
+{
+  @synchronized(self) {
+    if (_status != DOUAudioStreamerPaused &&
+        _status != DOUAudioStreamerIdle &&
+        _status != DOUAudioStreamerFinished) {
+      return;
+    }
+
+    DOUAudioStreamer *currentStreamer = [[DOUAudioEventLoop sharedEventLoop] currentStreamer];
+    if (currentStreamer == nil ||
+        currentStreamer == self ||
+        [currentStreamer status] == DOUAudioStreamerIdle ||
+        [currentStreamer status] == DOUAudioStreamerFinished ||
+        [currentStreamer status] == DOUAudioStreamerError) {
+      [self play];
+      return;
+    }
+
+    [[DOUAudioEventLoop sharedEventLoop] setNextStreamer:self];
+  }
+}
+
+- (void)mix
+{
+  [self mixAfterDelay:0.0];
+}
+
+- (void)mixAfterDelay:(NSTimeInterval)delay
+{
+  @synchronized(self) {
+    if (_status != DOUAudioStreamerPaused &&
+        _status != DOUAudioStreamerIdle &&
+        _status != DOUAudioStreamerFinished) {
+      return;
+    }
+
+    if ([[DOUAudioEventLoop sharedEventLoop] currentStreamer] == self) {
+      return;
+    }
+
+    [[DOUAudioEventLoop sharedEventLoop] mixStreamer:self afterDelay:delay];
+  }
+}
+
 @end
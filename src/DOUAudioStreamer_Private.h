@@ -33,6 +33,12 @@
 @property (nonatomic, strong) DOUAudioDecoder *decoder;
 
 @property (nonatomic, assign) double bufferingRatio;
+@property (strong) NSDictionary *metadata;
+
+@property (assign) NSTimeInterval timeToFirstAudio;
+@property (assign) uint64_t playRequestedHostTime;
+
+- (void)computeTrackGainIfNeeded;
 
 #if TARGET_OS_IPHONE
 @property (nonatomic, assign, getter=isPausedByInterruption) BOOL pausedByInterruption;
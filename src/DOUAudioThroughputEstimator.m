@@ -0,0 +1,113 @@
+/* vim: set ft=objc fenc=utf-8 sw=2 ts=2 et: */
+/*
+ *  DOUAudioStreamer - A Core Audio based streaming audio player for iOS/Mac:
+ *
+ *      https://github.com/douban/DOUAudioStreamer
+ *
+ *  Copyright 2013-2016 Douban Inc.  All rights reserved.
+ *
+ *  Use and distribution licensed under the BSD license.  See
+ *  the LICENSE file for full text.
+ *
+ *  Authors:
+ *      Chongyu Zhu <i@lembacon.com>
+ *
+ */
+
+#import "DOUAudioThroughputEstimator.h"
+
+static const CFTimeInterval kDOUAudioThroughputEstimatorWindow = 0.25;
+static const CFTimeInterval kDOUAudioThroughputEstimatorStallInterval = 1.0;
+static const double kDOUAudioThroughputEstimatorWeight = 0.25;
+
+/*
+ * Received bytes are grouped into windows of at least a quarter of a second,
+ * and every window contributes one rate sample to an exponentially weighted
+ * mean and variance.  A window that has been open for too long is folded in
+ * on the fly, so that a stalled connection is noticed before data resumes.
+ */
+
+@interface DOUAudioThroughputEstimator () {
+@private
+  CFAbsoluteTime _windowStartTime;
+  NSUInteger _windowLength;
+
+  NSUInteger _sampleCount;
+  double _mean;
+  double _variance;
+}
+@end
+
+@implementation DOUAudioThroughputEstimator
+
+- (void)_addRate:(double)rate
+{
+  if (_sampleCount == 0) {
+    _mean = rate;
+    _variance = 0.0;
+  }
+  else {
+    double diff = rate - _mean;
+    _mean += kDOUAudioThroughputEstimatorWeight * diff;
+    _variance = (1.0 - kDOUAudioThroughputEstimatorWeight) * (_variance + kDOUAudioThroughputEstimatorWeight * diff * diff);
+  }
+
+  _sampleCount++;
+}
+
+- (void)addSampleWithLength:(NSUInteger)length
+{
+  CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+  @synchronized(self) {
+    if (_windowStartTime == 0.0) {
+      _windowStartTime = now;
+    }
+
+    _windowLength += length;
+
+    CFTimeInterval elapsed = now - _windowStartTime;
+    if (elapsed >= kDOUAudioThroughputEstimatorWindow) {
+      [self _addRate:_windowLength / elapsed];
+      _windowStartTime = now;
+      _windowLength = 0;
+    }
+  }
+}
+
+- (void)restart
+{
+  @synchronized(self) {
+    _windowStartTime = CFAbsoluteTimeGetCurrent();
+    _windowLength = 0;
+  }
+}
+
+- (double)throughput
+{
+  CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+  @synchronized(self) {
+    CFTimeInterval elapsed = _windowStartTime != 0.0 ? now - _windowStartTime : 0.0;
+
+    if (_sampleCount == 0) {
+      return elapsed > 0.0 ? _windowLength / elapsed : 0.0;
+    }
+
+    if (elapsed >= kDOUAudioThroughputEstimatorStallInterval) {
+      double rate = _windowLength / elapsed;
+      return _mean + kDOUAudioThroughputEstimatorWeight * (rate - _mean);
+    }
+
+    return _mean;
+  }
+}
+
+- (double)deviation
+{
+  @synchronized(self) {
+    return sqrt(_variance);
+  }
+}
+
+@end
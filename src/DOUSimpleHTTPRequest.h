@@ -21,6 +21,15 @@ typedef void (^DOUSimpleHTTPRequestProgressBlock)(double downloadProgress);
 typedef void (^DOUSimpleHTTPRequestDidReceiveResponseBlock)(void);
 typedef void (^DOUSimpleHTTPRequestDidReceiveDataBlock)(NSData *data);
 
+/*
+ * When a destination block is set, the response body is read straight into
+ * the buffer it returns instead of being copied through an NSData.  The block
+ * reports the writable capacity and the did-write block is then called with
+ * the number of bytes actually stored.  Returning NULL discards the bytes.
+ */
+typedef void *(^DOUSimpleHTTPRequestDestinationBlock)(NSUInteger *capacity);
+typedef void (^DOUSimpleHTTPRequestDidWriteDataBlock)(NSUInteger length);
+
 @interface DOUSimpleHTTPRequest : NSObject
 
 + (instancetype)requestWithURL:(NSURL *)url;
@@ -33,11 +42,27 @@ typedef void (^DOUSimpleHTTPRequestDidReceiveDataBlock)(NSData *data);
 @property (nonatomic, strong) NSString *userAgent;
 @property (nonatomic, strong) NSString *host;
 
+@property (nonatomic, assign) NSUInteger rangeOffset;
+@property (nonatomic, assign) NSUInteger rangeLength;
+@property (nonatomic, strong) NSString *rangeValidator;
+
+/*
+ * Caps how fast the response body is read, in bytes per second; zero means
+ * unlimited.  Once the budget is spent the stream is left unread until it
+ * refills, so TCP flow control slows the sender down as well.
+ */
+@property (assign) NSUInteger maximumDownloadSpeed;
+
+- (void)setValue:(NSString *)value forHTTPHeaderField:(NSString *)field;
+
 @property (nonatomic, readonly) NSData *responseData;
 @property (nonatomic, readonly) NSString *responseString;
 
 @property (nonatomic, readonly) NSDictionary *responseHeaders;
 @property (nonatomic, readonly) NSUInteger responseContentLength;
+@property (nonatomic, readonly) NSUInteger responseRangeOffset;
+@property (nonatomic, readonly) NSUInteger responseTotalLength;
+@property (nonatomic, readonly, getter=isPartialContent) BOOL partialContent;
 @property (nonatomic, readonly) NSInteger statusCode;
 @property (nonatomic, readonly) NSString *statusMessage;
 
@@ -48,6 +73,8 @@ typedef void (^DOUSimpleHTTPRequestDidReceiveDataBlock)(NSData *data);
 @property (copy) DOUSimpleHTTPRequestProgressBlock progressBlock;
 @property (copy) DOUSimpleHTTPRequestDidReceiveResponseBlock didReceiveResponseBlock;
 @property (copy) DOUSimpleHTTPRequestDidReceiveDataBlock didReceiveDataBlock;
+@property (copy) DOUSimpleHTTPRequestDestinationBlock destinationBlock;
+@property (copy) DOUSimpleHTTPRequestDidWriteDataBlock didWriteDataBlock;
 
 - (void)start;
 - (void)cancel;
@@ -19,6 +19,8 @@
 #include <sys/sysctl.h>
 #include <pthread.h>
 
+static const CFIndex kDOUSimpleHTTPRequestMinimumThrottledRead = 4096;
+
 static struct {
   pthread_t thread;
   pthread_mutex_t mutex;
@@ -78,10 +80,16 @@ static CFRunLoopRef controller_get_runloop()
   DOUSimpleHTTPRequestProgressBlock _progressBlock;
   DOUSimpleHTTPRequestDidReceiveResponseBlock _didReceiveResponseBlock;
   DOUSimpleHTTPRequestDidReceiveDataBlock _didReceiveDataBlock;
+  DOUSimpleHTTPRequestDestinationBlock _destinationBlock;
+  DOUSimpleHTTPRequestDidWriteDataBlock _didWriteDataBlock;
 
   NSString *_userAgent;
   NSTimeInterval _timeoutInterval;
 
+  NSUInteger _rangeOffset;
+  NSUInteger _rangeLength;
+  NSString *_rangeValidator;
+
   CFHTTPMessageRef _message;
   CFReadStreamRef _responseStream;
 
@@ -97,7 +105,17 @@ static CFRunLoopRef controller_get_runloop()
   NSUInteger _downloadSpeed;
 
   NSUInteger _responseContentLength;
+  NSUInteger _responseRangeOffset;
+  NSUInteger _responseTotalLength;
   NSUInteger _receivedLength;
+
+  UInt8 *_readBuffer;
+  CFIndex _readBufferSize;
+
+  NSUInteger _maximumDownloadSpeed;
+  double _throttleTokens;
+  CFAbsoluteTime _throttleTime;
+  CFRunLoopTimerRef _throttleTimer;
 }
 @end
 
@@ -106,10 +124,17 @@ static CFRunLoopRef controller_get_runloop()
 @synthesize timeoutInterval = _timeoutInterval;
 @synthesize userAgent = _userAgent;
 
+@synthesize rangeOffset = _rangeOffset;
+@synthesize rangeLength = _rangeLength;
+@synthesize rangeValidator = _rangeValidator;
+@synthesize maximumDownloadSpeed = _maximumDownloadSpeed;
+
 @synthesize responseData = _responseData;
 
 @synthesize responseHeaders = _responseHeaders;
 @synthesize responseContentLength = _responseContentLength;
+@synthesize responseRangeOffset = _responseRangeOffset;
+@synthesize responseTotalLength = _responseTotalLength;
 @synthesize statusCode = _statusCode;
 @synthesize statusMessage = _statusMessage;
 
@@ -120,6 +145,8 @@ static CFRunLoopRef controller_get_runloop()
 @synthesize progressBlock = _progressBlock;
 @synthesize didReceiveResponseBlock = _didReceiveResponseBlock;
 @synthesize didReceiveDataBlock = _didReceiveDataBlock;
+@synthesize destinationBlock = _destinationBlock;
+@synthesize didWriteDataBlock = _didWriteDataBlock;
 
 + (instancetype)requestWithURL:(NSURL *)url
 {
@@ -151,6 +178,10 @@ static CFRunLoopRef controller_get_runloop()
   }
 
   CFRelease(_message);
+
+  if (_readBuffer != NULL) {
+    free(_readBuffer);
+  }
 }
 
 + (NSTimeInterval)defaultTimeoutInterval
@@ -246,6 +277,17 @@ static CFRunLoopRef controller_get_runloop()
   }
 }
 
+- (UInt8 *)_readBufferWithSize:(CFIndex)size
+{
+  if (_readBufferSize < size) {
+    free(_readBuffer);
+    _readBuffer = (UInt8 *)malloc((size_t)size);
+    _readBufferSize = (_readBuffer != NULL ? size : 0);
+  }
+
+  return _readBuffer;
+}
+
 - (void)_checkResponseContentLength
 {
   if (_responseHeaders == nil) {
@@ -260,6 +302,47 @@ static CFRunLoopRef controller_get_runloop()
   _responseContentLength = (NSUInteger)[string integerValue];
 }
 
+- (void)_checkResponseContentRange
+{
+  _responseRangeOffset = 0;
+  _responseTotalLength = _responseContentLength;
+
+  if (![self isPartialContent]) {
+    return;
+  }
+
+  NSString *string = [_responseHeaders objectForKey:@"Content-Range"];
+  if (string == nil) {
+    return;
+  }
+
+  unsigned long long first = 0;
+  unsigned long long last = 0;
+  unsigned long long total = 0;
+
+  NSScanner *scanner = [NSScanner scannerWithString:string];
+  if (![scanner scanString:@"bytes" intoString:NULL] ||
+      ![scanner scanUnsignedLongLong:&first] ||
+      ![scanner scanString:@"-" intoString:NULL] ||
+      ![scanner scanUnsignedLongLong:&last] ||
+      ![scanner scanString:@"/" intoString:NULL]) {
+    return;
+  }
+
+  _responseRangeOffset = (NSUInteger)first;
+  if ([scanner scanUnsignedLongLong:&total]) {
+    _responseTotalLength = (NSUInteger)total;
+  }
+  else {
+    _responseTotalLength = 0;
+  }
+}
+
+- (BOOL)isPartialContent
+{
+  return _statusCode == 206;
+}
+
 - (void)_readResponseHeaders
 {
   if (_responseHeaders != nil) {
@@ -282,6 +365,7 @@ static CFRunLoopRef controller_get_runloop()
   CFRelease(message);
 
   [self _checkResponseContentLength];
+  [self _checkResponseContentRange];
   [self _invokeDidReceiveResponseBlock];
 }
 
@@ -308,8 +392,70 @@ static CFRunLoopRef controller_get_runloop()
   _downloadSpeed = _receivedLength / (CFAbsoluteTimeGetCurrent() - _startedTime);
 }
 
+- (void)_invalidateThrottleTimer
+{
+  if (_throttleTimer == NULL) {
+    return;
+  }
+
+  CFRunLoopTimerInvalidate(_throttleTimer);
+  CFRelease(_throttleTimer);
+  _throttleTimer = NULL;
+}
+
+- (void)_throttleTimerFired
+{
+  [self _invalidateThrottleTimer];
+  [self _responseStreamHasBytesAvailable];
+}
+
+/*
+ * A token bucket holding at most a quarter of a second of data.  When it
+ * runs dry the read is put off with a one-shot timer on the controller run
+ * loop, since the stream will not signal the unread bytes again.
+ */
+
+- (CFIndex)_throttledReadSizeWithBufferSize:(CFIndex)bufferSize
+{
+  NSUInteger maximumDownloadSpeed = [self maximumDownloadSpeed];
+  if (maximumDownloadSpeed == 0) {
+    _throttleTime = 0.0;
+    return bufferSize;
+  }
+
+  if (_throttleTimer != NULL) {
+    return 0;
+  }
+
+  CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+  double capacity = MAX(maximumDownloadSpeed / 4.0, (double)kDOUSimpleHTTPRequestMinimumThrottledRead);
+  if (_throttleTime == 0.0) {
+    _throttleTokens = capacity;
+  }
+  else {
+    _throttleTokens = MIN(capacity, _throttleTokens + (now - _throttleTime) * maximumDownloadSpeed);
+  }
+  _throttleTime = now;
+
+  if (_throttleTokens < kDOUSimpleHTTPRequestMinimumThrottledRead) {
+    CFTimeInterval delay = (kDOUSimpleHTTPRequestMinimumThrottledRead - _throttleTokens) / maximumDownloadSpeed;
+    _throttleTimer = CFRunLoopTimerCreateWithHandler(kCFAllocatorDefault, now + delay, 0.0, 0, 0, ^(CFRunLoopTimerRef timer) {
+      @autoreleasepool {
+        @synchronized(self) {
+          [self _throttleTimerFired];
+        }
+      }
+    });
+    CFRunLoopAddTimer(controller_get_runloop(), _throttleTimer, kCFRunLoopDefaultMode);
+    return 0;
+  }
+
+  return MIN(bufferSize, (CFIndex)_throttleTokens);
+}
+
 - (void)_closeResponseStream
 {
+  [self _invalidateThrottleTimer];
   CFReadStreamClose(_responseStream);
   CFReadStreamUnscheduleFromRunLoop(_responseStream, controller_get_runloop(), kCFRunLoopDefaultMode);
   CFReadStreamSetClient(_responseStream, kCFStreamEventNone, NULL, NULL);
@@ -334,29 +480,62 @@ static CFRunLoopRef controller_get_runloop()
     bufferSize = 16384;
   }
 
-  UInt8 buffer[bufferSize];
-  CFIndex bytesRead = CFReadStreamRead(_responseStream, buffer, bufferSize);
-  if (bytesRead < 0) {
-    [self _responseStreamErrorOccurred];
+  bufferSize = [self _throttledReadSizeWithBufferSize:bufferSize];
+  if (bufferSize == 0) {
     return;
   }
 
-  if (bytesRead > 0) {
-    NSData *data = [NSData dataWithBytesNoCopy:buffer length:(NSUInteger)bytesRead freeWhenDone:NO];
-
-    @synchronized(self) {
-      if (_didReceiveDataBlock == NULL) {
-        if (_responseData == nil) {
-          _responseData = [NSMutableData data];
+  CFIndex bytesRead;
+
+  /*
+   * The read happens under the request lock so that a concurrent detach
+   * cannot clear the destination while bytes are being copied into it.
+   * The destination and did-write blocks take the provider lock in turn,
+   * so the lock order is always request, then provider: providers must
+   * never call into a request that takes @synchronized(request) while
+   * holding their own lock.  CFReadStreamRead only copies what is already
+   * buffered here, since the stream reported bytes available.
+   */
+  @synchronized(self) {
+    if (_destinationBlock != NULL) {
+      NSUInteger capacity = 0;
+      UInt8 *destination = (UInt8 *)_destinationBlock(&capacity);
+      if (destination != NULL && capacity > 0) {
+        bytesRead = CFReadStreamRead(_responseStream, destination, (CFIndex)MIN(capacity, (NSUInteger)bufferSize));
+        if (bytesRead > 0 && _didWriteDataBlock != NULL) {
+          _didWriteDataBlock((NSUInteger)bytesRead);
         }
-
-        [_responseData appendData:data];
       }
       else {
-        [self _invokeDidReceiveDataBlockWithData:data];
+        bytesRead = CFReadStreamRead(_responseStream, [self _readBufferWithSize:bufferSize], bufferSize);
       }
     }
+    else if (_didReceiveDataBlock == NULL) {
+      if (_responseData == nil) {
+        _responseData = [NSMutableData data];
+      }
 
+      NSUInteger length = [_responseData length];
+      [_responseData increaseLengthBy:(NSUInteger)bufferSize];
+      bytesRead = CFReadStreamRead(_responseStream, (UInt8 *)[_responseData mutableBytes] + length, bufferSize);
+      [_responseData setLength:length + (NSUInteger)MAX(bytesRead, 0)];
+    }
+    else {
+      UInt8 *buffer = [self _readBufferWithSize:bufferSize];
+      bytesRead = CFReadStreamRead(_responseStream, buffer, bufferSize);
+      if (bytesRead > 0) {
+        [self _invokeDidReceiveDataBlockWithData:[NSData dataWithBytesNoCopy:buffer length:(NSUInteger)bytesRead freeWhenDone:NO]];
+      }
+    }
+  }
+
+  if (bytesRead < 0) {
+    [self _responseStreamErrorOccurred];
+    return;
+  }
+
+  if (bytesRead > 0) {
+    _throttleTokens -= bytesRead;
     _receivedLength += (unsigned long)bytesRead;
     [self _updateProgress];
     [self _updateDownloadSpeed];
@@ -405,6 +584,15 @@ static void response_stream_client_callback(CFReadStreamRef stream, CFStreamEven
   }
 }
 
+- (void)setValue:(NSString *)value forHTTPHeaderField:(NSString *)field
+{
+  if (_responseStream != NULL || field == nil) {
+    return;
+  }
+
+  CFHTTPMessageSetHeaderFieldValue(_message, (__bridge CFStringRef)field, (__bridge CFStringRef)value);
+}
+
 - (void)start
 {
   if (_responseStream != NULL) {
@@ -416,6 +604,21 @@ static void response_stream_client_callback(CFReadStreamRef stream, CFStreamEven
     CFHTTPMessageSetHeaderFieldValue(_message, CFSTR("Host"), (__bridge CFStringRef)_host);
   }
 
+  if (_rangeOffset > 0 || _rangeLength > 0) {
+    NSString *range;
+    if (_rangeLength > 0) {
+      range = [NSString stringWithFormat:@"bytes=%lu-%lu", (unsigned long)_rangeOffset, (unsigned long)(_rangeOffset + _rangeLength - 1)];
+    }
+    else {
+      range = [NSString stringWithFormat:@"bytes=%lu-", (unsigned long)_rangeOffset];
+    }
+
+    CFHTTPMessageSetHeaderFieldValue(_message, CFSTR("Range"), (__bridge CFStringRef)range);
+    if (_rangeValidator != nil) {
+      CFHTTPMessageSetHeaderFieldValue(_message, CFSTR("If-Range"), (__bridge CFStringRef)_rangeValidator);
+    }
+  }
+
   _responseStream = CFReadStreamCreateForHTTPRequest(kCFAllocatorDefault, _message);
   CFReadStreamSetProperty(_responseStream, kCFStreamPropertyHTTPShouldAutoredirect, kCFBooleanTrue);
   CFReadStreamSetProperty(_responseStream, CFSTR("_kCFStreamPropertyReadTimeout"), (__bridge CFNumberRef)[NSNumber numberWithDouble:_timeoutInterval]);